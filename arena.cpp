@@ -0,0 +1,72 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "arena.h"
+
+#include "common.h"
+
+// Arena
+
+Arena::Arena( std::size_t initialSize )
+    : m_block( new char[initialSize] )
+    , m_size( initialSize )
+{
+    m_resource.emplace( m_block.get(), m_size, &m_upstream );
+}
+
+Arena::~Arena()
+{
+    m_resource.reset();
+}
+
+void Arena::reset()
+{
+    std::size_t needed = m_size + m_upstream.allocated;
+
+    // Returns the overflow to the upstream
+    m_resource.reset();
+
+    if( needed > m_size )
+    {
+        PRINT_DEBUG( "Arena: growing from %zu to %zu bytes\n", m_size, needed );
+
+        m_block.reset( new char[needed] );
+        m_size = needed;
+    }
+
+    m_upstream.allocated = 0;
+    m_resource.emplace( m_block.get(), m_size, &m_upstream );
+}
+
+void* Arena::Upstream::do_allocate( std::size_t bytes, std::size_t alignment )
+{
+    allocated += bytes;
+
+    return std::pmr::new_delete_resource()->allocate( bytes, alignment );
+}
+
+void Arena::Upstream::do_deallocate( void* ptr, std::size_t bytes, std::size_t alignment )
+{
+    std::pmr::new_delete_resource()->deallocate( ptr, bytes, alignment );
+}
+
+bool Arena::Upstream::do_is_equal( const std::pmr::memory_resource& other ) const noexcept
+{
+    return this == &other;
+}
@@ -0,0 +1,84 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef ICEQUERY_ARENA_H
+#define ICEQUERY_ARENA_H
+
+#include <cstddef>      // size_t
+#include <memory>       // unique_ptr
+#include <memory_resource>
+#include <optional>
+
+#define ARENA_INITIAL_SIZE          ( 64 * 1024 )
+
+// Bump allocator for data living as long as a snapshot, all freed at once by
+// reset(). Its block is kept across resets and grown to the size the last
+// snapshot needed, so that steady-state refreshes don't allocate at all.
+class Arena
+{
+public:
+    explicit Arena( std::size_t initialSize = ARENA_INITIAL_SIZE );
+    ~Arena();
+
+    Arena( const Arena& ) = delete;
+    Arena& operator=( const Arena& ) = delete;
+
+public:
+    // Stays the same across resets
+    std::pmr::memory_resource* resource()
+    {
+        return &*m_resource;
+    }
+
+    // Frees everything allocated so far, which must not be used anymore
+    void reset();
+
+    std::size_t capacity() const
+    {
+        return m_size;
+    }
+
+    // Bytes which didn't fit the block since the last reset
+    std::size_t overflow() const
+    {
+        return m_upstream.allocated;
+    }
+
+private:
+    // Where the allocations not fitting the block go, counting them
+    class Upstream : public std::pmr::memory_resource
+    {
+    public:
+        std::size_t allocated = 0;
+
+    private:
+        void* do_allocate( std::size_t bytes, std::size_t alignment ) override;
+        void do_deallocate( void* ptr, std::size_t bytes, std::size_t alignment ) override;
+        bool do_is_equal( const std::pmr::memory_resource& other ) const noexcept override;
+    };
+
+private:
+    std::unique_ptr<char[]> m_block;
+    std::size_t m_size;
+
+    Upstream m_upstream;
+    std::optional<std::pmr::monotonic_buffer_resource> m_resource;
+};
+
+#endif // ICEQUERY_ARENA_H
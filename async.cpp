@@ -0,0 +1,423 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "async.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>      // INT_MAX
+#include <cstring>      // strerror()
+
+#include <poll.h>
+#include <unistd.h>     // close()
+
+#include <icecc/comm.h>
+
+#include "common.h"
+#include "discovery.h"
+#include "query.h"
+
+// Reactor
+
+Reactor::Reactor( IoBackend::Type backendType )
+    : m_backend( IoBackend::create( backendType ) )
+    , m_stopped( false )
+{
+    if( !m_backend )
+    {
+        PRINT_WARN( "I/O backend '%s' unavailable, falling back to '%s'.\n", IoBackend::typeToStr( backendType ), IoBackend::typeToStr( IoBackend::Type::Poll ) );
+
+        m_backend = IoBackend::create( IoBackend::Type::Poll );
+    }
+}
+
+Reactor::~Reactor()
+{
+}
+
+void Reactor::spawn( Task<void>&& task )
+{
+    m_tasks.push_back( std::move( task ) );
+    m_tasks.back().start();
+}
+
+bool Reactor::run()
+{
+    std::vector<IoEvent> events;
+    std::vector<Waiter> ready;
+
+    while( true )
+    {
+        m_tasks.erase( std::remove_if( m_tasks.begin(), m_tasks.end(), [] ( const Task<void>& task ) { return task.isDone(); } ), m_tasks.end() );
+
+        if( m_stopped || m_tasks.empty() || m_waiters.empty() )
+        {
+            // Nothing left to wake up anything still running
+            return true;
+        }
+
+        long now = getTimestamp();
+        long deadline = -1;
+
+        for( const Waiter& waiter : m_waiters )
+        {
+            if( waiter.deadline >= 0 && ( deadline < 0 || waiter.deadline < deadline ) )
+            {
+                deadline = waiter.deadline;
+            }
+        }
+
+        int timeout = deadline < 0 ? -1 : static_cast<int>( std::min<long>( std::max<long>( deadline - now, 0 ), INT_MAX ) );
+
+        events.clear();
+
+        if( !m_backend->wait( timeout, events ) )
+        {
+            int lastErrno = errno;
+
+            PRINT_ERR( "IoBackend::wait(): (%d) %s\n", lastErrno, strerror( lastErrno ) );
+
+            return false;
+        }
+
+        // Resuming may register new waiters, so pick the ready ones first
+        ready.clear();
+
+        for( const IoEvent& event : events )
+        {
+            auto it = std::find_if( m_waiters.begin(), m_waiters.end(), [&event] ( const Waiter& waiter ) { return waiter.fd == event.fd; } );
+
+            if( event.revents && it != m_waiters.end() )
+            {
+                *it->revents = event.revents;
+                ready.push_back( *it );
+                m_waiters.erase( it );
+            }
+        }
+
+        now = getTimestamp();
+
+        auto expired = std::stable_partition( m_waiters.begin(), m_waiters.end(), [now] ( const Waiter& waiter ) { return waiter.deadline < 0 || now < waiter.deadline; } );
+
+        for( auto it = expired; it != m_waiters.end(); ++it )
+        {
+            if( it->fd >= 0 )
+            {
+                m_backend->unwatch( it->fd );
+            }
+
+            *it->revents = 0;
+            ready.push_back( *it );
+        }
+
+        m_waiters.erase( expired, m_waiters.end() );
+
+        for( const Waiter& waiter : ready )
+        {
+            waiter.handle.resume();
+        }
+    }
+}
+
+bool Reactor::addWaiter( const Waiter& waiter )
+{
+    if( waiter.fd >= 0 && !m_backend->watch( waiter.fd, waiter.events ) )
+    {
+        // Such as a regular file with epoll, which poll() reports as always
+        // ready; parking the waiter would leave it hanging without a deadline
+        PRINT_DEBUG( "Reactor: Unable to watch descriptor %d, taking it as ready\n", waiter.fd );
+
+        *waiter.revents = POLLIN | POLLOUT;
+        return false;
+    }
+
+    m_waiters.push_back( waiter );
+
+    return true;
+}
+
+// QueryTarget
+
+std::string QueryTarget::label() const
+{
+    std::string res = netName;
+
+    if( !schedAddr.empty() )
+    {
+        if( !res.empty() )
+        {
+            res.append( "@" );
+        }
+
+        res.append( schedAddr );
+
+        if( schedPort )
+        {
+            res.append( ":" ).append( std::to_string( schedPort ) );
+        }
+    }
+
+    return res.empty() ? "default" : res;
+}
+
+// Query coroutines
+
+// Receive deadline for a message, clipped to the overall one
+static long receiveDeadline( const QueryTarget& target )
+{
+    long deadline = getTimestamp() + target.rtimeout;
+
+    return target.deadline >= 0 ? std::min( deadline, target.deadline ) : deadline;
+}
+
+Task<std::unique_ptr<MsgChannel>> discoverScheduler( Reactor& reactor, const QueryTarget& target )
+{
+    long timeoutTimestamp = getTimestamp() + target.timeout;
+
+    if( target.deadline >= 0 )
+    {
+        timeoutTimestamp = std::min( timeoutTimestamp, target.deadline );
+    }
+
+    PRINT_INFO( "Attempting to connect to the scheduler...\n" );
+
+    std::string addr = target.schedAddr;
+    uint16_t port = target.schedPort ? target.schedPort : SCHEDULER_PORT;
+
+    if( addr.empty() && !schedulerFromEnv( addr, port ) )
+    {
+        int discoverFd = startDiscovery();
+
+        if( discoverFd < 0 )
+        {
+            co_return nullptr;
+        }
+
+        std::vector<SchedulerInfo> schedulers;
+        const SchedulerInfo* scheduler = nullptr;
+
+        while( !scheduler && co_await reactor.wait( discoverFd, POLLIN, timeoutTimestamp ) )
+        {
+            readDiscoveryReplies( discoverFd, schedulers );
+
+            // The first scheduler of the net answering is taken
+            scheduler = findScheduler( schedulers, target.netName );
+        }
+
+        close( discoverFd );
+
+        if( !scheduler )
+        {
+            PRINT_ERR( "Timed out while trying to connect to the scheduler.\n" );
+
+            co_return nullptr;
+        }
+
+        PRINT_DEBUG( "Scheduler '%s' found at %s:%u\n", scheduler->netName.c_str(), scheduler->addr.c_str(), scheduler->port );
+
+        addr = scheduler->addr;
+        port = scheduler->port;
+    }
+
+    struct sockaddr_storage peer;
+    socklen_t peerLen = sizeof( peer );
+    int fd = startConnect( addr, port, &peer, &peerLen );
+
+    if( fd < 0 )
+    {
+        co_return nullptr;
+    }
+
+    if( !co_await reactor.wait( fd, POLLOUT, timeoutTimestamp ) )
+    {
+        PRINT_ERR( "Timed out while trying to connect to the scheduler.\n" );
+
+        close( fd );
+        co_return nullptr;
+    }
+
+    if( !finishConnect( fd ) )
+    {
+        close( fd );
+        co_return nullptr;
+    }
+
+    // Owns the descriptor from now on
+    std::unique_ptr<HandshakeChannel> channel( new HandshakeChannel( fd, peer, peerLen ) );
+
+    while( channel->needsProtocol() )
+    {
+        if( !co_await reactor.wait( fd, POLLIN, timeoutTimestamp ) )
+        {
+            PRINT_ERR( "Timed out while trying to connect to the scheduler.\n" );
+
+            co_return nullptr;
+        }
+
+        if( !channel->read_a_bit() || channel->at_eof() )
+        {
+            PRINT_ERR( "MsgChannel::read_a_bit(): Protocol version exchange with the scheduler failed.\n" );
+
+            co_return nullptr;
+        }
+    }
+
+    co_return std::move( channel );
+}
+
+Task<bool> logIn( Reactor& reactor, MsgChannel& channel, const QueryTarget& target )
+{
+    channel.setBulkTransfer();
+
+    // The message is tiny, sent at once if there's room for it
+    long deadline = receiveDeadline( target );
+
+    if( !co_await reactor.wait( channel.fd, POLLOUT, deadline ) )
+    {
+        PRINT_ERR( "Timed out while logging in to the scheduler.\n" );
+
+        co_return false;
+    }
+
+    if( !channel.send_msg( MonLoginMsg() ) )
+    {
+        PRINT_ERR( "MsgChannel::send_msg(): Scheduler rejected the MonLoginMsg message.\n" );
+
+        co_return false;
+    }
+
+    PRINT_INFO( "Retrieving messages...\n" );
+
+    co_return true;
+}
+
+Task<MsgBatch> receiveBatch( Reactor& reactor, MsgChannel& channel, long deadline )
+{
+    MsgBatch batch { false, false, {} };
+
+    short revents = co_await reactor.wait( channel.fd, POLLIN | POLLPRI, deadline );
+
+    if( !revents )
+    {
+        batch.timedOut = true;
+        co_return batch;
+    }
+
+    while( !channel.read_a_bit() || channel.has_msg() )
+    {
+        std::unique_ptr<Msg> msg( channel.get_msg() );
+
+        if( !msg )
+        {
+            PRINT_ERR( "MsgChannel::get_msg(): No messages received from the scheduler.\n" );
+
+            batch.failed = true;
+            break;
+        }
+
+        batch.msgs.push_back( std::move( msg ) );
+    }
+
+    co_return batch;
+}
+
+Task<QueryResult> runQuery( Reactor& reactor, QueryTarget target )
+{
+    QueryResult result { EXIT_CONNECTION_ERR, {} };
+
+    if( target.client == MonitorClient::Native )
+    {
+        // The built-in client makes no blocking calls, a Query is good enough
+        Query query( target.netName, target.timeout, target.rtimeout, target.schedAddr, target.schedPort, target.client );
+        query.setDeadline( target.deadline );
+
+        short revents = 0;
+
+        while( !query.process( revents ) )
+        {
+            revents = co_await reactor.wait( query.fd(), query.events(), query.deadline() );
+        }
+
+        result.exitCode = query.exitCode();
+        result.nodes = query.takeNodes();
+
+        co_return result;
+    }
+
+    std::unique_ptr<MsgChannel> channel = co_await discoverScheduler( reactor, target );
+
+    if( !channel || !co_await logIn( reactor, *channel, target ) )
+    {
+        co_return result;
+    }
+
+    NodeCollector collector;
+    long deadline = receiveDeadline( target );
+
+    while( true )
+    {
+        MsgBatch batch = co_await receiveBatch( reactor, *channel, deadline );
+
+        if( batch.timedOut )
+        {
+            if( target.deadline >= 0 && getTimestamp() >= target.deadline )
+            {
+                PRINT_WARN( "Deadline reached while retrieving messages from '%s', the data may be incomplete.\n", target.label().c_str() );
+            }
+
+            break;
+        }
+
+        bool wasUseful = false;
+
+        for( const auto& msg : batch.msgs )
+        {
+            NodeCollector::Result res = collector.handle( *msg );
+
+            if( res == NodeCollector::Result::End )
+            {
+                co_return result;
+            }
+
+            wasUseful |= ( res == NodeCollector::Result::Useful );
+        }
+
+        if( batch.failed )
+        {
+            co_return result;
+        }
+
+        if( !wasUseful )
+        {
+            break;
+        }
+
+        deadline = receiveDeadline( target );
+    }
+
+    result.exitCode = EXIT_OK;
+    result.nodes = std::move( collector.nodes() );
+
+    co_return result;
+}
+
+Task<void> runQueryInto( Reactor& reactor, QueryTarget target, QueryResult& result )
+{
+    result = co_await runQuery( reactor, std::move( target ) );
+}
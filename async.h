@@ -0,0 +1,400 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef ICEQUERY_ASYNC_H
+#define ICEQUERY_ASYNC_H
+
+#include <coroutine>
+#include <cstdint>      // uint16_t
+#include <exception>    // terminate()
+#include <optional>
+#include <string>
+#include <utility>      // exchange()
+#include <vector>
+
+#include "iobackend.h"
+#include "monitorchannel.h"
+#include "nodeinfo.h"
+
+class Msg;
+class MsgChannel;
+
+// Task
+
+template<typename T>
+class Task;
+
+namespace detail
+{
+    class PromiseBase
+    {
+    public:
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept
+            {
+                return false;
+            }
+
+            template<typename Promise>
+            std::coroutine_handle<> await_suspend( std::coroutine_handle<Promise> handle ) noexcept
+            {
+                std::coroutine_handle<> continuation = handle.promise().m_continuation;
+
+                return continuation ? continuation : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept
+            {
+            }
+        };
+
+    public:
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        FinalAwaiter final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void unhandled_exception() noexcept
+        {
+            std::terminate();
+        }
+
+        void setContinuation( std::coroutine_handle<> continuation )
+        {
+            m_continuation = continuation;
+        }
+
+    private:
+        std::coroutine_handle<> m_continuation;
+    };
+
+    template<typename T>
+    class Promise : public PromiseBase
+    {
+    public:
+        Task<T> get_return_object();
+
+        template<typename U>
+        void return_value( U&& value )
+        {
+            m_value.emplace( std::forward<U>( value ) );
+        }
+
+        T takeValue()
+        {
+            return std::move( *m_value );
+        }
+
+    private:
+        std::optional<T> m_value;
+    };
+
+    template<>
+    class Promise<void> : public PromiseBase
+    {
+    public:
+        Task<void> get_return_object();
+
+        void return_void()
+        {
+        }
+
+        void takeValue()
+        {
+        }
+    };
+}
+
+// Lazily started coroutine, runs when awaited (or spawned on a Reactor) and
+// resumes its awaiter once it finishes
+template<typename T = void>
+class [[nodiscard]] Task
+{
+public:
+    typedef detail::Promise<T> promise_type;
+
+public:
+    Task()
+    {
+    }
+
+    explicit Task( std::coroutine_handle<promise_type> handle )
+        : m_handle( handle )
+    {
+    }
+
+    Task( Task&& other ) noexcept
+        : m_handle( std::exchange( other.m_handle, nullptr ) )
+    {
+    }
+
+    Task& operator=( Task&& other ) noexcept
+    {
+        if( this != &other )
+        {
+            reset();
+            m_handle = std::exchange( other.m_handle, nullptr );
+        }
+
+        return *this;
+    }
+
+    Task( const Task& ) = delete;
+    Task& operator=( const Task& ) = delete;
+
+    ~Task()
+    {
+        reset();
+    }
+
+public:
+    bool isDone() const
+    {
+        return !m_handle || m_handle.done();
+    }
+
+    // Starts a task that has no awaiter
+    void start()
+    {
+        m_handle.resume();
+    }
+
+    auto operator co_await() && noexcept
+    {
+        struct Awaiter
+        {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() noexcept
+            {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend( std::coroutine_handle<> awaiter ) noexcept
+            {
+                handle.promise().setContinuation( awaiter );
+
+                return handle;
+            }
+
+            T await_resume()
+            {
+                return handle.promise().takeValue();
+            }
+        };
+
+        return Awaiter { m_handle };
+    }
+
+private:
+    void reset()
+    {
+        if( m_handle )
+        {
+            m_handle.destroy();
+            m_handle = nullptr;
+        }
+    }
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+// Awaits the task storing its result, for spawning on a Reactor
+template<typename T>
+Task<void> awaitInto( Task<T> task, T& result )
+{
+    result = co_await std::move( task );
+}
+
+namespace detail
+{
+    template<typename T>
+    Task<T> Promise<T>::get_return_object()
+    {
+        return Task<T>( std::coroutine_handle<Promise<T>>::from_promise( *this ) );
+    }
+
+    inline Task<void> Promise<void>::get_return_object()
+    {
+        return Task<void>( std::coroutine_handle<Promise<void>>::from_promise( *this ) );
+    }
+}
+
+// Reactor
+
+// Single-threaded event loop resuming coroutines once their descriptor
+// becomes ready or their deadline passes
+class Reactor
+{
+private:
+    struct Waiter
+    {
+        int fd;
+        short events;
+        long deadline;
+        short* revents;
+        std::coroutine_handle<> handle;
+    };
+
+public:
+    class WaitAwaiter
+    {
+    public:
+        WaitAwaiter( Reactor& reactor, int fd, short events, long deadline )
+            : m_reactor( reactor )
+            , m_fd( fd )
+            , m_events( events )
+            , m_deadline( deadline )
+            , m_revents( 0 )
+        {
+        }
+
+    public:
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+
+        bool await_suspend( std::coroutine_handle<> handle )
+        {
+            return m_reactor.addWaiter( { m_fd, m_events, m_deadline, &m_revents, handle } );
+        }
+
+        // Ready events, 0 if the deadline passed first
+        short await_resume() noexcept
+        {
+            return m_revents;
+        }
+
+    private:
+        Reactor& m_reactor;
+        int m_fd;
+        short m_events;
+        long m_deadline;
+        short m_revents;
+    };
+
+public:
+    // Falls back to poll() if the backend is unavailable
+    explicit Reactor( IoBackend::Type backendType = IoBackend::Type::Poll );
+    ~Reactor();
+
+    Reactor( const Reactor& ) = delete;
+    Reactor& operator=( const Reactor& ) = delete;
+
+public:
+    // Waits for poll() events on fd (none if -1) until the absolute
+    // getTimestamp() deadline (none if -1)
+    WaitAwaiter wait( int fd, short events, long deadline )
+    {
+        return WaitAwaiter( *this, fd, events, deadline );
+    }
+
+    WaitAwaiter sleepUntil( long deadline )
+    {
+        return WaitAwaiter( *this, -1, 0, deadline );
+    }
+
+    // Runs the task concurrently with the others, the reactor keeps it alive
+    void spawn( Task<void>&& task );
+
+    // Runs until all spawned tasks are finished or stop() is called, false
+    // on a backend error
+    bool run();
+
+    // Makes run() return before waiting again, the tasks still running are
+    // destroyed along with the reactor
+    void stop()
+    {
+        m_stopped = true;
+    }
+
+    IoBackend& backend()
+    {
+        return *m_backend;
+    }
+
+private:
+    // False if the waiter is to be resumed right away, as its descriptor
+    // can't be watched
+    bool addWaiter( const Waiter& waiter );
+
+private:
+    std::unique_ptr<IoBackend> m_backend;
+    std::vector<Waiter> m_waiters;
+    std::vector<Task<void>> m_tasks;
+    bool m_stopped;
+};
+
+// Query coroutines
+
+struct QueryTarget
+{
+    std::string netName;
+    std::string schedAddr;
+    uint16_t schedPort;
+    int timeout;
+    int rtimeout;
+
+    // Absolute getTimestamp() value after which the query finishes with
+    // whatever it has, -1 for none
+    long deadline;
+
+    MonitorClient client;
+
+    // Human-readable scheduler identification
+    std::string label() const;
+};
+
+struct QueryResult
+{
+    int exitCode;
+    NodeList nodes;
+};
+
+// Messages read after a single wakeup of the channel
+struct MsgBatch
+{
+    bool timedOut;
+    bool failed;
+    std::vector<std::unique_ptr<Msg>> msgs;
+};
+
+// Resolves the target to a connected channel done with the protocol
+// version exchange, null on failure; nothing blocks on the way
+Task<std::unique_ptr<MsgChannel>> discoverScheduler( Reactor& reactor, const QueryTarget& target );
+
+Task<bool> logIn( Reactor& reactor, MsgChannel& channel, const QueryTarget& target );
+
+Task<MsgBatch> receiveBatch( Reactor& reactor, MsgChannel& channel, long deadline );
+
+// The whole query, equivalent to driving a Query to completion
+Task<QueryResult> runQuery( Reactor& reactor, QueryTarget target );
+
+// Same as above, storing the result, for spawning on a reactor
+Task<void> runQueryInto( Reactor& reactor, QueryTarget target, QueryResult& result );
+
+#endif // ICEQUERY_ASYNC_H
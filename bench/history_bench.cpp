@@ -0,0 +1,205 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+/*
+    Records synthetic history of a farm into a temporary directory, then
+    reports the bytes stored per node sample and how long a full scan of the
+    raw frames and of the rollups takes.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "history.h"
+
+// Consts
+
+#define NODES_DEFAULT               1500
+#define DAYS_DEFAULT                14
+#define INTERVAL_DEFAULT            60
+
+// Utility functions
+
+static uint64_t directorySize( const std::string& dir, bool remove )
+{
+    uint64_t size = 0;
+    DIR* dirp = opendir( dir.c_str() );
+
+    while( struct dirent* entry = readdir( dirp ) )
+    {
+        std::string path = dir + "/" + entry->d_name;
+        struct stat st {};
+
+        if( entry->d_name[0] != '.' && stat( path.c_str(), &st ) == 0 )
+        {
+            size += st.st_size;
+
+            if( remove )
+            {
+                unlink( path.c_str() );
+            }
+        }
+    }
+
+    closedir( dirp );
+
+    return size;
+}
+
+template<typename Fn>
+static double timeMsecs( Fn fn )
+{
+    auto start = std::chrono::steady_clock::now();
+    fn();
+
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+// Benchmark
+
+int main( int argc, char** argv )
+{
+    int nodeCount = NODES_DEFAULT;
+    int days = DAYS_DEFAULT;
+    int interval = INTERVAL_DEFAULT;
+
+    while( true )
+    {
+        static struct option options[] = {
+            { "nodes",    required_argument, 0, 'n' },
+            { "days",     required_argument, 0, 'd' },
+            { "interval", required_argument, 0, 'i' },
+            { 0,          0,                 0,  0  }
+        };
+
+        int optRes = getopt_long( argc, argv, "n:d:i:", options, nullptr );
+
+        if( optRes == -1 )
+        {
+            break;
+        }
+
+        switch( optRes )
+        {
+            case 'n':
+                nodeCount = std::atoi( optarg );
+                break;
+
+            case 'd':
+                days = std::atoi( optarg );
+                break;
+
+            case 'i':
+                interval = std::atoi( optarg );
+                break;
+
+            default:
+                fprintf( stderr, "usage: %s [--nodes=N] [--days=N] [--interval=SECS]\n", argv[0] );
+                return 1;
+        }
+    }
+
+    char dirTemplate[] = "/tmp/icequery-history-XXXXXX";
+    const std::string dir = mkdtemp( dirTemplate );
+
+    std::vector<std::string> names;
+    std::vector<uint32_t> jobs( nodeCount );
+
+    for( int i = 0; i < nodeCount; ++i )
+    {
+        names.push_back( "build-node-" + std::to_string( i ) );
+    }
+
+    std::minstd_rand random( 1 );
+    std::vector<HistoryEntry> entries( nodeCount );
+    const int64_t start = 1700000000 - 1700000000 % HISTORY_ROLLUP_PERIOD;
+    const int64_t end = start + static_cast<int64_t>( days ) * 86400;
+    uint64_t samples = 0;
+
+    double writeMsecs = timeMsecs( [&] ()
+    {
+        std::unique_ptr<HistoryWriter> writer = HistoryWriter::open( dir );
+
+        for( int64_t time = start; time < end; time += interval )
+        {
+            // Most of the nodes keep their job counts between two samples
+            for( int i = 0; i < nodeCount; ++i )
+            {
+                uint32_t maxJobs = 8 + ( i % 4 ) * 8;
+
+                if( random() % 8 == 0 )
+                {
+                    jobs[i] = random() % ( maxJobs + 1 );
+                }
+
+                entries[i] = HistoryEntry { "scheduler", static_cast<uint32_t>( i + 1 ), names[i], i % 5 ? "x86_64" : "aarch64",
+                                            static_cast<uint8_t>( i % 97 == 0 ? HISTORY_FLAG_OFFLINE : 0 ), maxJobs, maxJobs - jobs[i], jobs[i] };
+            }
+
+            writer->append( time, entries );
+            samples += nodeCount;
+        }
+    } );
+
+    uint64_t size = directorySize( dir, false );
+    uint64_t sum = 0;
+
+    double rawMsecs = timeMsecs( [&] ()
+    {
+        scanHistoryFrames( dir, start, end, [&sum] ( int64_t, const std::vector<HistoryNode>&, bool, const std::vector<HistorySample>& frameSamples )
+        {
+            for( const HistorySample& sample : frameSamples )
+            {
+                sum += sample.freeSlots;
+            }
+        } );
+    } );
+
+    double rollupMsecs = timeMsecs( [&sum, &dir, start, end] ()
+    {
+        scanHistoryRollups( dir, start, end, [&sum] ( int64_t, uint32_t, const std::vector<HistoryNode>&, bool, const std::vector<HistoryRollup>& rollups )
+        {
+            for( const HistoryRollup& rollup : rollups )
+            {
+                sum += rollup.freeSlots;
+            }
+        } );
+    } );
+
+    directorySize( dir, true );
+    rmdir( dir.c_str() );
+
+    printf( "%d nodes, %d days, a frame every %d s: %llu samples (checksum %llu)\n\n", nodeCount, days, interval,
+            static_cast<unsigned long long>( samples ), static_cast<unsigned long long>( sum ) );
+    printf( "Stored:          %.1f MB, %.2f bytes/sample\n", size / 1e6, static_cast<double>( size ) / samples );
+    printf( "Recording:       %.0f ms\n", writeMsecs );
+    printf( "Raw scan:        %.0f ms, %.1f M samples/s\n", rawMsecs, samples / rawMsecs / 1e3 );
+    printf( "Rollup scan:     %.1f ms\n", rollupMsecs );
+
+    return 0;
+}
@@ -0,0 +1,283 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+/*
+    Compares the I/O backends on many connections streaming small messages:
+    system calls per message and reader CPU time per 10k messages, both when
+    only readiness is reported (and the reader calls recv() itself) and when
+    the backend receives on its own.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <ctime>        // clock_gettime()
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "iobackend.h"
+
+// Consts
+
+#define CONNECTIONS_DEFAULT         64
+#define MESSAGES_DEFAULT            200000
+#define MSG_SIZE_DEFAULT            128
+
+// Utility functions
+
+static double threadCpuUsecs()
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts );
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void writeAll( int fd, const char* data, std::size_t size )
+{
+    while( size > 0 )
+    {
+        ssize_t res = write( fd, data, size );
+
+        if( res <= 0 )
+        {
+            perror( "write()" );
+            std::exit( 1 );
+        }
+
+        data += res;
+        size -= res;
+    }
+}
+
+// Benchmark
+
+struct Result
+{
+    bool ok;
+    uint64_t syscalls;
+    double cpuUsecs;
+};
+
+static Result runBench( IoBackend::Type type, bool backendReceives, int connections, long messages, int msgSize )
+{
+    Result result { false, 0, 0 };
+    std::unique_ptr<IoBackend> backend = IoBackend::create( type );
+
+    if( !backend )
+    {
+        return result;
+    }
+
+    std::vector<int> readers( connections );
+    std::vector<int> writers( connections );
+
+    for( int i = 0; i < connections; ++i )
+    {
+        int fds[2];
+
+        if( socketpair( AF_UNIX, SOCK_STREAM, 0, fds ) < 0 )
+        {
+            perror( "socketpair()" );
+            std::exit( 1 );
+        }
+
+        fcntl( fds[0], F_SETFL, fcntl( fds[0], F_GETFL ) | O_NONBLOCK );
+        readers[i] = fds[0];
+        writers[i] = fds[1];
+    }
+
+    // Messages are written in bursts of a few per connection, like a
+    // scheduler pushing stats and job updates to its monitors
+    std::thread writer( [&] ()
+    {
+        std::vector<char> burst( msgSize * 4, 'x' );
+
+        for( long sent = 0; sent < messages; sent += 4 )
+        {
+            writeAll( writers[( sent / 4 ) % connections], burst.data(), burst.size() );
+        }
+
+        for( int fd : writers )
+        {
+            close( fd );
+        }
+    } );
+
+    std::vector<IoEvent> events;
+    std::vector<char> buffer( 65536 );
+    uint64_t extraSyscalls = 0;
+    long long received = 0;
+    long long expected = ( ( messages + 3 ) / 4 ) * 4 * static_cast<long long>( msgSize );
+    int open = connections;
+
+    double cpuStart = threadCpuUsecs();
+
+    for( int fd : readers )
+    {
+        if( backendReceives )
+        {
+            backend->receive( fd );
+        }
+        else
+        {
+            backend->watch( fd, POLLIN );
+        }
+    }
+
+    while( open > 0 )
+    {
+        events.clear();
+
+        if( !backend->wait( 1000, events ) )
+        {
+            perror( "IoBackend::wait()" );
+            break;
+        }
+
+        for( const IoEvent& event : events )
+        {
+            if( backendReceives )
+            {
+                if( event.size > 0 )
+                {
+                    received += event.size;
+                }
+                else
+                {
+                    --open;
+                }
+
+                continue;
+            }
+
+            bool eof = false;
+
+            while( true )
+            {
+                ssize_t res = recv( event.fd, buffer.data(), buffer.size(), 0 );
+                ++extraSyscalls;
+
+                if( res > 0 )
+                {
+                    received += res;
+                }
+                else
+                {
+                    eof = ( res == 0 );
+                    break;
+                }
+            }
+
+            if( eof )
+            {
+                --open;
+            }
+            else
+            {
+                backend->watch( event.fd, POLLIN );
+            }
+        }
+    }
+
+    result.cpuUsecs = threadCpuUsecs() - cpuStart;
+    result.syscalls = backend->syscallCount() + extraSyscalls;
+    result.ok = ( received == expected );
+
+    writer.join();
+
+    for( int fd : readers )
+    {
+        close( fd );
+    }
+
+    return result;
+}
+
+int main( int argc, char** argv )
+{
+    int connections = CONNECTIONS_DEFAULT;
+    long messages = MESSAGES_DEFAULT;
+    int msgSize = MSG_SIZE_DEFAULT;
+
+    while( true )
+    {
+        static struct option options[] = {
+            { "connections", required_argument, 0, 'c' },
+            { "messages",    required_argument, 0, 'm' },
+            { "size",        required_argument, 0, 's' },
+            { 0,             0,                 0,  0  }
+        };
+
+        int optRes = getopt_long( argc, argv, "c:m:s:", options, nullptr );
+
+        if( optRes == -1 )
+        {
+            break;
+        }
+
+        switch( optRes )
+        {
+            case 'c':
+                connections = std::atoi( optarg );
+                break;
+
+            case 'm':
+                messages = std::atol( optarg );
+                break;
+
+            case 's':
+                msgSize = std::atoi( optarg );
+                break;
+
+            default:
+                fprintf( stderr, "usage: %s [--connections=N] [--messages=N] [--size=BYTES]\n", argv[0] );
+                return 1;
+        }
+    }
+
+    printf( "%d connections, %ld messages of %d bytes\n\n", connections, messages, msgSize );
+    printf( "%-10s %-10s %14s %20s\n", "Backend", "Receive", "Syscalls/msg", "CPU usecs/10k msgs" );
+
+    for( IoBackend::Type type : { IoBackend::Type::Poll, IoBackend::Type::Epoll, IoBackend::Type::IoUring } )
+    {
+        for( bool backendReceives : { false, true } )
+        {
+            Result result = runBench( type, backendReceives, connections, messages, msgSize );
+
+            if( !result.ok )
+            {
+                printf( "%-10s %-10s %14s %20s\n", IoBackend::typeToStr( type ), backendReceives ? "backend" : "reader", "n/a", "n/a" );
+                continue;
+            }
+
+            printf( "%-10s %-10s %14.3f %20.1f\n", IoBackend::typeToStr( type ), backendReceives ? "backend" : "reader",
+                    static_cast<double>( result.syscalls ) / messages, result.cpuUsecs * 10000 / messages );
+        }
+    }
+
+    return 0;
+}
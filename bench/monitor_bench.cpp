@@ -0,0 +1,235 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Measures how fast a monitor client takes in the scheduler's stats dump,
+    job messages interleaved, from a stand-in scheduler in the same process:
+    the time till the last node is known and the reader's CPU time per
+    message, for the client picked with --client.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ctime>        // clock_gettime()
+#include <getopt.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <icecc/comm.h>
+
+#include "common.h"
+#include "query.h"
+#include "standin.h"
+
+// Consts
+
+#define NODES_DEFAULT               5000
+#define JOBS_DEFAULT                4
+#define RUNS_DEFAULT                20
+
+// Utility functions
+
+static double threadCpuUsecs()
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts );
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void appendUint32( std::string& buf, uint32_t value, bool bigEndian = true )
+{
+    for( int i = 0; i < 4; ++i )
+    {
+        buf.push_back( static_cast<char>( value >> ( bigEndian ? 24 - 8 * i : 8 * i ) ) );
+    }
+}
+
+static bool readAll( int fd, char* data, std::size_t size )
+{
+    while( size )
+    {
+        ssize_t len = read( fd, data, size );
+
+        if( len <= 0 )
+        {
+            return false;
+        }
+
+        data += len;
+        size -= len;
+    }
+
+    return true;
+}
+
+// Plays the scheduler to every connection: the version handshake, the
+// monitor login, then the dump, keeping the connection open till the
+// client closes it
+static void standIn( int listenFd, const std::string& dump, int runs )
+{
+    for( int run = 0; run < runs; ++run )
+    {
+        int fd = accept( listenFd, nullptr, nullptr );
+        char buf[8];
+        std::string out;
+
+        appendUint32( out, PROTOCOL_VERSION, false );
+        write( fd, out.data(), out.size() );
+
+        if( readAll( fd, buf, 4 ) && write( fd, buf, 4 ) == 4 && readAll( fd, buf, 4 ) && readAll( fd, buf, 8 ) )
+        {
+            for( std::size_t sent = 0; sent < dump.size(); )
+            {
+                ssize_t len = write( fd, dump.data() + sent, dump.size() - sent );
+
+                if( len <= 0 )
+                {
+                    break;
+                }
+
+                sent += len;
+            }
+
+            while( read( fd, buf, sizeof( buf ) ) > 0 )
+            {
+            }
+        }
+
+        close( fd );
+    }
+}
+
+// Benchmark
+
+int main( int argc, char** argv )
+{
+    int nodeCount = NODES_DEFAULT;
+    int jobsPerNode = JOBS_DEFAULT;
+    int runs = RUNS_DEFAULT;
+    MonitorClient client = MonitorClient::Native;
+
+    while( true )
+    {
+        static struct option options[] = {
+            { "nodes",  required_argument, 0, 'n' },
+            { "jobs",   required_argument, 0, 'j' },
+            { "runs",   required_argument, 0, 'r' },
+            { "client", required_argument, 0, 'c' },
+            { 0,        0,                 0,  0  }
+        };
+
+        int optRes = getopt_long( argc, argv, "n:j:r:c:", options, nullptr );
+
+        if( optRes == -1 )
+        {
+            break;
+        }
+
+        switch( optRes )
+        {
+            case 'n':
+                nodeCount = std::atoi( optarg );
+                break;
+
+            case 'j':
+                jobsPerNode = std::atoi( optarg );
+                break;
+
+            case 'r':
+                runs = std::atoi( optarg );
+                break;
+
+            case 'c':
+                if( strToMonitorClient( optarg, client ) )
+                {
+                    break;
+                }
+
+                [[fallthrough]];
+
+            default:
+                fprintf( stderr, "usage: %s [--nodes=N] [--jobs=PER_NODE] [--runs=N] [--client=libicecc|native]\n", argv[0] );
+                return 1;
+        }
+    }
+
+    veryQuiet = true;
+
+    uint32_t msgCount;
+    const std::string dump = makeStandInDump( nodeCount, jobsPerNode, msgCount );
+
+    int listenFd = socket( AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    struct sockaddr_in addr {};
+    socklen_t addrLen = sizeof( addr );
+
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+    if( bind( listenFd, reinterpret_cast<struct sockaddr*>( &addr ), sizeof( addr ) ) < 0 || listen( listenFd, runs ) < 0 ||
+        getsockname( listenFd, reinterpret_cast<struct sockaddr*>( &addr ), &addrLen ) < 0 )
+    {
+        perror( "listen" );
+        return 1;
+    }
+
+    std::thread server( standIn, listenFd, std::cref( dump ), runs );
+
+    double wallUsecs = 0;
+    double cpuUsecs = 0;
+    int failures = 0;
+
+    for( int run = 0; run < runs; ++run )
+    {
+        Query query( "", 2000, 2000, "127.0.0.1", ntohs( addr.sin_port ), client );
+        short revents = 0;
+
+        double wallStart = getTimestamp() * 1e3;
+        double cpuStart = threadCpuUsecs();
+
+        while( !query.process( revents ) && query.nodes().size() < static_cast<std::size_t>( nodeCount ) )
+        {
+            struct pollfd pollData { query.fd(), query.events(), 0 };
+
+            revents = ( poll( &pollData, 1, query.pollTimeout() ) > 0 ) ? pollData.revents : 0;
+        }
+
+        cpuUsecs += threadCpuUsecs() - cpuStart;
+        wallUsecs += getTimestamp() * 1e3 - wallStart;
+        failures += ( query.nodes().size() != static_cast<std::size_t>( nodeCount ) );
+    }
+
+    server.join();
+    close( listenFd );
+
+    printf( "%s client, %d nodes, %u messages (%.1f MB) per dump, %d runs%s\n\n", MonitorClientToStr( client ), nodeCount, msgCount,
+            dump.size() / 1e6, runs, failures ? ", some incomplete" : "" );
+    printf( "Time per dump:      %.2f ms\n", wallUsecs / runs / 1e3 );
+    printf( "CPU per dump:       %.2f ms\n", cpuUsecs / runs / 1e3 );
+    printf( "CPU per message:    %.0f ns\n", cpuUsecs * 1e3 / runs / msgCount );
+
+    return failures ? 1 : 0;
+}
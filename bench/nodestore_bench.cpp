@@ -0,0 +1,214 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+/*
+    Compares the node list (a heap object per node) with the columnar
+    NodeStore on a synthetic farm: bytes allocated to hold the nodes and time
+    taken by the totals, with and without a platform filter.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <ctime>        // clock_gettime()
+#include <getopt.h>
+#include <malloc.h>     // mallinfo2()
+
+#include "nodeinfo.h"
+#include "nodestore.h"
+
+// Consts
+
+#define NODES_DEFAULT               100000
+#define ITERATIONS_DEFAULT          200
+
+static const char* Platforms[] = { "x86_64", "x86_64", "x86_64", "aarch64", "i686" };
+
+// Utility functions
+
+static double nowUsecs()
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static std::size_t allocatedBytes()
+{
+    return mallinfo2().uordblks;
+}
+
+static std::string nodeStats( long i )
+{
+    char stats[256];
+
+    snprintf( stats, sizeof( stats ), "Name:build-node-%06ld.farm.example.com\nIP:10.%ld.%ld.%ld\nMaxJobs:%ld\nNoRemote:%s\nState:%s\nPlatform:%s\n",
+              i, ( i >> 16 ) & 255, ( i >> 8 ) & 255, i & 255, 4 + i % 60, i % 17 == 0 ? "true" : "false", i % 23 == 0 ? "Offline" : "Online",
+              Platforms[i % ( sizeof( Platforms ) / sizeof( Platforms[0] ) )] );
+
+    return stats;
+}
+
+// The list's aggregations, as done by the output
+
+static uint32_t listCores( const NodeList& nodes, const std::string& platform )
+{
+    uint32_t res = 0;
+
+    for( const auto& node : nodes )
+    {
+        if( !node->noRemote() && !node->isOffline() && ( platform.empty() || std::string_view( node->platform() ) == platform ) )
+        {
+            res += node->maxJobs();
+        }
+    }
+
+    return res;
+}
+
+static uint32_t listNodes( const NodeList& nodes, const std::string& platform )
+{
+    return std::count_if( nodes.cbegin(), nodes.cend(), [&platform] ( const NodeInfoPtr& node )
+    {
+        return !node->isOffline() && !node->noRemote() && ( platform.empty() || std::string_view( node->platform() ) == platform );
+    } );
+}
+
+// Benchmark
+
+template<typename Fn>
+static double timeUsecs( int iterations, Fn fn, uint32_t& result )
+{
+    double start = nowUsecs();
+
+    for( int i = 0; i < iterations; ++i )
+    {
+        result = fn();
+
+        // Keep the compiler from hoisting the work out of the loop
+        asm volatile( "" : : "r"( result ) : "memory" );
+    }
+
+    return ( nowUsecs() - start ) / iterations;
+}
+
+int main( int argc, char** argv )
+{
+    long nodeCount = NODES_DEFAULT;
+    int iterations = ITERATIONS_DEFAULT;
+
+    while( true )
+    {
+        static struct option options[] = {
+            { "nodes",       required_argument, 0, 'n' },
+            { "iterations",  required_argument, 0, 'i' },
+            { 0,             0,                 0,  0  }
+        };
+
+        int optRes = getopt_long( argc, argv, "n:i:", options, nullptr );
+
+        if( optRes == -1 )
+        {
+            break;
+        }
+
+        switch( optRes )
+        {
+            case 'n':
+                nodeCount = std::atol( optarg );
+                break;
+
+            case 'i':
+                iterations = std::atoi( optarg );
+                break;
+
+            default:
+                fprintf( stderr, "usage: %s [--nodes=N] [--iterations=N]\n", argv[0] );
+                return 1;
+        }
+    }
+
+    std::vector<std::string> stats;
+    stats.reserve( nodeCount );
+
+    for( long i = 0; i < nodeCount; ++i )
+    {
+        stats.push_back( nodeStats( i ) );
+    }
+
+    std::size_t before = allocatedBytes();
+
+    NodeList nodes;
+
+    for( long i = 0; i < nodeCount; ++i )
+    {
+        nodes.push_back( NodeInfo::create( static_cast<uint32_t>( i + 1 ), stats[i] ) );
+    }
+
+    std::size_t listBytes = allocatedBytes() - before;
+
+    before = allocatedBytes();
+
+    NodeStore store( nodes );
+
+    std::size_t storeBytes = allocatedBytes() - before;
+
+    const std::string platform = "aarch64";
+    const uint32_t platformId = store.platformId( platform );
+
+    uint32_t listRes[4];
+    uint32_t storeRes[4];
+
+    double listUsecs[4] = {
+        timeUsecs( iterations, [&] { return listCores( nodes, std::string() ); }, listRes[0] ),
+        timeUsecs( iterations, [&] { return listNodes( nodes, std::string() ); }, listRes[1] ),
+        timeUsecs( iterations, [&] { return listCores( nodes, platform ); }, listRes[2] ),
+        timeUsecs( iterations, [&] { return listNodes( nodes, platform ); }, listRes[3] )
+    };
+
+    double storeUsecs[4] = {
+        timeUsecs( iterations, [&] { return store.countCores(); }, storeRes[0] ),
+        timeUsecs( iterations, [&] { return store.countNodes( true, true ); }, storeRes[1] ),
+        timeUsecs( iterations, [&] { return store.countCores( platformId ); }, storeRes[2] ),
+        timeUsecs( iterations, [&] { return store.countNodes( true, true, platformId ); }, storeRes[3] )
+    };
+
+    static const char* Names[] = { "cores", "nodes", "cores, platform", "nodes, platform" };
+
+    printf( "%ld nodes, %d iterations\n\n", nodeCount, iterations );
+    printf( "%-18s %14s %14s\n", "", "NodeList", "NodeStore" );
+    printf( "%-18s %14zu %14zu\n", "bytes", listBytes, storeBytes );
+
+    for( int i = 0; i < 4; ++i )
+    {
+        if( listRes[i] != storeRes[i] )
+        {
+            fprintf( stderr, "Mismatch for %s: %u vs %u\n", Names[i], listRes[i], storeRes[i] );
+            return 1;
+        }
+
+        printf( "%-18s %12.1fus %12.1fus\n", Names[i], listUsecs[i], storeUsecs[i] );
+    }
+
+    return 0;
+}
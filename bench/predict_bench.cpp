@@ -0,0 +1,142 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Times predicting a build of synthetic files: loading the collected costs,
+    reading the file list and looking the costs up, and searching for the best
+    job count on a farm of the given size.
+*/
+
+#include <chrono>
+#include <cmath>        // std::exp()
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+#include <unistd.h>     // unlink()
+
+#include "compilecosts.h"
+#include "predict.h"
+
+// Consts
+
+#define FILES_DEFAULT               50000
+#define SLOTS_DEFAULT               2000
+
+// Utility functions
+
+template<typename Fn>
+static double timeMsecs( Fn fn )
+{
+    auto start = std::chrono::steady_clock::now();
+    fn();
+
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+// Benchmark
+
+int main( int argc, char** argv )
+{
+    int fileCount = FILES_DEFAULT;
+    int slots = SLOTS_DEFAULT;
+
+    while( true )
+    {
+        static struct option options[] = {
+            { "files", required_argument, 0, 'f' },
+            { "slots", required_argument, 0, 's' },
+            { 0,       0,                 0,  0  }
+        };
+
+        int optRes = getopt_long( argc, argv, "f:s:", options, nullptr );
+
+        if( optRes == -1 )
+        {
+            break;
+        }
+
+        switch( optRes )
+        {
+            case 'f':
+                fileCount = std::atoi( optarg );
+                break;
+
+            case 's':
+                slots = std::atoi( optarg );
+                break;
+
+            default:
+                fprintf( stderr, "usage: %s [--files=N] [--slots=N]\n", argv[0] );
+                return 1;
+        }
+    }
+
+    char costsTemplate[] = "/tmp/icequery-costs-XXXXXX";
+    char listTemplate[] = "/tmp/icequery-files-XXXXXX";
+    close( mkstemp( costsTemplate ) );
+
+    int listFd = mkstemp( listTemplate );
+    FILE* list = fdopen( listFd, "w" );
+
+    // Most files compile in a second or two, a few take much longer; a tenth
+    // of the list is new
+    {
+        std::minstd_rand random( 1 );
+        std::normal_distribution<double> logMsecs( 7.2, 0.8 );
+        CompileCosts costs;
+
+        for( int i = 0; i < fileCount; ++i )
+        {
+            std::string path = "src/module" + std::to_string( i % 400 ) + "/file" + std::to_string( i ) + ".cpp";
+
+            if( i % 10 )
+            {
+                costs.add( path, static_cast<uint32_t>( std::exp( logMsecs( random ) ) ) + 1 );
+            }
+
+            fprintf( list, "%s\n", path.c_str() );
+        }
+
+        costs.save( costsTemplate );
+        fclose( list );
+    }
+
+    CompileCosts costs;
+    BuildCosts build;
+    uint64_t wallTime = 0;
+    uint32_t bestJobs = 0;
+
+    double loadMsecs = timeMsecs( [&] () { costs.load( costsTemplate ); } );
+    double readMsecs = timeMsecs( [&] () { readBuildCosts( listTemplate, costs, build ); } );
+    double searchMsecs = timeMsecs( [&] () { bestJobs = bestJobCount( build.costs, slots, wallTime ); } );
+
+    unlink( costsTemplate );
+    unlink( listTemplate );
+
+    printf( "%d files, %zu known, %d slots: -j%u, %.1f s\n\n", fileCount, build.knownCount, slots, bestJobs, wallTime / 1000.0 );
+    printf( "Loading costs:   %.1f ms\n", loadMsecs );
+    printf( "Reading list:    %.1f ms\n", readMsecs );
+    printf( "Best -j search:  %.1f ms\n", searchMsecs );
+    printf( "Total:           %.1f ms\n", loadMsecs + readMsecs + searchMsecs );
+
+    return 0;
+}
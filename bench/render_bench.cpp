@@ -0,0 +1,153 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+/*
+    Times renderTable() on a large node table in the plain, custom
+    encoding and --ascii modes, the latter transliterating every cell.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <ctime>        // clock_gettime()
+#include <getopt.h>
+
+#include <unicode/ucnv.h>       // icu::ucnv_getDefaultName
+
+#include "output.h"
+
+// Consts
+
+#define ROWS_DEFAULT                20000
+#define ITERATIONS_DEFAULT          5
+
+static const char* Platforms[] = { "x86_64", "x86_64", "aarch64", "i686" };
+
+// Utility functions
+
+static double nowMsecs()
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Names with a few non-ASCII letters, in either UTF-8 or ISO-8859-2
+static NodeList makeNodes( long rows, bool latin2 )
+{
+    NodeList nodes;
+
+    for( long i = 0; i < rows; ++i )
+    {
+        char stats[256];
+
+        snprintf( stats, sizeof( stats ), "Name:%s-%ld\nIP:10.%ld.%ld.%ld\nMaxJobs:%ld\nNoRemote:%s\nPlatform:%s\n",
+                  latin2 ? "w\xea\xbf" "e\xb3-kompilacji" : "w\xc4\x99\xc5\xbc\x65\xc5\x82-kompilacji", i % 500, ( i >> 16 ) & 255, ( i >> 8 ) & 255, i & 255,
+                  4 + i % 60, i % 17 == 0 ? "true" : "false", Platforms[i % ( sizeof( Platforms ) / sizeof( Platforms[0] ) )] );
+
+        nodes.push_back( NodeInfo::create( static_cast<uint32_t>( i + 1 ), stats ) );
+    }
+
+    return nodes;
+}
+
+// Benchmark
+
+static double runBench( long rows, int iterations, bool ascii, const char* encoding )
+{
+    OutputSpec spec;
+    spec.ascii = ascii;
+    spec.customEncoding = encoding ? encoding : ucnv_getDefaultName();
+
+    NodeList nodes = makeNodes( rows, encoding != nullptr );
+
+    const std::vector<ColumnHeader> header = nodeHeader( spec );
+    Cells strings;
+
+    for( const auto& node : nodes )
+    {
+        appendNodeCells( spec, strings, *node );
+    }
+
+    double start = nowMsecs();
+    int32_t length = 0;
+
+    for( int i = 0; i < iterations; ++i )
+    {
+        length += renderTable( header, strings, spec.plain, spec.ascii, spec.customEncoding ).length();
+    }
+
+    if( length == 0 )
+    {
+        fprintf( stderr, "Nothing rendered\n" );
+        std::exit( 1 );
+    }
+
+    return ( nowMsecs() - start ) / iterations;
+}
+
+int main( int argc, char** argv )
+{
+    long rows = ROWS_DEFAULT;
+    int iterations = ITERATIONS_DEFAULT;
+
+    while( true )
+    {
+        static struct option options[] = {
+            { "rows",        required_argument, 0, 'r' },
+            { "iterations",  required_argument, 0, 'i' },
+            { 0,             0,                 0,  0  }
+        };
+
+        int optRes = getopt_long( argc, argv, "r:i:", options, nullptr );
+
+        if( optRes == -1 )
+        {
+            break;
+        }
+
+        switch( optRes )
+        {
+            case 'r':
+                rows = std::atol( optarg );
+                break;
+
+            case 'i':
+                iterations = std::atoi( optarg );
+                break;
+
+            default:
+                fprintf( stderr, "usage: %s [--rows=N] [--iterations=N]\n", argv[0] );
+                return 1;
+        }
+    }
+
+    printf( "%ld rows, %d iterations\n\n", rows, iterations );
+    printf( "%-36s %14s\n", "Mode", "ms/render" );
+
+    printf( "%-36s %14.1f\n", "default encoding", runBench( rows, iterations, false, nullptr ) );
+    printf( "%-36s %14.1f\n", "--encoding=ISO-8859-2", runBench( rows, iterations, false, "ISO-8859-2" ) );
+    printf( "%-36s %14.1f\n", "--ascii", runBench( rows, iterations, true, nullptr ) );
+    printf( "%-36s %14.1f\n", "--ascii --encoding=ISO-8859-2", runBench( rows, iterations, true, "ISO-8859-2" ) );
+
+    return 0;
+}
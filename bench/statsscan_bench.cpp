@@ -0,0 +1,242 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+/*
+    Compares scanning stats messages by repeated find() calls, as NodeInfo
+    used to, with the single-pass block scanner in each of its variants.
+    Payloads recorded with 'icequery --debug 2> LOG' can be passed with
+    --payloads=LOG, otherwise built-in ones shaped like the scheduler's are
+    used.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <ctime>        // clock_gettime()
+#include <getopt.h>
+
+#include "nodeinfo.h"
+#include "statsscan.h"
+
+// Consts
+
+#define ITERATIONS_DEFAULT          200000
+
+// A node logging in, a load update, a long feature list and a node leaving
+static const char* BuiltinPayloads[] = {
+    "Name:build-node-042.farm.example.com\nIP:10.0.3.42\nMaxJobs:32\nNoRemote:false\nPlatform:x86_64\nVersion:42\n"
+    "Features:env_xz env_zstd\nSpeed:214.137\nLoad:120\nLoadAvg1:287\nLoadAvg5:310\nLoadAvg10:305\nFreeMem:51234\n",
+
+    "Name:build-node-042.farm.example.com\nIP:10.0.3.42\nMaxJobs:32\nNoRemote:false\nPlatform:x86_64\nLoad:640\n"
+    "LoadAvg1:1533\nLoadAvg5:1210\nLoadAvg10:980\nFreeMem:40990\n",
+
+    "Name:arm-builder-7\nIP:192.168.17.7\nMaxJobs:8\nNoRemote:true\nPlatform:aarch64\nVersion:42\n"
+    "Features:env_xz env_zstd remote_gcc_plugins chroot_environments proto_47_compression\nSpeed:88.5\nLoad:0\n",
+
+    "Name:laptop\nIP:192.168.17.99\nMaxJobs:4\nNoRemote:false\nPlatform:x86_64\nState:Offline\n"
+};
+
+// Utility functions
+
+static double nowUsecs()
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Stats messages logged by --debug are enclosed in lines of a single '-'
+static std::vector<std::string> readPayloads( const char* path )
+{
+    std::vector<std::string> payloads;
+    std::ifstream in( path );
+    std::string line;
+    std::string payload;
+    bool inside = false;
+
+    while( std::getline( in, line ) )
+    {
+        if( line == "-" )
+        {
+            if( inside && !payload.empty() )
+            {
+                payloads.push_back( payload );
+            }
+
+            payload.clear();
+            inside = !inside;
+        }
+        else if( inside )
+        {
+            payload.append( line ).append( 1, '\n' );
+        }
+    }
+
+    return payloads;
+}
+
+// The scanning as done by NodeInfo::create() before, find() for every field
+template<typename Fn>
+static void scanStatsFind( const std::string& stats, Fn&& fn )
+{
+    std::string::size_type linePos = 0;
+
+    while( true )
+    {
+        auto nextLinePos = stats.find( '\n', linePos );
+        auto colonPos = stats.find( ':', linePos );
+
+        if( colonPos != std::string::npos && !( nextLinePos != std::string::npos && colonPos > nextLinePos ) )
+        {
+            fn( std::string_view( stats ).substr( linePos, colonPos - linePos ),
+                std::string_view( stats ).substr( colonPos + 1, nextLinePos == std::string::npos ? std::string::npos : nextLinePos - ( colonPos + 1 ) ) );
+        }
+
+        linePos = nextLinePos;
+
+        if( nextLinePos == std::string::npos || ++linePos > stats.length() )
+        {
+            break;
+        }
+    }
+}
+
+// Benchmark
+
+template<typename Scan>
+static double runBench( const std::vector<std::string>& payloads, long iterations, Scan scan, std::size_t& checksum )
+{
+    checksum = 0;
+
+    auto sink = [&checksum] ( std::string_view name, std::string_view value ) { checksum += name.size() * 31 + value.size(); };
+
+    double start = nowUsecs();
+
+    for( long i = 0; i < iterations; ++i )
+    {
+        scan( payloads[i % payloads.size()], sink );
+    }
+
+    return ( nowUsecs() - start ) * 1000 / iterations;
+}
+
+int main( int argc, char** argv )
+{
+    long iterations = ITERATIONS_DEFAULT;
+    const char* payloadsPath = nullptr;
+
+    while( true )
+    {
+        static struct option options[] = {
+            { "iterations",  required_argument, 0, 'i' },
+            { "payloads",    required_argument, 0, 'p' },
+            { 0,             0,                 0,  0  }
+        };
+
+        int optRes = getopt_long( argc, argv, "i:p:", options, nullptr );
+
+        if( optRes == -1 )
+        {
+            break;
+        }
+
+        switch( optRes )
+        {
+            case 'i':
+                iterations = std::atol( optarg );
+                break;
+
+            case 'p':
+                payloadsPath = optarg;
+                break;
+
+            default:
+                fprintf( stderr, "usage: %s [--iterations=N] [--payloads=DEBUG_LOG]\n", argv[0] );
+                return 1;
+        }
+    }
+
+    std::vector<std::string> payloads;
+
+    if( payloadsPath )
+    {
+        payloads = readPayloads( payloadsPath );
+    }
+    else
+    {
+        payloads.assign( std::begin( BuiltinPayloads ), std::end( BuiltinPayloads ) );
+    }
+
+    if( payloads.empty() )
+    {
+        fprintf( stderr, "No payloads found.\n" );
+        return 1;
+    }
+
+    std::size_t totalBytes = 0;
+
+    for( const std::string& payload : payloads )
+    {
+        totalBytes += payload.size();
+    }
+
+    printf( "%zu payloads, %zu bytes on average, %ld iterations\n\n", payloads.size(), totalBytes / payloads.size(), iterations );
+    printf( "%-12s %16s %18s\n", "Scanner", "ns/payload", "NodeInfo ns/payload" );
+
+    std::size_t expected;
+    double findNs = runBench( payloads, iterations, [] ( const std::string& stats, auto& sink ) { scanStatsFind( stats, sink ); }, expected );
+
+    printf( "%-12s %16.1f %18s\n", "find()", findNs, "-" );
+
+    for( StatsScanner scanner : { StatsScanner::Scalar, StatsScanner::SSE2, StatsScanner::AVX2 } )
+    {
+        if( !setStatsScanner( scanner ) )
+        {
+            printf( "%-12s %16s %18s\n", StatsScannerToStr( scanner ), "n/a", "n/a" );
+            continue;
+        }
+
+        std::size_t checksum;
+        double scanNs = runBench( payloads, iterations, [] ( const std::string& stats, auto& sink ) { scanStats( stats, sink ); }, checksum );
+
+        if( checksum != expected )
+        {
+            fprintf( stderr, "Mismatch for %s\n", StatsScannerToStr( scanner ) );
+            return 1;
+        }
+
+        double start = nowUsecs();
+
+        for( long i = 0; i < iterations; ++i )
+        {
+            NodeInfo::create( 1, payloads[i % payloads.size()] );
+        }
+
+        double createNs = ( nowUsecs() - start ) * 1000 / iterations;
+
+        printf( "%-12s %16.1f %18.1f\n", StatsScannerToStr( scanner ), scanNs, createNs );
+    }
+
+    return 0;
+}
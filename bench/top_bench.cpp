@@ -0,0 +1,200 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+/*
+    Compares the bytes sent to the terminal per refresh of a '--top' screen
+    when only the changed cells are repainted and when the whole screen is,
+    on a farm where a few nodes start or finish jobs between refreshes.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+#include "top.h"
+
+// Consts
+
+#define NODES_DEFAULT               1500
+#define LINES_DEFAULT               1502
+#define CHANGES_DEFAULT             30
+#define REFRESHES_DEFAULT           100
+
+// Benchmark
+
+struct Node
+{
+    std::string name;
+    std::string ip;
+    uint32_t cores;
+    uint32_t jobs;
+};
+
+static std::vector<std::string> nodeCells( std::size_t i, const Node& node )
+{
+    return { std::to_string( i + 1 ), node.name, node.ip, "x86_64", std::to_string( node.cores ), std::to_string( node.jobs ),
+             std::to_string( node.cores - node.jobs ) };
+}
+
+static ScreenFrame buildFrame( const std::vector<Node>& nodes, std::vector<ColumnWidth>& widths, std::size_t lines )
+{
+    ScreenFrame frame;
+    std::size_t x = 0;
+    std::vector<std::size_t> xs;
+
+    for( const ColumnWidth& width : widths )
+    {
+        xs.push_back( x );
+        x += width.width() + 2;
+    }
+
+    for( std::size_t i = 0; i < nodes.size() && frame.size() < lines; ++i )
+    {
+        std::vector<std::string> cells = nodeCells( i, nodes[i] );
+        frame.emplace_back();
+
+        for( std::size_t c = 0; c < cells.size(); ++c )
+        {
+            std::size_t width = widths[c].width() + 2;
+            frame.back().push_back( ScreenCell { static_cast<uint16_t>( xs[c] ), static_cast<uint16_t>( width ), cells[c] + std::string( width - cells[c].size(), ' ' ) } );
+        }
+    }
+
+    return frame;
+}
+
+int main( int argc, char** argv )
+{
+    std::size_t nodeCount = NODES_DEFAULT;
+    std::size_t lines = LINES_DEFAULT;
+    int changes = CHANGES_DEFAULT;
+    int refreshes = REFRESHES_DEFAULT;
+
+    while( true )
+    {
+        static struct option options[] = {
+            { "nodes",     required_argument, 0, 'n' },
+            { "lines",     required_argument, 0, 'l' },
+            { "changes",   required_argument, 0, 'c' },
+            { "refreshes", required_argument, 0, 'r' },
+            { 0,           0,                 0,  0  }
+        };
+
+        int optRes = getopt_long( argc, argv, "n:l:c:r:", options, nullptr );
+
+        if( optRes == -1 )
+        {
+            break;
+        }
+
+        switch( optRes )
+        {
+            case 'n':
+                nodeCount = std::strtoul( optarg, nullptr, 10 );
+                break;
+
+            case 'l':
+                lines = std::strtoul( optarg, nullptr, 10 );
+                break;
+
+            case 'c':
+                changes = std::atoi( optarg );
+                break;
+
+            case 'r':
+                refreshes = std::atoi( optarg );
+                break;
+
+            default:
+                fprintf( stderr, "usage: %s [--nodes=N] [--lines=N] [--changes=N] [--refreshes=N]\n", argv[0] );
+                return 1;
+        }
+    }
+
+    std::minstd_rand random( 1 );
+    std::vector<Node> nodes( nodeCount );
+    std::vector<ColumnWidth> widths( 7 );
+
+    for( std::size_t i = 0; i < nodeCount; ++i )
+    {
+        nodes[i] = Node { "build-node-" + std::to_string( i ), "10.0." + std::to_string( i / 256 ) + "." + std::to_string( i % 256 ), 4u + static_cast<uint32_t>( i % 4 ) * 12, 0 };
+
+        for( std::size_t c = 0; const std::string& cell : nodeCells( i, nodes[i] ) )
+        {
+            widths[c++].add( cell.size() );
+        }
+    }
+
+    TerminalScreen incremental;
+    TerminalScreen full;
+    std::string out;
+    std::size_t incrementalBytes = 0;
+    std::size_t fullBytes = 0;
+
+    for( int refresh = 0; refresh <= refreshes; ++refresh )
+    {
+        // Jobs starting and finishing, with the widths following the cells
+        for( int i = 0; refresh > 0 && i < changes; ++i )
+        {
+            std::size_t n = random() % nodeCount;
+            std::vector<std::string> before = nodeCells( n, nodes[n] );
+
+            nodes[n].jobs = random() % ( nodes[n].cores + 1 );
+
+            std::vector<std::string> after = nodeCells( n, nodes[n] );
+
+            for( std::size_t c = 0; c < before.size(); ++c )
+            {
+                widths[c].remove( before[c].size() );
+                widths[c].add( after[c].size() );
+            }
+        }
+
+        ScreenFrame frame = buildFrame( nodes, widths, lines );
+
+        out.clear();
+        incremental.update( frame, out );
+
+        // The first refresh paints everything either way
+        if( refresh > 0 )
+        {
+            incrementalBytes += out.size();
+        }
+
+        out.clear();
+        full.invalidate();
+        full.update( frame, out );
+
+        if( refresh > 0 )
+        {
+            fullBytes += out.size();
+        }
+    }
+
+    printf( "%zu nodes, %zu lines, %d changes per refresh, %d refreshes\n\n", nodeCount, lines, changes, refreshes );
+    printf( "%-14s %16s\n", "Repaint", "Bytes/refresh" );
+    printf( "%-14s %16.0f\n", "full", static_cast<double>( fullBytes ) / refreshes );
+    printf( "%-14s %16.0f\n", "incremental", static_cast<double>( incrementalBytes ) / refreshes );
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "icequery.h"
+
+#include <icecc/logging.h>
+
+#include "common.h"
+#include "query.h"
+
+struct icequery
+{
+    icequery( const std::string& netName, int timeout, int rtimeout, const std::string& schedAddr, uint16_t schedPort )
+        : query( netName, timeout, rtimeout, schedAddr, schedPort )
+    {
+    }
+
+    Query query;
+};
+
+void icequery_set_verbosity( int level )
+{
+    veryQuiet = ( level <= 0 );
+    debug = ( level >= 2 );
+
+    if( level < 2 )
+    {
+        reset_debug( 0 );
+    }
+}
+
+icequery_t* icequery_new( const char* net_name, const char* addr, uint16_t port, int timeout, int rtimeout )
+{
+    // Nothing may throw across the C boundary
+    try
+    {
+        return new icequery( net_name ? net_name : "", timeout, rtimeout, addr ? addr : "", port );
+    }
+    catch( ... )
+    {
+        return nullptr;
+    }
+}
+
+void icequery_free( icequery_t* query )
+{
+    delete query;
+}
+
+int icequery_fd( const icequery_t* query )
+{
+    return query->query.fd();
+}
+
+short icequery_events( const icequery_t* query )
+{
+    return query->query.events();
+}
+
+int icequery_timeout( const icequery_t* query )
+{
+    return query->query.pollTimeout();
+}
+
+int icequery_process( icequery_t* query, short revents )
+{
+    try
+    {
+        query->query.process( revents );
+    }
+    catch( ... )
+    {
+        return ICEQUERY_FAILED;
+    }
+
+    switch( query->query.state() )
+    {
+        case Query::State::Done:
+            return ICEQUERY_DONE;
+
+        case Query::State::Failed:
+            return ICEQUERY_FAILED;
+
+        default:
+            return ICEQUERY_PENDING;
+    }
+}
+
+int icequery_exit_code( const icequery_t* query )
+{
+    return query->query.exitCode();
+}
+
+size_t icequery_node_count( const icequery_t* query )
+{
+    return query->query.nodes().size();
+}
+
+int icequery_node( const icequery_t* query, size_t index, icequery_node_t* node )
+{
+    const NodeList& nodes = query->query.nodes();
+
+    if( index >= nodes.size() || !node )
+    {
+        return -1;
+    }
+
+    const NodeInfo& info = *nodes[index];
+
+    node->host_id = info.hostId();
+    node->name = info.name().c_str();
+    node->ip = info.ip().c_str();
+    node->max_jobs = info.maxJobs();
+    node->no_remote = info.noRemote();
+    node->offline = info.isOffline();
+    node->platform = info.platform().c_str();
+
+    return 0;
+}
@@ -0,0 +1,158 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "common.h"
+
+#include <algorithm>
+#include <cctype>       // tolower, isdigit
+#include <cerrno>
+#include <cstdlib>      // getenv()
+#include <ctime>        // clock_gettime()
+
+#include <sys/stat.h>   // mkdir()
+
+// Global variables
+
+bool veryQuiet = false;
+bool debug = false;
+bool useColor = false;
+
+// Utility functions
+
+long getTimestamp()
+{
+    static struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC_RAW, &ts );
+
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+std::string toLower( std::string&& str )
+{
+    std::transform( str.cbegin(), str.cend(), str.begin(), tolower );
+
+    return std::move( str );
+}
+
+std::string& toLower( std::string& str )
+{
+    std::transform( str.cbegin(), str.cend(), str.begin(), tolower );
+
+    return str;
+}
+
+bool equalsIgnoreCase( std::string_view a, std::string_view b )
+{
+    return a.size() == b.size() && std::equal( a.cbegin(), a.cend(), b.cbegin(), [] ( char x, char y ) { return tolower( x ) == tolower( y ); } );
+}
+
+bool parseDuration( std::string_view str, long& seconds )
+{
+    long res = 0;
+    std::size_t pos = 0;
+
+    if( str.empty() )
+    {
+        return false;
+    }
+
+    while( pos < str.size() )
+    {
+        long value = 0;
+        std::size_t digits = 0;
+
+        for( ; pos < str.size() && isdigit( static_cast<unsigned char>( str[pos] ) ); ++pos, ++digits )
+        {
+            value = value * 10 + ( str[pos] - '0' );
+        }
+
+        if( !digits )
+        {
+            return false;
+        }
+
+        long unit = 1;
+
+        if( pos < str.size() )
+        {
+            switch( str[pos++] )
+            {
+                case 's':
+                    break;
+
+                case 'm':
+                    unit = 60;
+                    break;
+
+                case 'h':
+                    unit = 3600;
+                    break;
+
+                case 'd':
+                    unit = 86400;
+                    break;
+
+                case 'w':
+                    unit = 604800;
+                    break;
+
+                default:
+                    return false;
+            }
+        }
+
+        res += value * unit;
+    }
+
+    seconds = res;
+
+    return true;
+}
+
+std::string cachePath( const char* name )
+{
+    const char* cacheHome = getenv( "XDG_CACHE_HOME" );
+
+    if( cacheHome && *cacheHome )
+    {
+        return std::string( cacheHome ) + "/icequery/" + name;
+    }
+
+    const char* home = getenv( "HOME" );
+
+    if( home && *home )
+    {
+        return std::string( home ) + "/.cache/icequery/" + name;
+    }
+
+    return std::string();
+}
+
+bool createParentDirs( const std::string& path )
+{
+    for( std::size_t slash = path.find( '/', 1 ); slash != std::string::npos; slash = path.find( '/', slash + 1 ) )
+    {
+        if( mkdir( path.substr( 0, slash ).c_str(), 0755 ) != 0 && errno != EEXIST )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
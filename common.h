@@ -0,0 +1,103 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef ICEQUERY_COMMON_H
+#define ICEQUERY_COMMON_H
+
+#include <cstdio>
+#include <functional>   // hash
+#include <string>
+#include <string_view>
+
+// Utility macros
+
+#define PRINT_STREAM stderr
+
+#define PRINT_BASE( shouldPrint, colorSeq, format, args... ) \
+    do \
+    { \
+        if( !veryQuiet && shouldPrint ) \
+        { \
+            if( useColor ) \
+            { \
+                fprintf( PRINT_STREAM, "\e[" colorSeq format "\e[0m", ##args ); \
+            } \
+            else \
+            { \
+                fprintf( PRINT_STREAM, format, ##args ); \
+            } \
+        } \
+    } \
+    while( 0 )
+
+#define PRINT_INFO(  format, args... )  PRINT_BASE( true,  "1;32m", format, ##args )
+#define PRINT_WARN(  format, args... )  PRINT_BASE( true,  "1;33m", format, ##args )
+#define PRINT_ERR(   format, args... )  PRINT_BASE( true,  "31m",   format, ##args )
+#define PRINT_DEBUG( format, args... )  PRINT_BASE( debug, "1;36m", format, ##args )
+
+// Exit codes
+
+#define EXIT_OK                     0
+
+#define EXIT_INVALID_ARGS           1
+#define EXIT_CONNECTION_ERR         2
+#define EXIT_NO_DATA                3
+#define EXIT_LIBRARY_ERR            4
+#define EXIT_IO_ERR                 5
+
+// Utility types
+
+// Hashes strings as views, so that unordered maps keyed by strings can be
+// looked up by views without copying them
+struct StringViewHash
+{
+    typedef void is_transparent;
+
+    std::size_t operator()( std::string_view str ) const
+    {
+        return std::hash<std::string_view>()( str );
+    }
+};
+
+// Global variables
+
+extern bool veryQuiet;
+extern bool debug;
+extern bool useColor;
+
+// Utility functions
+
+long getTimestamp();
+
+std::string toLower( std::string&& str );
+std::string& toLower( std::string& str );
+
+bool equalsIgnoreCase( std::string_view a, std::string_view b );
+
+// Parses durations like '90', '30s', '15m', '1h30m', '2d' or '1w' into
+// seconds, false if malformed
+bool parseDuration( std::string_view str, long& seconds );
+
+// Path of a file kept between runs, under $XDG_CACHE_HOME/icequery or
+// ~/.cache/icequery, empty if neither is known
+std::string cachePath( const char* name );
+
+// Creates the missing directories leading to the path, false on error
+bool createParentDirs( const std::string& path );
+
+#endif // ICEQUERY_COMMON_H
@@ -0,0 +1,381 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "compilecosts.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>      // free()
+#include <cstring>      // strerror()
+#include <functional>   // greater
+#include <queue>
+
+#include <unistd.h>     // getpid(), unlink()
+
+#include <icecc/comm.h>
+
+// Utility functions
+
+static std::string_view fileName( std::string_view path )
+{
+    std::size_t slash = path.rfind( '/' );
+
+    return ( slash == std::string_view::npos ) ? path : path.substr( slash + 1 );
+}
+
+static std::string_view normalizePath( std::string_view path )
+{
+    while( path.substr( 0, 2 ) == "./" )
+    {
+        path.remove_prefix( 2 );
+    }
+
+    return path;
+}
+
+// CompileCosts
+
+CompileCosts::CompileCosts()
+    : m_dirty( false )
+{
+}
+
+std::string CompileCosts::defaultPath()
+{
+    return cachePath( "compile-costs" );
+}
+
+bool CompileCosts::load( const std::string& path )
+{
+    FILE* in = fopen( path.c_str(), "r" );
+
+    if( !in )
+    {
+        if( errno == ENOENT )
+        {
+            return true;
+        }
+
+        int lastErrno = errno;
+
+        PRINT_ERR( "Unable to open '%s': (%d) %s\n", path.c_str(), lastErrno, strerror( lastErrno ) );
+
+        return false;
+    }
+
+    bool res = true;
+    char* lineBuf = nullptr;
+    std::size_t lineBufSize = 0;
+    ssize_t lineLen;
+    unsigned lineNo = 0;
+
+    while( res && ( lineLen = getline( &lineBuf, &lineBufSize, in ) ) != -1 )
+    {
+        ++lineNo;
+
+        if( lineLen > 0 && lineBuf[lineLen - 1] == '\n' )
+        {
+            lineBuf[--lineLen] = '\0';
+        }
+
+        int version;
+        Cost cost;
+        int pathStart = 0;
+
+        if( lineNo == 1 )
+        {
+            res = sscanf( lineBuf, COSTS_MAGIC " %d", &version ) == 1 && version == COSTS_VERSION;
+        }
+        else
+        {
+            res = sscanf( lineBuf, "%u\t%u\t%n", &cost.msecs, &cost.count, &pathStart ) == 2 && pathStart && pathStart < lineLen;
+
+            if( res )
+            {
+                auto entry = m_costs.insert_or_assign( std::string( lineBuf + pathStart, lineLen - pathStart ), cost );
+                indexName( entry.first->first, entry.first->second );
+            }
+        }
+
+        if( !res )
+        {
+            PRINT_ERR( "Invalid compile costs '%s' at line %u.\n", path.c_str(), lineNo );
+        }
+    }
+
+    free( lineBuf );
+    fclose( in );
+
+    return res;
+}
+
+bool CompileCosts::save( const std::string& path )
+{
+    if( !m_dirty )
+    {
+        return true;
+    }
+
+    // Written aside and renamed, so that a reader never sees it halfway
+    const std::string tempPath = path + ".tmp-" + std::to_string( getpid() );
+    FILE* out = createParentDirs( path ) ? fopen( tempPath.c_str(), "w" ) : nullptr;
+
+    if( !out )
+    {
+        int lastErrno = errno;
+
+        PRINT_ERR( "Unable to write '%s': (%d) %s\n", tempPath.c_str(), lastErrno, strerror( lastErrno ) );
+
+        return false;
+    }
+
+    fprintf( out, "%s %d\n", COSTS_MAGIC, COSTS_VERSION );
+
+    for( const auto& entry : m_costs )
+    {
+        fprintf( out, "%u\t%u\t%s\n", entry.second.msecs, entry.second.count, entry.first.c_str() );
+    }
+
+    if( ( ferror( out ) | fclose( out ) ) || rename( tempPath.c_str(), path.c_str() ) != 0 )
+    {
+        int lastErrno = errno;
+
+        PRINT_ERR( "Unable to write '%s': (%d) %s\n", path.c_str(), lastErrno, strerror( lastErrno ) );
+        unlink( tempPath.c_str() );
+
+        return false;
+    }
+
+    m_dirty = false;
+
+    return true;
+}
+
+void CompileCosts::add( std::string_view file, uint32_t msecs )
+{
+    file = normalizePath( file );
+
+    auto it = m_costs.find( file );
+
+    if( it == m_costs.end() )
+    {
+        it = m_costs.emplace( std::string( file ), Cost { msecs, 1 } ).first;
+        indexName( it->first, it->second );
+    }
+    else
+    {
+        Cost& cost = it->second;
+        cost.msecs = static_cast<uint32_t>( cost.msecs + COSTS_SMOOTHING * ( static_cast<double>( msecs ) - cost.msecs ) + 0.5 );
+        ++cost.count;
+    }
+
+    m_dirty = true;
+}
+
+uint32_t CompileCosts::lookup( std::string_view file ) const
+{
+    file = normalizePath( file );
+
+    auto it = m_costs.find( file );
+
+    if( it != m_costs.end() )
+    {
+        return it->second.msecs;
+    }
+
+    auto nameIt = m_byName.find( fileName( file ) );
+
+    return ( nameIt != m_byName.end() && nameIt->second ) ? nameIt->second->msecs : 0;
+}
+
+uint32_t CompileCosts::median() const
+{
+    if( m_costs.empty() )
+    {
+        return 0;
+    }
+
+    std::vector<uint32_t> msecs;
+    msecs.reserve( m_costs.size() );
+
+    for( const auto& entry : m_costs )
+    {
+        msecs.push_back( entry.second.msecs );
+    }
+
+    auto middle = msecs.begin() + msecs.size() / 2;
+    std::nth_element( msecs.begin(), middle, msecs.end() );
+
+    return *middle;
+}
+
+void CompileCosts::indexName( const std::string& path, const Cost& cost )
+{
+    auto res = m_byName.emplace( fileName( path ), &cost );
+
+    if( !res.second && res.first->second != &cost )
+    {
+        res.first->second = nullptr;
+    }
+}
+
+// CompileCostCollector
+
+CompileCostCollector::CompileCostCollector( const std::vector<std::unique_ptr<Session>>& sessions, CompileCosts& costs )
+    : m_sessions( sessions )
+    , m_costs( costs )
+{
+    for( const auto& session : m_sessions )
+    {
+        session->addListener( this );
+    }
+}
+
+CompileCostCollector::~CompileCostCollector()
+{
+    for( const auto& session : m_sessions )
+    {
+        session->removeListener( this );
+    }
+}
+
+void CompileCostCollector::onStateChanged( Session& session )
+{
+    // Whatever was running won't be reported as done after a reconnect
+    if( session.state() == Session::State::Connecting )
+    {
+        std::size_t index = sessionIndex( session );
+
+        m_jobFiles.erase( m_jobFiles.lower_bound( std::make_pair( index, 0u ) ), m_jobFiles.lower_bound( std::make_pair( index + 1, 0u ) ) );
+    }
+}
+
+void CompileCostCollector::onMessage( Session& session, const Msg& msg )
+{
+    if( msg.type == M_MON_GET_CS )
+    {
+        const MonGetCSMsg& getCSMsg = dynamic_cast<const MonGetCSMsg&>( msg );
+
+        if( !getCSMsg.filename.empty() )
+        {
+            m_jobFiles[std::make_pair( sessionIndex( session ), getCSMsg.job_id )] = getCSMsg.filename;
+        }
+    }
+    else if( msg.type == M_MON_JOB_DONE )
+    {
+        const MonJobDoneMsg& doneMsg = dynamic_cast<const MonJobDoneMsg&>( msg );
+        auto it = m_jobFiles.find( std::make_pair( sessionIndex( session ), doneMsg.job_id ) );
+
+        if( it == m_jobFiles.end() )
+        {
+            return;
+        }
+
+        // Failed compiles may have stopped early
+        if( doneMsg.exitcode == 0 && doneMsg.real_msec > 0 )
+        {
+            m_costs.add( it->second, doneMsg.real_msec );
+        }
+
+        m_jobFiles.erase( it );
+    }
+}
+
+std::size_t CompileCostCollector::sessionIndex( const Session& session ) const
+{
+    for( std::size_t i = 0; i < m_sessions.size(); ++i )
+    {
+        if( m_sessions[i].get() == &session )
+        {
+            return i;
+        }
+    }
+
+    return 0;
+}
+
+// Simulation
+
+uint64_t simulateBuild( const std::vector<uint32_t>& costs, uint32_t slots )
+{
+    if( costs.empty() || slots == 0 )
+    {
+        return 0;
+    }
+
+    if( slots >= costs.size() )
+    {
+        return costs.front();
+    }
+
+    // When each slot frees up, earliest first
+    std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<uint64_t>> freeAt;
+    uint64_t wallTime = 0;
+
+    for( uint32_t i = 0; i < slots; ++i )
+    {
+        freeAt.push( 0 );
+    }
+
+    for( uint32_t cost : costs )
+    {
+        uint64_t end = freeAt.top() + cost;
+
+        freeAt.pop();
+        freeAt.push( end );
+        wallTime = std::max( wallTime, end );
+    }
+
+    return wallTime;
+}
+
+uint32_t bestJobCount( const std::vector<uint32_t>& costs, uint32_t slots, uint64_t& wallTime )
+{
+    uint32_t high = static_cast<uint32_t>( std::min<std::size_t>( slots, costs.size() ) );
+
+    wallTime = simulateBuild( costs, high );
+
+    if( high <= 1 )
+    {
+        return high;
+    }
+
+    // Adding slots hardly ever makes it longer, so a binary search does
+    const uint64_t goodEnough = static_cast<uint64_t>( wallTime * ( 1.0 + COSTS_JOBS_TOLERANCE ) );
+    uint32_t low = 1;
+
+    while( low < high )
+    {
+        uint32_t middle = low + ( high - low ) / 2;
+        uint64_t middleTime = simulateBuild( costs, middle );
+
+        if( middleTime <= goodEnough )
+        {
+            high = middle;
+            wallTime = middleTime;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+
+    // The upper end's time stays set when it's the answer
+    return high;
+}
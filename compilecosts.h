@@ -0,0 +1,142 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef ICEQUERY_COMPILECOSTS_H
+#define ICEQUERY_COMPILECOSTS_H
+
+#include <cstdint>      // uint32_t, uint64_t
+#include <functional>   // equal_to
+#include <map>
+#include <memory>       // unique_ptr
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>      // pair
+#include <vector>
+
+#include "common.h"
+#include "session.h"
+
+/*
+    The compile costs are kept in a text file, the first line of which is
+    'icequery-costs <VERSION>', each of the others a source file's
+    tab-separated average compile time in msecs, number of compiles seen and
+    path as the client named it.
+*/
+
+#define COSTS_MAGIC                 "icequery-costs"
+#define COSTS_VERSION               1
+
+// How often the collected costs are saved, in msecs
+#define COSTS_SAVE_INTERVAL         60000
+
+// Weight of the latest compile time in a file's average
+#define COSTS_SMOOTHING             0.3
+
+// A job count whose wall time is within this share of the shortest one is
+// just as good, and fewer jobs leave more of the farm to the others
+#define COSTS_JOBS_TOLERANCE        0.02
+
+// Average compile times of source files, as seen in the monitor stream
+class CompileCosts
+{
+public:
+    CompileCosts();
+
+    CompileCosts( const CompileCosts& ) = delete;
+    CompileCosts& operator=( const CompileCosts& ) = delete;
+
+public:
+    // Under $XDG_CACHE_HOME or ~/.cache
+    static std::string defaultPath();
+
+    // A missing file leaves the costs empty; both false on error, after
+    // printing it
+    bool load( const std::string& path );
+
+    // Only if anything was added since
+    bool save( const std::string& path );
+
+    void add( std::string_view file, uint32_t msecs );
+
+    // Average compile time in msecs, 0 if unknown. Files are matched by
+    // their whole path first, then by their name if a single known file has
+    // that name, as clients name them relative to where they run.
+    uint32_t lookup( std::string_view file ) const;
+
+    std::size_t size() const
+    {
+        return m_costs.size();
+    }
+
+    // Of the average compile times, 0 if there are none
+    uint32_t median() const;
+
+private:
+    struct Cost
+    {
+        uint32_t msecs;
+        uint32_t count;
+    };
+
+    void indexName( const std::string& path, const Cost& cost );
+
+private:
+    std::unordered_map<std::string, Cost, StringViewHash, std::equal_to<>> m_costs;
+
+    // Viewing the paths above, which stay put; null where the name is shared
+    std::unordered_map<std::string_view, const Cost*> m_byName;
+
+    bool m_dirty;
+};
+
+// Adds the compile time of every successful job of the sessions to the
+// costs, under the file the client asked the scheduler about
+class CompileCostCollector : public SessionListener
+{
+public:
+    CompileCostCollector( const std::vector<std::unique_ptr<Session>>& sessions, CompileCosts& costs );
+    ~CompileCostCollector();
+
+    CompileCostCollector( const CompileCostCollector& ) = delete;
+    CompileCostCollector& operator=( const CompileCostCollector& ) = delete;
+
+public:
+    void onStateChanged( Session& session ) override;
+    void onMessage( Session& session, const Msg& msg ) override;
+
+private:
+    std::size_t sessionIndex( const Session& session ) const;
+
+private:
+    const std::vector<std::unique_ptr<Session>>& m_sessions;
+    CompileCosts& m_costs;
+
+    // Files by session index and job id, till the job is done
+    std::map<std::pair<std::size_t, uint32_t>, std::string> m_jobFiles;
+};
+
+// Wall time of compiling the files on that many slots at once, longest first,
+// each onto the slot that frees up first; the costs are in descending order
+uint64_t simulateBuild( const std::vector<uint32_t>& costs, uint32_t slots );
+
+// Fewest slots of the given ones that compile the files within
+// COSTS_JOBS_TOLERANCE of the shortest wall time, which is set as well
+uint32_t bestJobCount( const std::vector<uint32_t>& costs, uint32_t slots, uint64_t& wallTime );
+
+#endif // ICEQUERY_COMPILECOSTS_H
@@ -0,0 +1,187 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "diffview.h"
+
+#include <ctime>        // localtime_r(), strftime()
+#include <string>
+
+#include "common.h"
+
+// Utility functions
+
+static const char* kindToStr( SnapshotChange::Kind kind )
+{
+    switch( kind )
+    {
+        case SnapshotChange::Kind::Added:
+            return "added";
+
+        case SnapshotChange::Kind::Removed:
+            return "removed";
+
+        case SnapshotChange::Kind::Changed:
+            return "changed";
+
+        case SnapshotChange::Kind::Renumbered:
+            return "renumbered";
+    }
+
+    return "";
+}
+
+static std::string stateStr( const SnapshotNode& node )
+{
+    return node.offline ? "offline" : node.noRemote ? "no remote" : "online";
+}
+
+// Either side's value, or both if they differ
+template<typename T, typename ToStr>
+static std::string beforeAfter( const SnapshotChange& change, T SnapshotNode::*member, ToStr toStr )
+{
+    if( !change.before )
+    {
+        return toStr( change.after->*member );
+    }
+
+    if( !change.after || change.before->*member == change.after->*member )
+    {
+        return toStr( change.before->*member );
+    }
+
+    return toStr( change.before->*member ) + " -> " + toStr( change.after->*member );
+}
+
+static std::string timeStr( int64_t time )
+{
+    time_t t = time;
+    struct tm tm {};
+    char buffer[32];
+
+    localtime_r( &t, &tm );
+    strftime( buffer, sizeof( buffer ), "%Y-%m-%d %H:%M:%S", &tm );
+
+    return buffer;
+}
+
+// Output functions
+
+int printSnapshotDiff( const OutputSpec& spec, const Snapshot& before, const Snapshot& after, FILE* out )
+{
+    const SnapshotDiff diff = diffSnapshots( before, after );
+    const long long delta = static_cast<long long>( diff.coresAfter ) - static_cast<long long>( diff.coresBefore );
+
+    if( spec.brief )
+    {
+        fprintf( out, "%+lld\n", delta );
+
+        return EXIT_OK;
+    }
+
+    // The scheduler is only worth a column if there's more than one, both
+    // snapshots being sorted by it
+    const std::string* firstScheduler = nullptr;
+    bool federated = false;
+
+    for( const Snapshot* snapshot : { &before, &after } )
+    {
+        if( snapshot->nodes.empty() )
+        {
+            continue;
+        }
+
+        for( const SnapshotNode* node : { &snapshot->nodes.front(), &snapshot->nodes.back() } )
+        {
+            federated = federated || ( firstScheduler && *firstScheduler != node->scheduler );
+            firstScheduler = &node->scheduler;
+        }
+    }
+
+    uint32_t counts[4] = {};
+
+    for( const SnapshotChange& change : diff.changes )
+    {
+        ++counts[static_cast<int>( change.kind )];
+    }
+
+    fprintf( out, "From %s to %s:\n", timeStr( before.time ).c_str(), timeStr( after.time ).c_str() );
+
+    if( !spec.noTable && !diff.changes.empty() )
+    {
+        std::vector<ColumnHeader> header { { Alignment::Left, Encoding::UTF8, "Change" } };
+
+        if( federated )
+        {
+            header.emplace_back( Alignment::Left, Encoding::UTF8, "Scheduler" );
+        }
+
+        header.insert( header.end(), {
+            { Alignment::Right , Encoding::UTF8     , "Node #"     },
+            { Alignment::Left  , Encoding::Custom   , "Name"       },
+            { Alignment::Left  , Encoding::UTF8     , "IP"         },
+            { Alignment::Left  , Encoding::UTF8     , "Platform"   },
+            { Alignment::Right , Encoding::UTF8     , "Cores"      },
+            { Alignment::Left  , Encoding::UTF8     , "State"      },
+            { Alignment::Right , Encoding::UTF8     , "Capacity"   }
+        } );
+
+        const auto str = [] ( const std::string& value ) { return value; };
+        const auto num = [] ( uint32_t value ) { return std::to_string( value ); };
+
+        Cells strings;
+        strings.reserve( diff.changes.size() * header.size() );
+
+        for( const SnapshotChange& change : diff.changes )
+        {
+            const SnapshotNode& node = change.after ? *change.after : *change.before;
+            long long capacity = static_cast<long long>( change.after ? change.after->cores() : 0 ) - ( change.before ? change.before->cores() : 0 );
+
+            strings.emplace_back( kindToStr( change.kind ) );
+
+            if( federated )
+            {
+                strings.emplace_back( node.scheduler );
+            }
+
+            strings.emplace_back( beforeAfter( change, &SnapshotNode::hostId, num ) );
+            strings.emplace_back( beforeAfter( change, &SnapshotNode::name, str ) );
+            strings.emplace_back( beforeAfter( change, &SnapshotNode::ip, str ) );
+            strings.emplace_back( beforeAfter( change, &SnapshotNode::platform, str ) );
+            strings.emplace_back( beforeAfter( change, &SnapshotNode::maxJobs, num ) );
+
+            std::string states = change.before ? stateStr( *change.before ) : std::string();
+
+            if( change.after && ( !change.before || stateStr( *change.after ) != states ) )
+            {
+                states += ( change.before ? " -> " : "" ) + stateStr( *change.after );
+            }
+
+            strings.emplace_back( states );
+            strings.emplace_back( capacity ? ( capacity > 0 ? "+" : "" ) + std::to_string( capacity ) : std::string() );
+        }
+
+        printTable( spec, header, strings, out );
+    }
+
+    fprintf( out, "%u added, %u removed, %u renumbered, %u changed.\n", counts[static_cast<int>( SnapshotChange::Kind::Added )],
+             counts[static_cast<int>( SnapshotChange::Kind::Removed )], counts[static_cast<int>( SnapshotChange::Kind::Renumbered )],
+             counts[static_cast<int>( SnapshotChange::Kind::Changed )] );
+    fprintf( out, "%llu -> %llu cores (%+lld).\n", static_cast<unsigned long long>( diff.coresBefore ), static_cast<unsigned long long>( diff.coresAfter ), delta );
+
+    return EXIT_OK;
+}
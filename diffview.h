@@ -0,0 +1,32 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef ICEQUERY_DIFFVIEW_H
+#define ICEQUERY_DIFFVIEW_H
+
+#include <cstdio>
+
+#include "output.h"
+#include "snapshot.h"
+
+// Prints the nodes added, removed, renumbered or changed between the two
+// snapshots and how the cores moved, returns one of EXIT_* codes. With
+// '--brief', prints the net change of the cores only.
+int printSnapshotDiff( const OutputSpec& spec, const Snapshot& before, const Snapshot& after, FILE* out );
+
+#endif // ICEQUERY_DIFFVIEW_H
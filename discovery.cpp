@@ -0,0 +1,339 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "discovery.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>      // atoi(), getenv()
+#include <cstring>      // memcpy(), strerror(), strnlen(), strrchr()
+
+#include <poll.h>
+#include <unistd.h>     // close()
+#include <arpa/inet.h>  // inet_ntop()
+#include <ifaddrs.h>
+#include <netdb.h>      // getaddrinfo()
+#include <net/if.h>     // IFF_BROADCAST
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <icecc/comm.h> // PROTOCOL_VERSION
+
+#include "common.h"
+
+// Consts
+
+// Reply sizes of the schedulers answering protocols 33-35, and 36 onwards
+#define BROADCAST_REPLY_33          32
+#define BROADCAST_REPLY_MAX         268
+
+// Utility functions
+
+// Sends the request to the broadcast address of every interface having one,
+// returns the number of successful sends
+static int broadcastRequest( int fd, char version )
+{
+    struct ifaddrs* addrs = nullptr;
+    int sent = 0;
+
+    if( getifaddrs( &addrs ) < 0 )
+    {
+        int lastErrno = errno;
+
+        PRINT_ERR( "getifaddrs(): (%d) %s\n", lastErrno, strerror( lastErrno ) );
+
+        return 0;
+    }
+
+    for( struct ifaddrs* addr = addrs; addr; addr = addr->ifa_next )
+    {
+        if( !addr->ifa_addr || addr->ifa_addr->sa_family != AF_INET ||
+            !( addr->ifa_flags & IFF_BROADCAST ) || !addr->ifa_broadaddr )
+        {
+            continue;
+        }
+
+        struct sockaddr_in target;
+        memcpy( &target, addr->ifa_broadaddr, sizeof( target ) );
+        target.sin_port = htons( SCHEDULER_PORT );
+
+        if( sendto( fd, &version, 1, 0, reinterpret_cast<struct sockaddr*>( &target ), sizeof( target ) ) == 1 )
+        {
+            ++sent;
+        }
+        else
+        {
+            int lastErrno = errno;
+
+            PRINT_DEBUG( "sendto(): %s: (%d) %s\n", addr->ifa_name, lastErrno, strerror( lastErrno ) );
+        }
+    }
+
+    freeifaddrs( addrs );
+
+    return sent;
+}
+
+// Discovery
+
+bool parseBroadcastReply( const char* buf, std::size_t len, int sentVersion, SchedulerInfo& info )
+{
+    if( len < 2 )
+    {
+        return false;
+    }
+
+    // The scheduler bumps the version it was sent by the layout it answers
+    // with: by one below protocol 33, with just the net name following; by
+    // two up to 35 and three from 36 on, with its own version (in host order,
+    // as it never leaves the subnet) and start time before the net name, in a
+    // 32 and a 268 byte reply. One older than the client answers the way it
+    // knows, so any bump up to the one matching sentVersion is fine.
+    int bump = static_cast<unsigned char>( buf[0] ) - sentVersion;
+    int maxBump = sentVersion < 33 ? 1 : ( sentVersion < 36 ? 2 : 3 );
+
+    if( bump < 1 || bump > maxBump )
+    {
+        return false;
+    }
+
+    std::size_t nameOffset = 1;
+
+    if( bump == 1 )
+    {
+        info.protocolVersion = -1;
+        info.netName.assign( buf + nameOffset, strnlen( buf + nameOffset, len - nameOffset ) );
+
+        return true;
+    }
+
+    std::size_t replyLen = bump == 2 ? BROADCAST_REPLY_33 : BROADCAST_REPLY_MAX;
+    uint32_t version;
+
+    nameOffset += sizeof( uint32_t ) + sizeof( uint64_t );
+
+    // The scheduler zero-fills the whole reply, cutting the net name short
+    if( len < replyLen || !memchr( buf + nameOffset, '\0', replyLen - nameOffset ) )
+    {
+        return false;
+    }
+
+    memcpy( &version, buf + 1, sizeof( version ) );
+    info.protocolVersion = static_cast<int>( version );
+    info.netName.assign( buf + nameOffset );
+
+    return true;
+}
+
+int startDiscovery()
+{
+    int fd = socket( AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+
+    if( fd < 0 )
+    {
+        int lastErrno = errno;
+
+        PRINT_ERR( "socket(): (%d) %s\n", lastErrno, strerror( lastErrno ) );
+
+        return -1;
+    }
+
+    int enable = 1;
+    setsockopt( fd, SOL_SOCKET, SO_BROADCAST, &enable, sizeof( enable ) );
+
+    if( !broadcastRequest( fd, PROTOCOL_VERSION ) )
+    {
+        PRINT_ERR( "No interface to broadcast on.\n" );
+
+        close( fd );
+        return -1;
+    }
+
+    return fd;
+}
+
+void readDiscoveryReplies( int fd, std::vector<SchedulerInfo>& schedulers )
+{
+    char buf[BROADCAST_REPLY_MAX];
+    struct sockaddr_in from;
+    socklen_t fromLen = sizeof( from );
+    ssize_t len;
+
+    while( ( len = recvfrom( fd, buf, sizeof( buf ), 0, reinterpret_cast<struct sockaddr*>( &from ), &fromLen ) ) >= 0 )
+    {
+        SchedulerInfo info;
+        char addrStr[INET_ADDRSTRLEN];
+
+        fromLen = sizeof( from );
+
+        if( !parseBroadcastReply( buf, len, PROTOCOL_VERSION, info ) )
+        {
+            PRINT_DEBUG( "Ignoring malformed broadcast reply (%zd bytes)\n", len );
+            continue;
+        }
+
+        info.addr.assign( inet_ntop( AF_INET, &from.sin_addr, addrStr, sizeof( addrStr ) ) );
+        info.port = ntohs( from.sin_port );
+
+        // Multiple interfaces can lead to the same scheduler
+        bool isKnown = std::any_of( schedulers.cbegin(), schedulers.cend(), [&info] ( const SchedulerInfo& known )
+        {
+            return known.addr == info.addr && known.port == info.port && known.netName == info.netName;
+        } );
+
+        if( !isKnown )
+        {
+            schedulers.push_back( std::move( info ) );
+        }
+    }
+}
+
+bool schedulerFromEnv( std::string& addr, uint16_t& port )
+{
+    const char* value = getenv( "ICECC_SCHEDULER_HOST" );
+
+    if( !value || !*value )
+    {
+        value = getenv( "USE_SCHEDULER" );
+    }
+
+    if( !value || !*value )
+    {
+        return false;
+    }
+
+    const char* colon = strrchr( value, ':' );
+
+    if( colon )
+    {
+        int envPort = atoi( colon + 1 );
+
+        addr.assign( value, colon - value );
+
+        if( envPort > 0 && envPort <= UINT16_MAX )
+        {
+            port = static_cast<uint16_t>( envPort );
+        }
+    }
+    else
+    {
+        addr.assign( value );
+    }
+
+    return true;
+}
+
+const SchedulerInfo* findScheduler( const std::vector<SchedulerInfo>& schedulers, const std::string& netName )
+{
+    auto it = std::find_if( schedulers.cbegin(), schedulers.cend(), [&netName] ( const SchedulerInfo& scheduler )
+    {
+        return netName.empty() || scheduler.netName == netName;
+    } );
+
+    return it != schedulers.cend() ? &*it : nullptr;
+}
+
+int startConnect( const std::string& addr, uint16_t port, struct sockaddr_storage* peer, socklen_t* peerLen )
+{
+    struct addrinfo hints {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV;
+
+    struct addrinfo* addrs = nullptr;
+    int res = getaddrinfo( addr.c_str(), std::to_string( port ).c_str(), &hints, &addrs );
+
+    if( res != 0 )
+    {
+        PRINT_ERR( "getaddrinfo(): %s: %s\n", addr.c_str(), gai_strerror( res ) );
+
+        return -1;
+    }
+
+    int fd = socket( addrs->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+
+    if( fd < 0 || ( connect( fd, addrs->ai_addr, addrs->ai_addrlen ) < 0 && errno != EINPROGRESS ) )
+    {
+        int lastErrno = errno;
+
+        PRINT_ERR( "connect(): %s: (%d) %s\n", addr.c_str(), lastErrno, strerror( lastErrno ) );
+
+        if( fd >= 0 )
+        {
+            close( fd );
+        }
+
+        freeaddrinfo( addrs );
+
+        return -1;
+    }
+
+    if( peer && peerLen )
+    {
+        memcpy( peer, addrs->ai_addr, addrs->ai_addrlen );
+        *peerLen = addrs->ai_addrlen;
+    }
+
+    freeaddrinfo( addrs );
+
+    return fd;
+}
+
+bool finishConnect( int fd )
+{
+    int error = 0;
+    socklen_t errorLen = sizeof( error );
+
+    if( getsockopt( fd, SOL_SOCKET, SO_ERROR, &error, &errorLen ) < 0 )
+    {
+        error = errno;
+    }
+
+    if( error )
+    {
+        PRINT_ERR( "connect(): (%d) %s\n", error, strerror( error ) );
+
+        return false;
+    }
+
+    return true;
+}
+
+Task<std::vector<SchedulerInfo>> listSchedulers( Reactor& reactor, int window )
+{
+    std::vector<SchedulerInfo> res;
+
+    int fd = startDiscovery();
+
+    if( fd < 0 )
+    {
+        co_return res;
+    }
+
+    long deadline = getTimestamp() + window;
+
+    while( co_await reactor.wait( fd, POLLIN, deadline ) )
+    {
+        readDiscoveryReplies( fd, res );
+    }
+
+    close( fd );
+
+    co_return res;
+}
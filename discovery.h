@@ -0,0 +1,76 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef ICEQUERY_DISCOVERY_H
+#define ICEQUERY_DISCOVERY_H
+
+#include <cstdint>      // uint16_t
+#include <string>
+#include <vector>
+
+#include <sys/socket.h> // sockaddr_storage, socklen_t
+
+#include "async.h"
+
+// Port the schedulers listen on for discovery broadcasts
+#define SCHEDULER_PORT              8765
+
+struct SchedulerInfo
+{
+    std::string netName;
+    std::string addr;
+    uint16_t port;
+
+    // -1 if the scheduler is too old to report it
+    int protocolVersion;
+};
+
+// Parses a scheduler's reply to a discovery broadcast carrying sentVersion
+bool parseBroadcastReply( const char* buf, std::size_t len, int sentVersion, SchedulerInfo& info );
+
+// Opens a non-blocking socket and broadcasts a discovery request on all
+// interfaces, -1 on failure after printing it
+int startDiscovery();
+
+// Reads the replies waiting on the socket into schedulers, skipping the ones
+// already there
+void readDiscoveryReplies( int fd, std::vector<SchedulerInfo>& schedulers );
+
+// The scheduler set in the environment as libicecc takes it, 'HOST[:PORT]'
+// in ICECC_SCHEDULER_HOST or USE_SCHEDULER; false if none
+bool schedulerFromEnv( std::string& addr, uint16_t& port );
+
+// The first of the schedulers of the net, or the first one at all if netName
+// is empty; null if none
+const SchedulerInfo* findScheduler( const std::vector<SchedulerInfo>& schedulers, const std::string& netName );
+
+// Starts connecting a non-blocking socket to the numeric address or host
+// name, storing the address connected to into peer if given; -1 on failure
+// after printing it
+int startConnect( const std::string& addr, uint16_t port, struct sockaddr_storage* peer = nullptr, socklen_t* peerLen = nullptr );
+
+// Tells how a connection started by startConnect() went once the socket
+// became writable, printing the error if any
+bool finishConnect( int fd );
+
+// Broadcasts a discovery request once on all interfaces and collects every
+// scheduler answering within the window (in msecs)
+Task<std::vector<SchedulerInfo>> listSchedulers( Reactor& reactor, int window );
+
+#endif // ICEQUERY_DISCOVERY_H
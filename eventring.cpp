@@ -0,0 +1,439 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "eventring.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>      // strerror()
+#include <new>          // placement new
+
+#include <fcntl.h>      // O_*
+#include <unistd.h>     // ftruncate()
+#include <sys/mman.h>   // shm_open(), mmap()
+#include <sys/stat.h>   // fstat()
+
+#include <icecc/comm.h>
+
+#include "common.h"
+
+// Shared memory layout
+
+struct EventSlot
+{
+    // 2 * seq + 1 while the record is being written, 2 * seq + 2 once done
+    std::atomic<uint64_t> version;
+
+    EventRecord record;
+};
+
+struct EventRingLayout
+{
+    // Written last by the publisher, so a valid magic means a ready ring
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t recordSize;
+
+    // Sequence number of the next event, on a cache line of its own as it's
+    // what all the readers keep polling
+    alignas( 64 ) std::atomic<uint64_t> head;
+
+    alignas( 64 ) EventSlot slots[EVENT_RING_CAPACITY];
+};
+
+static_assert( ( EVENT_RING_CAPACITY & ( EVENT_RING_CAPACITY - 1 ) ) == 0, "EVENT_RING_CAPACITY must be a power of 2" );
+static_assert( std::atomic<uint64_t>::is_always_lock_free, "Shared atomics must be lock-free" );
+
+// Utility functions
+
+static std::string ringPath( const std::string& name )
+{
+    return "/icequery-" + name;
+}
+
+static bool isValidName( const std::string& name )
+{
+    if( name.empty() || name.find( '/' ) != std::string::npos || name.size() > 200 )
+    {
+        PRINT_ERR( "Invalid event ring name '%s'.\n", name.c_str() );
+
+        return false;
+    }
+
+    return true;
+}
+
+// Copies as much as fits, keeping the end of the string if keepTail is set
+static void copyTruncated( char* dst, std::size_t size, std::string_view src, bool keepTail = false )
+{
+    std::size_t len = std::min( src.size(), size - 1 );
+    std::size_t offset = keepTail ? src.size() - len : 0;
+
+    memcpy( dst, src.data() + offset, len );
+    dst[len] = '\0';
+}
+
+const char* EventTypeToStr( EventType type )
+{
+    switch( type )
+    {
+        case EventType::SessionState:
+            return "SessionState";
+
+        case EventType::NodeUpdated:
+            return "NodeUpdated";
+
+        case EventType::NodeRemoved:
+            return "NodeRemoved";
+
+        case EventType::JobBegin:
+            return "JobBegin";
+
+        case EventType::JobDone:
+            return "JobDone";
+
+        case EventType::LocalJobBegin:
+            return "LocalJobBegin";
+    }
+
+    return "<Unknown>";
+}
+
+// EventPublisher
+
+std::unique_ptr<EventPublisher> EventPublisher::create( const std::string& name )
+{
+    if( !isValidName( name ) )
+    {
+        return nullptr;
+    }
+
+    const std::string path = ringPath( name );
+
+    // Readers of a ring left behind keep their old mapping, which simply
+    // never gets any new events
+    shm_unlink( path.c_str() );
+
+    int fd = shm_open( path.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644 );
+
+    if( fd == -1 )
+    {
+        int lastErrno = errno;
+
+        PRINT_ERR( "shm_open(): (%d) %s\n", lastErrno, strerror( lastErrno ) );
+
+        return nullptr;
+    }
+
+    void* mem = MAP_FAILED;
+
+    if( ftruncate( fd, sizeof( EventRingLayout ) ) == 0 )
+    {
+        mem = mmap( nullptr, sizeof( EventRingLayout ), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    }
+
+    int lastErrno = errno;
+
+    close( fd );
+
+    if( mem == MAP_FAILED )
+    {
+        PRINT_ERR( "Unable to map the event ring: (%d) %s\n", lastErrno, strerror( lastErrno ) );
+
+        shm_unlink( path.c_str() );
+
+        return nullptr;
+    }
+
+    // The memory comes zeroed, which makes all the slots empty
+    EventRingLayout* layout = new( mem ) EventRingLayout;
+    layout->version = EVENT_RING_VERSION;
+    layout->capacity = EVENT_RING_CAPACITY;
+    layout->recordSize = sizeof( EventRecord );
+
+    std::atomic_thread_fence( std::memory_order_release );
+    layout->magic = EVENT_RING_MAGIC;
+
+    PRINT_DEBUG( "Publishing events to '%s'\n", path.c_str() );
+
+    return std::unique_ptr<EventPublisher>( new EventPublisher( path, layout ) );
+}
+
+EventPublisher::EventPublisher( const std::string& path, EventRingLayout* layout )
+    : m_path( path )
+    , m_layout( layout )
+    , m_head( 0 )
+{
+}
+
+EventPublisher::~EventPublisher()
+{
+    for( const auto& scheduler : m_schedulers )
+    {
+        const_cast<Session*>( scheduler.first )->removeListener( this );
+    }
+
+    munmap( m_layout, sizeof( EventRingLayout ) );
+    shm_unlink( m_path.c_str() );
+}
+
+void EventPublisher::attach( Session& session )
+{
+    uint32_t index = static_cast<uint32_t>( m_schedulers.size() );
+
+    if( m_schedulers.emplace( &session, index ).second )
+    {
+        session.addListener( this );
+    }
+}
+
+void EventPublisher::publish( EventRecord& record )
+{
+    uint64_t seq = m_head++;
+    EventSlot& slot = m_layout->slots[seq & ( EVENT_RING_CAPACITY - 1 )];
+
+    record.seq = seq;
+    record.timestamp = getTimestamp();
+
+    // A seqlock per slot: readers copying the record while it's rewritten
+    // see the version change and know they've been lapped
+    slot.version.store( 2 * seq + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+
+    memcpy( &slot.record, &record, sizeof( EventRecord ) );
+
+    slot.version.store( 2 * seq + 2, std::memory_order_release );
+    m_layout->head.store( seq + 1, std::memory_order_release );
+}
+
+void EventPublisher::onStateChanged( Session& session )
+{
+    EventRecord record {};
+    record.type = EventType::SessionState;
+    record.scheduler = m_schedulers[&session];
+    record.value = static_cast<uint32_t>( session.state() );
+    copyTruncated( record.name, sizeof( record.name ), session.target().label() );
+
+    if( session.state() != Session::State::Live )
+    {
+        // The jobs' ends won't be reported, drop the ones of this scheduler
+        uint64_t first = static_cast<uint64_t>( record.scheduler ) << 32;
+        m_jobHosts.erase( m_jobHosts.lower_bound( first ), m_jobHosts.lower_bound( first + ( 1ull << 32 ) ) );
+    }
+
+    publish( record );
+}
+
+void EventPublisher::onNodeUpdated( Session& session, const NodeInfo& node )
+{
+    EventRecord record = nodeRecord( EventType::NodeUpdated, session, node );
+    publish( record );
+}
+
+void EventPublisher::onNodeRemoved( Session& session, const NodeInfo& node )
+{
+    EventRecord record = nodeRecord( EventType::NodeRemoved, session, node );
+    publish( record );
+}
+
+void EventPublisher::onMessage( Session& session, const Msg& msg )
+{
+    EventRecord record {};
+    record.scheduler = m_schedulers[&session];
+
+    uint64_t jobKey = static_cast<uint64_t>( record.scheduler ) << 32;
+
+    switch( msg.type )
+    {
+        case M_MON_JOB_BEGIN:
+        {
+            const MonJobBeginMsg& beginMsg = dynamic_cast<const MonJobBeginMsg&>( msg );
+
+            record.type = EventType::JobBegin;
+            record.hostId = beginMsg.hostid;
+            record.jobId = beginMsg.job_id;
+
+            m_jobHosts[jobKey | beginMsg.job_id] = beginMsg.hostid;
+            break;
+        }
+
+        case M_MON_JOB_DONE:
+        {
+            const MonJobDoneMsg& doneMsg = dynamic_cast<const MonJobDoneMsg&>( msg );
+
+            record.type = EventType::JobDone;
+            record.jobId = doneMsg.job_id;
+            record.value = doneMsg.real_msec;
+            record.flags = doneMsg.exitcode;
+
+            auto it = m_jobHosts.find( jobKey | doneMsg.job_id );
+
+            if( it != m_jobHosts.end() )
+            {
+                record.hostId = it->second;
+                m_jobHosts.erase( it );
+            }
+            break;
+        }
+
+        case M_MON_LOCAL_JOB_BEGIN:
+        {
+            const MonLocalJobBeginMsg& localMsg = dynamic_cast<const MonLocalJobBeginMsg&>( msg );
+
+            record.type = EventType::LocalJobBegin;
+            record.hostId = localMsg.hostid;
+            record.jobId = localMsg.job_id;
+
+            // The end of a path says more than its beginning
+            copyTruncated( record.name, sizeof( record.name ), localMsg.file, true );
+            break;
+        }
+
+        default:
+            return;
+    }
+
+    publish( record );
+}
+
+EventRecord EventPublisher::nodeRecord( EventType type, Session& session, const NodeInfo& node )
+{
+    EventRecord record {};
+    record.type = type;
+    record.scheduler = m_schedulers[&session];
+    record.hostId = node.hostId();
+    record.value = node.maxJobs();
+    record.flags = ( node.isOffline() ? EVENT_FLAG_OFFLINE : 0 ) | ( node.noRemote() ? EVENT_FLAG_NO_REMOTE : 0 ) | ( node.isStale() ? EVENT_FLAG_STALE : 0 );
+
+    copyTruncated( record.name, sizeof( record.name ), node.name() );
+    copyTruncated( record.platform, sizeof( record.platform ), node.platform() );
+
+    return record;
+}
+
+// EventReader
+
+std::unique_ptr<EventReader> EventReader::open( const std::string& name, bool fromOldest )
+{
+    if( !isValidName( name ) )
+    {
+        return nullptr;
+    }
+
+    const std::string path = ringPath( name );
+    int fd = shm_open( path.c_str(), O_RDONLY | O_CLOEXEC, 0 );
+
+    if( fd == -1 )
+    {
+        int lastErrno = errno;
+
+        PRINT_ERR( "Unable to open the event ring '%s': (%d) %s\n", path.c_str(), lastErrno, strerror( lastErrno ) );
+
+        return nullptr;
+    }
+
+    struct stat st;
+    void* mem = MAP_FAILED;
+
+    if( fstat( fd, &st ) == 0 && static_cast<std::size_t>( st.st_size ) >= sizeof( EventRingLayout ) )
+    {
+        mem = mmap( nullptr, sizeof( EventRingLayout ), PROT_READ, MAP_SHARED, fd, 0 );
+    }
+
+    close( fd );
+
+    if( mem == MAP_FAILED )
+    {
+        PRINT_ERR( "Unable to map the event ring '%s'.\n", path.c_str() );
+
+        return nullptr;
+    }
+
+    const EventRingLayout* layout = static_cast<const EventRingLayout*>( mem );
+
+    if( layout->magic != EVENT_RING_MAGIC || layout->version != EVENT_RING_VERSION || layout->capacity != EVENT_RING_CAPACITY || layout->recordSize != sizeof( EventRecord ) )
+    {
+        PRINT_ERR( "Event ring '%s' not ready or of an incompatible version.\n", path.c_str() );
+
+        munmap( mem, sizeof( EventRingLayout ) );
+
+        return nullptr;
+    }
+
+    std::atomic_thread_fence( std::memory_order_acquire );
+
+    return std::unique_ptr<EventReader>( new EventReader( layout, sizeof( EventRingLayout ), fromOldest ) );
+}
+
+EventReader::EventReader( const EventRingLayout* layout, std::size_t size, bool fromOldest )
+    : m_layout( layout )
+    , m_size( size )
+    , m_next( layout->head.load( std::memory_order_acquire ) )
+{
+    if( fromOldest )
+    {
+        m_next = m_next > EVENT_RING_CAPACITY ? m_next - EVENT_RING_CAPACITY : 0;
+    }
+}
+
+EventReader::~EventReader()
+{
+    munmap( const_cast<EventRingLayout*>( m_layout ), m_size );
+}
+
+EventReader::Result EventReader::next( EventRecord& record, uint64_t& missed )
+{
+    while( true )
+    {
+        uint64_t head = m_layout->head.load( std::memory_order_acquire );
+
+        if( m_next >= head )
+        {
+            return Result::Empty;
+        }
+
+        // Lapped, skip to the oldest event that can still be there
+        if( head - m_next > EVENT_RING_CAPACITY )
+        {
+            missed += head - EVENT_RING_CAPACITY - m_next;
+            m_next = head - EVENT_RING_CAPACITY;
+        }
+
+        const EventSlot& slot = m_layout->slots[m_next & ( EVENT_RING_CAPACITY - 1 )];
+        const uint64_t expected = 2 * m_next + 2;
+
+        if( slot.version.load( std::memory_order_acquire ) == expected )
+        {
+            memcpy( &record, &slot.record, sizeof( EventRecord ) );
+            std::atomic_thread_fence( std::memory_order_acquire );
+
+            if( slot.version.load( std::memory_order_relaxed ) == expected )
+            {
+                ++m_next;
+
+                return Result::Event;
+            }
+        }
+
+        // Overwritten meanwhile, the publisher is at least a lap ahead
+        ++missed;
+        ++m_next;
+    }
+}
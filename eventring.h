@@ -0,0 +1,174 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef ICEQUERY_EVENTRING_H
+#define ICEQUERY_EVENTRING_H
+
+#include <atomic>
+#include <cstdint>      // uint32_t, uint64_t
+#include <map>
+#include <memory>       // unique_ptr
+#include <string>
+
+#include "session.h"
+
+#define EVENT_RING_MAGIC            0x52656369  // "iceR"
+#define EVENT_RING_VERSION          1
+
+// Number of records kept, must be a power of 2
+#define EVENT_RING_CAPACITY         4096
+
+// How often a follower checks for new events
+#define EVENT_FOLLOW_TICK           20
+
+#define EVENT_NAME_LEN              48
+#define EVENT_PLATFORM_LEN          24
+
+enum class EventType : uint32_t
+{
+    // A session's state changed, value holds the Session::State
+    SessionState,
+
+    NodeUpdated,
+    NodeRemoved,
+
+    JobBegin,
+    JobDone,
+    LocalJobBegin
+};
+
+const char* EventTypeToStr( EventType type );
+
+#define EVENT_FLAG_OFFLINE          0x1
+#define EVENT_FLAG_NO_REMOTE        0x2
+#define EVENT_FLAG_STALE            0x4
+
+// A single event as stored in the ring, kept trivially copyable and of a
+// fixed size so that it can be shared between processes
+struct EventRecord
+{
+    // Sequence number, increasing by 1 with every event published
+    uint64_t seq;
+
+    // getTimestamp() of publishing
+    int64_t timestamp;
+
+    EventType type;
+
+    // Index of the scheduler within the publisher's command line
+    uint32_t scheduler;
+
+    uint32_t hostId;
+    uint32_t jobId;
+
+    // Cores for node events, session state for SessionState, real msecs
+    // for JobDone
+    uint32_t value;
+
+    // EVENT_FLAG_* for node events, exit code for JobDone
+    int32_t flags;
+
+    // Node name, or the compiled file for LocalJobBegin, truncated
+    char name[EVENT_NAME_LEN];
+    char platform[EVENT_PLATFORM_LEN];
+};
+
+// The shared memory contents
+struct EventRingLayout;
+
+// Writes events into a POSIX shared memory ring, /icequery-<NAME>. There's a
+// single publisher per ring; readers never block it, they're only told how
+// many events they've missed once it laps them.
+class EventPublisher : public SessionListener
+{
+public:
+    // Replaces any ring of the same name left behind, null on error
+    static std::unique_ptr<EventPublisher> create( const std::string& name );
+
+public:
+    ~EventPublisher();
+
+    EventPublisher( const EventPublisher& ) = delete;
+    EventPublisher& operator=( const EventPublisher& ) = delete;
+
+public:
+    // Starts publishing the session's events
+    void attach( Session& session );
+
+    // Fills in seq and timestamp
+    void publish( EventRecord& record );
+
+    void onStateChanged( Session& session ) override;
+    void onNodeUpdated( Session& session, const NodeInfo& node ) override;
+    void onNodeRemoved( Session& session, const NodeInfo& node ) override;
+    void onMessage( Session& session, const Msg& msg ) override;
+
+private:
+    EventPublisher( const std::string& path, EventRingLayout* layout );
+
+    EventRecord nodeRecord( EventType type, Session& session, const NodeInfo& node );
+
+private:
+    std::string m_path;
+    EventRingLayout* m_layout;
+    uint64_t m_head;
+
+    std::map<const Session*, uint32_t> m_schedulers;
+
+    // Hosts of the running jobs by scheduler and job id, as JobDone doesn't
+    // say where the job ran
+    std::map<uint64_t, uint32_t> m_jobHosts;
+};
+
+// Follows a ring without ever blocking its publisher
+class EventReader
+{
+public:
+    enum class Result : char
+    {
+        Event,
+        Empty
+    };
+
+public:
+    // Starts at the oldest event still in the ring if fromOldest is set,
+    // otherwise at the next one to be published; null on error
+    static std::unique_ptr<EventReader> open( const std::string& name, bool fromOldest );
+
+public:
+    ~EventReader();
+
+    EventReader( const EventReader& ) = delete;
+    EventReader& operator=( const EventReader& ) = delete;
+
+public:
+    // Copies out the next event; missed is increased by the number of events
+    // overwritten before they could be read
+    Result next( EventRecord& record, uint64_t& missed );
+
+private:
+    EventReader( const EventRingLayout* layout, std::size_t size, bool fromOldest );
+
+private:
+    const EventRingLayout* m_layout;
+    std::size_t m_size;
+    uint64_t m_next;
+};
+
+#endif // ICEQUERY_EVENTRING_H
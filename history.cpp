@@ -0,0 +1,1001 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "history.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>      // strerror()
+#include <ctime>        // time()
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>     // ftruncate(), getpid()
+#include <sys/mman.h>   // mmap()
+#include <sys/stat.h>   // mkdir(), fstat()
+
+#include "common.h"
+
+// Encoding
+
+static void putVarint( std::string& out, uint64_t value )
+{
+    while( value >= 0x80 )
+    {
+        out.push_back( static_cast<char>( value | 0x80 ) );
+        value >>= 7;
+    }
+
+    out.push_back( static_cast<char>( value ) );
+}
+
+static void putZigzag( std::string& out, int64_t value )
+{
+    putVarint( out, ( static_cast<uint64_t>( value ) << 1 ) ^ static_cast<uint64_t>( value >> 63 ) );
+}
+
+static void putString( std::string& out, std::string_view str )
+{
+    putVarint( out, str.size() );
+    out.append( str );
+}
+
+static void putBlock( std::string& out, char type, const std::string& payload )
+{
+    out.push_back( type );
+    putVarint( out, payload.size() );
+    out.append( payload );
+}
+
+// Decoding, never reading past the end and remembering whether it tried to
+class HistoryCursor
+{
+public:
+    HistoryCursor( const uint8_t* begin, const uint8_t* end )
+        : m_pos( begin )
+        , m_end( end )
+        , m_ok( true )
+    {
+    }
+
+public:
+    bool atEnd() const
+    {
+        return m_pos >= m_end;
+    }
+
+    bool ok() const
+    {
+        return m_ok;
+    }
+
+    uint8_t byte()
+    {
+        if( m_pos >= m_end )
+        {
+            m_ok = false;
+            return 0;
+        }
+
+        return *m_pos++;
+    }
+
+    uint64_t varint()
+    {
+        uint64_t value = 0;
+
+        for( int shift = 0; shift < 64; shift += 7 )
+        {
+            if( m_pos >= m_end )
+            {
+                break;
+            }
+
+            uint8_t b = *m_pos++;
+            value |= static_cast<uint64_t>( b & 0x7f ) << shift;
+
+            if( !( b & 0x80 ) )
+            {
+                return value;
+            }
+        }
+
+        m_ok = false;
+        return 0;
+    }
+
+    int64_t zigzag()
+    {
+        uint64_t value = varint();
+
+        return static_cast<int64_t>( value >> 1 ) ^ -static_cast<int64_t>( value & 1 );
+    }
+
+    // The next size bytes, as a cursor of their own
+    HistoryCursor sub( uint64_t size )
+    {
+        if( size > static_cast<uint64_t>( m_end - m_pos ) )
+        {
+            m_ok = false;
+            size = 0;
+        }
+
+        HistoryCursor res( m_pos, m_pos + size );
+        m_pos += size;
+
+        return res;
+    }
+
+    std::string string()
+    {
+        HistoryCursor str = sub( varint() );
+
+        return std::string( reinterpret_cast<const char*>( str.m_pos ), str.m_end - str.m_pos );
+    }
+
+private:
+    const uint8_t* m_pos;
+    const uint8_t* m_end;
+    bool m_ok;
+};
+
+// HistorySegmentWriter
+
+class HistorySegmentWriter
+{
+public:
+    static std::unique_ptr<HistorySegmentWriter> create( const std::string& dir, const char* prefix, uint32_t kind, int64_t startTime )
+    {
+        char name[64];
+        snprintf( name, sizeof( name ), "/%s-%lld-%d.iqh", prefix, static_cast<long long>( startTime ), static_cast<int>( getpid() ) );
+
+        const std::string path = dir + name;
+        int fd = ::open( path.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644 );
+        void* mem = MAP_FAILED;
+
+        if( fd != -1 && ftruncate( fd, HISTORY_SEGMENT_SIZE ) == 0 )
+        {
+            mem = mmap( nullptr, HISTORY_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+        }
+
+        if( mem == MAP_FAILED )
+        {
+            int lastErrno = errno;
+
+            PRINT_ERR( "Unable to create the history segment '%s': (%d) %s\n", path.c_str(), lastErrno, strerror( lastErrno ) );
+
+            if( fd != -1 )
+            {
+                close( fd );
+                unlink( path.c_str() );
+            }
+
+            return nullptr;
+        }
+
+        HistoryHeader* header = static_cast<HistoryHeader*>( mem );
+        header->magic = HISTORY_MAGIC;
+        header->version = HISTORY_VERSION;
+        header->kind = kind;
+        header->startTime = startTime;
+        header->used = 0;
+
+        return std::unique_ptr<HistorySegmentWriter>( new HistorySegmentWriter( fd, header ) );
+    }
+
+public:
+    // Gives back the space never used
+    ~HistorySegmentWriter()
+    {
+        std::size_t size = sizeof( HistoryHeader ) + m_header->used;
+
+        munmap( m_header, HISTORY_SEGMENT_SIZE );
+
+        if( ftruncate( m_fd, size ) != 0 )
+        {
+            int lastErrno = errno;
+
+            PRINT_WARN( "Unable to truncate a history segment: (%d) %s\n", lastErrno, strerror( lastErrno ) );
+        }
+
+        close( m_fd );
+    }
+
+    HistorySegmentWriter( const HistorySegmentWriter& ) = delete;
+    HistorySegmentWriter& operator=( const HistorySegmentWriter& ) = delete;
+
+public:
+    int64_t startTime() const
+    {
+        return m_header->startTime;
+    }
+
+    // All or nothing, false if the blocks don't fit
+    bool append( const std::string& blocks )
+    {
+        uint64_t used = m_header->used;
+
+        if( sizeof( HistoryHeader ) + used + blocks.size() > HISTORY_SEGMENT_SIZE )
+        {
+            return false;
+        }
+
+        memcpy( reinterpret_cast<char*>( m_header + 1 ) + used, blocks.data(), blocks.size() );
+
+        // Readers only look as far as this, so it goes last
+        std::atomic_ref<uint64_t>( m_header->used ).store( used + blocks.size(), std::memory_order_release );
+
+        return true;
+    }
+
+private:
+    HistorySegmentWriter( int fd, HistoryHeader* header )
+        : m_fd( fd )
+        , m_header( header )
+    {
+    }
+
+private:
+    int m_fd;
+    HistoryHeader* m_header;
+};
+
+// HistoryWriter
+
+std::unique_ptr<HistoryWriter> HistoryWriter::open( const std::string& dir )
+{
+    if( mkdir( dir.c_str(), 0755 ) != 0 && errno != EEXIST )
+    {
+        int lastErrno = errno;
+
+        PRINT_ERR( "Unable to create the history directory '%s': (%d) %s\n", dir.c_str(), lastErrno, strerror( lastErrno ) );
+
+        return nullptr;
+    }
+
+    return std::unique_ptr<HistoryWriter>( new HistoryWriter( dir ) );
+}
+
+HistoryWriter::HistoryWriter( const std::string& dir )
+    : m_dir( dir )
+    , m_lastTime( 0 )
+    , m_periodStart( 0 )
+    , m_periodFrames( 0 )
+{
+}
+
+HistoryWriter::~HistoryWriter()
+{
+    if( m_periodFrames > 0 )
+    {
+        writeRollup();
+    }
+}
+
+bool HistoryWriter::append( int64_t time, const std::vector<HistoryEntry>& entries )
+{
+    // A period's rollup goes once the first frame of the next one comes
+    int64_t periodStart = time - ( ( time % HISTORY_ROLLUP_PERIOD ) + HISTORY_ROLLUP_PERIOD ) % HISTORY_ROLLUP_PERIOD;
+
+    if( m_periodFrames > 0 && periodStart != m_periodStart && !writeRollup() )
+    {
+        return false;
+    }
+
+    m_periodStart = periodStart;
+    ++m_periodFrames;
+
+    for( const HistoryEntry& entry : entries )
+    {
+        HistoryRollup& sums = m_sums[NodeKey( entry.scheduler, entry.hostId, entry.name, entry.platform )];
+        ++sums.samples;
+        sums.freeSlots += entry.freeSlots;
+        sums.jobs += entry.jobs;
+
+        if( !( entry.flags & ( HISTORY_FLAG_OFFLINE | HISTORY_FLAG_NO_REMOTE ) ) )
+        {
+            sums.cores += entry.maxJobs;
+        }
+    }
+
+    // Once the segment is full, the frame goes into a new one, with all its
+    // nodes defined again
+    for( int attempt = 0; attempt < 2; ++attempt )
+    {
+        if( !m_raw )
+        {
+            m_raw = HistorySegmentWriter::create( m_dir, "raw", 0, time );
+            m_rawNodes.clear();
+            m_lastTime = time;
+
+            if( !m_raw )
+            {
+                return false;
+            }
+        }
+
+        std::string blocks;
+        std::vector<std::pair<NodeState*, const HistoryEntry*>> changed;
+        std::vector<NodeState*> seen;
+
+        seen.reserve( entries.size() );
+
+        for( const HistoryEntry& entry : entries )
+        {
+            NodeKey key( entry.scheduler, entry.hostId, entry.name, entry.platform );
+            auto it = m_rawNodes.find( key );
+
+            if( it == m_rawNodes.end() )
+            {
+                defineNode( m_rawNodes, key, blocks );
+                it = m_rawNodes.find( key );
+            }
+
+            NodeState& state = it->second;
+
+            if( !state.present || state.flags != entry.flags || state.maxJobs != entry.maxJobs || state.freeSlots != entry.freeSlots || state.jobs != entry.jobs )
+            {
+                changed.emplace_back( &state, &entry );
+            }
+
+            seen.push_back( &state );
+        }
+
+        std::sort( changed.begin(), changed.end(), [] ( const auto& a, const auto& b ) { return a.first->index < b.first->index; } );
+
+        std::string columns[6];
+        uint32_t lastIndex = 0;
+
+        for( auto& sample : changed )
+        {
+            NodeState& state = *sample.first;
+            const HistoryEntry& entry = *sample.second;
+
+            putVarint( columns[0], state.index - lastIndex );
+            columns[1].push_back( static_cast<char>( entry.flags ) );
+            putZigzag( columns[2], static_cast<int64_t>( entry.maxJobs ) - state.maxJobs );
+            putZigzag( columns[3], static_cast<int64_t>( entry.freeSlots ) - state.freeSlots );
+            putZigzag( columns[4], static_cast<int64_t>( entry.jobs ) - state.jobs );
+
+            lastIndex = state.index;
+            state.flags = entry.flags;
+            state.maxJobs = entry.maxJobs;
+            state.freeSlots = entry.freeSlots;
+            state.jobs = entry.jobs;
+        }
+
+        // The nodes of the previous frame missing from this one
+        std::vector<NodeState*> gone;
+
+        for( auto& node : m_rawNodes )
+        {
+            if( node.second.present )
+            {
+                gone.push_back( &node.second );
+                node.second.present = false;
+            }
+        }
+
+        for( NodeState* state : seen )
+        {
+            state->present = true;
+        }
+
+        gone.erase( std::remove_if( gone.begin(), gone.end(), [] ( const NodeState* state ) { return state->present; } ), gone.end() );
+        std::sort( gone.begin(), gone.end(), [] ( const NodeState* a, const NodeState* b ) { return a->index < b->index; } );
+
+        lastIndex = 0;
+
+        for( const NodeState* state : gone )
+        {
+            putVarint( columns[5], state->index - lastIndex );
+            lastIndex = state->index;
+        }
+
+        std::string payload;
+        putZigzag( payload, time - m_lastTime );
+        putVarint( payload, changed.size() );
+
+        for( int i = 0; i < 5; ++i )
+        {
+            putString( payload, columns[i] );
+        }
+
+        putVarint( payload, gone.size() );
+        putString( payload, columns[5] );
+
+        putBlock( blocks, 'F', payload );
+
+        if( m_raw->append( blocks ) )
+        {
+            m_lastTime = time;
+            return true;
+        }
+
+        m_raw.reset();
+    }
+
+    PRINT_ERR( "History frame of %zu nodes too large for a segment.\n", entries.size() );
+
+    return false;
+}
+
+bool HistoryWriter::writeRollup()
+{
+    for( int attempt = 0; attempt < 2; ++attempt )
+    {
+        if( !m_rollup )
+        {
+            m_rollup = HistorySegmentWriter::create( m_dir, "rollup", 1, m_periodStart );
+            m_rollupNodes.clear();
+
+            if( !m_rollup )
+            {
+                return false;
+            }
+        }
+
+        std::string blocks;
+        std::vector<std::pair<uint32_t, const HistoryRollup*>> rollups;
+        rollups.reserve( m_sums.size() );
+
+        for( const auto& sums : m_sums )
+        {
+            auto it = m_rollupNodes.find( sums.first );
+            uint32_t index = it != m_rollupNodes.end() ? it->second.index : defineNode( m_rollupNodes, sums.first, blocks );
+
+            rollups.emplace_back( index, &sums.second );
+        }
+
+        std::sort( rollups.begin(), rollups.end(), [] ( const auto& a, const auto& b ) { return a.first < b.first; } );
+
+        std::string columns[5];
+        uint32_t lastIndex = 0;
+
+        for( const auto& rollup : rollups )
+        {
+            putVarint( columns[0], rollup.first - lastIndex );
+            putVarint( columns[1], rollup.second->samples );
+            putVarint( columns[2], rollup.second->cores );
+            putVarint( columns[3], rollup.second->freeSlots );
+            putVarint( columns[4], rollup.second->jobs );
+
+            lastIndex = rollup.first;
+        }
+
+        std::string payload;
+        putZigzag( payload, m_periodStart - m_rollup->startTime() );
+        putVarint( payload, m_periodFrames );
+        putVarint( payload, rollups.size() );
+
+        for( const std::string& column : columns )
+        {
+            putString( payload, column );
+        }
+
+        putBlock( blocks, 'R', payload );
+
+        if( m_rollup->append( blocks ) )
+        {
+            m_sums.clear();
+            m_periodFrames = 0;
+
+            return true;
+        }
+
+        m_rollup.reset();
+    }
+
+    PRINT_ERR( "History rollup of %zu nodes too large for a segment.\n", m_sums.size() );
+
+    return false;
+}
+
+uint32_t HistoryWriter::defineNode( std::map<NodeKey, NodeState>& nodes, const NodeKey& key, std::string& out )
+{
+    uint32_t index = static_cast<uint32_t>( nodes.size() );
+    nodes.emplace( key, NodeState { index, 0, 0, 0, 0, false } );
+
+    std::string payload;
+    putVarint( payload, index );
+    putVarint( payload, std::get<1>( key ) );
+    putString( payload, std::get<0>( key ) );
+    putString( payload, std::get<2>( key ) );
+    putString( payload, std::get<3>( key ) );
+
+    putBlock( out, 'N', payload );
+
+    return index;
+}
+
+// Reading
+
+// A segment mapped read-only, up to the blocks complete when it was opened
+class HistorySegment
+{
+public:
+    static std::unique_ptr<HistorySegment> open( const std::string& path )
+    {
+        int fd = ::open( path.c_str(), O_RDONLY | O_CLOEXEC );
+        struct stat st {};
+        void* mem = MAP_FAILED;
+
+        if( fd != -1 && fstat( fd, &st ) == 0 && static_cast<std::size_t>( st.st_size ) >= sizeof( HistoryHeader ) )
+        {
+            mem = mmap( nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+        }
+
+        if( fd != -1 )
+        {
+            close( fd );
+        }
+
+        if( mem == MAP_FAILED )
+        {
+            PRINT_ERR( "Unable to map the history segment '%s'.\n", path.c_str() );
+
+            return nullptr;
+        }
+
+        const HistoryHeader* header = static_cast<const HistoryHeader*>( mem );
+
+        if( header->magic != HISTORY_MAGIC || header->version != HISTORY_VERSION )
+        {
+            PRINT_ERR( "'%s' is not a history segment of a compatible version.\n", path.c_str() );
+
+            munmap( mem, st.st_size );
+
+            return nullptr;
+        }
+
+        return std::unique_ptr<HistorySegment>( new HistorySegment( path, header, st.st_size ) );
+    }
+
+public:
+    ~HistorySegment()
+    {
+        munmap( const_cast<HistoryHeader*>( m_header ), m_size );
+    }
+
+    HistorySegment( const HistorySegment& ) = delete;
+    HistorySegment& operator=( const HistorySegment& ) = delete;
+
+public:
+    const std::string& path() const
+    {
+        return m_path;
+    }
+
+    const HistoryHeader& header() const
+    {
+        return *m_header;
+    }
+
+    HistoryCursor blocks() const
+    {
+        uint64_t used = std::atomic_ref<uint64_t>( const_cast<HistoryHeader*>( m_header )->used ).load( std::memory_order_acquire );
+        const uint8_t* begin = reinterpret_cast<const uint8_t*>( m_header + 1 );
+
+        return HistoryCursor( begin, begin + std::min<uint64_t>( used, m_size - sizeof( HistoryHeader ) ) );
+    }
+
+private:
+    HistorySegment( const std::string& path, const HistoryHeader* header, std::size_t size )
+        : m_path( path )
+        , m_header( header )
+        , m_size( size )
+    {
+    }
+
+private:
+    std::string m_path;
+    const HistoryHeader* m_header;
+    std::size_t m_size;
+};
+
+// The segments of the kind overlapping [since, until), oldest first
+static bool openSegments( const std::string& dir, const char* prefix, int64_t since, int64_t until, std::vector<std::unique_ptr<HistorySegment>>& segments )
+{
+    DIR* dirp = opendir( dir.c_str() );
+
+    if( !dirp )
+    {
+        int lastErrno = errno;
+
+        PRINT_ERR( "Unable to open the history directory '%s': (%d) %s\n", dir.c_str(), lastErrno, strerror( lastErrno ) );
+
+        return false;
+    }
+
+    const std::string_view prefixView( prefix );
+    std::vector<std::unique_ptr<HistorySegment>> all;
+
+    while( struct dirent* entry = readdir( dirp ) )
+    {
+        std::string_view name( entry->d_name );
+
+        if( name.size() > prefixView.size() + 5 && name.substr( 0, prefixView.size() ) == prefixView && name[prefixView.size()] == '-' &&
+            name.substr( name.size() - 4 ) == ".iqh" )
+        {
+            if( auto segment = HistorySegment::open( dir + "/" + entry->d_name ) )
+            {
+                all.push_back( std::move( segment ) );
+            }
+        }
+    }
+
+    closedir( dirp );
+
+    std::sort( all.begin(), all.end(), [] ( const auto& a, const auto& b )
+    {
+        return std::make_pair( a->header().startTime, a->path() ) < std::make_pair( b->header().startTime, b->path() );
+    } );
+
+    for( std::size_t i = 0; i < all.size(); ++i )
+    {
+        // A segment ends where the next one starts
+        bool endsBefore = ( i + 1 < all.size() ) && all[i + 1]->header().startTime <= since;
+
+        if( !endsBefore && all[i]->header().startTime < until )
+        {
+            segments.push_back( std::move( all[i] ) );
+        }
+    }
+
+    return true;
+}
+
+// Reads a node definition, false if malformed
+static bool readNode( HistoryCursor& cursor, std::vector<HistoryNode>& nodes )
+{
+    uint64_t index = cursor.varint();
+    uint32_t hostId = static_cast<uint32_t>( cursor.varint() );
+    std::string scheduler = cursor.string();
+    std::string name = cursor.string();
+    std::string platform = cursor.string();
+
+    // Defined in order, so the index can't be far off
+    if( !cursor.ok() || index > nodes.size() )
+    {
+        return false;
+    }
+
+    if( index == nodes.size() )
+    {
+        nodes.emplace_back();
+    }
+
+    nodes[index] = HistoryNode { std::move( scheduler ), hostId, std::move( name ), std::move( platform ) };
+
+    return true;
+}
+
+bool scanHistoryFrames( const std::string& dir, int64_t since, int64_t until, const HistoryFrameFn& fn )
+{
+    std::vector<std::unique_ptr<HistorySegment>> segments;
+
+    if( !openSegments( dir, "raw", since, until, segments ) )
+    {
+        return false;
+    }
+
+    std::vector<HistoryNode> nodes;
+    std::vector<HistorySample> previous;
+    std::vector<bool> present;
+    std::vector<HistorySample> samples;
+    bool nodesChanged = true;
+
+    for( const auto& segment : segments )
+    {
+        HistoryCursor cursor = segment->blocks();
+        int64_t time = segment->header().startTime;
+
+        nodes.clear();
+        previous.clear();
+        present.clear();
+
+        while( !cursor.atEnd() && time < until )
+        {
+            uint8_t type = cursor.byte();
+            HistoryCursor block = cursor.sub( cursor.varint() );
+            bool ok = cursor.ok();
+
+            if( ok && type == 'N' )
+            {
+                ok = readNode( block, nodes );
+                previous.resize( nodes.size(), HistorySample { 0, 0, 0, 0, 0 } );
+                present.resize( nodes.size() );
+                nodesChanged = true;
+            }
+            else if( ok && type == 'F' )
+            {
+                time += block.zigzag();
+                uint64_t count = block.varint();
+
+                HistoryCursor indexes = block.sub( block.varint() );
+                HistoryCursor flags = block.sub( block.varint() );
+                HistoryCursor maxJobs = block.sub( block.varint() );
+                HistoryCursor freeSlots = block.sub( block.varint() );
+                HistoryCursor jobs = block.sub( block.varint() );
+
+                uint64_t index = 0;
+
+                for( uint64_t i = 0; i < count && ok; ++i )
+                {
+                    index += indexes.varint();
+
+                    if( index >= previous.size() )
+                    {
+                        ok = false;
+                        break;
+                    }
+
+                    HistorySample& sample = previous[index];
+                    sample.node = static_cast<uint32_t>( index );
+                    sample.flags = flags.byte();
+                    sample.maxJobs += static_cast<uint32_t>( maxJobs.zigzag() );
+                    sample.freeSlots += static_cast<uint32_t>( freeSlots.zigzag() );
+                    sample.jobs += static_cast<uint32_t>( jobs.zigzag() );
+
+                    present[index] = true;
+                }
+
+                uint64_t goneCount = block.varint();
+                HistoryCursor gone = block.sub( block.varint() );
+
+                index = 0;
+
+                for( uint64_t i = 0; i < goneCount && ok; ++i )
+                {
+                    index += gone.varint();
+
+                    if( index >= present.size() )
+                    {
+                        ok = false;
+                        break;
+                    }
+
+                    present[index] = false;
+                }
+
+                ok = ok && block.ok() && indexes.ok() && flags.ok() && maxJobs.ok() && freeSlots.ok() && jobs.ok() && gone.ok();
+
+                if( ok && time >= since && time < until )
+                {
+                    samples.clear();
+
+                    for( std::size_t i = 0; i < previous.size(); ++i )
+                    {
+                        if( present[i] )
+                        {
+                            samples.push_back( previous[i] );
+                        }
+                    }
+
+                    fn( time, nodes, nodesChanged, samples );
+                    nodesChanged = false;
+                }
+            }
+
+            // Unknown blocks are skipped, for the sake of newer writers
+            if( !ok )
+            {
+                PRINT_ERR( "Corrupt history segment '%s'.\n", segment->path().c_str() );
+
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool scanHistoryRollups( const std::string& dir, int64_t since, int64_t until, const HistoryRollupFn& fn )
+{
+    std::vector<std::unique_ptr<HistorySegment>> segments;
+
+    if( !openSegments( dir, "rollup", since, until, segments ) )
+    {
+        return false;
+    }
+
+    std::vector<HistoryNode> nodes;
+    std::vector<HistoryRollup> rollups;
+    bool nodesChanged = true;
+
+    for( const auto& segment : segments )
+    {
+        HistoryCursor cursor = segment->blocks();
+        int64_t periodStart = segment->header().startTime;
+
+        nodes.clear();
+
+        while( !cursor.atEnd() && periodStart < until )
+        {
+            uint8_t type = cursor.byte();
+            HistoryCursor block = cursor.sub( cursor.varint() );
+            bool ok = cursor.ok();
+
+            if( ok && type == 'N' )
+            {
+                ok = readNode( block, nodes );
+                nodesChanged = true;
+            }
+            else if( ok && type == 'R' )
+            {
+                periodStart = segment->header().startTime + block.zigzag();
+                uint32_t frames = static_cast<uint32_t>( block.varint() );
+                uint64_t count = block.varint();
+
+                HistoryCursor indexes = block.sub( block.varint() );
+                HistoryCursor samples = block.sub( block.varint() );
+                HistoryCursor cores = block.sub( block.varint() );
+                HistoryCursor freeSlots = block.sub( block.varint() );
+                HistoryCursor jobs = block.sub( block.varint() );
+
+                rollups.clear();
+                uint64_t index = 0;
+
+                for( uint64_t i = 0; i < count && block.ok(); ++i )
+                {
+                    index += indexes.varint();
+
+                    if( index >= nodes.size() )
+                    {
+                        ok = false;
+                        break;
+                    }
+
+                    rollups.push_back( HistoryRollup { static_cast<uint32_t>( index ), static_cast<uint32_t>( samples.varint() ), cores.varint(),
+                                                       freeSlots.varint(), jobs.varint() } );
+                }
+
+                ok = ok && block.ok() && indexes.ok() && samples.ok() && cores.ok() && freeSlots.ok() && jobs.ok();
+
+                if( ok && periodStart >= since && periodStart < until )
+                {
+                    fn( periodStart, frames, nodes, nodesChanged, rollups );
+                    nodesChanged = false;
+                }
+            }
+
+            if( !ok )
+            {
+                PRINT_ERR( "Corrupt history segment '%s'.\n", segment->path().c_str() );
+
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// HistoryRecorder
+
+HistoryRecorder::HistoryRecorder( const std::vector<std::unique_ptr<Session>>& sessions, HistoryWriter& writer, int interval )
+    : m_sessions( sessions )
+    , m_writer( writer )
+    , m_interval( interval )
+{
+    for( const auto& session : m_sessions )
+    {
+        session->addListener( this );
+    }
+}
+
+HistoryRecorder::~HistoryRecorder()
+{
+    for( const auto& session : m_sessions )
+    {
+        session->removeListener( this );
+    }
+}
+
+Task<int> HistoryRecorder::run( Reactor& reactor )
+{
+    std::vector<std::string> labels;
+
+    for( const auto& session : m_sessions )
+    {
+        labels.push_back( session->target().label() );
+    }
+
+    std::vector<HistoryEntry> entries;
+    long nextSample = getTimestamp();
+
+    while( true )
+    {
+        nextSample += m_interval;
+        co_await reactor.sleepUntil( nextSample );
+
+        entries.clear();
+        bool anyConnected = false;
+
+        for( std::size_t i = 0; i < m_sessions.size(); ++i )
+        {
+            const Session& session = *m_sessions[i];
+
+            // Nothing known is not the same as no nodes
+            if( session.connectionCount() == 0 )
+            {
+                continue;
+            }
+
+            anyConnected = true;
+
+            for( const auto& entry : session.nodes() )
+            {
+                const NodeInfo& node = *entry.second;
+                uint32_t jobs = m_jobs.jobCount( i, node.hostId() );
+                bool counted = !node.isOffline() && !node.noRemote();
+
+                entries.push_back( HistoryEntry {
+                    labels[i], node.hostId(), node.name(), node.platform(),
+                    static_cast<uint8_t>( ( node.isOffline() ? HISTORY_FLAG_OFFLINE : 0 ) | ( node.noRemote() ? HISTORY_FLAG_NO_REMOTE : 0 ) |
+                                          ( node.isStale() ? HISTORY_FLAG_STALE : 0 ) ),
+                    node.maxJobs(), ( counted && node.maxJobs() > jobs ) ? node.maxJobs() - jobs : 0, jobs
+                } );
+            }
+        }
+
+        if( !anyConnected )
+        {
+            continue;
+        }
+
+        if( !m_writer.append( time( nullptr ), entries ) )
+        {
+            for( const auto& session : m_sessions )
+            {
+                session->stop();
+            }
+
+            co_return EXIT_IO_ERR;
+        }
+    }
+}
+
+void HistoryRecorder::onStateChanged( Session& session )
+{
+    if( session.state() == Session::State::Connecting )
+    {
+        m_jobs.drop( sessionIndex( session ) );
+    }
+}
+
+void HistoryRecorder::onMessage( Session& session, const Msg& msg )
+{
+    m_jobs.handle( sessionIndex( session ), msg );
+}
+
+std::size_t HistoryRecorder::sessionIndex( const Session& session ) const
+{
+    for( std::size_t i = 0; i < m_sessions.size(); ++i )
+    {
+        if( m_sessions[i].get() == &session )
+        {
+            return i;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,236 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef ICEQUERY_HISTORY_H
+#define ICEQUERY_HISTORY_H
+
+#include <cstdint>      // uint32_t, int64_t
+#include <functional>
+#include <map>
+#include <memory>       // unique_ptr
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "jobtracker.h"
+#include "session.h"
+
+#define HISTORY_MAGIC               0x54534849  // "IHST"
+#define HISTORY_VERSION             1
+
+// Size a segment file is created with, truncated to what's used once done
+#define HISTORY_SEGMENT_SIZE        ( 8 << 20 )
+
+// Seconds summarized by a single rollup
+#define HISTORY_ROLLUP_PERIOD       3600
+
+// How often the recorder takes a sample, in msecs
+#define HISTORY_INTERVAL_DEFAULT    60000
+
+#define HISTORY_FLAG_OFFLINE        0x1
+#define HISTORY_FLAG_NO_REMOTE      0x2
+#define HISTORY_FLAG_STALE          0x4
+
+/*
+    A history directory holds two series of append-only segment files: raw
+    ones with a sample of every node per recorded frame, and rollup ones with
+    the sums of those samples per node and period. Each file starts with a
+    HistoryHeader followed by blocks of a type byte, a varint payload size
+    and the payload:
+
+    'N' node: index, host id, then length-prefixed scheduler, name and
+        platform; indexes are only valid within the file
+    'F' frame (raw files): zigzag time delta from the previous frame (the
+        header's for the first one), count of the nodes that changed or
+        appeared, their index, flags, max jobs, free slots and job count
+        columns, then count of the nodes gone and their index column; each
+        column is prefixed by its size in bytes, indexes are deltas from the
+        previous one in the column, the numbers zigzag deltas from the
+        node's previous sample. Nodes not mentioned keep their values.
+    'R' rollup (rollup files): zigzag period start delta from the header's
+        time, frames recorded in it, node count, then the node index,
+        samples, cores, free slots and job count columns, each prefixed by
+        its size; indexes are deltas, the sums plain varints
+
+    All integers but the header's are LEB128 varints. Times are in seconds
+    since the Epoch.
+*/
+
+struct HistoryHeader
+{
+    uint32_t magic;
+    uint32_t version;
+
+    // 0 for raw, 1 for rollup files
+    uint32_t kind;
+    uint32_t reserved;
+
+    int64_t startTime;
+
+    // Bytes of blocks following the header, only ever growing, so that a
+    // reader always sees complete blocks
+    uint64_t used;
+};
+
+struct HistoryNode
+{
+    std::string scheduler;
+    uint32_t hostId;
+    std::string name;
+    std::string platform;
+};
+
+// A node's values in a frame, node being an index into the nodes
+struct HistorySample
+{
+    uint32_t node;
+    uint8_t flags;
+    uint32_t maxJobs;
+    uint32_t freeSlots;
+    uint32_t jobs;
+};
+
+// A node's sums over a rollup period; cores are the max jobs of the samples
+// where the node was neither offline nor 'no remote'
+struct HistoryRollup
+{
+    uint32_t node;
+    uint32_t samples;
+    uint64_t cores;
+    uint64_t freeSlots;
+    uint64_t jobs;
+};
+
+// What the writer is given for each node
+struct HistoryEntry
+{
+    std::string_view scheduler;
+    uint32_t hostId;
+    std::string_view name;
+    std::string_view platform;
+
+    uint8_t flags;
+    uint32_t maxJobs;
+    uint32_t freeSlots;
+    uint32_t jobs;
+};
+
+class HistorySegmentWriter;
+
+// Appends frames to the raw segments of a directory and, once a period is
+// over, its rollup to the rollup segments
+class HistoryWriter
+{
+public:
+    // Creates the directory if needed, null on error
+    static std::unique_ptr<HistoryWriter> open( const std::string& dir );
+
+public:
+    // Writes the rollup of the current period, however incomplete
+    ~HistoryWriter();
+
+    HistoryWriter( const HistoryWriter& ) = delete;
+    HistoryWriter& operator=( const HistoryWriter& ) = delete;
+
+public:
+    // All the nodes present at time, false on error
+    bool append( int64_t time, const std::vector<HistoryEntry>& entries );
+
+private:
+    explicit HistoryWriter( const std::string& dir );
+
+    typedef std::tuple<std::string, uint32_t, std::string, std::string> NodeKey;
+
+    struct NodeState
+    {
+        uint32_t index;
+
+        // The previous sample, in the current raw segment
+        uint8_t flags;
+        uint32_t maxJobs;
+        uint32_t freeSlots;
+        uint32_t jobs;
+
+        // Whether it was in the previous frame
+        bool present;
+    };
+
+    bool writeRollup();
+
+    static uint32_t defineNode( std::map<NodeKey, NodeState>& nodes, const NodeKey& key, std::string& out );
+
+private:
+    std::string m_dir;
+
+    std::unique_ptr<HistorySegmentWriter> m_raw;
+    std::map<NodeKey, NodeState> m_rawNodes;
+    int64_t m_lastTime;
+
+    std::unique_ptr<HistorySegmentWriter> m_rollup;
+    std::map<NodeKey, NodeState> m_rollupNodes;
+
+    // Of the current period
+    int64_t m_periodStart;
+    uint32_t m_periodFrames;
+    std::map<NodeKey, HistoryRollup> m_sums;
+};
+
+// Called for every frame, with all the nodes of its segment; nodesChanged
+// tells whether any were (re)defined since the previous call
+typedef std::function<void( int64_t time, const std::vector<HistoryNode>& nodes, bool nodesChanged, const std::vector<HistorySample>& samples )> HistoryFrameFn;
+
+// Called for every rollup, likewise
+typedef std::function<void( int64_t periodStart, uint32_t frames, const std::vector<HistoryNode>& nodes, bool nodesChanged,
+                            const std::vector<HistoryRollup>& rollups )> HistoryRollupFn;
+
+// Scan the mapped segments in order, skipping the ones entirely outside
+// [since, until); false on error
+bool scanHistoryFrames( const std::string& dir, int64_t since, int64_t until, const HistoryFrameFn& fn );
+bool scanHistoryRollups( const std::string& dir, int64_t since, int64_t until, const HistoryRollupFn& fn );
+
+// Samples the nodes of the sessions every interval into a history directory
+class HistoryRecorder : public SessionListener
+{
+public:
+    HistoryRecorder( const std::vector<std::unique_ptr<Session>>& sessions, HistoryWriter& writer, int interval );
+    ~HistoryRecorder();
+
+    HistoryRecorder( const HistoryRecorder& ) = delete;
+    HistoryRecorder& operator=( const HistoryRecorder& ) = delete;
+
+public:
+    // Runs until writing fails, returns one of EXIT_* codes
+    Task<int> run( Reactor& reactor );
+
+    void onStateChanged( Session& session ) override;
+    void onMessage( Session& session, const Msg& msg ) override;
+
+private:
+    std::size_t sessionIndex( const Session& session ) const;
+
+private:
+    const std::vector<std::unique_ptr<Session>>& m_sessions;
+    HistoryWriter& m_writer;
+    int m_interval;
+
+    JobTracker m_jobs;
+};
+
+#endif // ICEQUERY_HISTORY_H
@@ -0,0 +1,592 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "historyview.h"
+
+#include <algorithm>
+#include <cmath>        // std::sqrt(), std::round()
+#include <cstring>      // strcmp()
+#include <ctime>        // strptime(), mktime()
+#include <map>
+#include <vector>
+
+#include "common.h"
+#include "history.h"
+
+// Aggregation
+
+namespace
+{
+
+struct Sums
+{
+    uint64_t nodes = 0;
+    uint64_t cores = 0;
+    uint64_t freeSlots = 0;
+    uint64_t jobs = 0;
+};
+
+struct Bucket
+{
+    uint64_t frames = 0;
+
+    // By group id
+    std::vector<Sums> sums;
+};
+
+class Aggregator
+{
+public:
+    Aggregator( const HistoryQuery& query )
+        : m_query( query )
+    {
+    }
+
+public:
+    // Maps the nodes to their groups, once per change
+    void mapNodes( const std::vector<HistoryNode>& nodes )
+    {
+        m_nodeGroups.resize( nodes.size() );
+
+        for( std::size_t i = 0; i < nodes.size(); ++i )
+        {
+            m_nodeGroups[i] = groupId( nodes[i] );
+        }
+    }
+
+    Bucket& bucket( int64_t time )
+    {
+        Bucket& bucket = m_buckets[time - ( time - m_query.since ) % m_query.step];
+        bucket.sums.resize( m_groupNames.size() );
+
+        return bucket;
+    }
+
+    Sums& sums( Bucket& bucket, uint32_t node )
+    {
+        return bucket.sums[m_nodeGroups[node]];
+    }
+
+    const std::map<int64_t, Bucket>& buckets() const
+    {
+        return m_buckets;
+    }
+
+    const std::vector<std::string>& groupNames() const
+    {
+        return m_groupNames;
+    }
+
+private:
+    std::size_t groupId( const HistoryNode& node )
+    {
+        std::string name;
+
+        switch( m_query.groupBy )
+        {
+            case HistoryGroupBy::None:
+                break;
+
+            case HistoryGroupBy::Platform:
+                name = node.platform;
+                break;
+
+            case HistoryGroupBy::Node:
+                name = node.name;
+                break;
+
+            case HistoryGroupBy::Scheduler:
+                name = node.scheduler;
+                break;
+        }
+
+        auto res = m_groupIds.emplace( name, m_groupNames.size() );
+
+        if( res.second )
+        {
+            m_groupNames.push_back( name );
+        }
+
+        return res.first->second;
+    }
+
+private:
+    const HistoryQuery& m_query;
+
+    std::map<std::string, std::size_t> m_groupIds;
+    std::vector<std::string> m_groupNames;
+    std::vector<std::size_t> m_nodeGroups;
+
+    std::map<int64_t, Bucket> m_buckets;
+};
+
+}
+
+static std::string formatAverage( uint64_t sum, uint64_t count )
+{
+    char buffer[32];
+    snprintf( buffer, sizeof( buffer ), "%.1f", static_cast<double>( sum ) / count );
+
+    return buffer;
+}
+
+// Utility functions
+
+bool strToGroupBy( const char* str, HistoryGroupBy& groupBy )
+{
+    if( strcmp( str, "none" ) == 0 )
+    {
+        groupBy = HistoryGroupBy::None;
+    }
+    else if( strcmp( str, "platform" ) == 0 )
+    {
+        groupBy = HistoryGroupBy::Platform;
+    }
+    else if( strcmp( str, "node" ) == 0 )
+    {
+        groupBy = HistoryGroupBy::Node;
+    }
+    else if( strcmp( str, "scheduler" ) == 0 )
+    {
+        groupBy = HistoryGroupBy::Scheduler;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+bool parseHistoryTime( const char* str, int64_t now, int64_t& time )
+{
+    long seconds;
+
+    if( parseDuration( str, seconds ) )
+    {
+        time = now - seconds;
+        return true;
+    }
+
+    struct tm tm {};
+    const char* end = strptime( str, "%Y-%m-%d", &tm );
+
+    if( end && *end )
+    {
+        end = strptime( end, " %H:%M", &tm );
+    }
+
+    if( !end || *end )
+    {
+        return false;
+    }
+
+    tm.tm_isdst = -1;
+    time = mktime( &tm );
+
+    return true;
+}
+
+// Output functions
+
+// Sums up the query's period into the aggregator, returns one of EXIT_* codes
+static int aggregateHistory( const HistoryQuery& query, Aggregator& aggregator )
+{
+    // Start times of the rolled up periods, in order
+    std::vector<int64_t> rolled;
+
+    if( query.step % HISTORY_ROLLUP_PERIOD == 0 )
+    {
+        bool res = scanHistoryRollups( query.dir, query.since, query.until, [&] ( int64_t periodStart, uint32_t frames, const std::vector<HistoryNode>& nodes,
+                                                                                  bool nodesChanged, const std::vector<HistoryRollup>& rollups )
+        {
+            if( nodesChanged )
+            {
+                aggregator.mapNodes( nodes );
+            }
+
+            Bucket& bucket = aggregator.bucket( periodStart );
+            bucket.frames += frames;
+
+            for( const HistoryRollup& rollup : rollups )
+            {
+                Sums& sums = aggregator.sums( bucket, rollup.node );
+                sums.nodes += rollup.samples;
+                sums.cores += rollup.cores;
+                sums.freeSlots += rollup.freeSlots;
+                sums.jobs += rollup.jobs;
+            }
+
+            rolled.push_back( periodStart );
+        } );
+
+        if( !res )
+        {
+            return EXIT_IO_ERR;
+        }
+
+        std::sort( rolled.begin(), rolled.end() );
+    }
+
+    auto scanFrames = [&] ( int64_t since, int64_t until )
+    {
+        return scanHistoryFrames( query.dir, since, until, [&] ( int64_t time, const std::vector<HistoryNode>& nodes, bool nodesChanged,
+                                                                 const std::vector<HistorySample>& samples )
+        {
+            if( nodesChanged )
+            {
+                aggregator.mapNodes( nodes );
+            }
+
+            Bucket& bucket = aggregator.bucket( time );
+            ++bucket.frames;
+
+            for( const HistorySample& sample : samples )
+            {
+                Sums& sums = aggregator.sums( bucket, sample.node );
+                ++sums.nodes;
+                sums.freeSlots += sample.freeSlots;
+                sums.jobs += sample.jobs;
+
+                if( !( sample.flags & ( HISTORY_FLAG_OFFLINE | HISTORY_FLAG_NO_REMOTE ) ) )
+                {
+                    sums.cores += sample.maxJobs;
+                }
+            }
+        } );
+    };
+
+    // Raw frames for every gap between the rollups: the hour being recorded,
+    // hours a recorder was stopped in before rolling them up, and the part
+    // of the first hour before query.since
+    int64_t gapStart = query.since;
+
+    for( int64_t periodStart : rolled )
+    {
+        if( periodStart > gapStart && !scanFrames( gapStart, periodStart ) )
+        {
+            return EXIT_IO_ERR;
+        }
+
+        gapStart = std::max( gapStart, periodStart + HISTORY_ROLLUP_PERIOD );
+    }
+
+    if( gapStart < query.until && !scanFrames( gapStart, query.until ) )
+    {
+        return EXIT_IO_ERR;
+    }
+
+    if( aggregator.buckets().empty() )
+    {
+        PRINT_ERR( "No history recorded in the period.\n" );
+
+        return EXIT_NO_DATA;
+    }
+
+    return EXIT_OK;
+}
+
+int printHistory( const HistoryQuery& query, const OutputSpec& spec, FILE* out )
+{
+    Aggregator aggregator( query );
+    int res = aggregateHistory( query, aggregator );
+
+    if( res != EXIT_OK )
+    {
+        return res;
+    }
+
+    std::vector<ColumnHeader> header { { Alignment::Left, Encoding::UTF8, "Time" } };
+
+    switch( query.groupBy )
+    {
+        case HistoryGroupBy::None:
+            break;
+
+        case HistoryGroupBy::Platform:
+            header.emplace_back( Alignment::Left, Encoding::UTF8, "Platform" );
+            break;
+
+        case HistoryGroupBy::Node:
+            header.emplace_back( Alignment::Left, Encoding::Custom, "Node" );
+            break;
+
+        case HistoryGroupBy::Scheduler:
+            header.emplace_back( Alignment::Left, Encoding::UTF8, "Scheduler" );
+            break;
+    }
+
+    header.insert( header.end(), {
+        { Alignment::Right , Encoding::UTF8     , "Nodes"      },
+        { Alignment::Right , Encoding::UTF8     , "Cores"      },
+        { Alignment::Right , Encoding::UTF8     , "Free"       },
+        { Alignment::Right , Encoding::UTF8     , "Jobs"       },
+        { Alignment::Right , Encoding::UTF8     , "Busy"       }
+    } );
+
+    // Groups in order of their names
+    const std::vector<std::string>& groupNames = aggregator.groupNames();
+    std::vector<std::size_t> groupOrder( groupNames.size() );
+
+    for( std::size_t i = 0; i < groupOrder.size(); ++i )
+    {
+        groupOrder[i] = i;
+    }
+
+    std::sort( groupOrder.begin(), groupOrder.end(), [&groupNames] ( std::size_t a, std::size_t b ) { return groupNames[a] < groupNames[b]; } );
+
+    Cells strings;
+    uint64_t frameCount = 0;
+
+    for( const auto& entry : aggregator.buckets() )
+    {
+        const Bucket& bucket = entry.second;
+        frameCount += bucket.frames;
+
+        time_t time = entry.first;
+        struct tm tm {};
+        char timeStr[32];
+
+        localtime_r( &time, &tm );
+        strftime( timeStr, sizeof( timeStr ), "%Y-%m-%d %H:%M", &tm );
+
+        for( std::size_t group : groupOrder )
+        {
+            if( group >= bucket.sums.size() || !bucket.sums[group].nodes )
+            {
+                continue;
+            }
+
+            const Sums& sums = bucket.sums[group];
+
+            strings.emplace_back( timeStr );
+
+            if( query.groupBy != HistoryGroupBy::None )
+            {
+                strings.emplace_back( groupNames[group] );
+            }
+
+            strings.emplace_back( formatAverage( sums.nodes, bucket.frames ) );
+            strings.emplace_back( formatAverage( sums.cores, bucket.frames ) );
+            strings.emplace_back( formatAverage( sums.freeSlots, bucket.frames ) );
+            strings.emplace_back( formatAverage( sums.jobs, bucket.frames ) );
+            strings.emplace_back( sums.cores ? std::to_string( ( sums.jobs * 100 + sums.cores / 2 ) / sums.cores ) + "%" : std::string() );
+        }
+    }
+
+    printTable( spec, header, strings, out );
+    fprintf( out, "%llu frame%s recorded.\n", static_cast<unsigned long long>( frameCount ), frameCount == 1 ? "" : "s" );
+
+    return EXIT_OK;
+}
+
+// Forecasting
+
+namespace
+{
+
+// Running mean and variance, Welford's way
+struct Moments
+{
+    uint32_t count = 0;
+    double mean = 0;
+    double m2 = 0;
+
+    void add( double value )
+    {
+        double delta = value - mean;
+
+        ++count;
+        mean += delta / count;
+        m2 += delta * ( value - mean );
+    }
+
+    double variance() const
+    {
+        return count > 1 ? m2 / ( count - 1 ) : 0;
+    }
+};
+
+// Averages of the hours seen on the same weekday and hour, falling back to
+// the same hour of any day, then to all the hours
+class SeasonalProfile
+{
+public:
+    void add( int64_t time, double value )
+    {
+        struct tm tm = localTime( time );
+
+        m_weekHours[tm.tm_wday * 24 + tm.tm_hour].add( value );
+        m_dayHours[tm.tm_hour].add( value );
+        m_all.add( value );
+    }
+
+    // Also tells how many recorded hours the mean is made of
+    double mean( int64_t time, uint32_t& basis ) const
+    {
+        struct tm tm = localTime( time );
+        const Moments* moments = &m_weekHours[tm.tm_wday * 24 + tm.tm_hour];
+
+        if( !moments->count )
+        {
+            moments = m_dayHours[tm.tm_hour].count ? &m_dayHours[tm.tm_hour] : &m_all;
+        }
+
+        basis = moments->count;
+
+        return moments->mean;
+    }
+
+private:
+    static struct tm localTime( int64_t time )
+    {
+        time_t t = time;
+        struct tm tm {};
+
+        localtime_r( &t, &tm );
+
+        return tm;
+    }
+
+private:
+    Moments m_weekHours[7 * 24];
+    Moments m_dayHours[24];
+    Moments m_all;
+};
+
+}
+
+int printForecast( const HistoryQuery& query, int64_t horizon, const OutputSpec& spec, FILE* out )
+{
+    HistoryQuery hourly = query;
+    hourly.step = HISTORY_ROLLUP_PERIOD;
+    hourly.groupBy = HistoryGroupBy::None;
+    hourly.since -= hourly.since % HISTORY_ROLLUP_PERIOD;
+
+    Aggregator aggregator( hourly );
+    int res = aggregateHistory( hourly, aggregator );
+
+    if( res != EXIT_OK )
+    {
+        return res;
+    }
+
+    // Average free slots and cores of every hour recorded
+    std::vector<std::pair<int64_t, double>> series;
+    double maxCores = 0;
+
+    for( const auto& entry : aggregator.buckets() )
+    {
+        const Bucket& bucket = entry.second;
+
+        if( !bucket.frames || bucket.sums.empty() )
+        {
+            continue;
+        }
+
+        series.emplace_back( entry.first, static_cast<double>( bucket.sums[0].freeSlots ) / bucket.frames );
+        maxCores = std::max( maxCores, static_cast<double>( bucket.sums[0].cores ) / bucket.frames );
+    }
+
+    SeasonalProfile profile;
+
+    for( const auto& hour : series )
+    {
+        profile.add( hour.first, hour.second );
+    }
+
+    // The recent trend is what the seasonal means miss, smoothed with a
+    // damped Holt's method over the residuals; its one-step errors give the
+    // width of the band
+    double level = 0;
+    double trend = 0;
+    Moments errors;
+
+    for( const auto& hour : series )
+    {
+        uint32_t basis;
+        double residual = hour.second - profile.mean( hour.first, basis );
+        double predicted = level + FORECAST_DAMPING * trend;
+
+        errors.add( residual - predicted );
+
+        double lastLevel = level;
+        level = FORECAST_ALPHA * residual + ( 1 - FORECAST_ALPHA ) * predicted;
+        trend = FORECAST_BETA * ( level - lastLevel ) + ( 1 - FORECAST_BETA ) * FORECAST_DAMPING * trend;
+    }
+
+    std::vector<ColumnHeader> header {
+        { Alignment::Left  , Encoding::UTF8     , "Time"       },
+        { Alignment::Right , Encoding::UTF8     , "Free"       },
+        { Alignment::Right , Encoding::UTF8     , "Low"        },
+        { Alignment::Right , Encoding::UTF8     , "High"       },
+        { Alignment::Right , Encoding::UTF8     , "Hours"      }
+    };
+
+    Cells strings;
+    const int64_t start = query.until - query.until % HISTORY_ROLLUP_PERIOD;
+    const double sigma = std::sqrt( errors.variance() );
+    double residualTrend = 0;
+    double damping = 1;
+    int64_t bestTime = start;
+    double bestFree = -1;
+
+    for( int64_t time = start, step = 1; time < query.until + horizon; time += HISTORY_ROLLUP_PERIOD, ++step )
+    {
+        damping *= FORECAST_DAMPING;
+        residualTrend += damping * trend;
+
+        uint32_t basis;
+        double free = std::clamp( profile.mean( time, basis ) + level + residualTrend, 0.0, maxCores );
+        double spread = FORECAST_BAND_Z * sigma * std::sqrt( 1 + ( step - 1 ) * FORECAST_ALPHA * FORECAST_ALPHA );
+
+        if( free > bestFree )
+        {
+            bestFree = free;
+            bestTime = time;
+        }
+
+        time_t t = time;
+        struct tm tm {};
+        char timeStr[32];
+
+        localtime_r( &t, &tm );
+        strftime( timeStr, sizeof( timeStr ), "%a %Y-%m-%d %H:%M", &tm );
+
+        strings.emplace_back( timeStr );
+        strings.emplace_back( std::to_string( std::lround( free ) ) );
+        strings.emplace_back( std::to_string( std::lround( std::max( free - spread, 0.0 ) ) ) );
+        strings.emplace_back( std::to_string( std::lround( std::min( free + spread, maxCores ) ) ) );
+        strings.emplace_back( std::to_string( basis ) );
+    }
+
+    printTable( spec, header, strings, out );
+
+    time_t t = bestTime;
+    struct tm tm {};
+    char timeStr[32];
+
+    localtime_r( &t, &tm );
+    strftime( timeStr, sizeof( timeStr ), "%a %Y-%m-%d %H:%M", &tm );
+
+    fprintf( out, "Free slots expected within an %d%% band, from %zu hour%s recorded.\n", FORECAST_BAND_PERCENT, series.size(), series.size() == 1 ? "" : "s" );
+    fprintf( out, "Most headroom: %s, about %ld free slots.\n", timeStr, std::lround( bestFree ) );
+
+    return EXIT_OK;
+}
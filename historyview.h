@@ -0,0 +1,83 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef ICEQUERY_HISTORYVIEW_H
+#define ICEQUERY_HISTORYVIEW_H
+
+#include <cstdint>      // int64_t
+#include <string>
+
+#include "output.h"
+
+// Default span and step of a history query, in seconds
+#define HISTORY_SINCE_DEFAULT       86400
+#define HISTORY_STEP_DEFAULT        3600
+
+// Default span of the history a forecast is made from, in seconds
+#define FORECAST_SINCE_DEFAULT      ( 4 * 7 * 86400 )
+
+// Smoothing of the recent trend: level and trend weights, and how much of the
+// trend is kept from one hour to the next
+#define FORECAST_ALPHA              0.3
+#define FORECAST_BETA               0.1
+#define FORECAST_DAMPING            0.9
+
+// The band printed around a forecast, and the normal quantile giving it
+#define FORECAST_BAND_PERCENT       80
+#define FORECAST_BAND_Z             1.2816
+
+enum class HistoryGroupBy : char
+{
+    None,
+    Platform,
+    Node,
+    Scheduler
+};
+
+struct HistoryQuery
+{
+    std::string dir;
+
+    // Seconds since the Epoch, since being rounded down to a step
+    int64_t since;
+    int64_t until;
+    int64_t step;
+
+    HistoryGroupBy groupBy;
+};
+
+bool strToGroupBy( const char* str, HistoryGroupBy& groupBy );
+
+// Parses either a duration back from now or a local 'YYYY-MM-DD[ HH:MM]'
+// date, false if malformed
+bool parseHistoryTime( const char* str, int64_t now, int64_t& time );
+
+// Prints the average nodes, cores, free slots and jobs of every step,
+// returns one of EXIT_* codes. Steps of whole rollup periods are taken from
+// the rollups where there are any, the rest from the raw frames.
+int printHistory( const HistoryQuery& query, const OutputSpec& spec, FILE* out );
+
+// Prints the free slots expected every hour from the end of the query's
+// period till horizon seconds after it, returns one of EXIT_* codes. Each
+// hour's average over the same weekday and hour of the recorded period is
+// corrected by the recent trend, with a band following from how well that
+// predicted the recorded hours.
+int printForecast( const HistoryQuery& query, int64_t horizon, const OutputSpec& spec, FILE* out );
+
+#endif // ICEQUERY_HISTORYVIEW_H
@@ -18,60 +18,46 @@
 
 #include <cstdio>
 #include <memory>       // unique_ptr
-#include <algorithm>
-#include <locale>       // isblank()
+#include <string>
 #include <vector>
 
-#include <ctime>        // clock_gettime()
+#include <cerrno>
+#include <csignal>
 #include <cstring>      // strerror()
 #include <cstdint>      // uint32_t
-#include <cctype>       // tolower
-#include <cstdlib>      // abort()
+#include <ctime>        // time()
 
 #include <poll.h>
 #include <getopt.h>
 #include <unistd.h>     // isatty()
+#include <sys/signalfd.h>
 
-#include <icecc/comm.h>
 #include <icecc/logging.h>
 
-#define U_HIDE_DRAFT_API
-#define U_HIDE_DEPRECATED_API
-#define U_HIDE_OBSOLETE_API
-#define U_HIDE_SYSTEM_API
-#define U_HIDE_INTERNAL_API
-
-#include <unicode/unistr.h>     // icu::UnicodeString
-#include <unicode/translit.h>   // icu::Transliterator
-#include <unicode/errorcode.h>  // icu::ErrorCode
 #include <unicode/ucnv.h>       // icu::ucnv_getDefaultName
-#include <unicode/ustdio.h>     // icu::u_printf()
 
-// Utility macros
+#include "arena.h"
+#include "async.h"
+#include "common.h"
+#include "compilecosts.h"
+#include "diffview.h"
+#include "discovery.h"
+#include "eventring.h"
+#include "history.h"
+#include "historyview.h"
+#include "nodeinfo.h"
+#include "output.h"
+#include "predict.h"
+#include "probe.h"
+#include "query.h"
+#include "rank.h"
+#include "resolver.h"
+#include "serve.h"
+#include "session.h"
+#include "snapshot.h"
+#include "top.h"
 
-#define PRINT_STREAM stderr
-
-#define PRINT_BASE( shouldPrint, colorSeq, format, args... ) \
-    do \
-    { \
-        if( !veryQuiet && shouldPrint ) \
-        { \
-            if( useColor ) \
-            { \
-                fprintf( PRINT_STREAM, "\e[" colorSeq format "\e[0m", ##args ); \
-            } \
-            else \
-            { \
-                fprintf( PRINT_STREAM, format, ##args ); \
-            } \
-        } \
-    } \
-    while( 0 )
-
-#define PRINT_INFO(  format, args... )  PRINT_BASE( true,  "1;32m", format, ##args )
-#define PRINT_WARN(  format, args... )  PRINT_BASE( true,  "1;33m", format, ##args )
-#define PRINT_ERR(   format, args... )  PRINT_BASE( true,  "31m",   format, ##args )
-#define PRINT_DEBUG( format, args... )  PRINT_BASE( debug, "1;36m", format, ##args )
+// Utility macros
 
 #define STR_INTERNAL( x )               #x
 #define STR( x )                        STR_INTERNAL( x )
@@ -80,58 +66,64 @@
 
 #define VER_NO                      20140705
 
-// Table consts
+// Other consts
 
-#define VERT_LINE_7BIT              "|"
-#define CROSS_7BIT                  "+"
-#define HOR_LINE_7BIT               "-"
+#define TIMEOUT_DEFAULT             2000
+#define RTIMEOUT_DEFAULT            2000
 
-#define TICK_7BIT                   "X"
-#define NO_TICK_7BIT                ""
+// Global variables
 
-#define VERT_LINE_UTF8              "│"
-#define CROSS_UTF8                  "┼"
-#define HOR_LINE_UTF8               "─"
+std::vector<QueryTarget> targets;
+int timeout = TIMEOUT_DEFAULT;
+int rtimeout = RTIMEOUT_DEFAULT;
+int deadline = -1;
+IoBackend::Type ioBackend = IoBackend::Type::Poll;
+MonitorClient monitorClient = MonitorClient::Libicecc;
 
-#define TICK_UTF8                   "√"
-#define NO_TICK_UTF8                ""
+bool listNetworks = false;
+bool withCapacity = false;
 
-// Other consts
+int watchInterval = 0;
+unsigned rankCount = 0;
+long rankPeriod = RANK_PERIOD_DEFAULT;
+bool serve = false;
+int topInterval = 0;
 
-#define TIMEOUT_DEFAULT             2000
-#define RTIMEOUT_DEFAULT            2000
+std::string recordDir;
+int recordInterval = HISTORY_INTERVAL_DEFAULT;
 
-// Exit codes
+bool showHistory = false;
+HistoryQuery historyQuery { std::string(), -1, -1, HISTORY_STEP_DEFAULT, HistoryGroupBy::None };
+long forecastHorizon = 0;
 
-#define EXIT_OK                     0
+std::string snapshotPath;
+std::string diffAgainstPath;
 
-#define EXIT_INVALID_ARGS           1
-#define EXIT_CONNECTION_ERR         2
-#define EXIT_NO_DATA                3
-#define EXIT_LIBRARY_ERR            4
+// Of the 'diff' command, if given
+std::string diffPaths[2];
 
-// Global variables
+std::string publishName;
+std::string followName;
 
-std::string netName;
-int timeout = TIMEOUT_DEFAULT;
-int rtimeout = RTIMEOUT_DEFAULT;
-std::string schedAddr;
-uint16_t schedPort = 0;
+std::string batchPath;
 
-bool quiet = false;
-bool veryQuiet = false;
-bool brief = false;
+bool progressive = false;
 
-std::string customEncoding;
-bool plain = false;
-bool ascii = false;
-bool noTable = false;
+bool resolveNames = false;
+long resolveTtl = RESOLVE_TTL_DEFAULT;
+std::unique_ptr<HostResolver> resolver;
+HostNameMap hostNames;
 
-bool noOffline = false;
-bool noNoRemote = false;
+bool probe = false;
+ProbeMap probes;
 
-bool debug = false;
-bool useColor = false;
+std::string costsPath;
+bool collectCosts = false;
+std::string predictPath;
+
+bool quiet = false;
+
+OutputSpec output;
 
 // Global consts
 
@@ -143,6 +135,8 @@ Licensed under GPLv2
 
 const char* UsageStr = \
 R"usage(usage: %s [options...]
+       %s history <DIR> [options...]
+       %s diff <SNAPSHOT> <SNAPSHOT> [options...]
 
 General options:
 
@@ -159,6 +153,101 @@ Connection options:
      --addr=<ADDRESS>   : scheduler address for avoiding broadcasting and
                           attempting to connect directly
      --port=<PORT>      : scheduler port for direct connection
+     --deadline=<MSECS> : overall time limit for the whole query, after which
+                          whatever has been retrieved is used
+     --io-backend=<IO>  : I/O mechanism of the event loop, used in every mode
+                          but querying a single scheduler once; IO can be:
+                          'poll' (default), 'epoll', or 'io_uring'
+     --monitor-client=<CLIENT>
+                        : how to speak to the scheduler(s) when querying once;
+                          CLIENT can be: 'libicecc' (default), or 'native' for
+                          the built-in client, which decodes the node stats
+                          only and skips the other messages unread
+
+Monitoring options:
+
+     --watch=<MSECS>    : keep monitoring the scheduler(s) and print the
+                          results every MSECS; the connection is re-established
+                          automatically, showing the last known nodes as stale
+                          in the meantime
+     --publish=<NAME>   : keep monitoring the scheduler(s) and publish node and
+                          job events into the shared memory ring
+                          /dev/shm/icequery-NAME, for any number of readers
+     --follow=<NAME>    : print the events published under NAME as they come,
+                          tab-separated: sequence number, timestamp, type,
+                          scheduler index, host id, job id, value, flags, name
+                          and platform
+     --top[=<MSECS>]    : keep monitoring the scheduler(s) and show the nodes,
+                          their running jobs and free slots full-screen,
+                          updated every MSECS (default: )usage" STR( TOP_INTERVAL_DEFAULT ) R"usage(); only the
+                          changed parts of the screen are repainted; press 'q'
+                          to quit
+     --serve-stdio      : keep monitoring the scheduler(s) and answer requests
+                          read from stdin line by line, see below
+     --rank[=<COUNT>]   : follow the jobs run on the nodes for a while, then
+                          print the best COUNT (default: )usage" STR( RANK_COUNT_DEFAULT ) R"usage() nodes for remote
+                          jobs, scored by their free slots, cores and how long
+                          their recent jobs took compared to the others, and
+                          the best one as ICECC_PREFERRED_HOST; with '--watch',
+                          the ranking is printed again every MSECS; with
+                          '--brief', only the node names are printed
+     --rank-period=<DURATION>
+                        : how long to follow the jobs first (default: 1m)
+     --record=<DIR>     : keep monitoring the scheduler(s) and append a sample
+                          of every node to the history kept in DIR, see below
+     --record-interval=<MSECS>
+                        : how often to take a sample (default: )usage" STR( HISTORY_INTERVAL_DEFAULT ) R"usage()
+
+ Requests served by '--serve-stdio', one per line, each answered with a line
+ starting with 'ok' or 'err' (and the listed lines following 'ok <COUNT>'):
+
+   totals [OPTS]          -> ok <NODES> <CORES>
+   nodes [OPTS]           -> ok <COUNT>, then a line per node
+   node <ID|NAME|IP>      -> ok <NODE>
+   wait <CORES> [<MSECS>] [OPTS]
+                          -> ok <CORES> once that many cores are available,
+                             err timeout <CORES> otherwise
+   status                 -> ok <COUNT>, then <SCHEDULER> <STATE> <NODES> lines
+   quit                   -> ok, and exits
+
+ OPTS are '--no-offline', '--no-noremote' and '--platform=<PLATFORM>', applied
+ on top of the ones from the command line. A node is described by tab-separated
+ id, name, IP, cores, platform, and 0/1 offline, no remote and stale flags.
+ The last known nodes of a disconnected scheduler are still counted. Requests
+ about the nodes wait until every scheduler has sent them or failed to connect
+ once; a request still waiting when stdin is closed ends with 'err input closed'
+ and the program exits.
+
+History options:
+
+ 'history <DIR>' prints the average nodes, cores, free slots and running jobs
+ recorded in DIR for every step of the period, and how busy the cores were.
+
+     --since=<WHEN>     : start of the period (default: 1d)
+     --until=<WHEN>     : end of the period (default: now)
+     --step=<DURATION>  : length of a step (default: 1h); steps of whole hours
+                          are read from the hourly rollups where possible
+     --group-by=<KEY>   : KEY can be: 'none' (default), 'platform', 'node', or
+                          'scheduler'
+     --forecast=<DURATION>
+                        : print the free slots expected every hour from the
+                          end of the period (of 4w by default) till DURATION
+                          after it instead, judging by the same weekdays and
+                          hours and the recent trend, within an 80%% band
+
+ WHEN is either a duration back from now, or a local date 'YYYY-MM-DD' with an
+ optional ' HH:MM'. A DURATION is a number of seconds, or any sequence of
+ numbers followed by 's', 'm', 'h', 'd' or 'w', like '1h30m' or '2w'.
+
+Network listing options:
+
+     --list-networks    : list all schedulers answering a discovery broadcast
+                          within the '--timeout' period instead of querying one
+     --with-capacity    : query each of the listed schedulers for its capacity
+
+ Options '--net-name' and '--addr' can be repeated in order to query multiple
+ schedulers concurrently and show their merged capacity. A net name and an
+ address (and a port) given next to each other describe the same scheduler.
 
 General output options:
 
@@ -185,10 +274,72 @@ Table options:
 
  --no-offline  [*]      : do not include offline nodes in the table
  --no-noremote [*]      : do not include 'no remote' nodes in the table
+ --platform=<PLATFORM>  : include only the nodes of the given platform, both in
+                          the table and in the totals
+ --per-platform         : print the totals of each platform separately as well
+ --progressive          : print the table rows as the nodes arrive instead of
+                          once all of them have; the header is printed again
+                          whenever a column has to widen (a single scheduler
+                          only, not with '--batch')
+ --resolve              : add a column with the host name of each node's IP;
+                          the names are looked up concurrently within the
+                          '--deadline' (or )usage" STR( RESOLVE_TIMEOUT_DEFAULT ) R"usage( msecs) and cached in
+                          ~/.cache/icequery; with '--watch', the names looked
+                          up meanwhile show up in the next print
+ --resolve-ttl=<DURATION>
+                        : how long to cache the names (default: 1d)
+ --probe                : add columns with whether each node's daemon port
+                          ()usage" STR( PROBE_PORT ) R"usage() accepts connections from here and how long
+                          connecting took, and the totals of every subnet;
+                          up to )usage" STR( PROBE_CONCURRENCY ) R"usage( nodes are probed at once, each within
+                          )usage" STR( PROBE_TIMEOUT_DEFAULT ) R"usage( msecs and the '--deadline' (a single query
+                          only, not with '--watch' and the like)
 
  [*] Selected options affect the display of the table only, as neither offline
      nor 'no remote' nodes are taken into account when calculating totals.
 
+Batch options:
+
+     --batch=<FILE>     : read a list of queries from FILE ('-' for stdin), one
+                          per line, and evaluate all of them against a single
+                          snapshot retrieved from the scheduler(s)
+
+ Each line of a batch file consists of output and table options in their long
+ form ('--brief', '--no-table', '--plain', '--ascii', '--encoding=',
+ '--no-offline', '--no-noremote', '--platform=', '--per-platform') and an
+ optional '--output=<FILE>' naming where its result goes (default: stdout).
+ Options given on the command line apply to every line. Empty lines and lines
+ starting with '#' are skipped. The exit code is the first non-zero one of all
+ the queries.
+
+Snapshot options:
+
+     --snapshot=<FILE>  : also save the nodes retrieved into FILE
+     --diff-against=<SNAPSHOT>
+                        : instead of the table, print the nodes added, removed,
+                          renumbered or changed since SNAPSHOT was saved, and
+                          the net change of the cores
+
+ 'diff <SNAPSHOT> <SNAPSHOT>' compares two saved snapshots the same way. Nodes
+ are matched by their scheduler and host id; a node registering again under a
+ new id is reported as renumbered. With '--brief', only the net change of the
+ cores is printed.
+
+Build prediction options:
+
+     --collect-costs    : keep monitoring the scheduler(s) and remember how
+                          long every file compiled remotely took, saving the
+                          costs every )usage" STR( COSTS_SAVE_INTERVAL ) R"usage( msecs and on exit
+     --costs=<FILE>     : where the costs are kept (default:
+                          ~/.cache/icequery/compile-costs)
+     --predict=<FILE>   : read the files of an upcoming build from FILE ('-'
+                          for stdin), one per line, and print how long
+                          compiling them on the cores of the farm would take
+                          with a few job counts, longest files first, and the
+                          fewest jobs within 2%% of the shortest time; files of
+                          unknown cost are taken as the median one; with
+                          '--brief', only that job count is printed
+
 Exit codes:
 
  0 : No errors occurred
@@ -197,426 +348,455 @@ Exit codes:
  2 : Connection error
  3 : No useful data retrieved
  4 : Library error
+ 5 : Input/output error
 )usage";
 
-// Utility functions
-
-long getTimestamp()
+std::vector<std::string> nodeAddresses( const std::vector<QueryResult>& results )
 {
-    static struct timespec ts;
-
-    clock_gettime( CLOCK_MONOTONIC_RAW, &ts );
-
-    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
-}
+    std::vector<std::string> addrs;
 
-std::string toLower( std::string&& str )
-{
-    std::transform( str.cbegin(), str.cend(), str.begin(), tolower );
+    for( const QueryResult& result : results )
+    {
+        for( const auto& node : result.nodes )
+        {
+            if( !node->ip().empty() )
+            {
+                addrs.emplace_back( node->ip() );
+            }
+        }
+    }
 
-    return std::move( str );
+    return addrs;
 }
 
-std::string& toLower( std::string& str )
+// Names the IPs of the results' nodes into hostNames, waiting for the lookups
+// till the deadline at most
+void resolveHostNames( HostResolver& resolver, const std::vector<QueryResult>& results, long deadline )
 {
-    std::transform( str.cbegin(), str.cend(), str.begin(), tolower );
-
-    return str;
+    resolver.resolve( nodeAddresses( results ), deadline, hostNames );
+    resolver.save();
 }
 
-bool checkEncoding( const std::string& encoding )
+Task<void> printPeriodically( Reactor& reactor, const std::vector<std::unique_ptr<Session>>& sessions, const std::vector<OutputSpec>& specs )
 {
-    if( encoding.empty() || std::all_of( encoding.cbegin(), encoding.cend(), std::isblank ) )
+    // Snapshots live in arenas taking turns, so that the previous one stays
+    // valid while the next one is taken, and once the arenas have grown to
+    // the farm's size refreshing allocates nothing
+    struct Generation
     {
-        return false;
-    }
-
-    icu::ErrorCode errorCode;
-    UConverter* converter = ucnv_open( encoding.c_str(), errorCode );
+        Arena arena;
+        std::vector<QueryResult> results;
+    };
 
-    if( converter )
-    {
-        ucnv_close( converter );
-    }
+    Generation generations[2];
+    int current = 0;
 
-    if( errorCode.isFailure() )
+    for( Generation& generation : generations )
     {
-        PRINT_ERR( "ucnv_open(): %s\n", errorCode.errorName() );
+        generation.results.reserve( sessions.size() );
     }
 
-    return !errorCode.isFailure();
-}
-
-// Types/Classes
-
-enum class Alignment : char
-{
-    Left,
-    Right,
-    Center
-};
-
-enum class Encoding : char
-{
-    UTF8,
-    Custom
-};
+    long nextPrint = getTimestamp();
 
-class NodeInfo
-{
-public:
-    static std::unique_ptr<NodeInfo> create( uint32_t hostId, const std::string& stats )
+    while( true )
     {
-        if( !hostId )
-        {
-            return std::unique_ptr<NodeInfo>();
-        }
+        nextPrint += watchInterval;
+        co_await reactor.sleepUntil( nextPrint );
 
-        std::unique_ptr<NodeInfo> res( new NodeInfo( hostId ) );
+        current ^= 1;
 
-        std::string::size_type linePos = 0;
+        std::vector<QueryResult>& results = generations[current].results;
+        Arena& arena = generations[current].arena;
 
-        while( true )
-        {
-            auto nextLinePos = stats.find( '\n', linePos );
-            auto colonPos = stats.find( ':', linePos );
+        // The nodes from two refreshes ago go before their arena is reused
+        results.clear();
+        arena.reset();
 
-            if( colonPos != std::string::npos && !( nextLinePos != std::string::npos && colonPos > nextLinePos ) )
-            {
-                std::string name = std::move( toLower( stats.substr( linePos, colonPos - linePos ) ) );
-                std::string value = std::move( stats.substr( colonPos + 1, nextLinePos == std::string::npos ? std::string::npos : nextLinePos - ( colonPos + 1 ) ) );
+        bool hasNodes = false;
 
-                if( name == "name" )
-                {
-                    res->m_name = std::move( value );
-                }
-                else if( name == "ip" )
-                {
-                    res->m_ip = std::move( value );
-                }
-                else if( name == "maxjobs" )
-                {
-                    res->m_maxJobs = std::stoi( value );
-                }
-                else if( name == "noremote" )
-                {
-                    res->m_noRemote = ( toLower( value ) == "true" );
-                }
-                else if( name == "state" )
-                {
-                    res->m_offline = ( toLower( value ) == "offline" );
-                }
-                else if( name == "platform" )
-                {
-                    res->m_platform = std::move( value );
-                }
-            }
+        for( std::size_t i = 0; i < sessions.size(); ++i )
+        {
+            const Session& session = *sessions[i];
 
-            linePos = nextLinePos;
+            // Whatever was known counts as an answer, stale or not
+            results.push_back( QueryResult { ( session.connectionCount() > 0 ) ? EXIT_OK : EXIT_CONNECTION_ERR, session.snapshot( arena.resource() ) } );
+            hasNodes |= !results[i].nodes.empty();
 
-            if( nextLinePos == std::string::npos )
+            if( session.state() != Session::State::Live && !results[i].nodes.empty() )
             {
-                break;
+                PRINT_WARN( "Scheduler '%s' not connected, showing the last known nodes.\n", session.target().label().c_str() );
             }
-            else
-            {
-                ++linePos;
+        }
 
-                if( linePos > stats.length() )
-                {
-                    break;
-                }
-            }
+        if( !hasNodes )
+        {
+            continue;
         }
 
-        if( !res->isValid() )
+        // Without waiting, the names still being looked up show up next time
+        if( resolver )
         {
-            res.reset();
+            resolveHostNames( *resolver, results, getTimestamp() );
         }
 
-        return std::move( res );
+        for( const OutputSpec& spec : specs )
+        {
+            printResults( spec, targets, results, arena.resource() );
+        }
     }
+}
+
+Task<void> saveCostsPeriodically( Reactor& reactor, CompileCosts& costs )
+{
+    long nextSave = getTimestamp();
 
-public:
-    uint32_t hostId() const
+    while( true )
     {
-        return m_hostId;
+        nextSave += COSTS_SAVE_INTERVAL;
+        co_await reactor.sleepUntil( nextSave );
+
+        costs.save( costsPath );
     }
+}
+
+Task<void> recordHistory( Reactor& reactor, HistoryRecorder& recorder, int& res )
+{
+    res = co_await recorder.run( reactor );
 
-    const std::string& name() const
+    // Printing goes on forever otherwise
+    reactor.stop();
+}
+
+// Makes the reactor return on SIGINT or SIGTERM, so that the history and
+// the costs are written out by their owners on the way out
+Task<void> stopOnSignal( Reactor& reactor, int signalFd )
+{
+    co_await reactor.wait( signalFd, POLLIN, -1 );
+
+    reactor.stop();
+}
+
+int watchSessions( std::vector<OutputSpec>& specs, int signalFd )
+{
+    Reactor reactor( ioBackend );
+    std::vector<std::unique_ptr<Session>> sessions;
+
+    std::unique_ptr<EventPublisher> publisher;
+
+    for( OutputSpec& spec : specs )
     {
-        return m_name;
+        spec.showStale = true;
     }
 
-    const std::string& ip() const
+    if( !publishName.empty() )
     {
-        return m_ip;
+        publisher = EventPublisher::create( publishName );
+
+        if( !publisher )
+        {
+            return EXIT_IO_ERR;
+        }
     }
 
-    uint32_t maxJobs() const
+    for( const QueryTarget& target : targets )
     {
-        return m_maxJobs;
+        sessions.emplace_back( new Session( target ) );
+
+        if( publisher )
+        {
+            publisher->attach( *sessions.back() );
+        }
+
+        reactor.spawn( sessions.back()->run( reactor ) );
     }
 
-    bool noRemote() const
+    if( watchInterval > 0 )
     {
-        return m_noRemote;
+        reactor.spawn( printPeriodically( reactor, sessions, specs ) );
     }
 
-    bool isOffline() const
+    std::unique_ptr<HistoryWriter> historyWriter;
+    std::unique_ptr<HistoryRecorder> recorder;
+    int recordRes = EXIT_OK;
+
+    if( !recordDir.empty() )
     {
-        return m_offline;
+        historyWriter = HistoryWriter::open( recordDir );
+
+        if( !historyWriter )
+        {
+            return EXIT_IO_ERR;
+        }
+
+        recorder.reset( new HistoryRecorder( sessions, *historyWriter, recordInterval ) );
+        reactor.spawn( recordHistory( reactor, *recorder, recordRes ) );
     }
 
-    const std::string& platform() const
+    CompileCosts costs;
+    std::unique_ptr<CompileCostCollector> collector;
+
+    if( collectCosts )
     {
-        return m_platform;
+        if( !costs.load( costsPath ) )
+        {
+            return EXIT_IO_ERR;
+        }
+
+        collector.reset( new CompileCostCollector( sessions, costs ) );
+        reactor.spawn( saveCostsPeriodically( reactor, costs ) );
     }
 
-private:
-    NodeInfo( uint32_t hostId )
-        : m_hostId( hostId )
-        , m_maxJobs( 0 )
-        , m_noRemote( false )
-        , m_offline( false )
+    reactor.spawn( stopOnSignal( reactor, signalFd ) );
+
+    bool ran = reactor.run();
+
+    // Whatever was collected since the last periodic save
+    if( collector && !costs.save( costsPath ) )
     {
+        return EXIT_IO_ERR;
     }
 
-    bool isValid() const
+    if( !ran )
     {
-        return m_hostId &&
-               !m_name.empty() &&
-               !m_ip.empty() &&
-               m_maxJobs &&
-               !m_platform.empty();
+        return EXIT_CONNECTION_ERR;
     }
 
-private:
-    uint32_t m_hostId;
-    std::string m_name;
-    std::string m_ip;
-    uint32_t m_maxJobs;
-    bool m_noRemote;
-    bool m_offline;
-    std::string m_platform;
-};
+    return recordRes;
+}
 
-class ColumnHeader
+int watchSessions( std::vector<OutputSpec>& specs )
 {
-public:
-    ColumnHeader( Alignment alignment, Encoding encoding, const std::string& name )
-        : m_alignment( alignment )
-        , m_encoding( encoding )
-        , m_name( name )
-    {
-    }
+    sigset_t stopSignals;
 
-    ColumnHeader( Alignment alignment, Encoding encoding, const std::string&& name )
-        : m_alignment( alignment )
-        , m_encoding( encoding )
-        , m_name( std::move( name ) )
-    {
-    }
+    sigemptyset( &stopSignals );
+    sigaddset( &stopSignals, SIGINT );
+    sigaddset( &stopSignals, SIGTERM );
 
-public:
-    Alignment alignment() const
-    {
-        return m_alignment;
-    }
+    // Delivered through the descriptor instead, as exiting from a handler
+    // would skip the destructors
+    int signalFd = -1;
 
-    Encoding encoding() const
+    if( sigprocmask( SIG_BLOCK, &stopSignals, nullptr ) == 0 )
     {
-        return m_encoding;
+        signalFd = signalfd( -1, &stopSignals, SFD_NONBLOCK | SFD_CLOEXEC );
     }
 
-    const std::string& name() const
+    if( signalFd < 0 )
     {
-        return m_name;
+        int lastErrno = errno;
+
+        PRINT_ERR( "signalfd(): (%d) %s\n", lastErrno, strerror( lastErrno ) );
+
+        return EXIT_IO_ERR;
     }
 
-private:
-    Alignment m_alignment;
-    Encoding m_encoding;
-    std::string m_name;
-};
+    int res = watchSessions( specs, signalFd );
 
-// Other functions
+    close( signalFd );
+
+    return res;
+}
 
-const char* MsgTypeToStr( MsgType msgType )
+int followEvents()
 {
-    switch( msgType )
+    std::unique_ptr<EventReader> reader = EventReader::open( followName, false );
+
+    if( !reader )
     {
-        case MsgType::M_MON_GET_CS:
-            return "M_MON_GET_CS";
+        return EXIT_IO_ERR;
+    }
 
-        case MsgType::M_MON_JOB_BEGIN:
-            return "M_MON_JOB_BEGIN";
+    EventRecord record;
 
-        case MsgType::M_MON_JOB_DONE:
-            return "M_MON_JOB_DONE";
+    while( true )
+    {
+        uint64_t missed = 0;
+        bool any = false;
 
-        case MsgType::M_MON_LOCAL_JOB_BEGIN:
-            return "M_MON_LOCAL_JOB_BEGIN";
+        while( reader->next( record, missed ) == EventReader::Result::Event )
+        {
+            if( missed )
+            {
+                PRINT_WARN( "Fell behind, %llu events missed.\n", static_cast<unsigned long long>( missed ) );
+                missed = 0;
+            }
 
-        case MsgType::M_MON_STATS:
-            return "M_MON_STATS";
+            printf( "%llu\t%lld\t%s\t%u\t%u\t%u\t%u\t%d\t%s\t%s\n", static_cast<unsigned long long>( record.seq ), static_cast<long long>( record.timestamp ),
+                    EventTypeToStr( record.type ), record.scheduler, record.hostId, record.jobId, record.value, record.flags, record.name, record.platform );
+            any = true;
+        }
+
+        if( any )
+        {
+            fflush( stdout );
+        }
 
-        default:
-            return "<Unknown>";
+        poll( nullptr, 0, EVENT_FOLLOW_TICK );
     }
 }
 
-icu::UnicodeString renderTable( const std::vector<ColumnHeader>& header, const std::vector<std::string>& strings, bool plain, bool ascii )
+int printNetworks()
 {
-    auto columnCount = header.size();
-    auto rowCount = strings.size() / columnCount;
+    Reactor reactor( ioBackend );
+    std::vector<SchedulerInfo> schedulers;
 
-    std::vector<std::size_t> colMaxLens( columnCount );
+    PRINT_INFO( "Looking for schedulers...\n" );
 
-    std::unique_ptr<icu::Transliterator> trans;
-    std::vector<icu::UnicodeString> data( columnCount * ( rowCount + 1 ) );
-    std::vector<std::size_t> lens( columnCount * ( rowCount + 1 ) );
+    reactor.spawn( awaitInto( listSchedulers( reactor, timeout ), schedulers ) );
 
-    // Init Transliterator
-    if( ascii )
+    if( !reactor.run() )
     {
-        icu::ErrorCode errorCode;
-        trans.reset( icu::Transliterator::createInstance( "Latin-ASCII", UTRANS_FORWARD, errorCode ) );
-
-        if( errorCode.isFailure() )
-        {
-            PRINT_ERR( "icu::Transliterator::createInstance(): %s\n", errorCode.errorName() );
-            std::exit( EXIT_LIBRARY_ERR );
-        }
+        return EXIT_CONNECTION_ERR;
     }
 
-    // If needed, treat as UnicodeString and possibly transliterate,
-    // otherwise just determine column length and store back a string
-    for( std::size_t c = 0; c < columnCount; ++c )
+    if( schedulers.empty() )
     {
-        std::size_t& maxLen = colMaxLens[c];
+        PRINT_ERR( "No schedulers found.\n" );
 
-        for( std::size_t r = 0; r < rowCount + 1; ++r )
-        {
-            std::size_t& len = lens[columnCount * r + c];
-            icu::UnicodeString& res = data[columnCount * r + c];
+        return EXIT_NO_DATA;
+    }
 
-            const std::string& origStr = r == 0 ? header[c].name() : strings[columnCount * (r - 1) + c];
-            const Encoding encoding = header[c].encoding();
+    std::vector<QueryResult> results( withCapacity ? schedulers.size() : 0 );
 
-            if( r == 0 || encoding == Encoding::UTF8 )
-            {
-                res = std::move( icu::UnicodeString::fromUTF8( origStr ) );
-            }
-            else
-            {
-                res = std::move( icu::UnicodeString( origStr.c_str(), customEncoding.c_str() ) );
-            }
+    if( withCapacity )
+    {
+        long deadlineTimestamp = deadline < 0 ? -1 : getTimestamp() + deadline;
 
-            if( trans )
-            {
-                trans->transliterate( res );
-            }
+        for( std::size_t i = 0; i < schedulers.size(); ++i )
+        {
+            QueryTarget target { schedulers[i].netName, schedulers[i].addr, schedulers[i].port, timeout, rtimeout, deadlineTimestamp, monitorClient };
 
-            len = static_cast<std::size_t>( res.length() );
+            results[i].exitCode = EXIT_CONNECTION_ERR;
+            reactor.spawn( runQueryInto( reactor, std::move( target ), results[i] ) );
+        }
 
-            // Add 1 char margin to the first and last column
-            if( !plain )
-            {
-                if( c == 0 )
-                {
-                    res.insert( 0, ' ' );
-                    ++len;
-                }
-                else if( c == columnCount - 1 )
-                {
-                    res.append( ' ' );
-                    ++len;
-                }
-            }
+        if( !reactor.run() )
+        {
+            return EXIT_CONNECTION_ERR;
+        }
+    }
 
-            maxLen = std::max( maxLen, len );
+    if( output.brief )
+    {
+        for( const SchedulerInfo& scheduler : schedulers )
+        {
+            printf( "%s\n", scheduler.netName.c_str() );
         }
+
+        return EXIT_OK;
     }
 
-    // Pad the strings
-    for( std::size_t c = 0; c < columnCount; ++c )
+    if( !output.noTable )
     {
-        const std::size_t& maxLen = colMaxLens[c];
-        const Alignment align = header[c].alignment();
+        std::vector<ColumnHeader> header {
+            { Alignment::Left  , Encoding::UTF8     , "Net name"   },
+            { Alignment::Left  , Encoding::UTF8     , "Address"    },
+            { Alignment::Right , Encoding::UTF8     , "Port"       },
+            { Alignment::Right , Encoding::UTF8     , "Protocol"   }
+        };
 
-        for( std::size_t r = 0; r < rowCount + 1; ++r )
+        if( withCapacity )
         {
-            icu::UnicodeString& str = data[columnCount * r + c];
-            const std::size_t& len = lens[columnCount * r + c];
+            header.emplace_back( Alignment::Right, Encoding::UTF8, "Nodes" );
+            header.emplace_back( Alignment::Right, Encoding::UTF8, "Cores" );
+        }
 
-            if( len < maxLen )
-            {
-                std::size_t lenDiff = maxLen - len;
+        Cells strings;
+        strings.reserve( schedulers.size() * header.size() );
 
-                switch( align )
-                {
-                    case Alignment::Left:
-                        str.append( icu::UnicodeString::fromUTF8( std::string( lenDiff, ' ' ) ) );
-                        break;
+        for( std::size_t i = 0; i < schedulers.size(); ++i )
+        {
+            const SchedulerInfo& scheduler = schedulers[i];
 
-                    case Alignment::Right:
-                        str.insert( 0, icu::UnicodeString::fromUTF8( std::string( lenDiff, ' ' ) ) );
-                        break;
+            strings.emplace_back( scheduler.netName );
+            strings.emplace_back( scheduler.addr );
+            strings.emplace_back( std::to_string( scheduler.port ) );
+            strings.emplace_back( scheduler.protocolVersion < 0 ? "?" : std::to_string( scheduler.protocolVersion ) );
 
-                    case Alignment::Center:
-                        str.insert( 0, icu::UnicodeString::fromUTF8( std::string( lenDiff / 2, ' ' ) ) ).append( icu::UnicodeString::fromUTF8( std::string( lenDiff - lenDiff / 2, ' ' ) ) );
-                        break;
-                }
+            if( withCapacity )
+            {
+                bool isAvailable = ( results[i].exitCode == EXIT_OK );
+
+                strings.emplace_back( isAvailable ? std::to_string( countShownNodes( output, results[i].nodes ) ) : "-" );
+                strings.emplace_back( isAvailable ? std::to_string( countCores( output, results[i].nodes ) ) : "-" );
             }
         }
+
+        printTable( output, header, strings, stdout );
     }
 
-    // Render the table
-    icu::UnicodeString table;
+    printf( "%zu network%s found.\n", schedulers.size(), schedulers.size() == 1 ? "" : "s" );
+
+    return EXIT_OK;
+}
+
+int readBatch( std::vector<OutputSpec>& specs )
+{
+    bool fromStdin = ( batchPath == "-" );
+    FILE* in = fromStdin ? stdin : fopen( batchPath.c_str(), "r" );
 
-    for( std::size_t r = 0; r < rowCount + 1; ++r )
+    if( !in )
     {
-        for( std::size_t c = 0; c < columnCount; ++c )
-        {
-            if( c > 0 )
-            {
-                if( plain )
-                {
-                   table.append( ' ' );
-                }
-                else
-                {
-                    table.append( icu::UnicodeString::fromUTF8( std::string( ascii ? ( " " VERT_LINE_7BIT " " ) : ( " " VERT_LINE_UTF8 " " ) ) ) );
-                }
-            }
+        int lastErrno = errno;
+
+        PRINT_ERR( "Unable to open '%s': (%d) %s\n", batchPath.c_str(), lastErrno, strerror( lastErrno ) );
 
-            table.append( data[columnCount * r + c] );
+        return EXIT_INVALID_ARGS;
+    }
+
+    int res = EXIT_OK;
+    char* lineBuf = nullptr;
+    std::size_t lineBufSize = 0;
+    ssize_t lineLen;
+    unsigned lineNo = 0;
+
+    while( ( lineLen = getline( &lineBuf, &lineBufSize, in ) ) != -1 )
+    {
+        ++lineNo;
+
+        std::string line( lineBuf, lineLen );
+
+        if( !line.empty() && line.back() == '\n' )
+        {
+            line.pop_back();
         }
 
-        table.append( '\n' );
+        std::size_t first = line.find_first_not_of( " \t" );
 
-        // Draw the horizontal line below the header
-        if( r == 0 && !plain )
+        if( first == std::string::npos || line[first] == '#' )
         {
-            for( std::size_t c = 0; c < columnCount; ++c )
-            {
-                if( c > 0 )
-                {
-                    table.append( ascii ? ( HOR_LINE_7BIT CROSS_7BIT HOR_LINE_7BIT ) : ( HOR_LINE_UTF8 CROSS_UTF8 HOR_LINE_UTF8 ) );
-                }
+            continue;
+        }
 
-                for( std::size_t i = 0; i < colMaxLens[c]; ++i )
-                {
-                    table.append( ascii ? HOR_LINE_7BIT : HOR_LINE_UTF8 );
-                }
-            }
+        // Each query starts off with whatever was given on the command line
+        OutputSpec spec = output;
+
+        if( !parseOutputOptions( line, spec ) )
+        {
+            PRINT_ERR( "Invalid query in '%s' at line %u.\n", batchPath.c_str(), lineNo );
 
-            table.append( '\n' );
+            res = EXIT_INVALID_ARGS;
+            break;
         }
+
+        specs.push_back( std::move( spec ) );
+    }
+
+    free( lineBuf );
+
+    if( !fromStdin )
+    {
+        fclose( in );
     }
 
-    return std::move( table );
+    if( res == EXIT_OK && specs.empty() )
+    {
+        PRINT_ERR( "No queries found in '%s'.\n", batchPath.c_str() );
+
+        res = EXIT_INVALID_ARGS;
+    }
+
+    return res;
 }
 
 // And the entry point...
@@ -636,7 +816,7 @@ int main( int argc, char** argv )
         useColor = ( isatty( fd ) == 1 );
     }
 
-    customEncoding.assign( ucnv_getDefaultName() );
+    output.customEncoding.assign( ucnv_getDefaultName() );
 
     // Command-line option parsing
 
@@ -656,6 +836,35 @@ int main( int argc, char** argv )
             { "rtimeout",    required_argument, 0, 'r' },
             { "addr",        required_argument, 0,  1  },
             { "port",        required_argument, 0,  2  },
+            { "deadline",    required_argument, 0,  7  },
+            { "io-backend",  required_argument, 0,  8  },
+            { "monitor-client", required_argument, 0, 38 },
+
+            { "watch",       required_argument, 0,  11 },
+            { "top",         optional_argument, 0,  20 },
+            { "rank",        optional_argument, 0,  33 },
+            { "rank-period", required_argument, 0,  34 },
+            { "serve-stdio", no_argument,       0,  16 },
+            { "publish",     required_argument, 0,  17 },
+            { "follow",      required_argument, 0,  18 },
+            { "record",      required_argument, 0,  21 },
+            { "record-interval", required_argument, 0, 22 },
+
+            { "since",       required_argument, 0,  23 },
+            { "until",       required_argument, 0,  24 },
+            { "step",        required_argument, 0,  25 },
+            { "group-by",    required_argument, 0,  26 },
+            { "forecast",    required_argument, 0,  27 },
+
+            { "snapshot",    required_argument, 0,  28 },
+            { "diff-against", required_argument, 0, 29 },
+
+            { "costs",       required_argument, 0,  35 },
+            { "collect-costs", no_argument,     0,  36 },
+            { "predict",     required_argument, 0,  37 },
+
+            { "list-networks", no_argument,     0,  9  },
+            { "with-capacity", no_argument,     0,  10 },
 
             { "color",       required_argument, 0,  5  },
             { "quiet",       no_argument,       0, 'q' },
@@ -670,6 +879,14 @@ int main( int argc, char** argv )
 
             { "no-offline",  no_argument,       0,  3  },
             { "no-noremote", no_argument,       0,  4  },
+            { "platform",    required_argument, 0,  14 },
+            { "per-platform", no_argument,      0,  15 },
+            { "progressive", no_argument,       0,  19 },
+            { "resolve",     no_argument,       0,  30 },
+            { "resolve-ttl", required_argument, 0,  31 },
+            { "probe",       no_argument,       0,  32 },
+
+            { "batch",       required_argument, 0,  12 },
 
             { 0,             0,                 0,  0  }
         };
@@ -684,7 +901,7 @@ int main( int argc, char** argv )
         switch( optRes )
         {
             case 'h':
-                fprintf( stderr, UsageStr, argv[0], customEncoding.c_str() );
+                fprintf( stderr, UsageStr, argv[0], argv[0], argv[0], output.customEncoding.c_str() );
                 return EXIT_INVALID_ARGS;
 
             case 'v': // version
@@ -700,7 +917,12 @@ int main( int argc, char** argv )
                 return EXIT_INVALID_ARGS;
 
             case 'n':
-                netName.assign( optarg );
+                if( targets.empty() || !targets.back().netName.empty() )
+                {
+                    targets.emplace_back();
+                }
+
+                targets.back().netName.assign( optarg );
                 break;
 
             case 't':
@@ -729,16 +951,16 @@ int main( int argc, char** argv )
                 break;
 
             case 'b':
-                brief = true;
+                output.brief = true;
                 quiet = true;
                 veryQuiet = true;
-                noTable = true;
+                output.noTable = true;
                 break;
 
             case 6: // encoding
-                customEncoding.assign( optarg );
+                output.customEncoding.assign( optarg );
 
-                if( !checkEncoding( customEncoding ) )
+                if( !checkEncoding( output.customEncoding ) )
                 {
                     PRINT_ERR( "Invalid ICU encoding '%s'.\n", optarg );
                     return EXIT_INVALID_ARGS;
@@ -747,23 +969,57 @@ int main( int argc, char** argv )
                 break;
 
             case 'P':
-                plain = true;
+                output.plain = true;
                 break;
 
             case 'A':
-                ascii = true;
+                output.ascii = true;
                 break;
 
             case 'T':
-                noTable = true;
+                output.noTable = true;
                 break;
 
             case 1: // addr
-                schedAddr.assign( optarg );
+                if( targets.empty() || !targets.back().schedAddr.empty() )
+                {
+                    targets.emplace_back();
+                }
+
+                targets.back().schedAddr.assign( optarg );
                 break;
 
             case 2: // port
-                if( sscanf( optarg, "%hu", &schedPort ) != 1 )
+                if( targets.empty() || targets.back().schedPort )
+                {
+                    targets.emplace_back();
+                }
+
+                if( sscanf( optarg, "%hu", &targets.back().schedPort ) != 1 )
+                {
+                    PRINT_ERR( "Invalid argument for '%s'.\n", options[currOpt].name );
+                    return EXIT_INVALID_ARGS;
+                }
+                break;
+
+            case 7: // deadline
+                if( sscanf( optarg, "%u", &deadline ) != 1 )
+                {
+                    PRINT_ERR( "Invalid argument for '%s'.\n", options[currOpt].name );
+                    return EXIT_INVALID_ARGS;
+                }
+                break;
+
+            case 8: // io-backend
+                if( !IoBackend::strToType( optarg, ioBackend ) )
+                {
+                    PRINT_ERR( "Invalid argument for '%s'.\n", options[currOpt].name );
+                    return EXIT_INVALID_ARGS;
+                }
+                break;
+
+            case 38: // monitor-client
+                if( !strToMonitorClient( optarg, monitorClient ) )
                 {
                     PRINT_ERR( "Invalid argument for '%s'.\n", options[currOpt].name );
                     return EXIT_INVALID_ARGS;
@@ -771,11 +1027,43 @@ int main( int argc, char** argv )
                 break;
 
             case 3: // no-offline
-                noOffline = true;
+                output.noOffline = true;
                 break;
 
             case 4: // no-noremote
-                noNoRemote = true;
+                output.noNoRemote = true;
+                break;
+
+            case 14: // platform
+                output.platform.assign( optarg );
+                break;
+
+            case 15: // per-platform
+                output.perPlatform = true;
+                break;
+
+            case 30: // resolve
+                resolveNames = true;
+                break;
+
+            case 31: // resolve-ttl
+                if( !parseDuration( optarg, resolveTtl ) || resolveTtl <= 0 )
+                {
+                    PRINT_ERR( "Invalid argument for '%s'.\n", options[currOpt].name );
+                    return EXIT_INVALID_ARGS;
+                }
+                break;
+
+            case 32: // probe
+                probe = true;
+                break;
+
+            case 19: // progressive
+                progressive = true;
+                break;
+
+            case 12: // batch
+                batchPath.assign( optarg );
                 break;
 
             case 5: // color
@@ -794,12 +1082,188 @@ int main( int argc, char** argv )
                 }
                 break;
 
+            case 11: // watch
+                if( sscanf( optarg, "%u", &watchInterval ) != 1 || watchInterval <= 0 )
+                {
+                    PRINT_ERR( "Invalid argument for '%s'.\n", options[currOpt].name );
+                    return EXIT_INVALID_ARGS;
+                }
+                break;
+
+            case 20: // top
+                topInterval = TOP_INTERVAL_DEFAULT;
+
+                if( optarg && ( sscanf( optarg, "%u", &topInterval ) != 1 || topInterval <= 0 ) )
+                {
+                    PRINT_ERR( "Invalid argument for '%s'.\n", options[currOpt].name );
+                    return EXIT_INVALID_ARGS;
+                }
+                break;
+
+            case 33: // rank
+                rankCount = RANK_COUNT_DEFAULT;
+
+                if( optarg && ( sscanf( optarg, "%u", &rankCount ) != 1 || rankCount <= 0 ) )
+                {
+                    PRINT_ERR( "Invalid argument for '%s'.\n", options[currOpt].name );
+                    return EXIT_INVALID_ARGS;
+                }
+                break;
+
+            case 34: // rank-period
+                if( !parseDuration( optarg, rankPeriod ) || rankPeriod <= 0 )
+                {
+                    PRINT_ERR( "Invalid argument for '%s'.\n", options[currOpt].name );
+                    return EXIT_INVALID_ARGS;
+                }
+                break;
+
+            case 16: // serve-stdio
+                serve = true;
+                break;
+
+            case 17: // publish
+                publishName.assign( optarg );
+                break;
+
+            case 18: // follow
+                followName.assign( optarg );
+                break;
+
+            case 21: // record
+                recordDir.assign( optarg );
+                break;
+
+            case 22: // record-interval
+                if( sscanf( optarg, "%u", &recordInterval ) != 1 || recordInterval <= 0 )
+                {
+                    PRINT_ERR( "Invalid argument for '%s'.\n", options[currOpt].name );
+                    return EXIT_INVALID_ARGS;
+                }
+                break;
+
+            case 23: // since
+            case 24: // until
+                if( !parseHistoryTime( optarg, time( nullptr ), optRes == 23 ? historyQuery.since : historyQuery.until ) )
+                {
+                    PRINT_ERR( "Invalid argument for '%s'.\n", options[currOpt].name );
+                    return EXIT_INVALID_ARGS;
+                }
+                break;
+
+            case 25: // step
+            {
+                long step;
+
+                if( !parseDuration( optarg, step ) || step <= 0 )
+                {
+                    PRINT_ERR( "Invalid argument for '%s'.\n", options[currOpt].name );
+                    return EXIT_INVALID_ARGS;
+                }
+
+                historyQuery.step = step;
+                break;
+            }
+
+            case 26: // group-by
+                if( !strToGroupBy( optarg, historyQuery.groupBy ) )
+                {
+                    PRINT_ERR( "Invalid argument for '%s'.\n", options[currOpt].name );
+                    return EXIT_INVALID_ARGS;
+                }
+                break;
+
+            case 27: // forecast
+                if( !parseDuration( optarg, forecastHorizon ) || forecastHorizon <= 0 )
+                {
+                    PRINT_ERR( "Invalid argument for '%s'.\n", options[currOpt].name );
+                    return EXIT_INVALID_ARGS;
+                }
+                break;
+
+            case 28: // snapshot
+                snapshotPath.assign( optarg );
+                break;
+
+            case 29: // diff-against
+                diffAgainstPath.assign( optarg );
+                break;
+
+            case 35: // costs
+                costsPath.assign( optarg );
+                break;
+
+            case 36: // collect-costs
+                collectCosts = true;
+                break;
+
+            case 37: // predict
+                predictPath.assign( optarg );
+                break;
+
+            case 9: // list-networks
+                listNetworks = true;
+                break;
+
+            case 10: // with-capacity
+                withCapacity = true;
+                break;
+
             case 13: // debug
                 debug = true;
                 break;
         }
     }
 
+    // Commands and their arguments
+    if( optind < argc )
+    {
+        const char* command = argv[optind];
+        int argCount = ( strcmp( command, "history" ) == 0 ) ? 1 : ( strcmp( command, "diff" ) == 0 ) ? 2 : 0;
+
+        if( !argCount || optind + 1 + argCount < argc )
+        {
+            PRINT_ERR( "Unexpected argument '%s'. Try '--help'.\n", argv[optind + ( argCount ? 1 + argCount : 0 )] );
+            return EXIT_INVALID_ARGS;
+        }
+
+        if( optind + 1 + argCount > argc )
+        {
+            PRINT_ERR( "Missing %s of the '%s' command. Try '--help'.\n", argCount == 1 ? "history directory" : "snapshots", command );
+            return EXIT_INVALID_ARGS;
+        }
+
+        if( argCount == 1 )
+        {
+            showHistory = true;
+            historyQuery.dir.assign( argv[optind + 1] );
+        }
+        else
+        {
+            diffPaths[0].assign( argv[optind + 1] );
+            diffPaths[1].assign( argv[optind + 2] );
+        }
+    }
+
+    if( forecastHorizon && !showHistory )
+    {
+        PRINT_ERR( "The '--forecast' option needs a 'history <DIR>' to forecast from. Try '--help'.\n" );
+        return EXIT_INVALID_ARGS;
+    }
+
+    if( !predictPath.empty() && !diffAgainstPath.empty() )
+    {
+        PRINT_ERR( "The '--predict' and '--diff-against' options can't be combined. Try '--help'.\n" );
+        return EXIT_INVALID_ARGS;
+    }
+
+    // These ride along with the sessions of --watch, the other modes run their own
+    if( ( !recordDir.empty() || !publishName.empty() || collectCosts ) && ( serve || topInterval > 0 || rankCount > 0 ) )
+    {
+        PRINT_ERR( "The '--record', '--publish' and '--collect-costs' options can't be combined with '--serve-stdio', '--top' or '--rank'. Try '--help'.\n" );
+        return EXIT_INVALID_ARGS;
+    }
+
     // Getting to it...
 
     if( quiet )
@@ -808,188 +1272,318 @@ int main( int argc, char** argv )
         reset_debug( 0 );
     }
 
-    std::unique_ptr<MsgChannel> channel;
-    std::unique_ptr<DiscoverSched> discover( new DiscoverSched( netName, timeout, schedAddr, schedPort ) );
+    if( listNetworks )
+    {
+        return printNetworks();
+    }
+
+    if( showHistory )
+    {
+        int64_t now = time( nullptr );
 
-    long channelTimestamp = getTimestamp();
+        if( historyQuery.until < 0 )
+        {
+            historyQuery.until = now;
+        }
 
-    PRINT_INFO( "Attempting to connect to the scheduler...\n" );
+        if( historyQuery.since < 0 )
+        {
+            historyQuery.since = historyQuery.until - ( forecastHorizon ? FORECAST_SINCE_DEFAULT : HISTORY_SINCE_DEFAULT );
+        }
 
-    do
+        if( forecastHorizon )
+        {
+            return printForecast( historyQuery, forecastHorizon, output, stdout );
+        }
+
+        // Whole steps only
+        historyQuery.since -= historyQuery.since % historyQuery.step;
+
+        return printHistory( historyQuery, output, stdout );
+    }
+
+    if( !diffPaths[0].empty() )
     {
-        channel.reset( discover->try_get_scheduler() );
+        Snapshot snapshots[2];
 
-        if( discover->timed_out() )
+        if( !readSnapshot( diffPaths[0], snapshots[0] ) || !readSnapshot( diffPaths[1], snapshots[1] ) )
         {
-            return EXIT_CONNECTION_ERR;
+            return EXIT_IO_ERR;
         }
+
+        return printSnapshotDiff( output, snapshots[0], snapshots[1], stdout );
     }
-    while( !channel && ( getTimestamp() - channelTimestamp ) <= timeout );
 
-    // Check this twice since it can be reported with a delay?
-    if( discover->timed_out() )
+    if( !followName.empty() )
     {
-        return EXIT_CONNECTION_ERR;
+        return followEvents();
     }
 
-    if( !channel )
+    if( targets.empty() )
     {
-        PRINT_ERR( "Timed out while trying to connect to the scheduler.\n" );
+        targets.emplace_back();
+    }
 
-        return EXIT_CONNECTION_ERR;
+    long deadlineTimestamp = deadline < 0 ? -1 : getTimestamp() + deadline;
+
+    for( QueryTarget& target : targets )
+    {
+        target.timeout = timeout;
+        target.rtimeout = rtimeout;
+        target.deadline = deadlineTimestamp;
+        target.client = monitorClient;
     }
 
-    channel->setBulkTransfer();
+    if( costsPath.empty() )
+    {
+        costsPath = CompileCosts::defaultPath();
+    }
 
-    if( !channel->send_msg( MonLoginMsg() ) )
+    if( resolveNames )
     {
-        PRINT_ERR( "MsgChannel::send_msg(): Scheduler rejected the MonLoginMsg message.\n" );
+        resolver = std::make_unique<HostResolver>( HostResolver::defaultCachePath(), resolveTtl );
+        output.hostNames = &hostNames;
+    }
 
-        return EXIT_CONNECTION_ERR;
+    if( probe )
+    {
+        if( serve || topInterval > 0 || watchInterval > 0 || !publishName.empty() || !recordDir.empty() )
+        {
+            PRINT_WARN( "Option '--probe' applies to a single query only, ignoring it.\n" );
+            probe = false;
+        }
+        else
+        {
+            output.probes = &probes;
+        }
+    }
+
+    std::vector<OutputSpec> specs;
+
+    if( !batchPath.empty() )
+    {
+        // Read it before querying, so that a mistake doesn't cost a round trip
+        int res = readBatch( specs );
+
+        if( res != EXIT_OK )
+        {
+            return res;
+        }
+    }
+    else
+    {
+        specs.push_back( output );
+    }
+
+    if( serve )
+    {
+        return serveStdio( targets, ioBackend, output );
+    }
+
+    if( topInterval > 0 )
+    {
+        return runTop( targets, ioBackend, output, topInterval );
+    }
+
+    if( rankCount > 0 )
+    {
+        return runRanking( targets, ioBackend, output, rankCount, rankPeriod, watchInterval );
     }
 
-    PRINT_INFO( "Retrieving messages...\n" );
+    if( watchInterval > 0 || !publishName.empty() || !recordDir.empty() || collectCosts )
+    {
+        return watchSessions( specs );
+    }
+
+    if( progressive && ( targets.size() > 1 || !batchPath.empty() || !diffAgainstPath.empty() || !predictPath.empty() || resolveNames || probe ) )
+    {
+        PRINT_WARN( "Option '--progressive' applies to a single scheduler without '--batch', '--diff-against', '--predict', '--resolve' or '--probe' only, ignoring it.\n" );
+        progressive = false;
+    }
 
-    struct pollfd pollData { channel->fd, POLLIN | POLLPRI, 0 };
+    // Read it before querying, for the same reason as the batch
+    Snapshot diffBase;
 
-    std::vector<std::unique_ptr<NodeInfo>> nodes;
-    uint32_t hostIdMax = 0;
+    if( !diffAgainstPath.empty() && !readSnapshot( diffAgainstPath, diffBase ) )
+    {
+        return EXIT_IO_ERR;
+    }
 
-    int pollRes;
-    bool wasPollUseful;
+    BuildCosts buildCosts;
 
-    do
+    if( !predictPath.empty() )
     {
-        pollRes = poll( &pollData, 1, rtimeout );
-        wasPollUseful = false;
-        static uint32_t msgNo = 0;
+        CompileCosts costs;
 
-        if( pollRes < 0 )
+        if( !costs.load( costsPath ) || !readBuildCosts( predictPath, costs, buildCosts ) )
         {
-            int lastErrno = errno;
+            return EXIT_IO_ERR;
+        }
+    }
 
-            PRINT_ERR( "poll(): (%d) %s\n", lastErrno, strerror( lastErrno ) );
+    std::vector<QueryResult> results( targets.size() );
 
-            return EXIT_CONNECTION_ERR;
+    if( targets.size() > 1 )
+    {
+        // Query all the schedulers at once, so that the slowest one decides how long it takes
+        Reactor reactor( ioBackend );
+
+        for( std::size_t i = 0; i < targets.size(); ++i )
+        {
+            results[i].exitCode = EXIT_CONNECTION_ERR;
+            reactor.spawn( runQueryInto( reactor, targets[i], results[i] ) );
         }
-        else if( pollRes > 0 )
+
+        if( !reactor.run() )
         {
-            while( !channel->read_a_bit() || channel->has_msg() )
-            {
-                std::unique_ptr<Msg> msg( channel->get_msg() );
+            return EXIT_CONNECTION_ERR;
+        }
+    }
+    else
+    {
+        const QueryTarget& target = targets.front();
+        Query query( target.netName, timeout, rtimeout, target.schedAddr, target.schedPort, target.client );
+        query.setDeadline( deadlineTimestamp );
 
-                if( !msg )
-                {
-                    PRINT_ERR( "MsgChannel::get_msg(): No messages received from the scheduler.\n" );
+        std::unique_ptr<ProgressiveTable> table;
+        std::size_t printedCount = 0;
 
-                    return EXIT_CONNECTION_ERR;
-                }
+        if( progressive )
+        {
+            table = std::make_unique<ProgressiveTable>( specs.front(), stdout );
+        }
+
+        auto printNewNodes = [&] ()
+        {
+            for( ; table && printedCount < query.nodes().size(); ++printedCount )
+            {
+                table->addNode( *query.nodes()[printedCount] );
+            }
+        };
 
-                bool isMsgUseful = false;
-                ++msgNo;
+        short revents = 0;
 
-                if( msg->type == M_MON_STATS )
-                {
-                    const MonStatsMsg* statsMsg = dynamic_cast<MonStatsMsg*>(msg.get());
+        while( !query.process( revents ) )
+        {
+            printNewNodes();
 
-                    PRINT_DEBUG( "\nMessage %u:\n-\n%s-\n", msgNo, statsMsg->statmsg.c_str() );
+            struct pollfd pollData { query.fd(), query.events(), 0 };
 
-                    auto nodeInfo = std::move( NodeInfo::create( statsMsg->hostid, statsMsg->statmsg ) );
+            int pollRes = poll( &pollData, 1, query.pollTimeout() );
 
-                    if( nodeInfo && nodeInfo->hostId() > hostIdMax)
-                    {
-                        // Keep track of highest hostId in case the scheduler sends multiple copies of the same hostInfos
-                        hostIdMax = nodeInfo->hostId();
-                        nodes.push_back( std::move( nodeInfo ) );
-                        wasPollUseful |= ( isMsgUseful = true );
-                    }
-                }
-                else if( msg->type == M_END )
-                {
-                    PRINT_ERR( "Received M_END (%d). Scheduler has quit.\n", M_END );
+            if( pollRes < 0 && errno != EINTR )
+            {
+                int lastErrno = errno;
 
-                    return EXIT_CONNECTION_ERR;
-                }
-                else
-                {
-                    PRINT_DEBUG( "Message %u of type %s (%d) ignored\n", msgNo, MsgTypeToStr( msg->type ), msg->type );
-                }
+                PRINT_ERR( "poll(): (%d) %s\n", lastErrno, strerror( lastErrno ) );
 
-                if( !isMsgUseful )
-                {
-                    PRINT_DEBUG( "Message %u considered useless\n", msgNo );
-                }
+                return EXIT_CONNECTION_ERR;
             }
+
+            revents = pollRes > 0 ? pollData.revents : 0;
         }
-    } while( pollRes != 0 && wasPollUseful );
 
-    if( nodes.empty() ||
-        std::all_of( nodes.cbegin(), nodes.cend(), [] ( const std::unique_ptr<NodeInfo>& node ) -> bool
+        printNewNodes();
+
+        results.front().exitCode = query.exitCode();
+        results.front().nodes = query.takeNodes();
+
+        if( table && results.front().exitCode == EXIT_OK )
         {
-            return ( noOffline && node->isOffline() ) || ( noNoRemote && node->noRemote() );
-        } ) )
+            results.front().exitCode = table->finish( results.front().nodes );
+        }
+    }
+
+    bool anyRetrieved = false;
+
+    for( const QueryResult& result : results )
     {
-        PRINT_ERR( "No useful data retrieved.\n" );
+        anyRetrieved = anyRetrieved || result.exitCode == EXIT_OK;
+    }
 
-        return EXIT_NO_DATA;
+    if( !snapshotPath.empty() && anyRetrieved && !writeSnapshot( snapshotPath, makeSnapshot( targets, results ) ) )
+    {
+        return EXIT_IO_ERR;
     }
-    else
+
+    if( progressive )
     {
-        std::uint32_t coreCount = std::accumulate( nodes.cbegin(), nodes.cend(), static_cast<std::uint32_t>( 0 ), [] ( std::uint32_t count, const std::unique_ptr<NodeInfo>& node )
+        return results.front().exitCode;
+    }
+
+    if( !diffAgainstPath.empty() )
+    {
+        if( !anyRetrieved )
         {
-            if( !node->noRemote() && !node->isOffline() )
-            {
-                return count + node->maxJobs();
-            }
-            else
+            return results.front().exitCode;
+        }
+
+        // The nodes of the schedulers that didn't answer would all show up as
+        // removed otherwise
+        for( std::size_t i = 0; i < targets.size(); ++i )
+        {
+            if( results[i].exitCode != EXIT_OK )
             {
-                return count;
+                const std::string label = targets[i].label();
+
+                PRINT_WARN( "No nodes retrieved from %s, leaving it out of the comparison.\n", label.c_str() );
+                std::erase_if( diffBase.nodes, [&label] ( const SnapshotNode& node ) { return node.scheduler == label; } );
             }
-        } );
+        }
 
-        std::uint32_t nodeCount = std::count_if( nodes.cbegin(), nodes.cend(), [] ( const std::unique_ptr<NodeInfo>& node ) { return ( !noOffline || !node->isOffline() ) && ( !noNoRemote || !node->noRemote() ); } );
+        return printSnapshotDiff( output, diffBase, makeSnapshot( targets, results ), stdout );
+    }
 
-        if( brief )
+    if( !predictPath.empty() )
+    {
+        if( !anyRetrieved )
         {
-            printf( "%u\n", coreCount );
+            return results.front().exitCode;
         }
-        else
+
+        // Whatever the other builds occupy is unknown to a single query, so
+        // all the cores count as free slots
+        uint32_t slots = 0;
+
+        for( const QueryResult& result : results )
         {
-            if( !noTable )
-            {
-                const std::vector<ColumnHeader> header {
-                    { Alignment::Right , Encoding::UTF8     , "Node #"     },
-                    { Alignment::Center, Encoding::UTF8     , "Offline?"   },
-                    { Alignment::Center, Encoding::UTF8     , "No remote?" },
-                    { Alignment::Left  , Encoding::Custom   , "Name"       },
-                    { Alignment::Left  , Encoding::UTF8     , "IP"         },
-                    { Alignment::Right , Encoding::UTF8     , "Cores"      },
-                    { Alignment::Left  , Encoding::UTF8     , "Platform"   }
-                };
-
-                std::vector<std::string> strings;
-                strings.reserve( nodeCount * header.size() );
-
-                for( const auto& node : nodes )
-                {
-                    if( ( !noOffline || !node->isOffline() ) && ( !noNoRemote || !node->noRemote() ) )
-                    {
-                        strings.emplace_back( std::to_string( node->hostId() ) );
-                        strings.emplace_back( node->isOffline() ? ( ascii ? TICK_7BIT : TICK_UTF8 ) : ( ascii ? NO_TICK_7BIT : NO_TICK_UTF8 ) );
-                        strings.emplace_back( node->noRemote()  ? ( ascii ? TICK_7BIT : TICK_UTF8 ) : ( ascii ? NO_TICK_7BIT : NO_TICK_UTF8 ) );
-                        strings.push_back( node->name() );
-                        strings.push_back( node->ip() );
-                        strings.emplace_back( std::to_string( node->maxJobs() ) );
-                        strings.push_back( node->platform() );
-                    }
-                }
+            slots += ( result.exitCode == EXIT_OK ) ? countCores( output, result.nodes ) : 0;
+        }
 
-                u_fputs( renderTable( header, strings, plain, ascii ).insert( 0, '\n' ).getTerminatedBuffer(), u_get_stdout() );
-            }
+        return printPrediction( output, buildCosts, slots, stdout );
+    }
 
-            printf( "%u node%s, %u core%s total.\n", nodeCount, nodeCount == 1 ? "" : "s", coreCount, coreCount == 1 ? "" : "s" );
+    if( probe )
+    {
+        // Looking the names up meanwhile
+        if( resolver )
+        {
+            resolveHostNames( *resolver, results, getTimestamp() );
         }
 
-        return EXIT_OK;
+        if( !probeAddresses( ioBackend, nodeAddresses( results ), PROBE_PORT, PROBE_TIMEOUT_DEFAULT, deadlineTimestamp, probes ) )
+        {
+            return EXIT_CONNECTION_ERR;
+        }
     }
+
+    if( resolver )
+    {
+        resolveHostNames( *resolver, results, deadlineTimestamp < 0 ? getTimestamp() + RESOLVE_TIMEOUT_DEFAULT : deadlineTimestamp );
+    }
+
+    // Every query is evaluated against the same snapshot
+    int exitCode = EXIT_OK;
+
+    for( const OutputSpec& spec : specs )
+    {
+        int res = printResults( spec, targets, results );
+
+        if( exitCode == EXIT_OK )
+        {
+            exitCode = res;
+        }
+    }
+
+    return exitCode;
 }
@@ -0,0 +1,101 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+/*
+    C interface of libicequery, allowing a query to be embedded into a
+    foreign event loop. A typical driver looks like:
+
+        icequery_t* query = icequery_new( NULL, NULL, 0, 2000, 2000 );
+
+        while( icequery_process( query, revents ) == ICEQUERY_PENDING )
+        {
+            wait for icequery_fd() to report icequery_events(), at most
+            icequery_timeout() msecs, and store the ready events in revents
+            (0 on timeout)
+        }
+
+        if( icequery_exit_code( query ) == 0 )
+        {
+            icequery_node( query, ... );
+        }
+
+        icequery_free( query );
+
+    icequery_fd() may change after every call to icequery_process(), so it
+    has to be re-registered with the loop each time.
+*/
+
+#ifndef ICEQUERY_H
+#define ICEQUERY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct icequery icequery_t;
+
+typedef struct icequery_node
+{
+    uint32_t host_id;
+    const char* name;
+    const char* ip;
+    uint32_t max_jobs;
+    int no_remote;
+    int offline;
+    const char* platform;
+} icequery_node_t;
+
+enum
+{
+    ICEQUERY_FAILED = -1,
+    ICEQUERY_PENDING = 0,
+    ICEQUERY_DONE = 1
+};
+
+/* 0: silent, 1: errors and progress, 2: debug output */
+void icequery_set_verbosity( int level );
+
+/* Any of net_name and addr can be NULL, port can be 0; NULL on failure */
+icequery_t* icequery_new( const char* net_name, const char* addr, uint16_t port, int timeout, int rtimeout );
+void icequery_free( icequery_t* query );
+
+int icequery_fd( const icequery_t* query );
+short icequery_events( const icequery_t* query );
+int icequery_timeout( const icequery_t* query );
+
+/* Returns one of ICEQUERY_* values, ICEQUERY_FAILED if the query
+   couldn't go on (as on running out of memory) */
+int icequery_process( icequery_t* query, short revents );
+
+/* One of icequery's exit codes, valid once no longer ICEQUERY_PENDING */
+int icequery_exit_code( const icequery_t* query );
+
+size_t icequery_node_count( const icequery_t* query );
+
+/* Strings stay valid until icequery_free(), returns 0 on success */
+int icequery_node( const icequery_t* query, size_t index, icequery_node_t* node );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ICEQUERY_H */
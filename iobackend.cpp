@@ -0,0 +1,870 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "iobackend.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>      // strerror(), memset()
+#include <unordered_map>
+
+#include <poll.h>
+#include <unistd.h>     // close()
+#include <sys/epoll.h>
+#include <sys/socket.h> // recv()
+
+#ifdef ICEQUERY_WITH_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "common.h"
+
+// Consts
+
+#define RECV_BUFFER_SIZE            4096
+
+#define EPOLL_MAX_EVENTS            256
+
+#define URING_ENTRIES               256
+#define URING_BUFFER_COUNT          256
+#define URING_BUFFER_GROUP          0
+
+// IoBackend
+
+IoBackend::IoBackend()
+    : m_syscalls( 0 )
+{
+}
+
+IoBackend::~IoBackend()
+{
+}
+
+const char* IoBackend::typeToStr( Type type )
+{
+    switch( type )
+    {
+        case Type::Poll:
+            return "poll";
+
+        case Type::Epoll:
+            return "epoll";
+
+        case Type::IoUring:
+            return "io_uring";
+    }
+
+    return "<Unknown>";
+}
+
+bool IoBackend::strToType( const char* str, Type& type )
+{
+    for( Type candidate : { Type::Poll, Type::Epoll, Type::IoUring } )
+    {
+        if( strcmp( str, typeToStr( candidate ) ) == 0 )
+        {
+            type = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// ReadinessBackend
+
+// Common part of the backends that only report readiness and thus have to
+// receive on their own
+class ReadinessBackend : public IoBackend
+{
+protected:
+    ReadinessBackend()
+        : m_usedBuffers( 0 )
+    {
+    }
+
+    void releaseBuffers()
+    {
+        m_usedBuffers = 0;
+    }
+
+    // Receives once from a readable descriptor, returns false once there's
+    // nothing more to receive from it
+    bool receiveFrom( int fd, std::vector<IoEvent>& events )
+    {
+        if( m_usedBuffers == m_buffers.size() )
+        {
+            m_buffers.emplace_back( new char[RECV_BUFFER_SIZE] );
+        }
+
+        char* buffer = m_buffers[m_usedBuffers].get();
+        ssize_t res = recv( fd, buffer, RECV_BUFFER_SIZE, MSG_DONTWAIT );
+        ++m_syscalls;
+
+        if( res < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) )
+        {
+            return true;
+        }
+
+        ++m_usedBuffers;
+        events.push_back( { fd, 0, buffer, res < 0 ? -errno : static_cast<int>( res ) } );
+
+        return res > 0;
+    }
+
+private:
+    std::vector<std::unique_ptr<char[]>> m_buffers;
+    std::size_t m_usedBuffers;
+};
+
+// PollBackend
+
+class PollBackend : public ReadinessBackend
+{
+private:
+    struct Interest
+    {
+        short events;
+        bool receiving;
+    };
+
+public:
+    Type type() const override
+    {
+        return Type::Poll;
+    }
+
+    bool watch( int fd, short events ) override
+    {
+        m_interests[fd].events = events;
+
+        return true;
+    }
+
+    void unwatch( int fd ) override
+    {
+        auto it = m_interests.find( fd );
+
+        if( it != m_interests.end() )
+        {
+            it->second.events = 0;
+
+            if( !it->second.receiving )
+            {
+                m_interests.erase( it );
+            }
+        }
+    }
+
+    bool receive( int fd ) override
+    {
+        m_interests[fd].receiving = true;
+
+        return true;
+    }
+
+    bool wait( int timeout, std::vector<IoEvent>& events ) override
+    {
+        releaseBuffers();
+
+        m_pollData.clear();
+
+        for( const auto& interest : m_interests )
+        {
+            m_pollData.push_back( { interest.first, static_cast<short>( interest.second.events | ( interest.second.receiving ? POLLIN : 0 ) ), 0 } );
+        }
+
+        int pollRes = poll( m_pollData.data(), m_pollData.size(), timeout );
+        ++m_syscalls;
+
+        if( pollRes < 0 )
+        {
+            return errno == EINTR;
+        }
+
+        for( const struct pollfd& data : m_pollData )
+        {
+            if( !data.revents )
+            {
+                continue;
+            }
+
+            Interest& interest = m_interests[data.fd];
+
+            if( interest.receiving && !receiveFrom( data.fd, events ) )
+            {
+                interest.receiving = false;
+            }
+
+            if( interest.events )
+            {
+                events.push_back( { data.fd, data.revents, nullptr, 0 } );
+                interest.events = 0;
+            }
+
+            if( !interest.events && !interest.receiving )
+            {
+                m_interests.erase( data.fd );
+            }
+        }
+
+        return true;
+    }
+
+private:
+    std::unordered_map<int, Interest> m_interests;
+    std::vector<struct pollfd> m_pollData;
+};
+
+// EpollBackend
+
+class EpollBackend : public ReadinessBackend
+{
+public:
+    static std::unique_ptr<IoBackend> create()
+    {
+        int epollFd = epoll_create1( EPOLL_CLOEXEC );
+
+        if( epollFd < 0 )
+        {
+            int lastErrno = errno;
+
+            PRINT_ERR( "epoll_create1(): (%d) %s\n", lastErrno, strerror( lastErrno ) );
+
+            return std::unique_ptr<IoBackend>();
+        }
+
+        return std::unique_ptr<IoBackend>( new EpollBackend( epollFd ) );
+    }
+
+    ~EpollBackend()
+    {
+        close( m_epollFd );
+    }
+
+public:
+    Type type() const override
+    {
+        return Type::Epoll;
+    }
+
+    bool watch( int fd, short events ) override
+    {
+        // poll() and epoll share the event bit values on Linux
+        return control( fd, static_cast<uint32_t>( events ) | EPOLLONESHOT );
+    }
+
+    void unwatch( int fd ) override
+    {
+        if( !m_receiving.count( fd ) )
+        {
+            epoll_ctl( m_epollFd, EPOLL_CTL_DEL, fd, nullptr );
+            ++m_syscalls;
+        }
+    }
+
+    bool receive( int fd ) override
+    {
+        m_receiving[fd] = true;
+
+        return control( fd, EPOLLIN );
+    }
+
+    bool wait( int timeout, std::vector<IoEvent>& events ) override
+    {
+        releaseBuffers();
+
+        struct epoll_event epollEvents[EPOLL_MAX_EVENTS];
+
+        int res = epoll_wait( m_epollFd, epollEvents, EPOLL_MAX_EVENTS, timeout );
+        ++m_syscalls;
+
+        if( res < 0 )
+        {
+            return errno == EINTR;
+        }
+
+        for( int i = 0; i < res; ++i )
+        {
+            int fd = epollEvents[i].data.fd;
+
+            if( m_receiving.count( fd ) )
+            {
+                if( !receiveFrom( fd, events ) )
+                {
+                    m_receiving.erase( fd );
+                    epoll_ctl( m_epollFd, EPOLL_CTL_DEL, fd, nullptr );
+                    ++m_syscalls;
+                }
+            }
+            else
+            {
+                events.push_back( { fd, static_cast<short>( epollEvents[i].events ), nullptr, 0 } );
+            }
+        }
+
+        return true;
+    }
+
+private:
+    EpollBackend( int epollFd )
+        : m_epollFd( epollFd )
+    {
+    }
+
+    // Re-arms the descriptor, which might have been closed and reused since
+    // it was last seen, so both operations are tried
+    bool control( int fd, uint32_t events )
+    {
+        struct epoll_event event;
+        memset( &event, 0, sizeof( event ) );
+        event.events = events;
+        event.data.fd = fd;
+
+        int res = epoll_ctl( m_epollFd, EPOLL_CTL_MOD, fd, &event );
+        ++m_syscalls;
+
+        if( res < 0 && errno == ENOENT )
+        {
+            res = epoll_ctl( m_epollFd, EPOLL_CTL_ADD, fd, &event );
+            ++m_syscalls;
+        }
+
+        if( res < 0 )
+        {
+            int lastErrno = errno;
+
+            PRINT_ERR( "epoll_ctl(): (%d) %s\n", lastErrno, strerror( lastErrno ) );
+        }
+
+        return res == 0;
+    }
+
+private:
+    int m_epollFd;
+    std::unordered_map<int, bool> m_receiving;
+};
+
+// IoUringBackend
+
+#ifdef ICEQUERY_WITH_IO_URING
+
+// Readiness through one-shot poll requests, receiving through multishot recv
+// requests picking buffers from a ring registered with the kernel, so that a
+// single io_uring_enter() both returns the data and re-provides the buffers
+class IoUringBackend : public IoBackend
+{
+private:
+    enum class Op : uint16_t
+    {
+        Poll = 1,
+        PollRemove,
+        Recv
+    };
+
+    struct ArmedPoll
+    {
+        short events;
+        uint16_t generation;
+    };
+
+public:
+    static std::unique_ptr<IoBackend> create()
+    {
+        std::unique_ptr<IoUringBackend> backend( new IoUringBackend() );
+
+        if( !backend->init() )
+        {
+            return std::unique_ptr<IoBackend>();
+        }
+
+        return std::unique_ptr<IoBackend>( backend.release() );
+    }
+
+    ~IoUringBackend()
+    {
+        if( m_bufferRing != MAP_FAILED )
+        {
+            munmap( m_bufferRing, m_bufferRingSize );
+        }
+
+        if( m_sqes != MAP_FAILED )
+        {
+            munmap( m_sqes, m_sqesSize );
+        }
+
+        if( m_cqRing != MAP_FAILED && m_cqRing != m_sqRing )
+        {
+            munmap( m_cqRing, m_cqRingSize );
+        }
+
+        if( m_sqRing != MAP_FAILED )
+        {
+            munmap( m_sqRing, m_sqRingSize );
+        }
+
+        if( m_ringFd >= 0 )
+        {
+            close( m_ringFd );
+        }
+    }
+
+public:
+    Type type() const override
+    {
+        return Type::IoUring;
+    }
+
+    bool watch( int fd, short events ) override
+    {
+        auto it = m_polls.find( fd );
+
+        if( it != m_polls.end() )
+        {
+            if( it->second.events == events )
+            {
+                return true;
+            }
+
+            unwatch( fd );
+        }
+
+        ArmedPoll& poll = m_polls[fd];
+        poll.events = events;
+        poll.generation = ++m_generation;
+
+        struct io_uring_sqe* sqe = nextSqe();
+
+        if( !sqe )
+        {
+            m_polls.erase( fd );
+            return false;
+        }
+
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll32_events = static_cast<uint16_t>( events );
+        sqe->user_data = userData( Op::Poll, poll.generation, fd );
+
+        return true;
+    }
+
+    void unwatch( int fd ) override
+    {
+        auto it = m_polls.find( fd );
+
+        if( it == m_polls.end() )
+        {
+            return;
+        }
+
+        struct io_uring_sqe* sqe = nextSqe();
+
+        if( sqe )
+        {
+            sqe->opcode = IORING_OP_POLL_REMOVE;
+            sqe->fd = -1;
+            sqe->addr = userData( Op::Poll, it->second.generation, fd );
+            sqe->user_data = userData( Op::PollRemove, 0, fd );
+        }
+
+        m_polls.erase( it );
+    }
+
+    bool receive( int fd ) override
+    {
+        struct io_uring_sqe* sqe = nextSqe();
+
+        if( !sqe )
+        {
+            return false;
+        }
+
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fd;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = URING_BUFFER_GROUP;
+        sqe->user_data = userData( Op::Recv, 0, fd );
+
+        return true;
+    }
+
+    bool wait( int timeout, std::vector<IoEvent>& events ) override
+    {
+        // Whatever was handed out by the previous call is free again
+        recycleBuffers();
+
+        bool hasCompletions = __atomic_load_n( m_cqTail, __ATOMIC_ACQUIRE ) != *m_cqHead;
+
+        if( m_sqTailLocal != m_sqTailSubmitted || ( !hasCompletions && timeout != 0 ) )
+        {
+            struct __kernel_timespec ts;
+            struct io_uring_getevents_arg arg;
+            memset( &arg, 0, sizeof( arg ) );
+
+            if( timeout >= 0 )
+            {
+                ts.tv_sec = timeout / 1000;
+                ts.tv_nsec = ( timeout % 1000 ) * 1000000L;
+                arg.ts = reinterpret_cast<uint64_t>( &ts );
+            }
+
+            unsigned minComplete = ( hasCompletions || timeout == 0 ) ? 0 : 1;
+
+            if( !enter( minComplete, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof( arg ) ) )
+            {
+                return false;
+            }
+        }
+
+        unsigned head = *m_cqHead;
+        unsigned tail = __atomic_load_n( m_cqTail, __ATOMIC_ACQUIRE );
+
+        for( ; head != tail; ++head )
+        {
+            complete( m_cqes[head & m_cqMask], events );
+        }
+
+        __atomic_store_n( m_cqHead, head, __ATOMIC_RELEASE );
+
+        return true;
+    }
+
+private:
+    IoUringBackend()
+        : m_ringFd( -1 )
+        , m_sqRing( MAP_FAILED )
+        , m_cqRing( MAP_FAILED )
+        , m_sqes( MAP_FAILED )
+        , m_sqTailLocal( 0 )
+        , m_sqTailSubmitted( 0 )
+        , m_bufferRing( MAP_FAILED )
+        , m_bufferTail( 0 )
+        , m_generation( 0 )
+    {
+    }
+
+    static uint64_t userData( Op op, uint16_t generation, int fd )
+    {
+        return ( static_cast<uint64_t>( op ) << 48 ) | ( static_cast<uint64_t>( generation ) << 32 ) | static_cast<uint32_t>( fd );
+    }
+
+    bool init()
+    {
+        struct io_uring_params params;
+        memset( &params, 0, sizeof( params ) );
+
+        m_ringFd = syscall( __NR_io_uring_setup, URING_ENTRIES, &params );
+
+        if( m_ringFd < 0 )
+        {
+            int lastErrno = errno;
+
+            PRINT_ERR( "io_uring_setup(): (%d) %s\n", lastErrno, strerror( lastErrno ) );
+
+            return false;
+        }
+
+        if( !( params.features & IORING_FEAT_EXT_ARG ) )
+        {
+            PRINT_ERR( "io_uring: Kernel too old, IORING_FEAT_EXT_ARG is not supported.\n" );
+
+            return false;
+        }
+
+        m_sqEntries = params.sq_entries;
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe );
+
+        if( params.features & IORING_FEAT_SINGLE_MMAP )
+        {
+            m_sqRingSize = m_cqRingSize = std::max( m_sqRingSize, m_cqRingSize );
+        }
+
+        m_sqRing = mmap( nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING );
+
+        if( m_sqRing == MAP_FAILED )
+        {
+            return false;
+        }
+
+        if( params.features & IORING_FEAT_SINGLE_MMAP )
+        {
+            m_cqRing = m_sqRing;
+        }
+        else
+        {
+            m_cqRing = mmap( nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING );
+
+            if( m_cqRing == MAP_FAILED )
+            {
+                return false;
+            }
+        }
+
+        m_sqesSize = params.sq_entries * sizeof( struct io_uring_sqe );
+        m_sqes = mmap( nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES );
+
+        if( m_sqes == MAP_FAILED )
+        {
+            return false;
+        }
+
+        char* sq = static_cast<char*>( m_sqRing );
+        char* cq = static_cast<char*>( m_cqRing );
+
+        m_sqHead = reinterpret_cast<unsigned*>( sq + params.sq_off.head );
+        m_sqTail = reinterpret_cast<unsigned*>( sq + params.sq_off.tail );
+        m_sqMask = *reinterpret_cast<unsigned*>( sq + params.sq_off.ring_mask );
+        m_sqArray = reinterpret_cast<unsigned*>( sq + params.sq_off.array );
+
+        m_cqHead = reinterpret_cast<unsigned*>( cq + params.cq_off.head );
+        m_cqTail = reinterpret_cast<unsigned*>( cq + params.cq_off.tail );
+        m_cqMask = *reinterpret_cast<unsigned*>( cq + params.cq_off.ring_mask );
+        m_cqes = reinterpret_cast<struct io_uring_cqe*>( cq + params.cq_off.cqes );
+
+        m_sqTailLocal = m_sqTailSubmitted = *m_sqTail;
+
+        return initBuffers();
+    }
+
+    bool initBuffers()
+    {
+        m_bufferRingSize = URING_BUFFER_COUNT * sizeof( struct io_uring_buf ) + URING_BUFFER_COUNT * RECV_BUFFER_SIZE;
+        m_bufferRing = mmap( nullptr, m_bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+
+        if( m_bufferRing == MAP_FAILED )
+        {
+            return false;
+        }
+
+        m_buffers = static_cast<char*>( m_bufferRing ) + URING_BUFFER_COUNT * sizeof( struct io_uring_buf );
+
+        struct io_uring_buf_reg reg;
+        memset( &reg, 0, sizeof( reg ) );
+        reg.ring_addr = reinterpret_cast<uint64_t>( m_bufferRing );
+        reg.ring_entries = URING_BUFFER_COUNT;
+        reg.bgid = URING_BUFFER_GROUP;
+
+        if( syscall( __NR_io_uring_register, m_ringFd, IORING_REGISTER_PBUF_RING, &reg, 1 ) < 0 )
+        {
+            int lastErrno = errno;
+
+            PRINT_ERR( "io_uring_register(): (%d) %s\n", lastErrno, strerror( lastErrno ) );
+
+            return false;
+        }
+
+        for( uint16_t bid = 0; bid < URING_BUFFER_COUNT; ++bid )
+        {
+            m_recycled.push_back( bid );
+        }
+
+        recycleBuffers();
+
+        return true;
+    }
+
+    struct io_uring_buf* bufferRing()
+    {
+        return static_cast<struct io_uring_buf*>( m_bufferRing );
+    }
+
+    void recycleBuffers()
+    {
+        if( m_recycled.empty() )
+        {
+            return;
+        }
+
+        for( uint16_t bid : m_recycled )
+        {
+            struct io_uring_buf& buf = bufferRing()[m_bufferTail++ & ( URING_BUFFER_COUNT - 1 )];
+            buf.addr = reinterpret_cast<uint64_t>( m_buffers + bid * RECV_BUFFER_SIZE );
+            buf.len = RECV_BUFFER_SIZE;
+            buf.bid = bid;
+        }
+
+        // The ring tail overlays the reserved field of the first entry
+        __atomic_store_n( &bufferRing()[0].resv, m_bufferTail, __ATOMIC_RELEASE );
+
+        m_recycled.clear();
+    }
+
+    struct io_uring_sqe* nextSqe()
+    {
+        if( m_sqTailLocal - __atomic_load_n( m_sqHead, __ATOMIC_ACQUIRE ) >= m_sqEntries && !enter( 0, 0, nullptr, 0 ) )
+        {
+            return nullptr;
+        }
+
+        unsigned index = m_sqTailLocal & m_sqMask;
+        struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>( m_sqes ) + index;
+
+        memset( sqe, 0, sizeof( *sqe ) );
+        m_sqArray[index] = index;
+        ++m_sqTailLocal;
+
+        return sqe;
+    }
+
+    bool enter( unsigned minComplete, unsigned flags, void* arg, std::size_t argSize )
+    {
+        __atomic_store_n( m_sqTail, m_sqTailLocal, __ATOMIC_RELEASE );
+
+        int res = syscall( __NR_io_uring_enter, m_ringFd, m_sqTailLocal - m_sqTailSubmitted, minComplete, flags, arg, argSize );
+        ++m_syscalls;
+
+        if( res < 0 )
+        {
+            int lastErrno = errno;
+
+            if( lastErrno == ETIME || lastErrno == EINTR )
+            {
+                return true;
+            }
+
+            PRINT_ERR( "io_uring_enter(): (%d) %s\n", lastErrno, strerror( lastErrno ) );
+
+            return false;
+        }
+
+        m_sqTailSubmitted += res;
+
+        return true;
+    }
+
+    void complete( const struct io_uring_cqe& cqe, std::vector<IoEvent>& events )
+    {
+        Op op = static_cast<Op>( cqe.user_data >> 48 );
+        uint16_t generation = static_cast<uint16_t>( cqe.user_data >> 32 );
+        int fd = static_cast<int>( static_cast<uint32_t>( cqe.user_data ) );
+
+        switch( op )
+        {
+            case Op::Poll:
+            {
+                auto it = m_polls.find( fd );
+
+                // Removed or replaced in the meantime
+                if( cqe.res == -ECANCELED || it == m_polls.end() || it->second.generation != generation )
+                {
+                    break;
+                }
+
+                m_polls.erase( it );
+                events.push_back( { fd, static_cast<short>( cqe.res < 0 ? POLLERR : cqe.res ), nullptr, 0 } );
+                break;
+            }
+
+            case Op::Recv:
+            {
+                if( cqe.res == -ENOBUFS )
+                {
+                    // Ran out of buffers, they're back after the next recycle
+                    receive( fd );
+                    break;
+                }
+
+                const char* data = nullptr;
+
+                if( cqe.flags & IORING_CQE_F_BUFFER )
+                {
+                    uint16_t bid = static_cast<uint16_t>( cqe.flags >> IORING_CQE_BUFFER_SHIFT );
+
+                    data = m_buffers + bid * RECV_BUFFER_SIZE;
+                    m_recycled.push_back( bid );
+                }
+
+                events.push_back( { fd, 0, data, cqe.res } );
+
+                if( cqe.res > 0 && !( cqe.flags & IORING_CQE_F_MORE ) )
+                {
+                    receive( fd );
+                }
+
+                break;
+            }
+
+            case Op::PollRemove:
+                break;
+        }
+    }
+
+private:
+    int m_ringFd;
+
+    void* m_sqRing;
+    std::size_t m_sqRingSize;
+    void* m_cqRing;
+    std::size_t m_cqRingSize;
+    void* m_sqes;
+    std::size_t m_sqesSize;
+
+    unsigned* m_sqHead;
+    unsigned* m_sqTail;
+    unsigned* m_sqArray;
+    unsigned m_sqMask;
+    unsigned m_sqEntries;
+    unsigned m_sqTailLocal;
+    unsigned m_sqTailSubmitted;
+
+    unsigned* m_cqHead;
+    unsigned* m_cqTail;
+    unsigned m_cqMask;
+    struct io_uring_cqe* m_cqes;
+
+    void* m_bufferRing;
+    std::size_t m_bufferRingSize;
+    char* m_buffers;
+    uint16_t m_bufferTail;
+    std::vector<uint16_t> m_recycled;
+
+    std::unordered_map<int, ArmedPoll> m_polls;
+    uint16_t m_generation;
+};
+
+#endif // ICEQUERY_WITH_IO_URING
+
+// IoBackend factory
+
+std::unique_ptr<IoBackend> IoBackend::create( Type type )
+{
+    switch( type )
+    {
+        case Type::Poll:
+            return std::unique_ptr<IoBackend>( new PollBackend() );
+
+        case Type::Epoll:
+            return EpollBackend::create();
+
+        case Type::IoUring:
+#ifdef ICEQUERY_WITH_IO_URING
+            return IoUringBackend::create();
+#else
+            PRINT_ERR( "io_uring support was not compiled in.\n" );
+            return std::unique_ptr<IoBackend>();
+#endif
+    }
+
+    return std::unique_ptr<IoBackend>();
+}
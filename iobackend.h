@@ -0,0 +1,96 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef ICEQUERY_IOBACKEND_H
+#define ICEQUERY_IOBACKEND_H
+
+#include <cstdint>      // uint64_t
+#include <memory>       // unique_ptr
+#include <vector>
+
+// A readiness or receive notification delivered by an IoBackend
+struct IoEvent
+{
+    int fd;
+
+    // poll() events for readiness notifications, 0 for received data
+    short revents;
+
+    // Received data for descriptors subscribed with receive(), valid until
+    // the next call to IoBackend::wait(); size is 0 on EOF and -errno on
+    // errors
+    const char* data;
+    int size;
+};
+
+// Readiness and receive multiplexing, abstracted so that long-running modes
+// holding many connections can pick the cheapest mechanism available
+class IoBackend
+{
+public:
+    enum class Type : char
+    {
+        Poll,
+        Epoll,
+        IoUring
+    };
+
+public:
+    // Null if the type isn't supported by this build or the kernel
+    static std::unique_ptr<IoBackend> create( Type type );
+
+    static const char* typeToStr( Type type );
+
+    // Accepts the names returned by typeToStr(), false if unknown
+    static bool strToType( const char* str, Type& type );
+
+public:
+    virtual ~IoBackend();
+
+    virtual Type type() const = 0;
+
+    // Arms a one-shot readiness notification for the poll() events, re-arming
+    // an armed descriptor replaces its events
+    virtual bool watch( int fd, short events ) = 0;
+
+    // Disarms a readiness notification which didn't fire
+    virtual void unwatch( int fd ) = 0;
+
+    // Keeps receiving from the descriptor until EOF or error, delivering the
+    // data as IoEvents
+    virtual bool receive( int fd ) = 0;
+
+    // Waits up to timeout msecs (-1 for no limit) and appends the events;
+    // false on errors other than EINTR
+    virtual bool wait( int timeout, std::vector<IoEvent>& events ) = 0;
+
+    // Number of system calls made so far by the backend itself
+    uint64_t syscallCount() const
+    {
+        return m_syscalls;
+    }
+
+protected:
+    IoBackend();
+
+protected:
+    uint64_t m_syscalls;
+};
+
+#endif // ICEQUERY_IOBACKEND_H
@@ -0,0 +1,92 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "jobtracker.h"
+
+#include <icecc/comm.h>
+
+// JobTracker
+
+uint32_t JobTracker::handle( std::size_t scheduler, const Msg& msg )
+{
+    if( msg.type == M_MON_JOB_BEGIN )
+    {
+        const MonJobBeginMsg& beginMsg = dynamic_cast<const MonJobBeginMsg&>( msg );
+
+        if( !m_jobHosts.emplace( std::make_pair( scheduler, beginMsg.job_id ), beginMsg.hostid ).second )
+        {
+            return 0;
+        }
+
+        ++m_jobCounts[std::make_pair( scheduler, beginMsg.hostid )];
+
+        return beginMsg.hostid;
+    }
+
+    if( msg.type == M_MON_JOB_DONE )
+    {
+        const MonJobDoneMsg& doneMsg = dynamic_cast<const MonJobDoneMsg&>( msg );
+        auto it = m_jobHosts.find( std::make_pair( scheduler, doneMsg.job_id ) );
+
+        if( it == m_jobHosts.end() )
+        {
+            return 0;
+        }
+
+        uint32_t hostId = it->second;
+        auto key = std::make_pair( scheduler, hostId );
+
+        m_jobHosts.erase( it );
+
+        if( --m_jobCounts[key] == 0 )
+        {
+            m_jobCounts.erase( key );
+        }
+
+        return hostId;
+    }
+
+    return 0;
+}
+
+std::vector<uint32_t> JobTracker::drop( std::size_t scheduler )
+{
+    m_jobHosts.erase( m_jobHosts.lower_bound( std::make_pair( scheduler, 0u ) ), m_jobHosts.lower_bound( std::make_pair( scheduler + 1, 0u ) ) );
+
+    auto begin = m_jobCounts.lower_bound( std::make_pair( scheduler, 0u ) );
+    auto end = m_jobCounts.lower_bound( std::make_pair( scheduler + 1, 0u ) );
+
+    std::vector<uint32_t> hostIds;
+
+    for( auto it = begin; it != end; ++it )
+    {
+        hostIds.push_back( it->first.second );
+    }
+
+    m_jobCounts.erase( begin, end );
+
+    return hostIds;
+}
+
+uint32_t JobTracker::jobCount( std::size_t scheduler, uint32_t hostId ) const
+{
+    auto it = m_jobCounts.find( std::make_pair( scheduler, hostId ) );
+
+    return it != m_jobCounts.end() ? it->second : 0;
+}
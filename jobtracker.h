@@ -0,0 +1,53 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef ICEQUERY_JOBTRACKER_H
+#define ICEQUERY_JOBTRACKER_H
+
+#include <cstdint>      // uint32_t
+#include <map>
+#include <utility>      // pair
+#include <vector>
+
+class Msg;
+
+// Running remote jobs of the nodes of several schedulers, followed through
+// the monitor's job messages. The schedulers are told apart by their index.
+class JobTracker
+{
+public:
+    // Returns the host id of the node whose job count changed, 0 if none
+    uint32_t handle( std::size_t scheduler, const Msg& msg );
+
+    // Forgets the scheduler's jobs, as it doesn't repeat the running ones after
+    // a reconnect; returns the host ids of the nodes that had any
+    std::vector<uint32_t> drop( std::size_t scheduler );
+
+    uint32_t jobCount( std::size_t scheduler, uint32_t hostId ) const;
+
+private:
+    // Hosts by scheduler and job id, as the end of a job doesn't say where
+    // it ran
+    std::map<std::pair<std::size_t, uint32_t>, uint32_t> m_jobHosts;
+
+    // Job counts by scheduler and host id
+    std::map<std::pair<std::size_t, uint32_t>, uint32_t> m_jobCounts;
+};
+
+#endif // ICEQUERY_JOBTRACKER_H
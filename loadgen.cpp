@@ -0,0 +1,443 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>      // strtoul()
+#include <cstring>      // strerror()
+#include <ctime>        // clock_gettime()
+#include <memory>       // unique_ptr
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+#include <sys/resource.h>       // setrlimit()
+
+#include <icecc/logging.h>
+
+#include "async.h"
+#include "common.h"
+#include "discovery.h"
+#include "query.h"
+#include "standin.h"
+
+// Utility macros
+
+#define STR_INTERNAL( x )               #x
+#define STR( x )                        STR_INTERNAL( x )
+
+// Consts
+
+#define TIMEOUT_DEFAULT             2000
+#define RTIMEOUT_DEFAULT            2000
+
+#define RATES_DEFAULT               "10,50,100,200,500"
+
+// How long every rate is kept up, in seconds
+#define DURATION_DEFAULT            10
+
+#define MAX_SESSIONS_DEFAULT        2000
+
+#define STANDIN_NODES_DEFAULT       500
+#define STANDIN_JOBS_DEFAULT        2
+
+// Types
+
+// Sessions started at one rate and how they went
+struct RateRun
+{
+    unsigned rate;
+    uint64_t started;
+    uint64_t failed;
+
+    // Not started, as too many were still running
+    uint64_t skipped;
+
+    uint32_t inFlight;
+    uint64_t nodes;
+    long lastEndUsecs;
+
+    // Of the successful sessions: logged in, got the last node, finished
+    std::vector<long> loginUsecs;
+    std::vector<long> dumpUsecs;
+    std::vector<long> totalUsecs;
+};
+
+// Global variables
+
+QueryTarget target { std::string(), std::string(), 0, TIMEOUT_DEFAULT, RTIMEOUT_DEFAULT, -1, MonitorClient::Libicecc };
+IoBackend::Type ioBackend = IoBackend::Type::Poll;
+
+std::vector<unsigned> rates;
+long duration = DURATION_DEFAULT;
+uint32_t maxSessions = MAX_SESSIONS_DEFAULT;
+
+// Nodes of the stand-in scheduler, none to use a real one
+uint32_t standInNodes = 0;
+
+// Global consts
+
+const char* UsageStr = \
+R"usage(usage: %s [options...]
+
+Opens monitor sessions against a scheduler the way icequery does (discover or
+connect, log in, take the stats dump, close) at each of the given rates in
+turn, and reports how many failed and how long they took, so that the rate a
+scheduler can take before answering slower is known.
+
+Options:
+
+ -h, --help             : display this info
+ -n, --net-name=<NAME>  : net name of the scheduler, found by broadcasting
+     --addr=<ADDRESS>   : scheduler address to connect to directly
+     --port=<PORT>      : scheduler port for direct connection
+     --stand-in[=<NODES>]
+                        : start a stand-in scheduler on the loopback with NODES
+                          (default: )usage" STR( STANDIN_NODES_DEFAULT ) R"usage() nodes instead, sending job messages
+                          every )usage" STR( STANDIN_JOB_INTERVAL ) R"usage( msecs after the dump like a busy farm
+ -t, --timeout=<MSECS>  : timeout for establishing connection with the scheduler
+                          (default: )usage" STR( TIMEOUT_DEFAULT ) R"usage()
+ -r, --rtimeout=<MSECS> : timeout for retrieving a single message from the
+                          scheduler (default: )usage" STR( RTIMEOUT_DEFAULT ) R"usage()
+     --monitor-client=<CLIENT>
+                        : CLIENT can be: 'libicecc' (default), or 'native'
+     --io-backend=<IO>  : IO can be: 'poll' (default), 'epoll', or 'io_uring'
+
+     --rates=<LIST>     : comma-separated sessions started per second
+                          (default: )usage" RATES_DEFAULT R"usage()
+     --duration=<DURATION>
+                        : how long to keep up each rate (default: )usage" STR( DURATION_DEFAULT ) R"usage(s)
+     --max-sessions=<COUNT>
+                        : sessions running at once at most, the ones over it are
+                          skipped (default: )usage" STR( MAX_SESSIONS_DEFAULT ) R"usage()
+
+ Latencies are given as the median and 99th percentile of the successful
+ sessions, from the start of a session till logging in, till the last node of
+ the dump arrived and till the session ended. A stand-in shares the CPU with
+ the sessions, so its numbers describe the client side rather than a
+ scheduler.
+)usage";
+
+// Utility functions
+
+static long nowUsecs()
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static bool parseRates( const char* str, std::vector<unsigned>& res )
+{
+    res.clear();
+
+    while( *str )
+    {
+        char* end;
+        unsigned long rate = strtoul( str, &end, 10 );
+
+        if( end == str || !rate || ( *end && *end != ',' ) )
+        {
+            return false;
+        }
+
+        res.push_back( static_cast<unsigned>( rate ) );
+        str = *end ? end + 1 : end;
+    }
+
+    return !res.empty();
+}
+
+// In msecs
+static double percentile( std::vector<long>& usecs, unsigned pct )
+{
+    if( usecs.empty() )
+    {
+        return 0;
+    }
+
+    auto nth = usecs.begin() + std::min( usecs.size() - 1, usecs.size() * pct / 100 );
+    std::nth_element( usecs.begin(), nth, usecs.end() );
+
+    return *nth / 1e3;
+}
+
+// Thousands of sessions need as many descriptors
+static void raiseFileLimit()
+{
+    struct rlimit limit;
+
+    if( getrlimit( RLIMIT_NOFILE, &limit ) == 0 && limit.rlim_cur < limit.rlim_max )
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit( RLIMIT_NOFILE, &limit );
+    }
+}
+
+// Load generation
+
+Task<void> runSession( Reactor& reactor, RateRun& run )
+{
+    long start = nowUsecs();
+    long loggedIn = -1;
+    long lastNode = -1;
+    std::size_t nodeCount = 0;
+
+    Query query( target.netName, target.timeout, target.rtimeout, target.schedAddr, target.schedPort, target.client );
+    short revents = 0;
+
+    auto check = [&] ()
+    {
+        if( loggedIn < 0 && query.state() != Query::State::Discovering )
+        {
+            loggedIn = nowUsecs();
+        }
+
+        if( query.nodes().size() > nodeCount )
+        {
+            nodeCount = query.nodes().size();
+            lastNode = nowUsecs();
+        }
+    };
+
+    while( !query.process( revents ) )
+    {
+        check();
+
+        revents = co_await reactor.wait( query.fd(), query.events(), query.deadline() );
+    }
+
+    check();
+
+    long end = nowUsecs();
+
+    --run.inFlight;
+    run.lastEndUsecs = std::max( run.lastEndUsecs, end );
+
+    if( query.exitCode() != EXIT_OK || !nodeCount )
+    {
+        ++run.failed;
+        co_return;
+    }
+
+    run.nodes += nodeCount;
+    run.loginUsecs.push_back( loggedIn - start );
+    run.dumpUsecs.push_back( lastNode - start );
+    run.totalUsecs.push_back( end - start );
+}
+
+Task<void> generateLoad( Reactor& reactor, RateRun& run )
+{
+    const long start = getTimestamp();
+    const uint64_t count = static_cast<uint64_t>( run.rate ) * duration;
+
+    for( uint64_t i = 0; i < count; ++i )
+    {
+        co_await reactor.sleepUntil( start + static_cast<long>( i * 1000 / run.rate ) );
+
+        if( run.inFlight >= maxSessions )
+        {
+            ++run.skipped;
+            continue;
+        }
+
+        ++run.inFlight;
+        ++run.started;
+        reactor.spawn( runSession( reactor, run ) );
+    }
+}
+
+void printRun( RateRun& run, long startUsecs )
+{
+    uint64_t succeeded = run.started - run.failed;
+    double seconds = std::max( run.lastEndUsecs - startUsecs, 1L ) / 1e6;
+
+    printf( "%7u %8llu %8llu %5.1f%% %8llu %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f\n", run.rate, static_cast<unsigned long long>( run.started ),
+            static_cast<unsigned long long>( run.failed ), run.started ? 100.0 * run.failed / run.started : 0.0,
+            static_cast<unsigned long long>( run.skipped ), succeeded / seconds,
+            percentile( run.loginUsecs, 50 ), percentile( run.loginUsecs, 99 ), percentile( run.dumpUsecs, 50 ), percentile( run.dumpUsecs, 99 ),
+            percentile( run.totalUsecs, 50 ), percentile( run.totalUsecs, 99 ), succeeded ? static_cast<double>( run.nodes ) / succeeded : 0.0 );
+    fflush( stdout );
+}
+
+// And the entry point...
+
+int main( int argc, char** argv )
+{
+    parseRates( RATES_DEFAULT, rates );
+
+    // Disable built-in error messages
+    opterr = 0;
+
+    while( true )
+    {
+        static struct option options[] = {
+            { "help",        no_argument,       0, 'h' },
+            { "net-name",    required_argument, 0, 'n' },
+            { "addr",        required_argument, 0,  1  },
+            { "port",        required_argument, 0,  2  },
+            { "stand-in",    optional_argument, 0,  3  },
+            { "timeout",     required_argument, 0, 't' },
+            { "rtimeout",    required_argument, 0, 'r' },
+            { "monitor-client", required_argument, 0, 4 },
+            { "io-backend",  required_argument, 0,  5  },
+            { "rates",       required_argument, 0,  6  },
+            { "duration",    required_argument, 0,  7  },
+            { "max-sessions", required_argument, 0, 8  },
+            { 0,             0,                 0,  0  }
+        };
+
+        int currOpt = 0;
+        int optRes = getopt_long( argc, argv, ":hn:t:r:", options, &currOpt );
+
+        if( optRes == -1 )
+        {
+            break;
+        }
+
+        bool isValid = true;
+        unsigned value;
+
+        switch( optRes )
+        {
+            case 'h':
+                fprintf( stderr, UsageStr, argv[0] );
+                return EXIT_OK;
+
+            case 'n':
+                target.netName.assign( optarg );
+                break;
+
+            case 1: // addr
+                target.schedAddr.assign( optarg );
+                break;
+
+            case 2: // port
+                isValid = sscanf( optarg, "%u", &value ) == 1 && value && value <= UINT16_MAX;
+                target.schedPort = static_cast<uint16_t>( value );
+                break;
+
+            case 3: // stand-in
+                standInNodes = STANDIN_NODES_DEFAULT;
+                isValid = !optarg || ( sscanf( optarg, "%u", &standInNodes ) == 1 && standInNodes );
+                break;
+
+            case 't':
+                isValid = sscanf( optarg, "%d", &target.timeout ) == 1 && target.timeout > 0;
+                break;
+
+            case 'r':
+                isValid = sscanf( optarg, "%d", &target.rtimeout ) == 1 && target.rtimeout > 0;
+                break;
+
+            case 4: // monitor-client
+                isValid = strToMonitorClient( optarg, target.client );
+                break;
+
+            case 5: // io-backend
+                isValid = IoBackend::strToType( optarg, ioBackend );
+                break;
+
+            case 6: // rates
+                isValid = parseRates( optarg, rates );
+                break;
+
+            case 7: // duration
+                isValid = parseDuration( optarg, duration ) && duration > 0;
+                break;
+
+            case 8: // max-sessions
+                isValid = sscanf( optarg, "%u", &maxSessions ) == 1 && maxSessions;
+                break;
+
+            default:
+                PRINT_ERR( "Invalid option '%s'. Try '--help'.\n", argv[optind - 1] );
+                return EXIT_INVALID_ARGS;
+        }
+
+        if( !isValid )
+        {
+            PRINT_ERR( "Invalid argument for '%s'.\n", argv[optind - 1] );
+            return EXIT_INVALID_ARGS;
+        }
+    }
+
+    if( optind < argc )
+    {
+        PRINT_ERR( "Unexpected argument '%s'. Try '--help'.\n", argv[optind] );
+        return EXIT_INVALID_ARGS;
+    }
+
+    // Broadcasting to whatever answers isn't a sane default for a load test
+    if( target.netName.empty() && target.schedAddr.empty() && !standInNodes )
+    {
+        PRINT_ERR( "No scheduler given, use '--net-name', '--addr' or '--stand-in'. Try '--help'.\n" );
+        return EXIT_INVALID_ARGS;
+    }
+
+    raiseFileLimit();
+
+    std::unique_ptr<StandInScheduler> standIn;
+
+    if( standInNodes )
+    {
+        uint32_t msgCount;
+
+        standIn.reset( new StandInScheduler( makeStandInDump( standInNodes, STANDIN_JOBS_DEFAULT, msgCount ) ) );
+
+        if( !standIn->start( ioBackend ) )
+        {
+            return EXIT_CONNECTION_ERR;
+        }
+
+        target.schedAddr.assign( "127.0.0.1" );
+        target.schedPort = standIn->port();
+    }
+
+    printf( "%s, %s client, %ld s per rate%s\n\n", target.label().c_str(), MonitorClientToStr( target.client ), duration,
+            standIn ? ", stand-in scheduler" : "" );
+    printf( "%7s %8s %8s %6s %8s %8s %17s %17s %17s %8s\n", "", "", "", "", "", "", "Login (ms)", "Dump (ms)", "Session (ms)", "" );
+    printf( "%7s %8s %8s %6s %8s %8s %8s %8s %8s %8s %8s %8s %8s\n", "Rate/s", "Started", "Failed", "", "Skipped", "Done/s",
+            "p50", "p99", "p50", "p99", "p50", "p99", "Nodes" );
+
+    // The sessions would flood the terminal otherwise
+    veryQuiet = true;
+    reset_debug( 0 );
+
+    for( unsigned rate : rates )
+    {
+        RateRun run { rate, 0, 0, 0, 0, 0, 0, {}, {}, {} };
+        Reactor reactor( ioBackend );
+
+        long startUsecs = nowUsecs();
+
+        reactor.spawn( generateLoad( reactor, run ) );
+
+        if( !reactor.run() )
+        {
+            return EXIT_CONNECTION_ERR;
+        }
+
+        printRun( run, startUsecs );
+    }
+
+    return EXIT_OK;
+}
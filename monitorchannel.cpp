@@ -0,0 +1,398 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "monitorchannel.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>      // memmove(), strcmp(), strerror()
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>     // close(), read()
+
+#include <icecc/comm.h> // MsgType, PROTOCOL_VERSION
+
+#include "common.h"
+#include "discovery.h"
+
+// Consts
+
+// Reading less at once isn't worth a system call
+#define RECEIVE_MIN                 4096
+
+// Protocol versions beyond this are taken for garbage, as by libicecc
+#define PROTOCOL_VERSION_MAX        ( 1 << 20 )
+
+// Utility functions
+
+static uint32_t readBigEndian32( const char* buf )
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>( buf );
+
+    return ( uint32_t( bytes[0] ) << 24 ) | ( uint32_t( bytes[1] ) << 16 ) | ( uint32_t( bytes[2] ) << 8 ) | bytes[3];
+}
+
+static uint32_t readLittleEndian32( const char* buf )
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>( buf );
+
+    return ( uint32_t( bytes[3] ) << 24 ) | ( uint32_t( bytes[2] ) << 16 ) | ( uint32_t( bytes[1] ) << 8 ) | bytes[0];
+}
+
+// MonitorClient
+
+const char* MonitorClientToStr( MonitorClient client )
+{
+    switch( client )
+    {
+        case MonitorClient::Libicecc:
+            return "libicecc";
+
+        case MonitorClient::Native:
+            return "native";
+    }
+
+    return "";
+}
+
+bool strToMonitorClient( const char* str, MonitorClient& client )
+{
+    for( MonitorClient candidate : { MonitorClient::Libicecc, MonitorClient::Native } )
+    {
+        if( strcmp( str, MonitorClientToStr( candidate ) ) == 0 )
+        {
+            client = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// MonitorChannel
+
+MonitorChannel::MonitorChannel()
+    : m_fd( -1 )
+    , m_state( State::Closed )
+    , m_protocolVersion( 0 )
+    , m_versionsRead( 0 )
+    , m_inBuf( MONITOR_BUFFER_SIZE )
+    , m_begin( 0 )
+    , m_end( 0 )
+{
+}
+
+MonitorChannel::~MonitorChannel()
+{
+    close();
+}
+
+bool MonitorChannel::connect( const std::string& addr, uint16_t port )
+{
+    m_fd = startConnect( addr, port );
+
+    if( m_fd < 0 )
+    {
+        return false;
+    }
+
+    m_state = State::Connecting;
+    queueUint32( PROTOCOL_VERSION, false );
+
+    return true;
+}
+
+short MonitorChannel::events() const
+{
+    switch( m_state )
+    {
+        case State::Connecting:
+            return POLLOUT;
+
+        case State::Closed:
+            return 0;
+
+        default:
+            return m_outBuf.empty() ? POLLIN : POLLIN | POLLOUT;
+    }
+}
+
+bool MonitorChannel::process( short revents )
+{
+    if( m_state == State::Connecting )
+    {
+        if( !revents )
+        {
+            return true;
+        }
+
+        if( !finishConnect( m_fd ) )
+        {
+            close();
+            return false;
+        }
+
+        m_state = State::Handshaking;
+    }
+
+    if( m_state == State::Closed || !flush() )
+    {
+        return false;
+    }
+
+    // Whatever was read before the connection broke can still be taken
+    bool isOpen = receive();
+
+    if( m_state == State::Handshaking && !handshake() )
+    {
+        return false;
+    }
+
+    return isOpen;
+}
+
+bool MonitorChannel::nextFrame( Frame& frame )
+{
+    std::size_t pending = m_end - m_begin;
+
+    // Frames follow the versions, both of them
+    if( m_versionsRead < 2 || pending < 2 * sizeof( uint32_t ) )
+    {
+        return false;
+    }
+
+    const char* data = m_inBuf.data() + m_begin;
+    uint32_t length = readBigEndian32( data );
+
+    if( length < sizeof( uint32_t ) || length > MONITOR_FRAME_MAX )
+    {
+        PRINT_ERR( "MonitorChannel: Malformed frame of %u bytes, closing the connection.\n", length );
+
+        close();
+
+        // Nothing after it can be trusted
+        m_begin = m_end;
+
+        return false;
+    }
+
+    if( pending < sizeof( uint32_t ) + length )
+    {
+        return false;
+    }
+
+    frame.type = readBigEndian32( data + sizeof( uint32_t ) );
+    frame.payload = std::string_view( data + 2 * sizeof( uint32_t ), length - sizeof( uint32_t ) );
+
+    m_begin += sizeof( uint32_t ) + length;
+
+    return true;
+}
+
+bool MonitorChannel::parseStats( std::string_view payload, uint32_t& hostId, std::string_view& stats )
+{
+    if( payload.size() < 2 * sizeof( uint32_t ) )
+    {
+        return false;
+    }
+
+    hostId = readBigEndian32( payload.data() );
+
+    // Counting the terminating zero, which is sent along
+    uint32_t length = readBigEndian32( payload.data() + sizeof( uint32_t ) );
+    payload.remove_prefix( 2 * sizeof( uint32_t ) );
+
+    if( !length )
+    {
+        stats = std::string_view();
+
+        return true;
+    }
+
+    if( length > payload.size() || payload[length - 1] != '\0' )
+    {
+        return false;
+    }
+
+    stats = payload.substr( 0, length - 1 );
+
+    return true;
+}
+
+bool MonitorChannel::flush()
+{
+    std::size_t sent = 0;
+
+    while( sent < m_outBuf.size() )
+    {
+        ssize_t len = send( m_fd, m_outBuf.data() + sent, m_outBuf.size() - sent, MSG_NOSIGNAL );
+
+        if( len >= 0 )
+        {
+            sent += len;
+        }
+        else if( errno == EAGAIN || errno == EWOULDBLOCK )
+        {
+            break;
+        }
+        else if( errno != EINTR )
+        {
+            int lastErrno = errno;
+
+            PRINT_ERR( "send(): (%d) %s\n", lastErrno, strerror( lastErrno ) );
+
+            close();
+            return false;
+        }
+    }
+
+    m_outBuf.erase( 0, sent );
+
+    return true;
+}
+
+bool MonitorChannel::receive()
+{
+    while( true )
+    {
+        std::size_t pending = m_end - m_begin;
+        std::size_t needed = RECEIVE_MIN;
+
+        // The frame being read has to fit in whole, as it's handed out as is
+        if( m_state == State::Ready && pending >= sizeof( uint32_t ) )
+        {
+            std::size_t frameSize = sizeof( uint32_t ) + std::min<uint32_t>( readBigEndian32( m_inBuf.data() + m_begin ), MONITOR_FRAME_MAX );
+
+            if( frameSize <= pending && pending >= MONITOR_BUFFER_SIZE )
+            {
+                // Plenty to take already, the rest waits in the socket
+                return true;
+            }
+
+            needed = std::max( needed, frameSize > pending ? frameSize - pending : 0 );
+        }
+
+        if( m_inBuf.size() - m_end < needed )
+        {
+            memmove( m_inBuf.data(), m_inBuf.data() + m_begin, pending );
+            m_begin = 0;
+            m_end = pending;
+
+            if( m_inBuf.size() - m_end < needed )
+            {
+                m_inBuf.resize( std::max( m_inBuf.size() * 2, m_end + needed ) );
+            }
+        }
+
+        std::size_t room = m_inBuf.size() - m_end;
+        ssize_t len = read( m_fd, m_inBuf.data() + m_end, room );
+
+        if( len > 0 )
+        {
+            m_end += len;
+
+            if( static_cast<std::size_t>( len ) < room )
+            {
+                return true;
+            }
+        }
+        else if( len == 0 )
+        {
+            PRINT_DEBUG( "MonitorChannel: Connection closed by the scheduler\n" );
+
+            close();
+            return false;
+        }
+        else if( errno == EAGAIN || errno == EWOULDBLOCK )
+        {
+            return true;
+        }
+        else if( errno != EINTR )
+        {
+            int lastErrno = errno;
+
+            PRINT_ERR( "read(): (%d) %s\n", lastErrno, strerror( lastErrno ) );
+
+            close();
+            return false;
+        }
+    }
+}
+
+bool MonitorChannel::handshake()
+{
+    while( m_state == State::Handshaking && m_end - m_begin >= sizeof( uint32_t ) )
+    {
+        uint32_t version = readLittleEndian32( m_inBuf.data() + m_begin );
+        m_begin += sizeof( uint32_t );
+
+        if( m_versionsRead++ == 0 )
+        {
+            if( version < MIN_PROTOCOL_VERSION || version > PROTOCOL_VERSION_MAX )
+            {
+                PRINT_ERR( "MonitorChannel: Unsupported protocol version %u of the scheduler.\n", version );
+
+                close();
+                return false;
+            }
+
+            // Both sides settle on the older version
+            m_protocolVersion = std::min<uint32_t>( version, PROTOCOL_VERSION );
+            queueUint32( m_protocolVersion, false );
+        }
+        else
+        {
+            if( version != m_protocolVersion )
+            {
+                PRINT_ERR( "MonitorChannel: Protocol version mismatch (%u, expected %u).\n", version, m_protocolVersion );
+
+                close();
+                return false;
+            }
+
+            m_state = State::Ready;
+
+            // MonLoginMsg has no fields, it's all in the type
+            queueUint32( sizeof( uint32_t ), true );
+            queueUint32( M_MON_LOGIN, true );
+        }
+    }
+
+    return flush();
+}
+
+void MonitorChannel::queueUint32( uint32_t value, bool bigEndian )
+{
+    for( int i = 0; i < 4; ++i )
+    {
+        m_outBuf.push_back( static_cast<char>( value >> ( bigEndian ? 24 - 8 * i : 8 * i ) ) );
+    }
+}
+
+void MonitorChannel::close()
+{
+    if( m_fd >= 0 )
+    {
+        ::close( m_fd );
+        m_fd = -1;
+    }
+
+    m_state = State::Closed;
+    m_outBuf.clear();
+}
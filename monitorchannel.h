@@ -0,0 +1,153 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef ICEQUERY_MONITORCHANNEL_H
+#define ICEQUERY_MONITORCHANNEL_H
+
+#include <cstdint>      // uint16_t, uint32_t
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+    The monitor subset of the scheduler protocol, as spoken by libicecc:
+
+    - both sides send their protocol version as 4 little-endian bytes, then
+      the lower of the two versions the same way, which has to match
+    - each message is then a frame of a 4-byte big-endian length followed by
+      as many bytes: a 4-byte big-endian message type and its fields
+    - strings are a 4-byte big-endian length including the terminating zero,
+      followed by the characters and the zero
+*/
+
+// Frames longer than this are taken for a broken stream
+#define MONITOR_FRAME_MAX           ( 16 * 1024 * 1024 )
+
+// Initial size of the receive buffer, enough for a few hundred stats messages
+#define MONITOR_BUFFER_SIZE         ( 256 * 1024 )
+
+// Which client speaks the monitor protocol
+enum class MonitorClient : char
+{
+    // MsgChannel, decoding every message into a Msg object
+    Libicecc,
+
+    // MonitorChannel
+    Native
+};
+
+const char* MonitorClientToStr( MonitorClient client );
+
+// Accepts the names returned by MonitorClientToStr(), false if unknown
+bool strToMonitorClient( const char* str, MonitorClient& client );
+
+// A monitor connection reading the frames into a reusable buffer. Only the
+// frame header is looked at until the caller asks for more, so that unwanted
+// messages cost nothing but skipping them.
+class MonitorChannel
+{
+public:
+    enum class State : char
+    {
+        Connecting,
+
+        // Exchanging the protocol versions
+        Handshaking,
+
+        // Logged in as a monitor
+        Ready,
+
+        // Closed by the scheduler or broken, frames read before can still be
+        // taken
+        Closed
+    };
+
+    struct Frame
+    {
+        uint32_t type;
+
+        // Following the type, valid till the next call to process()
+        std::string_view payload;
+    };
+
+public:
+    MonitorChannel();
+    ~MonitorChannel();
+
+    MonitorChannel( const MonitorChannel& ) = delete;
+    MonitorChannel& operator=( const MonitorChannel& ) = delete;
+
+public:
+    // Starts connecting to the numeric address or host name without
+    // blocking, false on failure after printing it
+    bool connect( const std::string& addr, uint16_t port );
+
+    int fd() const
+    {
+        return m_fd;
+    }
+
+    // poll() events to wait for on fd()
+    short events() const;
+
+    State state() const
+    {
+        return m_state;
+    }
+
+    // Negotiated with the scheduler, 0 till then
+    uint32_t protocolVersion() const
+    {
+        return m_protocolVersion;
+    }
+
+    // Does whatever the events allow: finishes connecting, exchanges the
+    // versions, logs in and reads all that's there. False once the
+    // connection is closed.
+    bool process( short revents );
+
+    // Takes the next complete frame read, false if there's none
+    bool nextFrame( Frame& frame );
+
+    // Splits an M_MON_STATS payload, the stats viewing it; false if malformed
+    static bool parseStats( std::string_view payload, uint32_t& hostId, std::string_view& stats );
+
+private:
+    bool flush();
+    bool receive();
+    bool handshake();
+    void queueUint32( uint32_t value, bool bigEndian );
+    void close();
+
+private:
+    int m_fd;
+    State m_state;
+    uint32_t m_protocolVersion;
+
+    // Versions received so far during the handshake
+    int m_versionsRead;
+
+    std::string m_outBuf;
+
+    // Read data lives in [m_begin, m_end), the frames taken precede m_begin
+    std::vector<char> m_inBuf;
+    std::size_t m_begin;
+    std::size_t m_end;
+};
+
+#endif // ICEQUERY_MONITORCHANNEL_H
@@ -0,0 +1,180 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "nodeinfo.h"
+
+#include "common.h"
+#include "statsschema.h"
+#include "statsscan.h"
+
+// Stats schema
+
+struct StatsSchema
+{
+    typedef bool ( *Setter )( NodeInfo& node, std::string_view value );
+
+    struct Field
+    {
+        std::string_view key;
+        Setter set;
+    };
+
+    template<std::pmr::string NodeInfo::*Member>
+    static bool setString( NodeInfo& node, std::string_view value )
+    {
+        ( node.*Member ).assign( value );
+        return true;
+    }
+
+    template<typename T, T NodeInfo::*Member>
+    static bool setNumber( NodeInfo& node, std::string_view value )
+    {
+        return parseStatsNumber( value, node.*Member );
+    }
+
+    static bool setNoRemote( NodeInfo& node, std::string_view value )
+    {
+        node.m_noRemote = equalsStatsKey( value, "true" );
+        return true;
+    }
+
+    static bool setState( NodeInfo& node, std::string_view value )
+    {
+        node.m_offline = equalsStatsKey( value, "offline" );
+        return true;
+    }
+
+    // Adding a key takes just a line here
+    static constexpr Field Fields[] = {
+        { "Name",       setString<&NodeInfo::m_name>                        },
+        { "IP",         setString<&NodeInfo::m_ip>                          },
+        { "MaxJobs",    setNumber<uint32_t, &NodeInfo::m_maxJobs>           },
+        { "NoRemote",   setNoRemote                                         },
+        { "State",      setState                                            },
+        { "Platform",   setString<&NodeInfo::m_platform>                    },
+        { "Speed",      setNumber<float, &NodeInfo::m_speed>                },
+        { "Load",       setNumber<uint32_t, &NodeInfo::m_load>              },
+        { "LoadAvg1",   setNumber<uint32_t, &NodeInfo::m_loadAvg1>          },
+        { "LoadAvg5",   setNumber<uint32_t, &NodeInfo::m_loadAvg5>          },
+        { "LoadAvg10",  setNumber<uint32_t, &NodeInfo::m_loadAvg10>         },
+        { "FreeMem",    setNumber<uint32_t, &NodeInfo::m_freeMem>           },
+        { "Version",    setNumber<uint32_t, &NodeInfo::m_version>           },
+        { "Features",   setString<&NodeInfo::m_features>                    }
+    };
+
+    static constexpr StatsKeyTable<32> Keys = makeStatsKeyTable<32>( Fields );
+
+    // False for unknown keys and malformed values
+    static bool set( NodeInfo& node, std::string_view key, std::string_view value )
+    {
+        uint8_t i = Keys.candidate( key );
+
+        if( i == StatsKeyTable<32>::EMPTY || !equalsStatsKey( Fields[i].key, key ) )
+        {
+            PRINT_DEBUG( "Unknown stats key '%.*s'\n", static_cast<int>( key.size() ), key.data() );
+
+            return false;
+        }
+
+        if( !Fields[i].set( node, value ) )
+        {
+            PRINT_DEBUG( "Malformed value '%.*s' of stats key '%.*s'\n", static_cast<int>( value.size() ), value.data(), static_cast<int>( key.size() ), key.data() );
+
+            return false;
+        }
+
+        return true;
+    }
+};
+
+// NodeInfo
+
+NodeInfoPtr NodeInfo::create( uint32_t hostId, std::string_view stats, const NodeInfo* base, std::pmr::memory_resource* resource )
+{
+    if( !hostId )
+    {
+        return NodeInfoPtr();
+    }
+
+    NodeInfoPtr res;
+
+    if( base )
+    {
+        res = copy( *base, resource );
+    }
+    else
+    {
+        std::pmr::polymorphic_allocator<NodeInfo> allocator( resource );
+        res = NodeInfoPtr( new( allocator.allocate( 1 ) ) NodeInfo( hostId, resource ), NodeInfoDeleter { resource } );
+    }
+
+    // Any news from the scheduler mean the node is there unless stated otherwise
+    res->m_hostId = hostId;
+    res->m_offline = false;
+    res->m_stale = false;
+
+    NodeInfo& node = *res;
+
+    scanStats( stats, [&node] ( std::string_view name, std::string_view value )
+    {
+        StatsSchema::set( node, name, value );
+    } );
+
+    if( !res->isValid() )
+    {
+        res.reset();
+    }
+
+    return res;
+}
+
+NodeInfoPtr NodeInfo::copy( const NodeInfo& node, std::pmr::memory_resource* resource )
+{
+    std::pmr::polymorphic_allocator<NodeInfo> allocator( resource );
+
+    return NodeInfoPtr( new( allocator.allocate( 1 ) ) NodeInfo( node, resource ), NodeInfoDeleter { resource } );
+}
+
+NodeInfo::NodeInfo( const NodeInfo& other, std::pmr::memory_resource* resource )
+    : m_hostId( other.m_hostId )
+    , m_name( other.m_name, resource )
+    , m_ip( other.m_ip, resource )
+    , m_maxJobs( other.m_maxJobs )
+    , m_noRemote( other.m_noRemote )
+    , m_offline( other.m_offline )
+    , m_platform( other.m_platform, resource )
+    , m_stale( other.m_stale )
+    , m_speed( other.m_speed )
+    , m_load( other.m_load )
+    , m_loadAvg1( other.m_loadAvg1 )
+    , m_loadAvg5( other.m_loadAvg5 )
+    , m_loadAvg10( other.m_loadAvg10 )
+    , m_freeMem( other.m_freeMem )
+    , m_version( other.m_version )
+    , m_features( other.m_features, resource )
+{
+}
+
+// NodeInfoDeleter
+
+void NodeInfoDeleter::operator()( NodeInfo* node ) const
+{
+    node->~NodeInfo();
+    std::pmr::polymorphic_allocator<NodeInfo>( resource ).deallocate( node, 1 );
+}
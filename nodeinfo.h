@@ -0,0 +1,211 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef ICEQUERY_NODEINFO_H
+#define ICEQUERY_NODEINFO_H
+
+#include <cstdint>      // uint32_t
+#include <memory>       // unique_ptr
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class NodeInfo;
+struct StatsSchema;
+
+// Returns the node to the memory resource it was created from
+struct NodeInfoDeleter
+{
+    std::pmr::memory_resource* resource = nullptr;
+
+    void operator()( NodeInfo* node ) const;
+};
+
+typedef std::unique_ptr<NodeInfo, NodeInfoDeleter> NodeInfoPtr;
+
+class NodeInfo
+{
+    // Parses the stats into the members
+    friend struct StatsSchema;
+
+public:
+    // If given, base provides the values missing from stats, allowing partial
+    // updates of a known node. The node and its strings are allocated from
+    // resource, which has to outlive it.
+    static NodeInfoPtr create( uint32_t hostId, std::string_view stats, const NodeInfo* base = nullptr,
+                               std::pmr::memory_resource* resource = std::pmr::get_default_resource() );
+
+    static NodeInfoPtr copy( const NodeInfo& node, std::pmr::memory_resource* resource = std::pmr::get_default_resource() );
+
+public:
+    uint32_t hostId() const
+    {
+        return m_hostId;
+    }
+
+    const std::pmr::string& name() const
+    {
+        return m_name;
+    }
+
+    const std::pmr::string& ip() const
+    {
+        return m_ip;
+    }
+
+    uint32_t maxJobs() const
+    {
+        return m_maxJobs;
+    }
+
+    bool noRemote() const
+    {
+        return m_noRemote;
+    }
+
+    bool isOffline() const
+    {
+        return m_offline;
+    }
+
+    const std::pmr::string& platform() const
+    {
+        return m_platform;
+    }
+
+    // Values reported by the daemon, 0 (or empty) until it does
+
+    float speed() const
+    {
+        return m_speed;
+    }
+
+    // Load as reported by the daemon, 1000 meaning fully busy
+    uint32_t load() const
+    {
+        return m_load;
+    }
+
+    // System load averages, multiplied by 1000
+    uint32_t loadAvg1() const
+    {
+        return m_loadAvg1;
+    }
+
+    uint32_t loadAvg5() const
+    {
+        return m_loadAvg5;
+    }
+
+    uint32_t loadAvg10() const
+    {
+        return m_loadAvg10;
+    }
+
+    // In MB
+    uint32_t freeMem() const
+    {
+        return m_freeMem;
+    }
+
+    // Protocol version of the daemon
+    uint32_t version() const
+    {
+        return m_version;
+    }
+
+    const std::pmr::string& features() const
+    {
+        return m_features;
+    }
+
+    // Last known data, not confirmed by the scheduler since reconnecting
+    bool isStale() const
+    {
+        return m_stale;
+    }
+
+    void setStale( bool stale )
+    {
+        m_stale = stale;
+    }
+
+private:
+    NodeInfo( uint32_t hostId, std::pmr::memory_resource* resource )
+        : m_hostId( hostId )
+        , m_name( resource )
+        , m_ip( resource )
+        , m_maxJobs( 0 )
+        , m_noRemote( false )
+        , m_offline( false )
+        , m_platform( resource )
+        , m_stale( false )
+        , m_speed( 0 )
+        , m_load( 0 )
+        , m_loadAvg1( 0 )
+        , m_loadAvg5( 0 )
+        , m_loadAvg10( 0 )
+        , m_freeMem( 0 )
+        , m_version( 0 )
+        , m_features( resource )
+    {
+    }
+
+    // The strings are copied into resource, not the default one
+    NodeInfo( const NodeInfo& other, std::pmr::memory_resource* resource );
+
+    NodeInfo& operator=( const NodeInfo& ) = delete;
+
+    friend struct NodeInfoDeleter;
+
+    bool isValid() const
+    {
+        return m_hostId &&
+               !m_name.empty() &&
+               !m_ip.empty() &&
+               m_maxJobs &&
+               !m_platform.empty();
+    }
+
+private:
+    uint32_t m_hostId;
+    std::pmr::string m_name;
+    std::pmr::string m_ip;
+    uint32_t m_maxJobs;
+    bool m_noRemote;
+    bool m_offline;
+    std::pmr::string m_platform;
+    bool m_stale;
+
+    float m_speed;
+    uint32_t m_load;
+    uint32_t m_loadAvg1;
+    uint32_t m_loadAvg5;
+    uint32_t m_loadAvg10;
+    uint32_t m_freeMem;
+    uint32_t m_version;
+    std::pmr::string m_features;
+};
+
+// Allocated from the resource of its nodes, so that a whole snapshot can live
+// in an arena
+typedef std::pmr::vector<NodeInfoPtr> NodeList;
+
+#endif // ICEQUERY_NODEINFO_H
@@ -0,0 +1,276 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "nodestore.h"
+
+#include <algorithm>
+#include <functional>     // hash
+
+// StringPool
+
+uint32_t StringPool::intern( std::string_view str )
+{
+    // Kept at most half full, so that probing stays short
+    if( ( size() + 1 ) * 2 > m_slots.size() )
+    {
+        rehash( std::max<std::size_t>( 64, m_slots.size() * 2 ) );
+    }
+
+    std::size_t i = slot( str );
+
+    if( m_slots[i] == NONE )
+    {
+        m_slots[i] = static_cast<uint32_t>( size() );
+
+        m_chars.insert( m_chars.end(), str.begin(), str.end() );
+        m_offsets.push_back( static_cast<uint32_t>( m_chars.size() ) );
+    }
+
+    return m_slots[i];
+}
+
+uint32_t StringPool::find( std::string_view str ) const
+{
+    return m_slots.empty() ? NONE : m_slots[slot( str )];
+}
+
+std::size_t StringPool::memoryUsage() const
+{
+    return m_chars.capacity() + ( m_offsets.capacity() + m_slots.capacity() ) * sizeof( uint32_t );
+}
+
+std::size_t StringPool::slot( std::string_view str ) const
+{
+    const std::size_t mask = m_slots.size() - 1;
+    std::size_t i = std::hash<std::string_view>()( str ) & mask;
+
+    while( m_slots[i] != NONE && this->str( m_slots[i] ) != str )
+    {
+        i = ( i + 1 ) & mask;
+    }
+
+    return i;
+}
+
+void StringPool::rehash( std::size_t slotCount )
+{
+    m_slots.assign( slotCount, NONE );
+
+    for( uint32_t id = 0; id < size(); ++id )
+    {
+        m_slots[slot( str( id ) )] = id;
+    }
+}
+
+// NodeStore
+
+NodeStore::NodeStore()
+{
+}
+
+NodeStore::NodeStore( const NodeList& nodes )
+{
+    m_hostIds.reserve( nodes.size() );
+    m_maxJobs.reserve( nodes.size() );
+    m_names.reserve( nodes.size() );
+    m_ips.reserve( nodes.size() );
+    m_platforms.reserve( nodes.size() );
+    m_indices.reserve( nodes.size() );
+
+    for( const auto& node : nodes )
+    {
+        set( *node );
+    }
+}
+
+void NodeStore::set( const NodeInfo& node )
+{
+    std::size_t i = find( node.hostId() );
+
+    if( i == size() )
+    {
+        m_indices.emplace( node.hostId(), static_cast<uint32_t>( i ) );
+
+        m_hostIds.push_back( node.hostId() );
+        m_maxJobs.push_back( 0 );
+        m_names.push_back( 0 );
+        m_ips.push_back( 0 );
+        m_platforms.push_back( 0 );
+
+        if( i % 64 == 0 )
+        {
+            m_offline.push_back( 0 );
+            m_noRemote.push_back( 0 );
+            m_stale.push_back( 0 );
+        }
+    }
+
+    m_maxJobs[i] = node.maxJobs();
+    m_names[i] = m_strings.intern( node.name() );
+    m_ips[i] = m_strings.intern( node.ip() );
+    m_platforms[i] = m_strings.intern( node.platform() );
+
+    assignBit( m_offline, i, node.isOffline() );
+    assignBit( m_noRemote, i, node.noRemote() );
+    assignBit( m_stale, i, node.isStale() );
+}
+
+bool NodeStore::remove( uint32_t hostId )
+{
+    std::size_t i = find( hostId );
+
+    if( i == size() )
+    {
+        return false;
+    }
+
+    std::size_t last = size() - 1;
+
+    if( i != last )
+    {
+        m_hostIds[i] = m_hostIds[last];
+        m_maxJobs[i] = m_maxJobs[last];
+        m_names[i] = m_names[last];
+        m_ips[i] = m_ips[last];
+        m_platforms[i] = m_platforms[last];
+
+        assignBit( m_offline, i, testBit( m_offline, last ) );
+        assignBit( m_noRemote, i, testBit( m_noRemote, last ) );
+        assignBit( m_stale, i, testBit( m_stale, last ) );
+
+        m_indices[m_hostIds[i]] = static_cast<uint32_t>( i );
+    }
+
+    m_indices.erase( hostId );
+
+    m_hostIds.pop_back();
+    m_maxJobs.pop_back();
+    m_names.pop_back();
+    m_ips.pop_back();
+    m_platforms.pop_back();
+
+    if( last % 64 == 0 )
+    {
+        m_offline.pop_back();
+        m_noRemote.pop_back();
+        m_stale.pop_back();
+    }
+
+    return true;
+}
+
+void NodeStore::clear()
+{
+    *this = NodeStore();
+}
+
+std::size_t NodeStore::find( uint32_t hostId ) const
+{
+    auto it = m_indices.find( hostId );
+
+    return it == m_indices.end() ? size() : it->second;
+}
+
+uint32_t NodeStore::countNodes( bool noOffline, bool noNoRemote, uint32_t platformId ) const
+{
+    const std::size_t words = m_offline.size();
+    uint32_t res = 0;
+
+    if( platformId == ANY_PLATFORM )
+    {
+        for( std::size_t w = 0; w < words; ++w )
+        {
+            res += __builtin_popcountll( passing( w, noOffline, noNoRemote ) );
+        }
+    }
+    else
+    {
+        for( std::size_t w = 0; w < words; ++w )
+        {
+            for( uint64_t bits = passing( w, noOffline, noNoRemote ); bits; bits &= bits - 1 )
+            {
+                res += ( m_platforms[w * 64 + __builtin_ctzll( bits )] == platformId );
+            }
+        }
+    }
+
+    return res;
+}
+
+uint32_t NodeStore::countCores( uint32_t platformId ) const
+{
+    const std::size_t words = m_offline.size();
+    uint32_t res = 0;
+
+    for( std::size_t w = 0; w < words; ++w )
+    {
+        for( uint64_t bits = passing( w, true, true ); bits; bits &= bits - 1 )
+        {
+            std::size_t i = w * 64 + __builtin_ctzll( bits );
+
+            if( platformId == ANY_PLATFORM || m_platforms[i] == platformId )
+            {
+                res += m_maxJobs[i];
+            }
+        }
+    }
+
+    return res;
+}
+
+std::size_t NodeStore::memoryUsage() const
+{
+    return ( m_hostIds.capacity() + m_maxJobs.capacity() + m_names.capacity() + m_ips.capacity() + m_platforms.capacity() ) * sizeof( uint32_t ) +
+           ( m_offline.capacity() + m_noRemote.capacity() + m_stale.capacity() ) * sizeof( uint64_t ) +
+           m_indices.bucket_count() * sizeof( void* ) + m_indices.size() * ( sizeof( std::pair<uint32_t, uint32_t> ) + sizeof( void* ) ) +
+           m_strings.memoryUsage();
+}
+
+void NodeStore::assignBit( Bitset& bits, std::size_t i, bool value )
+{
+    uint64_t mask = uint64_t( 1 ) << ( i % 64 );
+
+    if( value )
+    {
+        bits[i / 64] |= mask;
+    }
+    else
+    {
+        bits[i / 64] &= ~mask;
+    }
+}
+
+uint64_t NodeStore::passing( std::size_t word, bool noOffline, bool noNoRemote ) const
+{
+    // Valid bits of the last, partially filled word
+    std::size_t remaining = size() - word * 64;
+    uint64_t res = remaining >= 64 ? ~uint64_t( 0 ) : ( uint64_t( 1 ) << remaining ) - 1;
+
+    if( noOffline )
+    {
+        res &= ~m_offline[word];
+    }
+
+    if( noNoRemote )
+    {
+        res &= ~m_noRemote[word];
+    }
+
+    return res;
+}
@@ -0,0 +1,187 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef ICEQUERY_NODESTORE_H
+#define ICEQUERY_NODESTORE_H
+
+#include <cstdint>      // uint32_t, uint64_t
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "nodeinfo.h"
+
+// Keeps a single copy of every distinct string, referred to by ids; the
+// characters are packed back to back and indexed by an open-addressing table
+class StringPool
+{
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+public:
+    uint32_t intern( std::string_view str );
+
+    // NONE if the string has never been interned
+    uint32_t find( std::string_view str ) const;
+
+    std::string_view str( uint32_t id ) const
+    {
+        return std::string_view( m_chars.data() + m_offsets[id], m_offsets[id + 1] - m_offsets[id] );
+    }
+
+    std::size_t size() const
+    {
+        return m_offsets.size() - 1;
+    }
+
+    std::size_t memoryUsage() const;
+
+private:
+    // Slot of the string, or of the empty slot where it would go
+    std::size_t slot( std::string_view str ) const;
+
+    void rehash( std::size_t slotCount );
+
+private:
+    std::vector<char> m_chars;
+
+    // Where each string starts, followed by the end of the last one
+    std::vector<uint32_t> m_offsets { 0 };
+
+    // String ids, NONE for empty slots; a power of 2 in size
+    std::vector<uint32_t> m_slots;
+};
+
+// Node table laid out column by column: the numbers in parallel arrays, the
+// flags in bitsets and the strings as ids into a pool. Totals become loops
+// over contiguous memory and plain node counts popcounts.
+class NodeStore
+{
+public:
+    // Any platform, for the filters below
+    static constexpr uint32_t ANY_PLATFORM = StringPool::NONE - 1;
+
+public:
+    NodeStore();
+
+    explicit NodeStore( const NodeList& nodes );
+
+public:
+    // Adds the node or overwrites the one with the same host id
+    void set( const NodeInfo& node );
+
+    // False if there's no such node; the last node takes the removed one's
+    // place
+    bool remove( uint32_t hostId );
+
+    void clear();
+
+    std::size_t size() const
+    {
+        return m_hostIds.size();
+    }
+
+    // Index of the node, size() if there's none
+    std::size_t find( uint32_t hostId ) const;
+
+    uint32_t hostId( std::size_t i ) const
+    {
+        return m_hostIds[i];
+    }
+
+    uint32_t maxJobs( std::size_t i ) const
+    {
+        return m_maxJobs[i];
+    }
+
+    std::string_view name( std::size_t i ) const
+    {
+        return m_strings.str( m_names[i] );
+    }
+
+    std::string_view ip( std::size_t i ) const
+    {
+        return m_strings.str( m_ips[i] );
+    }
+
+    std::string_view platform( std::size_t i ) const
+    {
+        return m_strings.str( m_platforms[i] );
+    }
+
+    bool isOffline( std::size_t i ) const
+    {
+        return testBit( m_offline, i );
+    }
+
+    bool noRemote( std::size_t i ) const
+    {
+        return testBit( m_noRemote, i );
+    }
+
+    bool isStale( std::size_t i ) const
+    {
+        return testBit( m_stale, i );
+    }
+
+    // Id for the platform filters, StringPool::NONE if no node ever had it
+    uint32_t platformId( const std::string& platform ) const
+    {
+        return m_strings.find( platform );
+    }
+
+    // Same semantics as the output's totals: nodes not excluded by the flags,
+    // cores of the nodes that are neither offline nor 'no remote'
+    uint32_t countNodes( bool noOffline, bool noNoRemote, uint32_t platformId = ANY_PLATFORM ) const;
+    uint32_t countCores( uint32_t platformId = ANY_PLATFORM ) const;
+
+    // Bytes allocated, including the string pool
+    std::size_t memoryUsage() const;
+
+private:
+    typedef std::vector<uint64_t> Bitset;
+
+    static bool testBit( const Bitset& bits, std::size_t i )
+    {
+        return ( bits[i / 64] >> ( i % 64 ) ) & 1;
+    }
+
+    static void assignBit( Bitset& bits, std::size_t i, bool value );
+
+    // Bits set for the nodes passing the filter flags, word by word
+    uint64_t passing( std::size_t word, bool noOffline, bool noNoRemote ) const;
+
+private:
+    std::vector<uint32_t> m_hostIds;
+    std::vector<uint32_t> m_maxJobs;
+
+    std::vector<uint32_t> m_names;
+    std::vector<uint32_t> m_ips;
+    std::vector<uint32_t> m_platforms;
+
+    Bitset m_offline;
+    Bitset m_noRemote;
+    Bitset m_stale;
+
+    std::unordered_map<uint32_t, uint32_t> m_indices;
+    StringPool m_strings;
+};
+
+#endif // ICEQUERY_NODESTORE_H
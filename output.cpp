@@ -0,0 +1,907 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "output.h"
+
+#include <algorithm>
+#include <cctype>       // isblank()
+#include <cerrno>
+#include <cstdlib>      // exit()
+#include <cstring>      // strerror()
+#include <map>
+#include <memory>       // unique_ptr
+#include <numeric>      // accumulate()
+#include <unordered_map>
+
+#include <arpa/inet.h>  // inet_pton(), inet_ntop()
+
+#include <unicode/translit.h>   // icu::Transliterator
+#include <unicode/errorcode.h>  // icu::ErrorCode
+#include <unicode/ucnv.h>       // icu::ucnv_open()
+#include <unicode/ustdio.h>     // icu::u_fputs()
+
+#include "common.h"
+
+// OutputSpec
+
+OutputSpec::OutputSpec()
+    : brief( false )
+    , noTable( false )
+    , plain( false )
+    , ascii( false )
+    , noOffline( false )
+    , noNoRemote( false )
+    , showStale( false )
+    , perPlatform( false )
+    , hostNames( nullptr )
+    , probes( nullptr )
+{
+}
+
+// Utility functions
+
+bool checkEncoding( const std::string& encoding )
+{
+    if( encoding.empty() || std::all_of( encoding.cbegin(), encoding.cend(), [] ( char c ) { return isblank( c ); } ) )
+    {
+        return false;
+    }
+
+    icu::ErrorCode errorCode;
+    UConverter* converter = ucnv_open( encoding.c_str(), errorCode );
+
+    if( converter )
+    {
+        ucnv_close( converter );
+    }
+
+    if( errorCode.isFailure() )
+    {
+        PRINT_ERR( "ucnv_open(): %s\n", errorCode.errorName() );
+    }
+
+    return !errorCode.isFailure();
+}
+
+// CellDecoder
+
+CellDecoder::CellDecoder( const std::vector<ColumnHeader>& header, bool ascii, const std::string& customEncoding )
+    : m_trans( nullptr )
+    , m_converter( nullptr, ucnv_close )
+{
+    // Init Transliterator, once for all the renders as creating it is costly
+    static std::unique_ptr<icu::Transliterator> asciiTrans;
+
+    if( ascii )
+    {
+        if( !asciiTrans )
+        {
+            icu::ErrorCode errorCode;
+            asciiTrans.reset( icu::Transliterator::createInstance( "Latin-ASCII", UTRANS_FORWARD, errorCode ) );
+
+            if( errorCode.isFailure() )
+            {
+                PRINT_ERR( "icu::Transliterator::createInstance(): %s\n", errorCode.errorName() );
+                std::exit( EXIT_LIBRARY_ERR );
+            }
+        }
+
+        m_trans = asciiTrans.get();
+    }
+
+    // Init UConverter, one for the whole table instead of one per cell
+    if( std::any_of( header.cbegin(), header.cend(), [] ( const ColumnHeader& column ) { return column.encoding() == Encoding::Custom; } ) )
+    {
+        icu::ErrorCode errorCode;
+        m_converter.reset( ucnv_open( customEncoding.c_str(), errorCode ) );
+
+        if( errorCode.isFailure() )
+        {
+            PRINT_ERR( "ucnv_open(): %s\n", errorCode.errorName() );
+            std::exit( EXIT_LIBRARY_ERR );
+        }
+    }
+}
+
+icu::UnicodeString CellDecoder::decode( std::string_view str, Encoding encoding ) const
+{
+    icu::UnicodeString res;
+
+    if( encoding == Encoding::UTF8 )
+    {
+        res = icu::UnicodeString::fromUTF8( icu::StringPiece( str.data(), str.size() ) );
+    }
+    else
+    {
+        icu::ErrorCode errorCode;
+        res = icu::UnicodeString( str.data(), static_cast<int32_t>( str.size() ), m_converter.get(), errorCode );
+    }
+
+    if( m_trans )
+    {
+        m_trans->transliterate( res );
+    }
+
+    return res;
+}
+
+// Table rendering
+
+// Add 1 char margin to the first and last column
+static void addMargin( icu::UnicodeString& str, std::size_t c, std::size_t columnCount, bool plain )
+{
+    if( plain )
+    {
+        return;
+    }
+
+    if( c == 0 )
+    {
+        str.insert( 0, ' ' );
+    }
+    else if( c == columnCount - 1 )
+    {
+        str.append( ' ' );
+    }
+}
+
+// Pads the cells of a row to the widths and appends it, separated
+static void appendRow( icu::UnicodeString& table, const std::vector<ColumnHeader>& header, icu::UnicodeString* row, const std::vector<std::size_t>& widths, bool plain, bool ascii )
+{
+    for( std::size_t c = 0; c < header.size(); ++c )
+    {
+        icu::UnicodeString& str = row[c];
+        const std::size_t len = static_cast<std::size_t>( str.length() );
+
+        if( len < widths[c] )
+        {
+            std::size_t lenDiff = widths[c] - len;
+
+            switch( header[c].alignment() )
+            {
+                case Alignment::Left:
+                    str.append( icu::UnicodeString::fromUTF8( std::string( lenDiff, ' ' ) ) );
+                    break;
+
+                case Alignment::Right:
+                    str.insert( 0, icu::UnicodeString::fromUTF8( std::string( lenDiff, ' ' ) ) );
+                    break;
+
+                case Alignment::Center:
+                    str.insert( 0, icu::UnicodeString::fromUTF8( std::string( lenDiff / 2, ' ' ) ) ).append( icu::UnicodeString::fromUTF8( std::string( lenDiff - lenDiff / 2, ' ' ) ) );
+                    break;
+            }
+        }
+
+        if( c > 0 )
+        {
+            if( plain )
+            {
+               table.append( ' ' );
+            }
+            else
+            {
+                table.append( icu::UnicodeString::fromUTF8( std::string( ascii ? ( " " VERT_LINE_7BIT " " ) : ( " " VERT_LINE_UTF8 " " ) ) ) );
+            }
+        }
+
+        table.append( str );
+    }
+
+    table.append( '\n' );
+}
+
+// Draws the horizontal line below the header
+static void appendHeaderLine( icu::UnicodeString& table, const std::vector<std::size_t>& widths, bool plain, bool ascii )
+{
+    if( plain )
+    {
+        return;
+    }
+
+    for( std::size_t c = 0; c < widths.size(); ++c )
+    {
+        if( c > 0 )
+        {
+            table.append( ascii ? ( HOR_LINE_7BIT CROSS_7BIT HOR_LINE_7BIT ) : ( HOR_LINE_UTF8 CROSS_UTF8 HOR_LINE_UTF8 ) );
+        }
+
+        for( std::size_t i = 0; i < widths[c]; ++i )
+        {
+            table.append( ascii ? HOR_LINE_7BIT : HOR_LINE_UTF8 );
+        }
+    }
+
+    table.append( '\n' );
+}
+
+icu::UnicodeString renderTable( const std::vector<ColumnHeader>& header, const Cells& strings, bool plain, bool ascii, const std::string& customEncoding )
+{
+    auto columnCount = header.size();
+    auto rowCount = strings.size() / columnCount;
+
+    std::vector<std::size_t> colMaxLens( columnCount );
+    std::vector<icu::UnicodeString> data( columnCount * ( rowCount + 1 ) );
+
+    const CellDecoder decoder( header, ascii, customEncoding );
+
+    // Transliterated strings by the original ones of each encoding, as the
+    // same platforms, ticks and numbers keep repeating
+    std::unordered_map<std::string_view, icu::UnicodeString> transliterated[2];
+
+    // Treat as UnicodeString, possibly transliterated, and determine the
+    // column lengths
+    for( std::size_t c = 0; c < columnCount; ++c )
+    {
+        std::size_t& maxLen = colMaxLens[c];
+
+        for( std::size_t r = 0; r < rowCount + 1; ++r )
+        {
+            icu::UnicodeString& res = data[columnCount * r + c];
+
+            const std::string_view origStr = r == 0 ? std::string_view( header[c].name() ) : std::string_view( strings[columnCount * (r - 1) + c] );
+            const Encoding encoding = r == 0 ? Encoding::UTF8 : header[c].encoding();
+
+            if( decoder.transliterates() )
+            {
+                auto& memo = transliterated[encoding == Encoding::UTF8 ? 0 : 1];
+                auto it = memo.find( origStr );
+
+                if( it == memo.end() )
+                {
+                    it = memo.emplace( origStr, decoder.decode( origStr, encoding ) ).first;
+                }
+
+                res = it->second;
+            }
+            else
+            {
+                res = decoder.decode( origStr, encoding );
+            }
+
+            addMargin( res, c, columnCount, plain );
+
+            maxLen = std::max( maxLen, static_cast<std::size_t>( res.length() ) );
+        }
+    }
+
+    // Render the table
+    icu::UnicodeString table;
+
+    for( std::size_t r = 0; r < rowCount + 1; ++r )
+    {
+        appendRow( table, header, &data[columnCount * r], colMaxLens, plain, ascii );
+
+        if( r == 0 )
+        {
+            appendHeaderLine( table, colMaxLens, plain, ascii );
+        }
+    }
+
+    return table;
+}
+
+bool parseOutputOptions( const std::string& line, OutputSpec& spec )
+{
+    std::size_t pos = 0;
+
+    while( true )
+    {
+        pos = line.find_first_not_of( " \t", pos );
+
+        if( pos == std::string::npos )
+        {
+            return true;
+        }
+
+        std::size_t end = line.find_first_of( " \t", pos );
+        const std::string arg = line.substr( pos, end == std::string::npos ? std::string::npos : end - pos );
+        pos = end;
+
+        std::size_t eqPos = arg.find( '=' );
+        const std::string name = arg.substr( 0, eqPos );
+        const std::string value = eqPos == std::string::npos ? std::string() : arg.substr( eqPos + 1 );
+        const bool hasValue = ( eqPos != std::string::npos );
+
+        if( name == "--brief" && !hasValue )
+        {
+            spec.brief = true;
+            spec.noTable = true;
+        }
+        else if( name == "--no-table" && !hasValue )
+        {
+            spec.noTable = true;
+        }
+        else if( name == "--plain" && !hasValue )
+        {
+            spec.plain = true;
+        }
+        else if( name == "--ascii" && !hasValue )
+        {
+            spec.ascii = true;
+        }
+        else if( name == "--no-offline" && !hasValue )
+        {
+            spec.noOffline = true;
+        }
+        else if( name == "--no-noremote" && !hasValue )
+        {
+            spec.noNoRemote = true;
+        }
+        else if( name == "--per-platform" && !hasValue )
+        {
+            spec.perPlatform = true;
+        }
+        else if( name == "--encoding" && hasValue )
+        {
+            if( !checkEncoding( value ) )
+            {
+                PRINT_ERR( "Invalid ICU encoding '%s'.\n", value.c_str() );
+                return false;
+            }
+
+            spec.customEncoding = value;
+        }
+        else if( name == "--platform" && hasValue )
+        {
+            spec.platform = value;
+        }
+        else if( name == "--output" && hasValue && !value.empty() )
+        {
+            spec.path = value;
+        }
+        else
+        {
+            PRINT_ERR( "Unknown/invalid option '%s'.\n", arg.c_str() );
+            return false;
+        }
+    }
+}
+
+// Output functions
+
+bool isNodeShown( const OutputSpec& spec, const NodeInfo& node )
+{
+    return ( !spec.noOffline || !node.isOffline() ) && ( !spec.noNoRemote || !node.noRemote() ) &&
+           ( spec.platform.empty() || std::string_view( node.platform() ) == spec.platform );
+}
+
+bool isNodeCounted( const OutputSpec& spec, const NodeInfo& node )
+{
+    return !node.noRemote() && !node.isOffline() && ( spec.platform.empty() || std::string_view( node.platform() ) == spec.platform );
+}
+
+std::uint32_t countCores( const OutputSpec& spec, const NodeList& nodes )
+{
+    return std::accumulate( nodes.cbegin(), nodes.cend(), static_cast<std::uint32_t>( 0 ), [&spec] ( std::uint32_t count, const NodeInfoPtr& node )
+    {
+        if( isNodeCounted( spec, *node ) )
+        {
+            return count + node->maxJobs();
+        }
+        else
+        {
+            return count;
+        }
+    } );
+}
+
+std::uint32_t countShownNodes( const OutputSpec& spec, const NodeList& nodes )
+{
+    return std::count_if( nodes.cbegin(), nodes.cend(), [&spec] ( const NodeInfoPtr& node ) { return isNodeShown( spec, *node ); } );
+}
+
+bool hasUsefulData( const OutputSpec& spec, const NodeList& nodes )
+{
+    return std::any_of( nodes.cbegin(), nodes.cend(), [&spec] ( const NodeInfoPtr& node ) { return isNodeShown( spec, *node ); } );
+}
+
+std::vector<ColumnHeader> nodeHeader( const OutputSpec& spec )
+{
+    std::vector<ColumnHeader> header {
+        { Alignment::Right , Encoding::UTF8     , "Node #"     },
+        { Alignment::Center, Encoding::UTF8     , "Offline?"   },
+        { Alignment::Center, Encoding::UTF8     , "No remote?" },
+        { Alignment::Left  , Encoding::Custom   , "Name"       },
+        { Alignment::Left  , Encoding::UTF8     , "IP"         }
+    };
+
+    if( spec.hostNames )
+    {
+        header.emplace_back( Alignment::Left, Encoding::UTF8, "Host name" );
+    }
+
+    if( spec.probes )
+    {
+        header.emplace_back( Alignment::Center, Encoding::UTF8, "Reachable?" );
+        header.emplace_back( Alignment::Right, Encoding::UTF8, "RTT" );
+    }
+
+    header.insert( header.end(), {
+        { Alignment::Right , Encoding::UTF8     , "Cores"      },
+        { Alignment::Left  , Encoding::UTF8     , "Platform"   }
+    } );
+
+    if( spec.showStale )
+    {
+        header.emplace_back( Alignment::Center, Encoding::UTF8, "Stale?" );
+    }
+
+    return header;
+}
+
+void appendNodeCells( const OutputSpec& spec, Cells& strings, const NodeInfo& node )
+{
+    const bool ascii = spec.ascii;
+
+    strings.emplace_back( std::to_string( node.hostId() ) );
+    strings.emplace_back( node.isOffline() ? ( ascii ? TICK_7BIT : TICK_UTF8 ) : ( ascii ? NO_TICK_7BIT : NO_TICK_UTF8 ) );
+    strings.emplace_back( node.noRemote()  ? ( ascii ? TICK_7BIT : TICK_UTF8 ) : ( ascii ? NO_TICK_7BIT : NO_TICK_UTF8 ) );
+    strings.emplace_back( node.name() );
+    strings.emplace_back( node.ip() );
+
+    if( spec.hostNames )
+    {
+        auto it = spec.hostNames->find( std::string_view( node.ip() ) );
+        strings.emplace_back( it != spec.hostNames->end() ? it->second : std::string() );
+    }
+
+    if( spec.probes )
+    {
+        auto it = spec.probes->find( std::string_view( node.ip() ) );
+        bool reachable = ( it != spec.probes->end() && it->second.rtt >= 0 );
+
+        strings.emplace_back( reachable ? ( ascii ? TICK_7BIT : TICK_UTF8 ) : ( ascii ? NO_TICK_7BIT : NO_TICK_UTF8 ) );
+        strings.emplace_back( it != spec.probes->end() ? probeResultToStr( it->second ) : std::string() );
+    }
+
+    strings.emplace_back( std::to_string( node.maxJobs() ) );
+    strings.emplace_back( node.platform() );
+
+    if( spec.showStale )
+    {
+        strings.emplace_back( node.isStale() ? ( ascii ? TICK_7BIT : TICK_UTF8 ) : ( ascii ? NO_TICK_7BIT : NO_TICK_UTF8 ) );
+    }
+}
+
+void printTable( const OutputSpec& spec, const std::vector<ColumnHeader>& header, const Cells& strings, FILE* out )
+{
+    // Not owning the FILE, so closing it only flushes
+    UFILE* uOut = u_finit( out, nullptr, nullptr );
+
+    u_fputs( renderTable( header, strings, spec.plain, spec.ascii, spec.customEncoding ).insert( 0, '\n' ).getTerminatedBuffer(), uOut );
+    u_fclose( uOut );
+}
+
+void printTotals( FILE* out, const char* label, std::uint32_t nodeCount, std::uint32_t coreCount )
+{
+    fprintf( out, "%s%s%u node%s, %u core%s%s.\n", label ? label : "", label ? ": " : "", nodeCount, nodeCount == 1 ? "" : "s", coreCount, coreCount == 1 ? "" : "s", label ? "" : " total" );
+}
+
+// The /24 (or /64 for IPv6) network of the address, empty if it's not numeric
+static std::string subnetOf( const std::string& addr )
+{
+    unsigned char bytes[16] {};
+    char buffer[INET6_ADDRSTRLEN + 4];
+
+    if( inet_pton( AF_INET, addr.c_str(), bytes ) == 1 )
+    {
+        bytes[3] = 0;
+        inet_ntop( AF_INET, bytes, buffer, sizeof( buffer ) );
+
+        return std::string( buffer ) + "/24";
+    }
+
+    if( inet_pton( AF_INET6, addr.c_str(), bytes ) == 1 )
+    {
+        std::fill( bytes + 8, bytes + 16, 0 );
+        inet_ntop( AF_INET6, bytes, buffer, sizeof( buffer ) );
+
+        return std::string( buffer ) + "/64";
+    }
+
+    return std::string();
+}
+
+// Reachability and connection times per subnet, of all the results together
+static void printSubnetTotals( const OutputSpec& spec, const std::vector<const NodeList*>& nodeLists, FILE* out )
+{
+    // Connection times by subnet, -1 for the unreachable nodes
+    std::map<std::string, std::vector<long>> rtts;
+
+    for( const NodeList* nodes : nodeLists )
+    {
+        for( const auto& node : *nodes )
+        {
+            auto it = spec.probes->find( std::string_view( node->ip() ) );
+
+            if( isNodeShown( spec, *node ) && it != spec.probes->end() )
+            {
+                rtts[subnetOf( std::string( node->ip() ) )].push_back( it->second.rtt );
+            }
+        }
+    }
+
+    for( auto& subnet : rtts )
+    {
+        std::vector<long>& times = subnet.second;
+        std::sort( times.begin(), times.end() );
+
+        auto reachable = std::upper_bound( times.begin(), times.end(), -1 );
+        std::size_t reachableCount = times.end() - reachable;
+
+        fprintf( out, "%s: %zu node%s, ", subnet.first.empty() ? "?" : subnet.first.c_str(), times.size(), times.size() == 1 ? "" : "s" );
+
+        if( !reachableCount )
+        {
+            fprintf( out, "none reachable.\n" );
+        }
+        else
+        {
+            fprintf( out, "%zu reachable, RTT %.2f/%.2f/%.2f ms min/median/max.\n", reachableCount, *reachable / 1000.0, reachable[reachableCount / 2] / 1000.0,
+                     times.back() / 1000.0 );
+        }
+    }
+}
+
+// Totals per platform, of all the results together
+static void printPlatformTotals( const OutputSpec& spec, const std::vector<const NodeList*>& nodeLists, FILE* out )
+{
+    // Keyed by views of the nodes' strings, which outlive it
+    std::map<std::string_view, std::pair<std::uint32_t, std::uint32_t>> totals;
+
+    for( const NodeList* nodes : nodeLists )
+    {
+        for( const auto& node : *nodes )
+        {
+            auto& total = totals[node->platform()];
+
+            if( isNodeShown( spec, *node ) )
+            {
+                ++total.first;
+            }
+
+            if( isNodeCounted( spec, *node ) )
+            {
+                total.second += node->maxJobs();
+            }
+        }
+    }
+
+    for( const auto& total : totals )
+    {
+        if( total.second.first || total.second.second )
+        {
+            printTotals( out, std::string( total.first ).c_str(), total.second.first, total.second.second );
+        }
+    }
+}
+
+int printNodes( const OutputSpec& spec, const NodeList& nodes, FILE* out, std::pmr::memory_resource* resource )
+{
+    if( !hasUsefulData( spec, nodes ) )
+    {
+        PRINT_ERR( "No useful data retrieved.\n" );
+
+        return EXIT_NO_DATA;
+    }
+
+    std::uint32_t coreCount = countCores( spec, nodes );
+    std::uint32_t nodeCount = countShownNodes( spec, nodes );
+
+    if( spec.brief )
+    {
+        fprintf( out, "%u\n", coreCount );
+    }
+    else
+    {
+        if( !spec.noTable )
+        {
+            const std::vector<ColumnHeader> header = nodeHeader( spec );
+
+            Cells strings( resource );
+            strings.reserve( nodeCount * header.size() );
+
+            for( const auto& node : nodes )
+            {
+                if( isNodeShown( spec, *node ) )
+                {
+                    appendNodeCells( spec, strings, *node );
+                }
+            }
+
+            printTable( spec, header, strings, out );
+        }
+
+        if( spec.perPlatform )
+        {
+            printPlatformTotals( spec, { &nodes }, out );
+        }
+
+        if( spec.probes )
+        {
+            printSubnetTotals( spec, { &nodes }, out );
+        }
+
+        printTotals( out, nullptr, nodeCount, coreCount );
+    }
+
+    return EXIT_OK;
+}
+
+int printFederated( const OutputSpec& spec, const std::vector<QueryTarget>& targets, const std::vector<QueryResult>& results, FILE* out, std::pmr::memory_resource* resource )
+{
+    bool anyConnected = false;
+    bool anyUseful = false;
+
+    for( std::size_t i = 0; i < targets.size(); ++i )
+    {
+        if( results[i].exitCode != EXIT_OK )
+        {
+            PRINT_WARN( "Scheduler '%s' unavailable.\n", targets[i].label().c_str() );
+        }
+        else
+        {
+            anyConnected = true;
+            anyUseful |= hasUsefulData( spec, results[i].nodes );
+        }
+    }
+
+    if( !anyConnected )
+    {
+        return EXIT_CONNECTION_ERR;
+    }
+
+    if( !anyUseful )
+    {
+        PRINT_ERR( "No useful data retrieved.\n" );
+
+        return EXIT_NO_DATA;
+    }
+
+    std::uint32_t coreCount = 0;
+    std::uint32_t nodeCount = 0;
+
+    for( const QueryResult& result : results )
+    {
+        coreCount += countCores( spec, result.nodes );
+        nodeCount += countShownNodes( spec, result.nodes );
+    }
+
+    if( spec.brief )
+    {
+        fprintf( out, "%u\n", coreCount );
+
+        return EXIT_OK;
+    }
+
+    if( !spec.noTable )
+    {
+        std::vector<ColumnHeader> header = nodeHeader( spec );
+        header.insert( header.begin(), ColumnHeader( Alignment::Left, Encoding::UTF8, "Scheduler" ) );
+
+        Cells strings( resource );
+        strings.reserve( nodeCount * header.size() );
+
+        for( std::size_t i = 0; i < targets.size(); ++i )
+        {
+            const std::string label = targets[i].label();
+
+            for( const auto& node : results[i].nodes )
+            {
+                if( isNodeShown( spec, *node ) )
+                {
+                    strings.emplace_back( label );
+                    appendNodeCells( spec, strings, *node );
+                }
+            }
+        }
+
+        printTable( spec, header, strings, out );
+    }
+
+    for( std::size_t i = 0; i < targets.size(); ++i )
+    {
+        const std::string label = targets[i].label();
+
+        if( results[i].exitCode != EXIT_OK )
+        {
+            fprintf( out, "%s: unavailable.\n", label.c_str() );
+        }
+        else
+        {
+            printTotals( out, label.c_str(), countShownNodes( spec, results[i].nodes ), countCores( spec, results[i].nodes ) );
+        }
+    }
+
+    std::vector<const NodeList*> nodeLists;
+
+    for( const QueryResult& result : results )
+    {
+        nodeLists.push_back( &result.nodes );
+    }
+
+    if( spec.perPlatform )
+    {
+        printPlatformTotals( spec, nodeLists, out );
+    }
+
+    if( spec.probes )
+    {
+        printSubnetTotals( spec, nodeLists, out );
+    }
+
+    printTotals( out, nullptr, nodeCount, coreCount );
+
+    return EXIT_OK;
+}
+
+int printResults( const OutputSpec& spec, const std::vector<QueryTarget>& targets, const std::vector<QueryResult>& results, std::pmr::memory_resource* resource )
+{
+    bool toStdout = spec.path.empty() || spec.path == "-";
+    FILE* out = toStdout ? stdout : fopen( spec.path.c_str(), "w" );
+
+    if( !out )
+    {
+        int lastErrno = errno;
+
+        PRINT_ERR( "Unable to open '%s': (%d) %s\n", spec.path.c_str(), lastErrno, strerror( lastErrno ) );
+
+        return EXIT_IO_ERR;
+    }
+
+    int res;
+
+    if( targets.size() == 1 )
+    {
+        res = ( results.front().exitCode == EXIT_OK ) ? printNodes( spec, results.front().nodes, out, resource ) : results.front().exitCode;
+    }
+    else
+    {
+        res = printFederated( spec, targets, results, out, resource );
+    }
+
+    if( toStdout )
+    {
+        fflush( out );
+    }
+    else if( fclose( out ) != 0 )
+    {
+        int lastErrno = errno;
+
+        PRINT_ERR( "Unable to write '%s': (%d) %s\n", spec.path.c_str(), lastErrno, strerror( lastErrno ) );
+
+        return EXIT_IO_ERR;
+    }
+
+    return res;
+}
+
+// ProgressiveTable
+
+ProgressiveTable::ProgressiveTable( const OutputSpec& spec, FILE* out )
+    : m_spec( spec )
+    , m_out( out )
+    , m_uOut( u_finit( out, nullptr, nullptr ) )
+    , m_header( nodeHeader( spec ) )
+    , m_decoder( std::make_unique<CellDecoder>( m_header, spec.ascii, spec.customEncoding ) )
+    , m_headerRow( m_header.size() )
+    , m_widths( m_header.size() )
+    , m_headerShown( false )
+{
+    for( std::size_t c = 0; c < m_header.size(); ++c )
+    {
+        m_headerRow[c] = m_decoder->decode( m_header[c].name(), Encoding::UTF8 );
+        addMargin( m_headerRow[c], c, m_header.size(), m_spec.plain );
+
+        m_widths[c] = static_cast<std::size_t>( m_headerRow[c].length() );
+    }
+}
+
+ProgressiveTable::~ProgressiveTable()
+{
+    // Not owning the FILE, so closing it only flushes
+    u_fclose( m_uOut );
+}
+
+void ProgressiveTable::addNode( const NodeInfo& node )
+{
+    if( m_spec.brief || m_spec.noTable || !isNodeShown( m_spec, node ) )
+    {
+        return;
+    }
+
+    const std::size_t columnCount = m_header.size();
+
+    m_cells.clear();
+    appendNodeCells( m_spec, m_cells, node );
+
+    std::vector<icu::UnicodeString> row( columnCount );
+    bool widened = false;
+
+    for( std::size_t c = 0; c < columnCount; ++c )
+    {
+        row[c] = m_decoder->decode( m_cells[c], m_header[c].encoding() );
+        addMargin( row[c], c, columnCount, m_spec.plain );
+
+        if( static_cast<std::size_t>( row[c].length() ) > m_widths[c] )
+        {
+            m_widths[c] = static_cast<std::size_t>( row[c].length() );
+            widened = true;
+        }
+    }
+
+    icu::UnicodeString text;
+
+    if( widened || !m_headerShown )
+    {
+        std::vector<icu::UnicodeString> headerRow( m_headerRow );
+
+        text.append( '\n' );
+        appendRow( text, m_header, headerRow.data(), m_widths, m_spec.plain, m_spec.ascii );
+        appendHeaderLine( text, m_widths, m_spec.plain, m_spec.ascii );
+
+        m_headerShown = true;
+    }
+
+    appendRow( text, m_header, row.data(), m_widths, m_spec.plain, m_spec.ascii );
+
+    // Whoever's watching should see it right away
+    u_file_write( text.getBuffer(), text.length(), m_uOut );
+    u_fflush( m_uOut );
+}
+
+int ProgressiveTable::finish( const NodeList& nodes )
+{
+    // printTable() prints the table with u_fputs(), which appends a newline,
+    // so an empty line separates the rows from the totals there as well
+    if( m_headerShown )
+    {
+        u_file_write( u"\n", 1, m_uOut );
+    }
+
+    u_fflush( m_uOut );
+
+    if( !hasUsefulData( m_spec, nodes ) )
+    {
+        PRINT_ERR( "No useful data retrieved.\n" );
+
+        return EXIT_NO_DATA;
+    }
+
+    std::uint32_t coreCount = countCores( m_spec, nodes );
+
+    if( m_spec.brief )
+    {
+        fprintf( m_out, "%u\n", coreCount );
+    }
+    else
+    {
+        if( m_spec.perPlatform )
+        {
+            printPlatformTotals( m_spec, { &nodes }, m_out );
+        }
+
+        printTotals( m_out, nullptr, countShownNodes( m_spec, nodes ), coreCount );
+    }
+
+    fflush( m_out );
+
+    return EXIT_OK;
+}
@@ -0,0 +1,242 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef ICEQUERY_OUTPUT_H
+#define ICEQUERY_OUTPUT_H
+
+#include <cstdio>
+#include <cstdint>      // uint32_t
+#include <memory>       // unique_ptr
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define U_HIDE_DRAFT_API
+#define U_HIDE_DEPRECATED_API
+#define U_HIDE_OBSOLETE_API
+#define U_HIDE_SYSTEM_API
+#define U_HIDE_INTERNAL_API
+
+#include <unicode/translit.h>   // icu::Transliterator
+#include <unicode/ucnv.h>       // UConverter
+#include <unicode/unistr.h>     // icu::UnicodeString
+#include <unicode/ustdio.h>     // UFILE
+
+#include "async.h"
+#include "nodeinfo.h"
+#include "probe.h"
+#include "resolver.h"
+
+// Table consts
+
+#define VERT_LINE_7BIT              "|"
+#define CROSS_7BIT                  "+"
+#define HOR_LINE_7BIT               "-"
+
+#define TICK_7BIT                   "X"
+#define NO_TICK_7BIT                ""
+
+#define VERT_LINE_UTF8              "│"
+#define CROSS_UTF8                  "┼"
+#define HOR_LINE_UTF8               "─"
+
+#define TICK_UTF8                   "√"
+#define NO_TICK_UTF8                ""
+
+// Types/Classes
+
+enum class Alignment : char
+{
+    Left,
+    Right,
+    Center
+};
+
+enum class Encoding : char
+{
+    UTF8,
+    Custom
+};
+
+class ColumnHeader
+{
+public:
+    ColumnHeader( Alignment alignment, Encoding encoding, const std::string& name )
+        : m_alignment( alignment )
+        , m_encoding( encoding )
+        , m_name( name )
+    {
+    }
+
+    ColumnHeader( Alignment alignment, Encoding encoding, const std::string&& name )
+        : m_alignment( alignment )
+        , m_encoding( encoding )
+        , m_name( std::move( name ) )
+    {
+    }
+
+public:
+    Alignment alignment() const
+    {
+        return m_alignment;
+    }
+
+    Encoding encoding() const
+    {
+        return m_encoding;
+    }
+
+    const std::string& name() const
+    {
+        return m_name;
+    }
+
+private:
+    Alignment m_alignment;
+    Encoding m_encoding;
+    std::string m_name;
+};
+
+// Table cells, row by row
+typedef std::pmr::vector<std::pmr::string> Cells;
+
+// Turns the cells into UnicodeStrings, transliterating them if needed
+class CellDecoder
+{
+public:
+    // Exits on failure, the encoding is expected to be checked already
+    CellDecoder( const std::vector<ColumnHeader>& header, bool ascii, const std::string& customEncoding );
+
+public:
+    bool transliterates() const
+    {
+        return m_trans;
+    }
+
+    icu::UnicodeString decode( std::string_view str, Encoding encoding ) const;
+
+private:
+    icu::Transliterator* m_trans;
+    std::unique_ptr<UConverter, void ( * )( UConverter* )> m_converter;
+};
+
+// What and how to print, set from the command line or a batch file line
+struct OutputSpec
+{
+    OutputSpec();
+
+    bool brief;
+    bool noTable;
+
+    std::string customEncoding;
+    bool plain;
+    bool ascii;
+
+    bool noOffline;
+    bool noNoRemote;
+    bool showStale;
+
+    // Only nodes of this platform are shown and counted, if not empty
+    std::string platform;
+    bool perPlatform;
+
+    // Where to print, '-' or empty for stdout
+    std::string path;
+
+    // Names of the nodes' IPs, shown in a column of their own if set
+    const HostNameMap* hostNames;
+
+    // Connection times to the nodes, shown in columns of their own and
+    // summed up per subnet if set
+    const ProbeMap* probes;
+};
+
+// Utility functions
+
+bool checkEncoding( const std::string& encoding );
+
+// Applies whitespace-separated long options (as in a batch file line) onto
+// the spec, false on error
+bool parseOutputOptions( const std::string& line, OutputSpec& spec );
+
+icu::UnicodeString renderTable( const std::vector<ColumnHeader>& header, const Cells& strings, bool plain, bool ascii, const std::string& customEncoding );
+
+// Output functions
+
+bool isNodeShown( const OutputSpec& spec, const NodeInfo& node );
+
+// Whether the node's cores count towards the totals
+bool isNodeCounted( const OutputSpec& spec, const NodeInfo& node );
+
+std::uint32_t countCores( const OutputSpec& spec, const NodeList& nodes );
+std::uint32_t countShownNodes( const OutputSpec& spec, const NodeList& nodes );
+bool hasUsefulData( const OutputSpec& spec, const NodeList& nodes );
+
+std::vector<ColumnHeader> nodeHeader( const OutputSpec& spec );
+void appendNodeCells( const OutputSpec& spec, Cells& strings, const NodeInfo& node );
+
+void printTable( const OutputSpec& spec, const std::vector<ColumnHeader>& header, const Cells& strings, FILE* out );
+void printTotals( FILE* out, const char* label, std::uint32_t nodeCount, std::uint32_t coreCount );
+
+// All these return one of EXIT_* codes
+// The cells are allocated from resource
+int printNodes( const OutputSpec& spec, const NodeList& nodes, FILE* out, std::pmr::memory_resource* resource = std::pmr::get_default_resource() );
+int printFederated( const OutputSpec& spec, const std::vector<QueryTarget>& targets, const std::vector<QueryResult>& results, FILE* out,
+                    std::pmr::memory_resource* resource = std::pmr::get_default_resource() );
+
+// Prints to the spec's path, as a single scheduler's or a federated result
+int printResults( const OutputSpec& spec, const std::vector<QueryTarget>& targets, const std::vector<QueryResult>& results,
+                  std::pmr::memory_resource* resource = std::pmr::get_default_resource() );
+
+// Prints the node table row by row as the nodes arrive, instead of once all
+// of them have. Column widths only grow: whenever a row doesn't fit, the
+// header is printed again with the new widths. The totals follow at the end.
+class ProgressiveTable
+{
+public:
+    ProgressiveTable( const OutputSpec& spec, FILE* out );
+    ~ProgressiveTable();
+
+    ProgressiveTable( const ProgressiveTable& ) = delete;
+    ProgressiveTable& operator=( const ProgressiveTable& ) = delete;
+
+public:
+    void addNode( const NodeInfo& node );
+
+    // Prints the totals of all the nodes, returns one of EXIT_* codes
+    int finish( const NodeList& nodes );
+
+private:
+    OutputSpec m_spec;
+    FILE* m_out;
+    UFILE* m_uOut;
+
+    std::vector<ColumnHeader> m_header;
+    std::unique_ptr<CellDecoder> m_decoder;
+
+    // Decoded header names, as they're re-printed
+    std::vector<icu::UnicodeString> m_headerRow;
+    std::vector<std::size_t> m_widths;
+    bool m_headerShown;
+
+    Cells m_cells;
+};
+
+#endif // ICEQUERY_OUTPUT_H
@@ -0,0 +1,207 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "predict.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>      // free()
+#include <cstring>      // strerror()
+#include <functional>   // greater
+
+#include "common.h"
+
+// Utility functions
+
+static std::string formatWallTime( uint64_t msecs )
+{
+    char buffer[32];
+
+    if( msecs >= 3600000 )
+    {
+        snprintf( buffer, sizeof( buffer ), "%lluh %02llum", static_cast<unsigned long long>( msecs / 3600000 ),
+                  static_cast<unsigned long long>( msecs / 60000 % 60 ) );
+    }
+    else if( msecs >= 60000 )
+    {
+        snprintf( buffer, sizeof( buffer ), "%llum %02llus", static_cast<unsigned long long>( msecs / 60000 ),
+                  static_cast<unsigned long long>( msecs / 1000 % 60 ) );
+    }
+    else if( msecs >= 10000 )
+    {
+        snprintf( buffer, sizeof( buffer ), "%llu s", static_cast<unsigned long long>( ( msecs + 500 ) / 1000 ) );
+    }
+    else
+    {
+        snprintf( buffer, sizeof( buffer ), "%llu ms", static_cast<unsigned long long>( msecs ) );
+    }
+
+    return buffer;
+}
+
+// Output functions
+
+bool readBuildCosts( const std::string& listPath, const CompileCosts& costs, BuildCosts& build )
+{
+    bool fromStdin = ( listPath == "-" );
+    FILE* in = fromStdin ? stdin : fopen( listPath.c_str(), "r" );
+
+    if( !in )
+    {
+        int lastErrno = errno;
+
+        PRINT_ERR( "Unable to open '%s': (%d) %s\n", listPath.c_str(), lastErrno, strerror( lastErrno ) );
+
+        return false;
+    }
+
+    uint32_t median = costs.median();
+
+    build.costs.clear();
+    build.knownCount = 0;
+    build.unknownCost = median ? median : PREDICT_COST_DEFAULT;
+
+    char* lineBuf = nullptr;
+    std::size_t lineBufSize = 0;
+    ssize_t lineLen;
+
+    while( ( lineLen = getline( &lineBuf, &lineBufSize, in ) ) != -1 )
+    {
+        std::string_view line( lineBuf, lineLen );
+
+        while( !line.empty() && ( line.back() == '\n' || line.back() == ' ' || line.back() == '\t' ) )
+        {
+            line.remove_suffix( 1 );
+        }
+
+        std::size_t first = line.find_first_not_of( " \t" );
+
+        if( first == std::string_view::npos || line[first] == '#' )
+        {
+            continue;
+        }
+
+        uint32_t cost = costs.lookup( line.substr( first ) );
+
+        build.knownCount += ( cost != 0 );
+        build.costs.push_back( cost ? cost : build.unknownCost );
+    }
+
+    free( lineBuf );
+
+    if( !fromStdin )
+    {
+        fclose( in );
+    }
+
+    if( build.costs.empty() )
+    {
+        PRINT_ERR( "No files found in '%s'.\n", listPath.c_str() );
+
+        return false;
+    }
+
+    std::sort( build.costs.begin(), build.costs.end(), std::greater<uint32_t>() );
+
+    return true;
+}
+
+int printPrediction( const OutputSpec& spec, const BuildCosts& build, uint32_t slots, FILE* out )
+{
+    if( slots == 0 )
+    {
+        PRINT_ERR( "No cores available to predict the build on.\n" );
+
+        return EXIT_NO_DATA;
+    }
+
+    uint64_t bestTime;
+    uint32_t bestJobs = bestJobCount( build.costs, slots, bestTime );
+
+    if( spec.brief )
+    {
+        fprintf( out, "%u\n", bestJobs );
+
+        return EXIT_OK;
+    }
+
+    uint64_t totalTime = 0;
+
+    for( uint32_t cost : build.costs )
+    {
+        totalTime += cost;
+    }
+
+    if( !spec.noTable )
+    {
+        // Doubling up to the best count, then the most that could be used
+        std::vector<uint32_t> jobCounts;
+        uint32_t maxJobs = static_cast<uint32_t>( std::min<std::size_t>( slots, build.costs.size() ) );
+
+        for( uint32_t jobs = 1; jobs < bestJobs; jobs *= 2 )
+        {
+            jobCounts.push_back( jobs );
+        }
+
+        jobCounts.push_back( bestJobs );
+
+        if( maxJobs != bestJobs )
+        {
+            jobCounts.push_back( maxJobs );
+        }
+
+        std::vector<ColumnHeader> header {
+            { Alignment::Right , Encoding::UTF8     , "Jobs"       },
+            { Alignment::Right , Encoding::UTF8     , "Wall time"  },
+            { Alignment::Right , Encoding::UTF8     , "Speedup"    },
+            { Alignment::Right , Encoding::UTF8     , "Busy"       },
+            { Alignment::Center, Encoding::UTF8     , "Best?"      }
+        };
+
+        Cells strings;
+        strings.reserve( jobCounts.size() * header.size() );
+
+        for( uint32_t jobs : jobCounts )
+        {
+            uint64_t wallTime = ( jobs == bestJobs ) ? bestTime : simulateBuild( build.costs, jobs );
+            char buffer[32];
+
+            strings.emplace_back( std::to_string( jobs ) );
+            strings.emplace_back( formatWallTime( wallTime ) );
+
+            snprintf( buffer, sizeof( buffer ), "%.1fx", static_cast<double>( totalTime ) / wallTime );
+            strings.emplace_back( buffer );
+
+            snprintf( buffer, sizeof( buffer ), "%.0f%%", 100.0 * totalTime / ( static_cast<double>( wallTime ) * jobs ) );
+            strings.emplace_back( buffer );
+
+            strings.emplace_back( ( jobs == bestJobs ) ? ( spec.ascii ? TICK_7BIT : TICK_UTF8 ) : ( spec.ascii ? NO_TICK_7BIT : NO_TICK_UTF8 ) );
+        }
+
+        printTable( spec, header, strings, out );
+    }
+
+    std::size_t unknownCount = build.costs.size() - build.knownCount;
+
+    fprintf( out, "%zu file%s, %zu of unknown cost, taken as %s each.\n", build.costs.size(), build.costs.size() == 1 ? "" : "s",
+             unknownCount, formatWallTime( build.unknownCost ).c_str() );
+    fprintf( out, "Compile time: %s in total, %s for the longest file.\n", formatWallTime( totalTime ).c_str(), formatWallTime( build.costs.front() ).c_str() );
+    fprintf( out, "Predicted wall time: %s with -j%u (of %u slots).\n", formatWallTime( bestTime ).c_str(), bestJobs, slots );
+
+    return EXIT_OK;
+}
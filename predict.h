@@ -0,0 +1,56 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef ICEQUERY_PREDICT_H
+#define ICEQUERY_PREDICT_H
+
+#include <cstdint>      // uint32_t
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "compilecosts.h"
+#include "output.h"
+
+// Assumed compile time of a file when no costs were collected at all, in msecs
+#define PREDICT_COST_DEFAULT        1000
+
+// Compile times of the files of an upcoming build
+struct BuildCosts
+{
+    // In descending order
+    std::vector<uint32_t> costs;
+
+    // Files whose cost was collected before
+    std::size_t knownCount;
+
+    // What the rest were assumed to take
+    uint32_t unknownCost;
+};
+
+// Reads the list of files, one per line ('-' for stdin), and looks their
+// costs up; the unknown ones are assumed to take the median. False on error,
+// after printing it.
+bool readBuildCosts( const std::string& listPath, const CompileCosts& costs, BuildCosts& build );
+
+// Prints the wall time of the build expected with a few job counts up to the
+// given slots, and the best one, returns one of EXIT_* codes. With '--brief',
+// prints the best job count only.
+int printPrediction( const OutputSpec& spec, const BuildCosts& build, uint32_t slots, FILE* out );
+
+#endif // ICEQUERY_PREDICT_H
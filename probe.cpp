@@ -0,0 +1,202 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "probe.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>       // snprintf()
+#include <cstring>      // strerror()
+#include <ctime>        // clock_gettime()
+
+#include <arpa/inet.h>  // inet_pton(), htons()
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>     // close()
+
+#include "async.h"
+
+namespace
+{
+
+struct ProbeQueue
+{
+    std::vector<std::string> addrs;
+    std::size_t next;
+
+    uint16_t port;
+    int timeout;
+    long deadline;
+
+    ProbeMap& results;
+};
+
+}
+
+// Utility functions
+
+static long nowUsecs()
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Fills in the address, false if it's not a numeric one
+static bool makeSockAddr( const std::string& addr, uint16_t port, struct sockaddr_storage& storage, socklen_t& length )
+{
+    auto* in4 = reinterpret_cast<struct sockaddr_in*>( &storage );
+    auto* in6 = reinterpret_cast<struct sockaddr_in6*>( &storage );
+
+    storage = {};
+
+    if( inet_pton( AF_INET, addr.c_str(), &in4->sin_addr ) == 1 )
+    {
+        in4->sin_family = AF_INET;
+        in4->sin_port = htons( port );
+        length = sizeof( *in4 );
+    }
+    else if( inet_pton( AF_INET6, addr.c_str(), &in6->sin6_addr ) == 1 )
+    {
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons( port );
+        length = sizeof( *in6 );
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+// Probe coroutines
+
+static Task<ProbeResult> probeOne( Reactor& reactor, const std::string& addr, uint16_t port, long deadline )
+{
+    struct sockaddr_storage storage;
+    socklen_t length;
+
+    if( !makeSockAddr( addr, port, storage, length ) )
+    {
+        co_return ProbeResult { -1, EINVAL };
+    }
+
+    int fd = socket( storage.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+
+    if( fd < 0 )
+    {
+        co_return ProbeResult { -1, errno };
+    }
+
+    const long start = nowUsecs();
+    int error = 0;
+
+    if( connect( fd, reinterpret_cast<struct sockaddr*>( &storage ), length ) != 0 )
+    {
+        error = errno;
+    }
+
+    if( error == EINPROGRESS )
+    {
+        if( co_await reactor.wait( fd, POLLOUT, deadline ) )
+        {
+            socklen_t errorLength = sizeof( error );
+
+            if( getsockopt( fd, SOL_SOCKET, SO_ERROR, &error, &errorLength ) != 0 )
+            {
+                error = errno;
+            }
+        }
+        else
+        {
+            error = ETIMEDOUT;
+        }
+    }
+
+    const long rtt = nowUsecs() - start;
+
+    close( fd );
+
+    co_return ProbeResult { error ? -1 : rtt, error };
+}
+
+static Task<void> probeWorker( Reactor& reactor, ProbeQueue& queue )
+{
+    while( queue.next < queue.addrs.size() )
+    {
+        const std::string& addr = queue.addrs[queue.next++];
+        long deadline = getTimestamp() + queue.timeout;
+
+        if( queue.deadline >= 0 )
+        {
+            deadline = std::min( deadline, queue.deadline );
+        }
+
+        queue.results[addr] = co_await probeOne( reactor, addr, queue.port, deadline );
+    }
+}
+
+// Probe functions
+
+bool probeAddresses( IoBackend::Type backendType, const std::vector<std::string>& addrs, uint16_t port, int timeout, long deadline, ProbeMap& results )
+{
+    ProbeQueue queue { addrs, 0, port, timeout, deadline, results };
+
+    std::sort( queue.addrs.begin(), queue.addrs.end() );
+    queue.addrs.erase( std::unique( queue.addrs.begin(), queue.addrs.end() ), queue.addrs.end() );
+
+    Reactor reactor( backendType );
+
+    for( std::size_t i = 0; i < std::min<std::size_t>( queue.addrs.size(), PROBE_CONCURRENCY ); ++i )
+    {
+        reactor.spawn( probeWorker( reactor, queue ) );
+    }
+
+    return reactor.run();
+}
+
+std::string probeResultToStr( const ProbeResult& result )
+{
+    switch( result.error )
+    {
+        case 0:
+        {
+            char buffer[32];
+            snprintf( buffer, sizeof( buffer ), "%.2f ms", result.rtt / 1000.0 );
+
+            return buffer;
+        }
+
+        case ETIMEDOUT:
+            return "timeout";
+
+        case ECONNREFUSED:
+            return "refused";
+
+        case EHOSTUNREACH:
+        case ENETUNREACH:
+            return "unreachable";
+
+        default:
+            return strerror( result.error );
+    }
+}
@@ -0,0 +1,61 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef ICEQUERY_PROBE_H
+#define ICEQUERY_PROBE_H
+
+#include <cstdint>      // uint16_t
+#include <functional>   // equal_to
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common.h"
+#include "iobackend.h"
+
+// The port compile nodes' daemons listen on
+#define PROBE_PORT                  10245
+
+// Connections being made at once at most
+#define PROBE_CONCURRENCY           64
+
+// How long a single connection is waited for without a '--deadline', in msecs
+#define PROBE_TIMEOUT_DEFAULT       1000
+
+struct ProbeResult
+{
+    // Time it took to connect, in microseconds, -1 if unreachable
+    long rtt;
+
+    // The errno of the failed connect(), ETIMEDOUT if not answered in time
+    int error;
+};
+
+// Results by address
+typedef std::unordered_map<std::string, ProbeResult, StringViewHash, std::equal_to<>> ProbeMap;
+
+// Connects to the port of every address with non-blocking sockets, at most
+// PROBE_CONCURRENCY of them at once, giving each timeout msecs and all of
+// them till the absolute getTimestamp() deadline (none if -1); false on a
+// backend error
+bool probeAddresses( IoBackend::Type backendType, const std::vector<std::string>& addrs, uint16_t port, int timeout, long deadline, ProbeMap& results );
+
+// A short description of the result, like '0.42 ms' or 'refused'
+std::string probeResultToStr( const ProbeResult& result );
+
+#endif // ICEQUERY_PROBE_H
@@ -0,0 +1,545 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "query.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>      // INT_MAX
+#include <utility>      // exchange()
+
+#include <poll.h>
+#include <unistd.h>     // close()
+
+#include <icecc/comm.h>
+
+#include "common.h"
+
+// Other functions
+
+const char* MsgTypeToStr( int msgType )
+{
+    switch( msgType )
+    {
+        case MsgType::M_MON_GET_CS:
+            return "M_MON_GET_CS";
+
+        case MsgType::M_MON_JOB_BEGIN:
+            return "M_MON_JOB_BEGIN";
+
+        case MsgType::M_MON_JOB_DONE:
+            return "M_MON_JOB_DONE";
+
+        case MsgType::M_MON_LOCAL_JOB_BEGIN:
+            return "M_MON_LOCAL_JOB_BEGIN";
+
+        case MsgType::M_MON_STATS:
+            return "M_MON_STATS";
+
+        default:
+            return "<Unknown>";
+    }
+}
+
+// NodeCollector
+
+NodeCollector::NodeCollector()
+    : m_hostIdMax( 0 )
+    , m_msgNo( 0 )
+{
+}
+
+NodeCollector::Result NodeCollector::handle( const Msg& msg )
+{
+    ++m_msgNo;
+
+    if( msg.type == M_MON_STATS )
+    {
+        const MonStatsMsg* statsMsg = dynamic_cast<const MonStatsMsg*>(&msg);
+
+        return handleStats( statsMsg->hostid, statsMsg->statmsg );
+    }
+
+    return handleOther( msg.type );
+}
+
+NodeCollector::Result NodeCollector::handle( const MonitorChannel::Frame& frame )
+{
+    ++m_msgNo;
+
+    if( frame.type == M_MON_STATS )
+    {
+        uint32_t hostId;
+        std::string_view stats;
+
+        if( !MonitorChannel::parseStats( frame.payload, hostId, stats ) )
+        {
+            PRINT_DEBUG( "Message %u is a malformed M_MON_STATS\n", m_msgNo );
+
+            return Result::Useless;
+        }
+
+        return handleStats( hostId, stats );
+    }
+
+    return handleOther( static_cast<int>( frame.type ) );
+}
+
+NodeCollector::Result NodeCollector::handleStats( uint32_t hostId, std::string_view stats )
+{
+    PRINT_DEBUG( "\nMessage %u:\n-\n%.*s-\n", m_msgNo, static_cast<int>( stats.size() ), stats.data() );
+
+    auto nodeInfo = NodeInfo::create( hostId, stats );
+
+    if( nodeInfo && nodeInfo->hostId() > m_hostIdMax )
+    {
+        // Keep track of highest hostId in case the scheduler sends multiple copies of the same hostInfos
+        m_hostIdMax = nodeInfo->hostId();
+        m_nodes.push_back( std::move( nodeInfo ) );
+
+        return Result::Useful;
+    }
+
+    PRINT_DEBUG( "Message %u considered useless\n", m_msgNo );
+
+    return Result::Useless;
+}
+
+NodeCollector::Result NodeCollector::handleOther( int msgType )
+{
+    if( msgType == M_END )
+    {
+        PRINT_ERR( "Received M_END (%d). Scheduler has quit.\n", M_END );
+
+        return Result::End;
+    }
+
+    PRINT_DEBUG( "Message %u of type %s (%d) ignored\n", m_msgNo, MsgTypeToStr( msgType ), msgType );
+    PRINT_DEBUG( "Message %u considered useless\n", m_msgNo );
+
+    return Result::Useless;
+}
+
+// Query
+
+Query::Query( const std::string& netName, int timeout, int rtimeout, const std::string& schedAddr, uint16_t schedPort, MonitorClient client )
+    : m_timeout( timeout )
+    , m_rtimeout( rtimeout )
+    , m_state( State::Discovering )
+    , m_exitCode( EXIT_OK )
+    , m_startTimestamp( getTimestamp() )
+    , m_deadline( m_startTimestamp )
+    , m_overallDeadline( -1 )
+    , m_client( client )
+    , m_netName( netName )
+    , m_discoverFd( -1 )
+    , m_connectFd( -1 )
+    , m_peerLen( sizeof( m_peer ) )
+    , m_isLoggedIn( false )
+{
+    PRINT_INFO( "Attempting to connect to the scheduler...\n" );
+
+    std::string addr = schedAddr;
+    uint16_t port = schedPort ? schedPort : SCHEDULER_PORT;
+    bool isStarted;
+
+    if( addr.empty() && !schedulerFromEnv( addr, port ) )
+    {
+        m_discoverFd = startDiscovery();
+        isStarted = m_discoverFd >= 0;
+    }
+    else
+    {
+        isStarted = connect( addr, port );
+    }
+
+    if( !isStarted )
+    {
+        fail( EXIT_CONNECTION_ERR );
+    }
+    else
+    {
+        m_deadline = m_startTimestamp + timeout;
+    }
+}
+
+Query::~Query()
+{
+    if( m_discoverFd >= 0 )
+    {
+        close( m_discoverFd );
+    }
+
+    if( m_connectFd >= 0 )
+    {
+        close( m_connectFd );
+    }
+}
+
+void Query::setDeadline( long deadline )
+{
+    m_overallDeadline = deadline;
+    m_deadline = clipDeadline( m_deadline );
+}
+
+int Query::fd() const
+{
+    switch( m_state )
+    {
+        case State::Discovering:
+            if( m_discoverFd >= 0 || m_connectFd >= 0 )
+            {
+                return m_discoverFd >= 0 ? m_discoverFd : m_connectFd;
+            }
+
+            return m_channel ? m_channel->fd : m_monitor->fd();
+
+        case State::Retrieving:
+            return m_channel ? m_channel->fd : m_monitor->fd();
+
+        default:
+            return -1;
+    }
+}
+
+short Query::events() const
+{
+    switch( m_state )
+    {
+        case State::Discovering:
+            if( m_discoverFd >= 0 )
+            {
+                return POLLIN;
+            }
+
+            if( m_monitor )
+            {
+                return m_monitor->events();
+            }
+
+            // Connected once writable, then the scheduler's protocol version
+            // is read and the login written
+            return ( m_connectFd < 0 && m_channel->needsProtocol() ) ? POLLIN : POLLOUT;
+
+        case State::Retrieving:
+            return m_channel ? POLLIN | POLLPRI : m_monitor->events() | POLLPRI;
+
+        default:
+            return 0;
+    }
+}
+
+long Query::deadline() const
+{
+    return m_deadline;
+}
+
+int Query::pollTimeout() const
+{
+    if( isFinished() )
+    {
+        return 0;
+    }
+
+    return static_cast<int>( std::min<long>( std::max<long>( m_deadline - getTimestamp(), 0 ), INT_MAX ) );
+}
+
+bool Query::process( short revents )
+{
+    switch( m_state )
+    {
+        case State::Discovering:
+            discover( revents );
+            break;
+
+        case State::Retrieving:
+            if( m_channel )
+            {
+                retrieve( revents );
+            }
+            else
+            {
+                retrieveNative( revents );
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return isFinished();
+}
+
+void Query::retrieve( short revents )
+{
+    if( !revents )
+    {
+        long now = getTimestamp();
+
+        if( now >= m_deadline )
+        {
+            if( m_overallDeadline >= 0 && now >= m_overallDeadline )
+            {
+                PRINT_WARN( "Deadline reached while retrieving messages, the data may be incomplete.\n" );
+            }
+
+            m_state = State::Done;
+        }
+
+        return;
+    }
+
+    bool wasPollUseful = false;
+
+    while( !m_channel->read_a_bit() || m_channel->has_msg() )
+    {
+        std::unique_ptr<Msg> msg( m_channel->get_msg() );
+
+        if( !msg )
+        {
+            PRINT_ERR( "MsgChannel::get_msg(): No messages received from the scheduler.\n" );
+
+            fail( EXIT_CONNECTION_ERR );
+            return;
+        }
+
+        NodeCollector::Result result = m_collector.handle( *msg );
+
+        if( result == NodeCollector::Result::End )
+        {
+            fail( EXIT_CONNECTION_ERR );
+            return;
+        }
+
+        wasPollUseful |= ( result == NodeCollector::Result::Useful );
+    }
+
+    if( wasPollUseful )
+    {
+        m_deadline = clipDeadline( getTimestamp() + m_rtimeout );
+    }
+    else
+    {
+        m_state = State::Done;
+    }
+}
+
+void Query::discover( short revents )
+{
+    long now = getTimestamp();
+    long timeoutTimestamp = clipDeadline( m_startTimestamp + m_timeout );
+    bool isOk = true;
+
+    if( m_discoverFd >= 0 )
+    {
+        if( revents )
+        {
+            readDiscoveryReplies( m_discoverFd, m_schedulers );
+
+            // The first scheduler of the net answering is taken
+            const SchedulerInfo* scheduler = findScheduler( m_schedulers, m_netName );
+
+            if( scheduler )
+            {
+                PRINT_DEBUG( "Scheduler '%s' found at %s:%u\n", scheduler->netName.c_str(), scheduler->addr.c_str(), scheduler->port );
+
+                close( m_discoverFd );
+                m_discoverFd = -1;
+
+                isOk = connect( scheduler->addr, scheduler->port );
+            }
+        }
+    }
+    else if( m_monitor )
+    {
+        isOk = m_monitor->process( revents );
+    }
+    else if( revents )
+    {
+        isOk = advanceLogIn();
+    }
+
+    if( !isOk )
+    {
+        fail( EXIT_CONNECTION_ERR );
+        return;
+    }
+
+    if( m_monitor ? m_monitor->state() == MonitorChannel::State::Ready : m_isLoggedIn )
+    {
+        if( m_monitor )
+        {
+            PRINT_DEBUG( "Logged in using protocol version %u\n", m_monitor->protocolVersion() );
+        }
+
+        PRINT_INFO( "Retrieving messages...\n" );
+
+        m_state = State::Retrieving;
+        m_deadline = clipDeadline( now + m_rtimeout );
+
+        if( m_monitor )
+        {
+            // The dump can follow the handshake within the same read
+            retrieveNative( POLLIN );
+        }
+
+        return;
+    }
+
+    if( now > timeoutTimestamp )
+    {
+        PRINT_ERR( "Timed out while trying to connect to the scheduler.\n" );
+
+        fail( EXIT_CONNECTION_ERR );
+        return;
+    }
+
+    m_deadline = timeoutTimestamp + 1;
+}
+
+bool Query::connect( const std::string& addr, uint16_t port )
+{
+    if( m_client == MonitorClient::Native )
+    {
+        m_monitor.reset( new MonitorChannel() );
+
+        return m_monitor->connect( addr, port );
+    }
+
+    m_peerLen = sizeof( m_peer );
+    m_connectFd = startConnect( addr, port, &m_peer, &m_peerLen );
+
+    return m_connectFd >= 0;
+}
+
+bool Query::advanceLogIn()
+{
+    if( m_connectFd >= 0 )
+    {
+        int fd = std::exchange( m_connectFd, -1 );
+
+        if( !finishConnect( fd ) )
+        {
+            close( fd );
+            return false;
+        }
+
+        // Owns the descriptor from now on
+        m_channel.reset( new HandshakeChannel( fd, m_peer, m_peerLen ) );
+
+        return true;
+    }
+
+    if( m_channel->needsProtocol() )
+    {
+        if( !m_channel->read_a_bit() || m_channel->at_eof() )
+        {
+            PRINT_ERR( "MsgChannel::read_a_bit(): Protocol version exchange with the scheduler failed.\n" );
+
+            return false;
+        }
+
+        return true;
+    }
+
+    // The message is tiny, sent at once now that there's room for it
+    m_channel->setBulkTransfer();
+
+    if( !m_channel->send_msg( MonLoginMsg() ) )
+    {
+        PRINT_ERR( "MsgChannel::send_msg(): Scheduler rejected the MonLoginMsg message.\n" );
+
+        return false;
+    }
+
+    m_isLoggedIn = true;
+
+    return true;
+}
+
+void Query::retrieveNative( short revents )
+{
+    if( !revents )
+    {
+        retrieve( revents );
+        return;
+    }
+
+    bool isOpen = m_monitor->process( revents );
+    bool wasAnyFrame = false;
+    bool wasPollUseful = false;
+    MonitorChannel::Frame frame;
+
+    while( m_monitor->nextFrame( frame ) )
+    {
+        NodeCollector::Result result = m_collector.handle( frame );
+
+        if( result == NodeCollector::Result::End )
+        {
+            fail( EXIT_CONNECTION_ERR );
+            return;
+        }
+
+        wasAnyFrame = true;
+        wasPollUseful |= ( result == NodeCollector::Result::Useful );
+    }
+
+    if( !isOpen || m_monitor->state() == MonitorChannel::State::Closed )
+    {
+        PRINT_ERR( "MonitorChannel: No more messages received from the scheduler.\n" );
+
+        fail( EXIT_CONNECTION_ERR );
+        return;
+    }
+
+    // Unlike with MsgChannel, reading just a part of a frame ends nothing
+    if( wasPollUseful )
+    {
+        m_deadline = clipDeadline( getTimestamp() + m_rtimeout );
+    }
+    else if( wasAnyFrame )
+    {
+        m_state = State::Done;
+    }
+}
+
+long Query::clipDeadline( long deadline ) const
+{
+    return m_overallDeadline >= 0 ? std::min( deadline, m_overallDeadline ) : deadline;
+}
+
+void Query::fail( int exitCode )
+{
+    m_state = State::Failed;
+    m_exitCode = exitCode;
+    m_channel.reset();
+    m_monitor.reset();
+
+    if( m_discoverFd >= 0 )
+    {
+        close( m_discoverFd );
+        m_discoverFd = -1;
+    }
+
+    if( m_connectFd >= 0 )
+    {
+        close( m_connectFd );
+        m_connectFd = -1;
+    }
+}
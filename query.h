@@ -0,0 +1,213 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef ICEQUERY_QUERY_H
+#define ICEQUERY_QUERY_H
+
+#include <cstdint>      // uint32_t, uint16_t
+#include <memory>       // unique_ptr
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <icecc/comm.h>
+
+#include "discovery.h"
+#include "monitorchannel.h"
+#include "nodeinfo.h"
+
+// Name of a MsgType value, for debugging purposes
+const char* MsgTypeToStr( int msgType );
+
+// A libicecc channel over a socket connected by startConnect(). It exchanges
+// the protocol versions by itself as data arrives, this only tells when
+// that's done, as waiting for it with wait_for_protocol() would block.
+class HandshakeChannel : public MsgChannel
+{
+public:
+    HandshakeChannel( int fd, struct sockaddr_storage& peer, socklen_t peerLen )
+        : MsgChannel( fd, reinterpret_cast<struct sockaddr*>( &peer ), peerLen, false )
+    {
+    }
+
+public:
+    bool needsProtocol() const
+    {
+        return instate == NEED_PROTO;
+    }
+};
+
+// Turns monitor messages into a node list, shared by all query drivers
+class NodeCollector
+{
+public:
+    enum class Result : char
+    {
+        Useful,
+        Useless,
+        End
+    };
+
+public:
+    NodeCollector();
+
+public:
+    Result handle( const Msg& msg );
+
+    // The same for a frame read by MonitorChannel, decoding stats only
+    Result handle( const MonitorChannel::Frame& frame );
+
+    const NodeList& nodes() const
+    {
+        return m_nodes;
+    }
+
+    NodeList& nodes()
+    {
+        return m_nodes;
+    }
+
+private:
+    Result handleStats( uint32_t hostId, std::string_view stats );
+    Result handleOther( int msgType );
+
+private:
+    NodeList m_nodes;
+    uint32_t m_hostIdMax;
+    uint32_t m_msgNo;
+};
+
+// A single scheduler query (discovery, login, retrieval) as a non-blocking
+// state machine. Whoever drives it waits for fd()/events() or deadline(),
+// whichever comes first, and then calls process() with the returned events
+// (or 0 on timeout) until isFinished() returns true.
+class Query
+{
+public:
+    enum class State : char
+    {
+        Discovering,
+        Retrieving,
+        Done,
+        Failed
+    };
+
+public:
+    Query( const std::string& netName, int timeout, int rtimeout, const std::string& schedAddr, uint16_t schedPort,
+           MonitorClient client = MonitorClient::Libicecc );
+    ~Query();
+
+    Query( const Query& ) = delete;
+    Query& operator=( const Query& ) = delete;
+
+public:
+    // Absolute getTimestamp() value after which the query finishes with
+    // whatever it has, -1 (default) for none
+    void setDeadline( long deadline );
+
+    // Descriptor to wait on, -1 if there's nothing to wait for but the
+    // deadline; it can change after any call to process()
+    int fd() const;
+
+    // poll() events to wait for on fd()
+    short events() const;
+
+    // Absolute getTimestamp() value at which process() has to be called
+    // even if fd() never becomes ready
+    long deadline() const;
+
+    // Milliseconds left until deadline(), suitable for poll() and friends
+    int pollTimeout() const;
+
+    // Advances the query; revents are the events fd() became ready with, 0 if
+    // the wait timed out. Returns true once the query is finished.
+    bool process( short revents );
+
+    State state() const
+    {
+        return m_state;
+    }
+
+    bool isFinished() const
+    {
+        return m_state == State::Done || m_state == State::Failed;
+    }
+
+    // One of EXIT_* codes, meaningful once finished
+    int exitCode() const
+    {
+        return m_exitCode;
+    }
+
+    const NodeList& nodes() const
+    {
+        return m_collector.nodes();
+    }
+
+    NodeList takeNodes()
+    {
+        return std::move( m_collector.nodes() );
+    }
+
+private:
+    // Broadcasts for the scheduler if there's no address to connect to, then
+    // connects and logs in with either client
+    void discover( short revents );
+    bool connect( const std::string& addr, uint16_t port );
+
+    // Takes the libicecc channel a step further through connecting, the
+    // protocol version exchange and sending the login once its descriptor
+    // is ready, false on failure
+    bool advanceLogIn();
+
+    void retrieve( short revents );
+
+    // The same with MonitorChannel
+    void retrieveNative( short revents );
+
+    void fail( int exitCode );
+    long clipDeadline( long deadline ) const;
+
+private:
+    int m_timeout;
+    int m_rtimeout;
+
+    State m_state;
+    int m_exitCode;
+    long m_startTimestamp;
+    long m_deadline;
+    long m_overallDeadline;
+
+    MonitorClient m_client;
+    std::string m_netName;
+    int m_discoverFd;
+
+    int m_connectFd;
+    struct sockaddr_storage m_peer;
+    socklen_t m_peerLen;
+    std::unique_ptr<HandshakeChannel> m_channel;
+    bool m_isLoggedIn;
+
+    std::vector<SchedulerInfo> m_schedulers;
+    std::unique_ptr<MonitorChannel> m_monitor;
+
+    NodeCollector m_collector;
+};
+
+#endif // ICEQUERY_QUERY_H
@@ -0,0 +1,349 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "rank.h"
+
+#include <algorithm>
+#include <cmath>        // std::log2()
+#include <string>
+
+#include <icecc/comm.h>
+
+#include "common.h"
+
+// Utility functions
+
+// The p-th percentile of the values, reordering them
+static uint32_t percentile( std::vector<uint32_t>& values, std::size_t p )
+{
+    auto nth = values.begin() + ( values.size() - 1 ) * p / 100;
+    std::nth_element( values.begin(), nth, values.end() );
+
+    return *nth;
+}
+
+static std::string formatMsecs( uint32_t msecs )
+{
+    char buffer[32];
+
+    if( msecs >= 10000 )
+    {
+        snprintf( buffer, sizeof( buffer ), "%u s", ( msecs + 500 ) / 1000 );
+    }
+    else
+    {
+        snprintf( buffer, sizeof( buffer ), "%u ms", msecs );
+    }
+
+    return buffer;
+}
+
+// NodeRanking
+
+NodeRanking::NodeRanking( const std::vector<std::unique_ptr<Session>>& sessions )
+    : m_sessions( sessions )
+{
+    for( const auto& session : m_sessions )
+    {
+        session->addListener( this );
+    }
+}
+
+NodeRanking::~NodeRanking()
+{
+    for( const auto& session : m_sessions )
+    {
+        session->removeListener( this );
+    }
+}
+
+std::vector<NodeRanking::Entry> NodeRanking::rank( const OutputSpec& spec ) const
+{
+    std::vector<Entry> entries;
+    std::vector<uint32_t> medians;
+    uint32_t maxJobs = 1;
+
+    for( std::size_t i = 0; i < m_sessions.size(); ++i )
+    {
+        for( const auto& nodeEntry : m_sessions[i]->nodes() )
+        {
+            const NodeInfo& node = *nodeEntry.second;
+
+            if( !isNodeCounted( spec, node ) || node.isStale() || node.maxJobs() == 0 )
+            {
+                continue;
+            }
+
+            uint32_t jobs = m_jobs.jobCount( i, node.hostId() );
+            Entry entry { i, &node, node.maxJobs() > jobs ? node.maxJobs() - jobs : 0, 0, 0, 0, 0 };
+            auto it = m_jobTimes.find( NodeKey( i, node.hostId() ) );
+
+            if( it != m_jobTimes.end() && it->second.msecs.size() >= RANK_MIN_JOBS )
+            {
+                std::vector<uint32_t> msecs = it->second.msecs;
+
+                entry.jobCount = msecs.size();
+                entry.p50 = std::max( percentile( msecs, 50 ), 1u );
+                entry.p90 = std::max( percentile( msecs, 90 ), entry.p50 );
+
+                medians.push_back( entry.p50 );
+            }
+
+            maxJobs = std::max( maxJobs, node.maxJobs() );
+            entries.push_back( entry );
+        }
+    }
+
+    // Nodes without enough jobs are taken as fast as a typical one
+    const double farmMedian = medians.empty() ? 0 : percentile( medians, 50 );
+    double bestScore = 0;
+
+    for( Entry& entry : entries )
+    {
+        double speed = 1;
+        double consistency = 1;
+
+        if( entry.jobCount && farmMedian > 0 )
+        {
+            speed = std::clamp( farmMedian / entry.p50, 1 / RANK_SPEED_LIMIT, RANK_SPEED_LIMIT );
+            consistency = static_cast<double>( entry.p50 ) / entry.p90;
+        }
+
+        double availability = static_cast<double>( entry.freeSlots ) / entry.node->maxJobs();
+        double capacity = std::log2( 1.0 + entry.node->maxJobs() ) / std::log2( 1.0 + maxJobs );
+
+        entry.score = speed * ( 0.25 + 0.75 * availability ) * ( 0.5 + 0.5 * capacity ) * ( 0.5 + 0.5 * consistency );
+        bestScore = std::max( bestScore, entry.score );
+    }
+
+    for( Entry& entry : entries )
+    {
+        entry.score = bestScore > 0 ? entry.score * 100 / bestScore : 0;
+    }
+
+    std::stable_sort( entries.begin(), entries.end(), [] ( const Entry& a, const Entry& b ) { return a.score > b.score; } );
+
+    return entries;
+}
+
+void NodeRanking::onStateChanged( Session& session )
+{
+    // The scheduler doesn't repeat the running jobs after a reconnect
+    if( session.state() == Session::State::Connecting )
+    {
+        m_jobs.drop( sessionIndex( session ) );
+    }
+}
+
+void NodeRanking::onMessage( Session& session, const Msg& msg )
+{
+    std::size_t index = sessionIndex( session );
+    uint32_t hostId = m_jobs.handle( index, msg );
+
+    if( !hostId || msg.type != M_MON_JOB_DONE )
+    {
+        return;
+    }
+
+    const MonJobDoneMsg& doneMsg = dynamic_cast<const MonJobDoneMsg&>( msg );
+
+    // Failed jobs say little about the node's speed
+    if( doneMsg.exitcode != 0 || doneMsg.real_msec == 0 )
+    {
+        return;
+    }
+
+    JobTimes& times = m_jobTimes[NodeKey( index, hostId )];
+
+    if( times.msecs.size() < RANK_JOB_WINDOW )
+    {
+        times.msecs.push_back( doneMsg.real_msec );
+    }
+    else
+    {
+        times.msecs[times.next] = doneMsg.real_msec;
+        times.next = ( times.next + 1 ) % RANK_JOB_WINDOW;
+    }
+}
+
+std::size_t NodeRanking::sessionIndex( const Session& session ) const
+{
+    for( std::size_t i = 0; i < m_sessions.size(); ++i )
+    {
+        if( m_sessions[i].get() == &session )
+        {
+            return i;
+        }
+    }
+
+    return 0;
+}
+
+// Output functions
+
+void printRanking( const OutputSpec& spec, const std::vector<QueryTarget>& targets, const std::vector<NodeRanking::Entry>& entries, std::size_t count, FILE* out )
+{
+    count = std::min( count, entries.size() );
+
+    if( spec.brief )
+    {
+        for( std::size_t i = 0; i < count; ++i )
+        {
+            fprintf( out, "%s\n", entries[i].node->name().c_str() );
+        }
+
+        fflush( out );
+
+        return;
+    }
+
+    if( !spec.noTable )
+    {
+        std::vector<ColumnHeader> header { { Alignment::Right, Encoding::UTF8, "#" } };
+
+        if( targets.size() > 1 )
+        {
+            header.emplace_back( Alignment::Left, Encoding::UTF8, "Scheduler" );
+        }
+
+        header.insert( header.end(), {
+            { Alignment::Right , Encoding::UTF8     , "Node #"     },
+            { Alignment::Left  , Encoding::Custom   , "Name"       },
+            { Alignment::Left  , Encoding::UTF8     , "IP"         },
+            { Alignment::Left  , Encoding::UTF8     , "Platform"   },
+            { Alignment::Right , Encoding::UTF8     , "Cores"      },
+            { Alignment::Right , Encoding::UTF8     , "Free"       },
+            { Alignment::Right , Encoding::UTF8     , "Jobs"       },
+            { Alignment::Right , Encoding::UTF8     , "Median"     },
+            { Alignment::Right , Encoding::UTF8     , "90th %"     },
+            { Alignment::Right , Encoding::UTF8     , "Score"      }
+        } );
+
+        Cells strings;
+        strings.reserve( count * header.size() );
+
+        for( std::size_t i = 0; i < count; ++i )
+        {
+            const NodeRanking::Entry& entry = entries[i];
+            char score[16];
+
+            snprintf( score, sizeof( score ), "%.0f", entry.score );
+
+            strings.emplace_back( std::to_string( i + 1 ) );
+
+            if( targets.size() > 1 )
+            {
+                strings.emplace_back( targets[entry.scheduler].label() );
+            }
+
+            strings.emplace_back( std::to_string( entry.node->hostId() ) );
+            strings.emplace_back( entry.node->name() );
+            strings.emplace_back( entry.node->ip() );
+            strings.emplace_back( entry.node->platform() );
+            strings.emplace_back( std::to_string( entry.node->maxJobs() ) );
+            strings.emplace_back( std::to_string( entry.freeSlots ) );
+            strings.emplace_back( std::to_string( entry.jobCount ) );
+            strings.emplace_back( entry.jobCount ? formatMsecs( entry.p50 ) : std::string() );
+            strings.emplace_back( entry.jobCount ? formatMsecs( entry.p90 ) : std::string() );
+            strings.emplace_back( score );
+        }
+
+        printTable( spec, header, strings, out );
+    }
+
+    if( count )
+    {
+        fprintf( out, "ICECC_PREFERRED_HOST=%s\n", entries.front().node->name().c_str() );
+    }
+    else
+    {
+        fprintf( out, "No nodes available.\n" );
+    }
+
+    fflush( out );
+}
+
+// Ranking coroutines
+
+static Task<int> rankPeriodically( Reactor& reactor, const std::vector<std::unique_ptr<Session>>& sessions, const std::vector<QueryTarget>& targets,
+                                   const NodeRanking& ranking, const OutputSpec& spec, std::size_t count, long period, int interval )
+{
+    int res = EXIT_OK;
+    long nextPrint = getTimestamp() + period * 1000;
+
+    while( true )
+    {
+        co_await reactor.sleepUntil( nextPrint );
+
+        bool anyConnected = false;
+
+        for( const auto& session : sessions )
+        {
+            anyConnected = anyConnected || session->connectionCount() > 0;
+        }
+
+        if( anyConnected )
+        {
+            printRanking( spec, targets, ranking.rank( spec ), count, stdout );
+        }
+        else if( interval <= 0 )
+        {
+            PRINT_ERR( "Unable to connect to the scheduler%s.\n", sessions.size() == 1 ? "" : "s" );
+
+            res = EXIT_CONNECTION_ERR;
+        }
+
+        if( interval <= 0 )
+        {
+            break;
+        }
+
+        nextPrint += interval;
+    }
+
+    for( const auto& session : sessions )
+    {
+        session->stop();
+    }
+
+    co_return res;
+}
+
+int runRanking( const std::vector<QueryTarget>& targets, IoBackend::Type ioBackend, const OutputSpec& spec, std::size_t count, long period, int interval )
+{
+    Reactor reactor( ioBackend );
+    std::vector<std::unique_ptr<Session>> sessions;
+
+    for( const QueryTarget& target : targets )
+    {
+        sessions.emplace_back( new Session( target ) );
+        reactor.spawn( sessions.back()->run( reactor ) );
+    }
+
+    NodeRanking ranking( sessions );
+    int exitCode = EXIT_OK;
+
+    reactor.spawn( awaitInto( rankPeriodically( reactor, sessions, targets, ranking, spec, count, period, interval ), exitCode ) );
+
+    if( !reactor.run() )
+    {
+        return EXIT_CONNECTION_ERR;
+    }
+
+    return exitCode;
+}
@@ -0,0 +1,114 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef ICEQUERY_RANK_H
+#define ICEQUERY_RANK_H
+
+#include <cstdint>      // uint32_t
+#include <cstdio>
+#include <map>
+#include <memory>       // unique_ptr
+#include <utility>      // pair
+#include <vector>
+
+#include "async.h"
+#include "jobtracker.h"
+#include "output.h"
+#include "session.h"
+
+#define RANK_COUNT_DEFAULT          10
+
+// How long the job stream is followed before ranking, in seconds
+#define RANK_PERIOD_DEFAULT         60
+
+// Recent jobs of each node whose durations are kept
+#define RANK_JOB_WINDOW             64
+
+// Jobs a node needs to have run for its durations to count
+#define RANK_MIN_JOBS               3
+
+// How far a node's speed relative to the farm can go either way
+#define RANK_SPEED_LIMIT            4.0
+
+// Scores the nodes eligible for remote jobs from what the monitor stream
+// says: how many jobs they take, how many of them are free right now, and
+// how long their recent jobs took compared to the rest of the farm, the
+// median and the 90th percentile.
+class NodeRanking : public SessionListener
+{
+public:
+    struct Entry
+    {
+        std::size_t scheduler;
+        const NodeInfo* node;
+
+        uint32_t freeSlots;
+
+        // Durations of the recent jobs, in msecs, 0 if there weren't enough
+        uint32_t jobCount;
+        uint32_t p50;
+        uint32_t p90;
+
+        // Relative to the best node, 0-100
+        double score;
+    };
+
+public:
+    explicit NodeRanking( const std::vector<std::unique_ptr<Session>>& sessions );
+    ~NodeRanking();
+
+    NodeRanking( const NodeRanking& ) = delete;
+    NodeRanking& operator=( const NodeRanking& ) = delete;
+
+public:
+    // The nodes counted by the spec, best first; valid till the sessions
+    // handle another message
+    std::vector<Entry> rank( const OutputSpec& spec ) const;
+
+    void onStateChanged( Session& session ) override;
+    void onMessage( Session& session, const Msg& msg ) override;
+
+private:
+    // Session index and host id
+    typedef std::pair<std::size_t, uint32_t> NodeKey;
+
+    // The last RANK_JOB_WINDOW durations, oldest overwritten first
+    struct JobTimes
+    {
+        std::vector<uint32_t> msecs;
+        std::size_t next = 0;
+    };
+
+    std::size_t sessionIndex( const Session& session ) const;
+
+private:
+    const std::vector<std::unique_ptr<Session>>& m_sessions;
+
+    JobTracker m_jobs;
+    std::map<NodeKey, JobTimes> m_jobTimes;
+};
+
+// Prints the first count entries and the best node as the client's
+// ICECC_PREFERRED_HOST, or their names only with '--brief'
+void printRanking( const OutputSpec& spec, const std::vector<QueryTarget>& targets, const std::vector<NodeRanking::Entry>& entries, std::size_t count, FILE* out );
+
+// Follows the job stream for period seconds and prints the ranking, then
+// again every interval msecs if that's positive; returns one of EXIT_* codes
+int runRanking( const std::vector<QueryTarget>& targets, IoBackend::Type ioBackend, const OutputSpec& spec, std::size_t count, long period, int interval );
+
+#endif // ICEQUERY_RANK_H
@@ -0,0 +1,323 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "resolver.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>      // free()
+#include <cstring>      // strerror()
+#include <ctime>        // time()
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+#include <arpa/inet.h>  // inet_pton()
+#include <netdb.h>      // getnameinfo()
+#include <unistd.h>     // getpid()
+
+#include "common.h"
+
+// What the worker threads share with the resolver
+struct HostResolver::Lookups
+{
+    enum class Status : char
+    {
+        Resolved,
+
+        // The address has no name
+        NoName,
+
+        // Anything else, not worth caching
+        Failed
+    };
+
+    struct Result
+    {
+        std::string addr;
+        std::string name;
+        Status status;
+    };
+
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    // Addresses to look up, taken in order
+    std::vector<std::string> queue;
+    std::size_t next = 0;
+
+    // Queued or being looked up
+    std::unordered_set<std::string> pending;
+    unsigned workers = 0;
+
+    // Not collected yet
+    std::vector<Result> results;
+};
+
+// Utility functions
+
+// Reverse lookup of a numeric address, error being one of EAI_* codes
+static void lookUp( const std::string& addr, std::string& name, int& error )
+{
+    struct sockaddr_storage storage {};
+    socklen_t length;
+
+    auto* in4 = reinterpret_cast<struct sockaddr_in*>( &storage );
+    auto* in6 = reinterpret_cast<struct sockaddr_in6*>( &storage );
+
+    if( inet_pton( AF_INET, addr.c_str(), &in4->sin_addr ) == 1 )
+    {
+        in4->sin_family = AF_INET;
+        length = sizeof( *in4 );
+    }
+    else if( inet_pton( AF_INET6, addr.c_str(), &in6->sin6_addr ) == 1 )
+    {
+        in6->sin6_family = AF_INET6;
+        length = sizeof( *in6 );
+    }
+    else
+    {
+        error = EAI_NONAME;
+        return;
+    }
+
+    char host[NI_MAXHOST];
+    error = getnameinfo( reinterpret_cast<struct sockaddr*>( &storage ), length, host, sizeof( host ), nullptr, 0, NI_NAMEREQD );
+
+    if( error == 0 )
+    {
+        name.assign( host );
+    }
+}
+
+// HostResolver
+
+void HostResolver::runWorker( std::shared_ptr<Lookups> lookups )
+{
+    std::unique_lock<std::mutex> lock( lookups->mutex );
+
+    while( lookups->next < lookups->queue.size() )
+    {
+        Lookups::Result result { lookups->queue[lookups->next++], std::string(), Lookups::Status::Failed };
+        int error;
+
+        lock.unlock();
+        lookUp( result.addr, result.name, error );
+        lock.lock();
+
+        result.status = ( error == 0 ) ? Lookups::Status::Resolved : ( error == EAI_NONAME ) ? Lookups::Status::NoName : Lookups::Status::Failed;
+
+        lookups->pending.erase( result.addr );
+        lookups->results.push_back( std::move( result ) );
+        lookups->finished.notify_all();
+    }
+
+    // Everything taken, start over with an empty queue
+    lookups->queue.clear();
+    lookups->next = 0;
+    --lookups->workers;
+}
+
+HostResolver::HostResolver( const std::string& cachePath, int64_t ttl )
+    : m_cachePath( cachePath )
+    , m_ttl( ttl )
+    , m_dirty( false )
+    , m_lookups( std::make_shared<Lookups>() )
+{
+    load();
+}
+
+HostResolver::~HostResolver()
+{
+    // Stop the workers from taking anything more
+    std::lock_guard<std::mutex> lock( m_lookups->mutex );
+    m_lookups->next = m_lookups->queue.size();
+}
+
+std::string HostResolver::defaultCachePath()
+{
+    return cachePath( "hostnames" );
+}
+
+void HostResolver::resolve( const std::vector<std::string>& addrs, long deadline, HostNameMap& names )
+{
+    const int64_t now = time( nullptr );
+    std::unique_lock<std::mutex> lock( m_lookups->mutex );
+
+    collect( *m_lookups );
+
+    for( const std::string& addr : addrs )
+    {
+        auto it = m_cache.find( addr );
+
+        if( ( it == m_cache.end() || it->second.expires <= now ) && m_lookups->pending.insert( addr ).second )
+        {
+            m_lookups->queue.push_back( addr );
+        }
+    }
+
+    std::size_t queued = m_lookups->queue.size() - m_lookups->next;
+
+    for( ; m_lookups->workers < std::min<std::size_t>( queued, RESOLVE_WORKERS ); ++m_lookups->workers )
+    {
+        std::thread( runWorker, m_lookups ).detach();
+    }
+
+    long timeout = deadline - getTimestamp();
+
+    if( timeout > 0 )
+    {
+        m_lookups->finished.wait_for( lock, std::chrono::milliseconds( timeout ), [this] () { return m_lookups->pending.empty(); } );
+    }
+
+    collect( *m_lookups );
+
+    for( const std::string& addr : addrs )
+    {
+        auto it = m_cache.find( addr );
+        names[addr] = ( it != m_cache.end() ) ? it->second.name : std::string();
+    }
+}
+
+void HostResolver::collect( Lookups& lookups )
+{
+    const int64_t now = time( nullptr );
+
+    for( Lookups::Result& result : lookups.results )
+    {
+        if( result.status == Lookups::Status::Failed )
+        {
+            continue;
+        }
+
+        int64_t ttl = ( result.status == Lookups::Status::Resolved ) ? m_ttl : std::min<int64_t>( m_ttl, RESOLVE_NEGATIVE_TTL );
+        m_cache[result.addr] = Entry { std::move( result.name ), now + ttl };
+        m_dirty = true;
+    }
+
+    lookups.results.clear();
+}
+
+void HostResolver::load()
+{
+    if( m_cachePath.empty() )
+    {
+        return;
+    }
+
+    FILE* in = fopen( m_cachePath.c_str(), "r" );
+
+    if( !in )
+    {
+        if( errno != ENOENT )
+        {
+            int lastErrno = errno;
+
+            PRINT_WARN( "Unable to open '%s': (%d) %s\n", m_cachePath.c_str(), lastErrno, strerror( lastErrno ) );
+        }
+
+        return;
+    }
+
+    const int64_t now = time( nullptr );
+    char* lineBuf = nullptr;
+    std::size_t lineBufSize = 0;
+    unsigned lineNo = 0;
+
+    while( getline( &lineBuf, &lineBufSize, in ) != -1 )
+    {
+        ++lineNo;
+
+        int version;
+        long long expires;
+        char addr[INET6_ADDRSTRLEN];
+        int nameStart = 0;
+
+        if( lineNo == 1 ? sscanf( lineBuf, RESOLVE_CACHE_MAGIC " %d", &version ) != 1 || version != RESOLVE_CACHE_VERSION
+                        : sscanf( lineBuf, "%45[^\t]\t%lld\t%n", addr, &expires, &nameStart ) != 2 || !nameStart )
+        {
+            PRINT_WARN( "Ignoring invalid host name cache '%s' from line %u on.\n", m_cachePath.c_str(), lineNo );
+            break;
+        }
+
+        if( lineNo > 1 && expires > now )
+        {
+            std::string name( lineBuf + nameStart );
+
+            if( !name.empty() && name.back() == '\n' )
+            {
+                name.pop_back();
+            }
+
+            m_cache[addr] = Entry { std::move( name ), std::min<int64_t>( expires, now + m_ttl ) };
+        }
+    }
+
+    free( lineBuf );
+    fclose( in );
+}
+
+bool HostResolver::save()
+{
+    if( m_cachePath.empty() || !m_dirty )
+    {
+        return true;
+    }
+
+    // Written aside and renamed, so that concurrent runs don't see it halfway
+    const std::string tempPath = m_cachePath + ".tmp-" + std::to_string( getpid() );
+    FILE* out = createParentDirs( m_cachePath ) ? fopen( tempPath.c_str(), "w" ) : nullptr;
+
+    if( !out )
+    {
+        int lastErrno = errno;
+
+        PRINT_WARN( "Unable to write '%s': (%d) %s\n", tempPath.c_str(), lastErrno, strerror( lastErrno ) );
+
+        return false;
+    }
+
+    const int64_t now = time( nullptr );
+
+    fprintf( out, "%s %d\n", RESOLVE_CACHE_MAGIC, RESOLVE_CACHE_VERSION );
+
+    for( const auto& entry : m_cache )
+    {
+        if( entry.second.expires > now )
+        {
+            fprintf( out, "%s\t%lld\t%s\n", entry.first.c_str(), static_cast<long long>( entry.second.expires ), entry.second.name.c_str() );
+        }
+    }
+
+    if( ( ferror( out ) | fclose( out ) ) || rename( tempPath.c_str(), m_cachePath.c_str() ) != 0 )
+    {
+        int lastErrno = errno;
+
+        PRINT_WARN( "Unable to write '%s': (%d) %s\n", m_cachePath.c_str(), lastErrno, strerror( lastErrno ) );
+        unlink( tempPath.c_str() );
+
+        return false;
+    }
+
+    m_dirty = false;
+
+    return true;
+}
@@ -0,0 +1,104 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef ICEQUERY_RESOLVER_H
+#define ICEQUERY_RESOLVER_H
+
+#include <cstdint>      // int64_t
+#include <functional>   // equal_to
+#include <memory>       // shared_ptr
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common.h"
+
+// How long resolved names are cached, in seconds
+#define RESOLVE_TTL_DEFAULT         86400
+
+// How long an address without a name is, in seconds
+#define RESOLVE_NEGATIVE_TTL        300
+
+// Lookups run at once at most
+#define RESOLVE_WORKERS             32
+
+// How long a query waits for the lookups without a '--deadline', in msecs
+#define RESOLVE_TIMEOUT_DEFAULT     2000
+
+#define RESOLVE_CACHE_MAGIC         "icequery-hostnames"
+#define RESOLVE_CACHE_VERSION       1
+
+// Host names by address, empty for the ones without any (yet)
+typedef std::unordered_map<std::string, std::string, StringViewHash, std::equal_to<>> HostNameMap;
+
+// Reverse DNS lookups run concurrently by a pool of threads, with the
+// results cached in a file between runs. The lookups still running past a
+// deadline are left to finish in the background; their results are picked
+// up by the next resolve().
+class HostResolver
+{
+public:
+    // Loads the cache; an empty path for none, a TTL of 0 for not caching
+    // anything past this object
+    HostResolver( const std::string& cachePath, int64_t ttl );
+    ~HostResolver();
+
+    HostResolver( const HostResolver& ) = delete;
+    HostResolver& operator=( const HostResolver& ) = delete;
+
+public:
+    // Default cache location, under $XDG_CACHE_HOME or ~/.cache
+    static std::string defaultCachePath();
+
+    // Names the addresses, waiting for the lookups till the absolute
+    // getTimestamp() deadline at most
+    void resolve( const std::vector<std::string>& addrs, long deadline, HostNameMap& names );
+
+    // Writes the cache back if anything was resolved, false on error
+    bool save();
+
+private:
+    struct Entry
+    {
+        std::string name;
+
+        // Seconds since the Epoch
+        int64_t expires;
+    };
+
+    struct Lookups;
+
+    static void runWorker( std::shared_ptr<Lookups> lookups );
+
+    void load();
+
+    // Moves the finished lookups into the cache
+    void collect( Lookups& lookups );
+
+private:
+    std::string m_cachePath;
+    int64_t m_ttl;
+    bool m_dirty;
+
+    std::unordered_map<std::string, Entry> m_cache;
+
+    // Shared with the worker threads, which may outlive this object
+    std::shared_ptr<Lookups> m_lookups;
+};
+
+#endif // ICEQUERY_RESOLVER_H
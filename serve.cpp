@@ -0,0 +1,506 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "serve.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>      // strtoul()
+#include <cstring>      // strerror()
+
+#include <poll.h>
+#include <unistd.h>     // read()
+#include <sys/eventfd.h>
+#include <sys/stat.h>   // fstat()
+
+#include "common.h"
+
+// StdioServer
+
+StdioServer::StdioServer( const std::vector<std::unique_ptr<Session>>& sessions, const OutputSpec& spec, int inFd, FILE* out )
+    : m_sessions( sessions )
+    , m_spec( spec )
+    , m_inFd( inFd )
+    , m_waitForInput( true )
+    , m_out( out )
+    , m_eventFd( eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) )
+    , m_quit( false )
+{
+    if( m_eventFd == -1 )
+    {
+        int lastErrno = errno;
+
+        PRINT_ERR( "eventfd(): (%d) %s\n", lastErrno, strerror( lastErrno ) );
+    }
+
+    struct stat inStat;
+
+    if( fstat( m_inFd, &inStat ) == 0 && S_ISREG( inStat.st_mode ) )
+    {
+        m_waitForInput = false;
+    }
+
+    for( const auto& session : m_sessions )
+    {
+        m_stores.emplace_back( session->snapshot() );
+        m_isSettled.push_back( session->state() == Session::State::Live || session->state() == Session::State::Backoff );
+        session->addListener( this );
+    }
+}
+
+StdioServer::~StdioServer()
+{
+    for( const auto& session : m_sessions )
+    {
+        session->removeListener( this );
+    }
+
+    if( m_eventFd != -1 )
+    {
+        close( m_eventFd );
+    }
+}
+
+Task<int> StdioServer::run( Reactor& reactor )
+{
+    int res = EXIT_OK;
+    std::string buffer;
+    char chunk[SERVE_MAX_LINE];
+
+    while( !m_quit )
+    {
+        if( m_waitForInput )
+        {
+            co_await reactor.wait( m_inFd, POLLIN, -1 );
+        }
+
+        ssize_t len = read( m_inFd, chunk, sizeof( chunk ) );
+
+        if( len < 0 )
+        {
+            if( errno == EINTR || errno == EAGAIN )
+            {
+                continue;
+            }
+
+            int lastErrno = errno;
+
+            PRINT_ERR( "read(): (%d) %s\n", lastErrno, strerror( lastErrno ) );
+
+            res = EXIT_IO_ERR;
+            break;
+        }
+
+        if( len == 0 )
+        {
+            break;
+        }
+
+        buffer.append( chunk, static_cast<std::size_t>( len ) );
+
+        std::size_t pos;
+
+        while( !m_quit && ( pos = buffer.find( '\n' ) ) != std::string::npos )
+        {
+            std::string line = buffer.substr( 0, pos );
+            buffer.erase( 0, pos + 1 );
+
+            co_await handle( reactor, line );
+        }
+
+        if( buffer.size() > SERVE_MAX_LINE )
+        {
+            respond( "err line too long" );
+            buffer.clear();
+        }
+    }
+
+    // The last line doesn't have to be terminated
+    if( !m_quit && !buffer.empty() )
+    {
+        co_await handle( reactor, buffer );
+    }
+
+    for( const auto& session : m_sessions )
+    {
+        session->stop();
+    }
+
+    co_return res;
+}
+
+void StdioServer::onStateChanged( Session& session )
+{
+    if( session.state() == Session::State::Live || session.state() == Session::State::Backoff )
+    {
+        m_isSettled[index( session )] = true;
+    }
+
+    notify();
+}
+
+void StdioServer::onNodeUpdated( Session& session, const NodeInfo& node )
+{
+    m_stores[index( session )].set( node );
+    notify();
+}
+
+void StdioServer::onNodeRemoved( Session& session, const NodeInfo& node )
+{
+    m_stores[index( session )].remove( node.hostId() );
+    notify();
+}
+
+Task<void> StdioServer::handle( Reactor& reactor, const std::string& line )
+{
+    std::size_t start = line.find_first_not_of( " \t\r" );
+
+    // Empty lines get no response, so that they can't desynchronize the client
+    if( start == std::string::npos )
+    {
+        co_return;
+    }
+
+    std::size_t end = line.find_first_of( " \t\r", start );
+    const std::string request = line.substr( start, end == std::string::npos ? std::string::npos : end - start );
+    const std::string args = end == std::string::npos ? std::string() : line.substr( end );
+
+    PRINT_DEBUG( "Request: '%s'\n", line.c_str() );
+
+    // Empty tables at startup would look just like an empty farm
+    if( request == "totals" || request == "nodes" || request == "node" )
+    {
+        bool isOpen = co_await waitForSync( reactor );
+
+        if( !isOpen )
+        {
+            respond( "err input closed" );
+            m_quit = true;
+            co_return;
+        }
+    }
+
+    if( request == "totals" )
+    {
+        OutputSpec spec = m_spec;
+
+        if( !parseOutputOptions( args, spec ) )
+        {
+            respond( "err invalid options" );
+            co_return;
+        }
+
+        std::uint32_t nodeCount;
+        std::uint32_t coreCount;
+        count( spec, nodeCount, coreCount );
+
+        respond( "ok " + std::to_string( nodeCount ) + " " + std::to_string( coreCount ) );
+    }
+    else if( request == "nodes" )
+    {
+        OutputSpec spec = m_spec;
+
+        if( !parseOutputOptions( args, spec ) )
+        {
+            respond( "err invalid options" );
+            co_return;
+        }
+
+        std::uint32_t nodeCount;
+        std::uint32_t coreCount;
+        count( spec, nodeCount, coreCount );
+
+        respond( "ok " + std::to_string( nodeCount ) );
+
+        for( const auto& session : m_sessions )
+        {
+            for( const auto& node : session->nodes() )
+            {
+                if( isNodeShown( spec, *node.second ) )
+                {
+                    respondNode( *node.second );
+                }
+            }
+        }
+    }
+    else if( request == "node" )
+    {
+        std::size_t keyStart = args.find_first_not_of( " \t\r" );
+        std::size_t keyEnd = args.find_last_not_of( " \t\r" );
+        const NodeInfo* node = keyStart == std::string::npos ? nullptr : findNode( args.substr( keyStart, keyEnd - keyStart + 1 ) );
+
+        if( !node )
+        {
+            respond( "err no such node" );
+            co_return;
+        }
+
+        fputs( "ok ", m_out );
+        respondNode( *node );
+    }
+    else if( request == "wait" )
+    {
+        co_await waitForCores( reactor, args );
+    }
+    else if( request == "status" )
+    {
+        respond( "ok " + std::to_string( m_sessions.size() ) );
+
+        for( const auto& session : m_sessions )
+        {
+            respond( session->target().label() + "\t" + Session::stateToStr( session->state() ) + "\t" + std::to_string( session->nodes().size() ) );
+        }
+    }
+    else if( request == "quit" )
+    {
+        respond( "ok" );
+        m_quit = true;
+    }
+    else
+    {
+        respond( "err unknown request '" + request + "'" );
+    }
+}
+
+Task<void> StdioServer::waitForCores( Reactor& reactor, const std::string& args )
+{
+    // wait <CORES> [<MSECS>] [options...]
+    const char* str = args.c_str();
+    char* end;
+
+    unsigned long cores = strtoul( str, &end, 10 );
+
+    if( end == str )
+    {
+        respond( "err invalid core count" );
+        co_return;
+    }
+
+    str = end;
+
+    long deadline = -1;
+    unsigned long msecs = strtoul( str, &end, 10 );
+
+    if( end != str )
+    {
+        deadline = getTimestamp() + static_cast<long>( msecs );
+        str = end;
+    }
+
+    OutputSpec spec = m_spec;
+
+    if( !parseOutputOptions( str, spec ) )
+    {
+        respond( "err invalid options" );
+        co_return;
+    }
+
+    while( true )
+    {
+        std::uint32_t nodeCount;
+        std::uint32_t coreCount;
+        count( spec, nodeCount, coreCount );
+
+        if( coreCount >= cores )
+        {
+            respond( "ok " + std::to_string( coreCount ) );
+            co_return;
+        }
+
+        if( m_eventFd == -1 || ( deadline >= 0 && getTimestamp() >= deadline ) )
+        {
+            respond( "err timeout " + std::to_string( coreCount ) );
+            co_return;
+        }
+
+        bool isOpen = co_await waitForChange( reactor, deadline );
+
+        if( !isOpen )
+        {
+            respond( "err input closed" );
+            m_quit = true;
+            co_return;
+        }
+    }
+}
+
+Task<bool> StdioServer::waitForSync( Reactor& reactor )
+{
+    while( m_eventFd != -1 && !isSynced() )
+    {
+        bool isOpen = co_await waitForChange( reactor, -1 );
+
+        if( !isOpen )
+        {
+            co_return false;
+        }
+    }
+
+    co_return true;
+}
+
+Task<bool> StdioServer::waitForChange( Reactor& reactor, long deadline )
+{
+    long wakeUp = deadline;
+
+    // Nothing is read while waiting, so look for the input being closed now
+    // and then, not to go on forever once the client is gone
+    if( m_waitForInput )
+    {
+        long tick = getTimestamp() + SERVE_TICK;
+
+        wakeUp = deadline >= 0 ? std::min( deadline, tick ) : tick;
+    }
+
+    if( co_await reactor.wait( m_eventFd, POLLIN, wakeUp ) )
+    {
+        uint64_t value;
+
+        if( read( m_eventFd, &value, sizeof( value ) ) < 0 && errno != EAGAIN )
+        {
+            int lastErrno = errno;
+
+            PRINT_ERR( "read(): (%d) %s\n", lastErrno, strerror( lastErrno ) );
+        }
+    }
+
+    co_return !isInputClosed();
+}
+
+bool StdioServer::isSynced() const
+{
+    return std::find( m_isSettled.cbegin(), m_isSettled.cend(), false ) == m_isSettled.cend();
+}
+
+bool StdioServer::isInputClosed() const
+{
+    if( !m_waitForInput )
+    {
+        return false;
+    }
+
+    struct pollfd pollFd { m_inFd, POLLIN | POLLRDHUP, 0 };
+
+    return poll( &pollFd, 1, 0 ) > 0 && ( pollFd.revents & ( POLLHUP | POLLRDHUP | POLLERR | POLLNVAL ) );
+}
+
+void StdioServer::respond( const std::string& response )
+{
+    fputs( response.c_str(), m_out );
+    fputc( '\n', m_out );
+    fflush( m_out );
+}
+
+void StdioServer::respondNode( const NodeInfo& node )
+{
+    fprintf( m_out, "%u\t%s\t%s\t%u\t%s\t%d\t%d\t%d\n", node.hostId(), node.name().c_str(), node.ip().c_str(), node.maxJobs(), node.platform().c_str(),
+             node.isOffline(), node.noRemote(), node.isStale() );
+    fflush( m_out );
+}
+
+const NodeInfo* StdioServer::findNode( const std::string& key ) const
+{
+    char* end;
+    unsigned long hostId = strtoul( key.c_str(), &end, 10 );
+    bool isId = ( *end == '\0' && end != key.c_str() );
+
+    for( const auto& session : m_sessions )
+    {
+        for( const auto& node : session->nodes() )
+        {
+            if( ( isId && node.first == hostId ) || std::string_view( node.second->name() ) == key || std::string_view( node.second->ip() ) == key )
+            {
+                return node.second.get();
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+void StdioServer::count( const OutputSpec& spec, std::uint32_t& nodeCount, std::uint32_t& coreCount ) const
+{
+    nodeCount = 0;
+    coreCount = 0;
+
+    for( const NodeStore& store : m_stores )
+    {
+        uint32_t platformId = spec.platform.empty() ? NodeStore::ANY_PLATFORM : store.platformId( spec.platform );
+
+        // No node of this scheduler has ever been of the platform
+        if( platformId == StringPool::NONE )
+        {
+            continue;
+        }
+
+        nodeCount += store.countNodes( spec.noOffline, spec.noNoRemote, platformId );
+        coreCount += store.countCores( platformId );
+    }
+}
+
+std::size_t StdioServer::index( const Session& session ) const
+{
+    std::size_t i = 0;
+
+    while( m_sessions[i].get() != &session )
+    {
+        ++i;
+    }
+
+    return i;
+}
+
+void StdioServer::notify()
+{
+    uint64_t value = 1;
+
+    if( m_eventFd != -1 && write( m_eventFd, &value, sizeof( value ) ) < 0 && errno != EAGAIN )
+    {
+        int lastErrno = errno;
+
+        PRINT_ERR( "write(): (%d) %s\n", lastErrno, strerror( lastErrno ) );
+    }
+}
+
+// Entry point
+
+int serveStdio( const std::vector<QueryTarget>& targets, IoBackend::Type ioBackend, const OutputSpec& spec )
+{
+    Reactor reactor( ioBackend );
+    std::vector<std::unique_ptr<Session>> sessions;
+
+    for( const QueryTarget& target : targets )
+    {
+        sessions.emplace_back( new Session( target ) );
+        reactor.spawn( sessions.back()->run( reactor ) );
+    }
+
+    StdioServer server( sessions, spec, STDIN_FILENO, stdout );
+    int exitCode = EXIT_OK;
+
+    reactor.spawn( awaitInto( server.run( reactor ), exitCode ) );
+
+    if( !reactor.run() )
+    {
+        return EXIT_CONNECTION_ERR;
+    }
+
+    return exitCode;
+}
@@ -0,0 +1,108 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef ICEQUERY_SERVE_H
+#define ICEQUERY_SERVE_H
+
+#include <memory>       // unique_ptr
+#include <string>
+#include <vector>
+
+#include "async.h"
+#include "nodestore.h"
+#include "output.h"
+#include "session.h"
+
+// Longest request line accepted, anything beyond is an error
+#define SERVE_MAX_LINE              4096
+
+// How often a wait checks whether the input has been closed
+#define SERVE_TICK                  500
+
+// Answers line-delimited requests read from a descriptor with line-delimited
+// responses, out of the node tables kept up to date by the sessions. Requests
+// are handled one at a time, so the responses come in the same order; the
+// ones about the nodes are held until every session has either synced or
+// failed its first attempt.
+class StdioServer : public SessionListener
+{
+public:
+    StdioServer( const std::vector<std::unique_ptr<Session>>& sessions, const OutputSpec& spec, int inFd, FILE* out );
+    ~StdioServer();
+
+    StdioServer( const StdioServer& ) = delete;
+    StdioServer& operator=( const StdioServer& ) = delete;
+
+public:
+    // Runs until the input is closed or 'quit' is requested, then stops the
+    // sessions; returns one of EXIT_* codes
+    Task<int> run( Reactor& reactor );
+
+    void onStateChanged( Session& session ) override;
+    void onNodeUpdated( Session& session, const NodeInfo& node ) override;
+    void onNodeRemoved( Session& session, const NodeInfo& node ) override;
+
+private:
+    Task<void> handle( Reactor& reactor, const std::string& line );
+
+    Task<void> waitForCores( Reactor& reactor, const std::string& args );
+
+    // Both false if the input was closed in the meantime
+    Task<bool> waitForSync( Reactor& reactor );
+    Task<bool> waitForChange( Reactor& reactor, long deadline );
+
+    bool isSynced() const;
+    bool isInputClosed() const;
+
+    void respond( const std::string& response );
+    void respondNode( const NodeInfo& node );
+
+    const NodeInfo* findNode( const std::string& key ) const;
+    void count( const OutputSpec& spec, std::uint32_t& nodeCount, std::uint32_t& coreCount ) const;
+
+    std::size_t index( const Session& session ) const;
+
+    // Wakes up waitForCores()
+    void notify();
+
+private:
+    const std::vector<std::unique_ptr<Session>>& m_sessions;
+
+    // Columnar copies of the sessions' nodes, for the totals
+    std::vector<NodeStore> m_stores;
+
+    // Whether each session has been live or failed an attempt
+    std::vector<bool> m_isSettled;
+    OutputSpec m_spec;
+    int m_inFd;
+
+    // Regular files are always ready, and not every backend can watch them
+    bool m_waitForInput;
+
+    FILE* m_out;
+
+    // Signalled on any change in the sessions
+    int m_eventFd;
+    bool m_quit;
+};
+
+// Keeps the sessions to the targets and serves requests on stdin/stdout
+int serveStdio( const std::vector<QueryTarget>& targets, IoBackend::Type ioBackend, const OutputSpec& spec );
+
+#endif // ICEQUERY_SERVE_H
@@ -0,0 +1,333 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "session.h"
+
+#include <algorithm>
+
+#include <icecc/comm.h>
+
+#include "common.h"
+#include "query.h"
+
+Session::Session( const QueryTarget& target )
+    : m_target( target )
+    , m_state( State::Connecting )
+    , m_stopped( false )
+    , m_connectionCount( 0 )
+    , m_backoff( BACKOFF_MIN )
+    , m_random( std::random_device()() )
+{
+    // A session has no overall deadline, only the connection attempts have
+    m_target.deadline = -1;
+}
+
+Session::~Session()
+{
+}
+
+Task<void> Session::run( Reactor& reactor )
+{
+    while( !m_stopped )
+    {
+        setState( State::Connecting );
+
+        std::unique_ptr<MsgChannel> channel = co_await discoverScheduler( reactor, m_target );
+        bool wasConnected = false;
+
+        if( channel && co_await logIn( reactor, *channel, m_target ) )
+        {
+            wasConnected = true;
+            ++m_connectionCount;
+
+            setState( State::Syncing );
+
+            co_await receive( reactor, *channel );
+        }
+
+        channel.reset();
+
+        if( m_stopped )
+        {
+            break;
+        }
+
+        markStale();
+        setState( State::Backoff );
+
+        int delay = nextBackoff();
+
+        if( wasConnected )
+        {
+            PRINT_WARN( "Connection to the scheduler '%s' lost, reconnecting in %d ms...\n", m_target.label().c_str(), delay );
+        }
+        else
+        {
+            PRINT_WARN( "Unable to reach the scheduler '%s', retrying in %d ms...\n", m_target.label().c_str(), delay );
+        }
+
+        long wakeup = getTimestamp() + delay;
+
+        while( !m_stopped && getTimestamp() < wakeup )
+        {
+            co_await reactor.sleepUntil( std::min( wakeup, getTimestamp() + SESSION_TICK ) );
+        }
+    }
+
+    setState( State::Stopped );
+}
+
+void Session::stop()
+{
+    m_stopped = true;
+}
+
+void Session::addListener( SessionListener* listener )
+{
+    m_listeners.push_back( listener );
+}
+
+void Session::removeListener( SessionListener* listener )
+{
+    m_listeners.erase( std::remove( m_listeners.begin(), m_listeners.end(), listener ), m_listeners.end() );
+}
+
+NodeList Session::snapshot( std::pmr::memory_resource* resource ) const
+{
+    NodeList res( resource );
+    res.reserve( m_nodes.size() );
+
+    for( const auto& node : m_nodes )
+    {
+        res.push_back( NodeInfo::copy( *node.second, resource ) );
+    }
+
+    return res;
+}
+
+Task<void> Session::receive( Reactor& reactor, MsgChannel& channel )
+{
+    // The dump is over once the scheduler goes quiet or sends only something
+    // else, same as for a one-shot query
+    long syncDeadline = getTimestamp() + m_target.rtimeout;
+
+    while( !m_stopped )
+    {
+        long now = getTimestamp();
+        long deadline = now + SESSION_TICK;
+
+        if( m_state == State::Syncing )
+        {
+            deadline = std::min( deadline, syncDeadline );
+        }
+
+        MsgBatch batch = co_await receiveBatch( reactor, channel, deadline );
+        bool wasUseful = false;
+
+        for( const auto& msg : batch.msgs )
+        {
+            if( msg->type == M_END )
+            {
+                PRINT_ERR( "Received M_END (%d). Scheduler has quit.\n", M_END );
+
+                co_return;
+            }
+
+            wasUseful |= handle( *msg );
+        }
+
+        if( batch.failed )
+        {
+            co_return;
+        }
+
+        if( m_state == State::Syncing )
+        {
+            now = getTimestamp();
+
+            if( wasUseful )
+            {
+                syncDeadline = now + m_target.rtimeout;
+            }
+            else if( !batch.timedOut || now >= syncDeadline )
+            {
+                dropStale();
+
+                // Only a complete dump proves the scheduler is back for good
+                m_backoff = BACKOFF_MIN;
+
+                setState( State::Live );
+            }
+        }
+    }
+}
+
+bool Session::handle( const Msg& msg )
+{
+    for( SessionListener* listener : m_listeners )
+    {
+        listener->onMessage( *this, msg );
+    }
+
+    if( msg.type != M_MON_STATS )
+    {
+        PRINT_DEBUG( "Message of type %s (%d) passed on\n", MsgTypeToStr( msg.type ), msg.type );
+
+        return false;
+    }
+
+    const MonStatsMsg& statsMsg = dynamic_cast<const MonStatsMsg&>( msg );
+
+    PRINT_DEBUG( "\nStats message:\n-\n%s-\n", statsMsg.statmsg.c_str() );
+
+    return handleStats( statsMsg.hostid, statsMsg.statmsg );
+}
+
+bool Session::handleStats( uint32_t hostId, const std::string& stats )
+{
+    auto it = m_nodes.find( hostId );
+    auto node = NodeInfo::create( hostId, stats, it != m_nodes.end() ? it->second.get() : nullptr );
+
+    if( !node )
+    {
+        return false;
+    }
+
+    if( it == m_nodes.end() )
+    {
+        // A restarted scheduler numbers the hosts anew, so the stale copy of
+        // the same host has to go
+        for( auto staleIt = m_nodes.begin(); staleIt != m_nodes.end(); )
+        {
+            const NodeInfo& stale = *staleIt->second;
+
+            if( stale.isStale() && stale.name() == node->name() && stale.ip() == node->ip() )
+            {
+                for( SessionListener* listener : m_listeners )
+                {
+                    listener->onNodeRemoved( *this, stale );
+                }
+
+                staleIt = m_nodes.erase( staleIt );
+            }
+            else
+            {
+                ++staleIt;
+            }
+        }
+
+        it = m_nodes.emplace( hostId, std::move( node ) ).first;
+    }
+    else
+    {
+        it->second = std::move( node );
+    }
+
+    for( SessionListener* listener : m_listeners )
+    {
+        listener->onNodeUpdated( *this, *it->second );
+    }
+
+    return true;
+}
+
+void Session::markStale()
+{
+    for( auto& node : m_nodes )
+    {
+        if( !node.second->isStale() )
+        {
+            node.second->setStale( true );
+
+            for( SessionListener* listener : m_listeners )
+            {
+                listener->onNodeUpdated( *this, *node.second );
+            }
+        }
+    }
+}
+
+void Session::dropStale()
+{
+    for( auto it = m_nodes.begin(); it != m_nodes.end(); )
+    {
+        if( it->second->isStale() )
+        {
+            for( SessionListener* listener : m_listeners )
+            {
+                listener->onNodeRemoved( *this, *it->second );
+            }
+
+            it = m_nodes.erase( it );
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+const char* Session::stateToStr( State state )
+{
+    switch( state )
+    {
+        case State::Connecting:
+            return "connecting";
+
+        case State::Syncing:
+            return "syncing";
+
+        case State::Live:
+            return "live";
+
+        case State::Backoff:
+            return "backoff";
+
+        case State::Stopped:
+            return "stopped";
+    }
+
+    return "<Unknown>";
+}
+
+void Session::setState( State state )
+{
+    if( m_state == state )
+    {
+        return;
+    }
+
+    m_state = state;
+
+    for( SessionListener* listener : m_listeners )
+    {
+        listener->onStateChanged( *this );
+    }
+}
+
+int Session::nextBackoff()
+{
+    // Half fixed, half random, so that clients of a restarted scheduler don't
+    // all come back at once
+    int delay = m_backoff / 2 + static_cast<int>( m_random() % static_cast<unsigned>( m_backoff / 2 + 1 ) );
+
+    m_backoff = std::min( m_backoff * 2, BACKOFF_MAX );
+
+    return delay;
+}
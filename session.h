@@ -0,0 +1,165 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef ICEQUERY_SESSION_H
+#define ICEQUERY_SESSION_H
+
+#include <cstdint>      // uint32_t
+#include <map>
+#include <memory>       // unique_ptr
+#include <random>
+#include <string>
+#include <vector>
+
+#include "async.h"
+#include "nodeinfo.h"
+
+class Msg;
+class MsgChannel;
+
+// Reconnection delays, doubled after every failed attempt
+#define BACKOFF_MIN                 250
+#define BACKOFF_MAX                 30000
+
+// How often a session checks whether it's been stopped
+#define SESSION_TICK                500
+
+class Session;
+
+// Notified about what happens within a session, all methods are optional
+class SessionListener
+{
+public:
+    virtual ~SessionListener()
+    {
+    }
+
+    virtual void onStateChanged( Session& /*session*/ )
+    {
+    }
+
+    virtual void onNodeUpdated( Session& /*session*/, const NodeInfo& /*node*/ )
+    {
+    }
+
+    virtual void onNodeRemoved( Session& /*session*/, const NodeInfo& /*node*/ )
+    {
+    }
+
+    // Every message received, including the ones not affecting the nodes
+    virtual void onMessage( Session& /*session*/, const Msg& /*msg*/ )
+    {
+    }
+};
+
+// A long-running monitor connection keeping an up-to-date node table. When
+// the connection is lost, the nodes are kept but marked stale and the session
+// reconnects with a jittered exponential backoff. After logging in again, the
+// stats dump sent by the scheduler refreshes the nodes still present and the
+// ones that weren't refreshed are dropped.
+class Session
+{
+public:
+    typedef std::map<uint32_t, NodeInfoPtr> NodeMap;
+
+    enum class State : char
+    {
+        Connecting,
+
+        // Logged in, receiving the initial stats dump
+        Syncing,
+
+        Live,
+
+        // Waiting before reconnecting
+        Backoff,
+
+        Stopped
+    };
+
+public:
+    explicit Session( const QueryTarget& target );
+    ~Session();
+
+    Session( const Session& ) = delete;
+    Session& operator=( const Session& ) = delete;
+
+public:
+    static const char* stateToStr( State state );
+
+    // Runs until stop() is called
+    Task<void> run( Reactor& reactor );
+
+    // Makes run() finish within SESSION_TICK
+    void stop();
+
+    void addListener( SessionListener* listener );
+    void removeListener( SessionListener* listener );
+
+    const QueryTarget& target() const
+    {
+        return m_target;
+    }
+
+    State state() const
+    {
+        return m_state;
+    }
+
+    // Number of successful logins so far
+    uint32_t connectionCount() const
+    {
+        return m_connectionCount;
+    }
+
+    const NodeMap& nodes() const
+    {
+        return m_nodes;
+    }
+
+    // Copies of the nodes, for consumers that need a stable NodeList, all
+    // allocated from resource
+    NodeList snapshot( std::pmr::memory_resource* resource = std::pmr::get_default_resource() ) const;
+
+private:
+    Task<void> receive( Reactor& reactor, MsgChannel& channel );
+
+    // Returns whether the message refreshed a node
+    bool handle( const Msg& msg );
+    bool handleStats( uint32_t hostId, const std::string& stats );
+
+    void markStale();
+    void dropStale();
+    void setState( State state );
+
+    int nextBackoff();
+
+private:
+    QueryTarget m_target;
+    State m_state;
+    bool m_stopped;
+    uint32_t m_connectionCount;
+    int m_backoff;
+    std::minstd_rand m_random;
+
+    NodeMap m_nodes;
+    std::vector<SessionListener*> m_listeners;
+};
+
+#endif // ICEQUERY_SESSION_H
@@ -0,0 +1,334 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "snapshot.h"
+
+#include <algorithm>
+#include <charconv>     // from_chars()
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>      // free()
+#include <cstring>      // strerror()
+#include <ctime>        // time()
+#include <string_view>
+#include <unordered_map>
+
+#include "common.h"
+
+// Utility functions
+
+static bool nodeLess( const SnapshotNode& a, const SnapshotNode& b )
+{
+    int res = a.scheduler.compare( b.scheduler );
+
+    return res < 0 || ( res == 0 && a.hostId < b.hostId );
+}
+
+// Splits off the next tab-separated field, false if there's none
+static bool nextField( std::string_view& line, std::string_view& field )
+{
+    if( line.data() == nullptr )
+    {
+        return false;
+    }
+
+    std::size_t tab = line.find( '\t' );
+
+    field = line.substr( 0, tab );
+    line = ( tab == std::string_view::npos ) ? std::string_view() : line.substr( tab + 1 );
+
+    return true;
+}
+
+static bool parseNumber( std::string_view field, uint32_t& value )
+{
+    auto res = std::from_chars( field.data(), field.data() + field.size(), value );
+
+    return !field.empty() && res.ec == std::errc() && res.ptr == field.data() + field.size();
+}
+
+static bool parseNode( std::string_view line, SnapshotNode& node )
+{
+    std::string_view fields[8];
+    uint32_t offline;
+    uint32_t noRemote;
+
+    for( std::string_view& field : fields )
+    {
+        if( !nextField( line, field ) )
+        {
+            return false;
+        }
+    }
+
+    if( line.data() != nullptr || !parseNumber( fields[1], node.hostId ) || !parseNumber( fields[4], node.maxJobs ) ||
+        !parseNumber( fields[6], offline ) || !parseNumber( fields[7], noRemote ) || offline > 1 || noRemote > 1 )
+    {
+        return false;
+    }
+
+    node.scheduler.assign( fields[0] );
+    node.name.assign( fields[2] );
+    node.ip.assign( fields[3] );
+    node.platform.assign( fields[5] );
+    node.offline = offline;
+    node.noRemote = noRemote;
+
+    return true;
+}
+
+static bool sameNode( const SnapshotNode& a, const SnapshotNode& b )
+{
+    return a.name == b.name && a.ip == b.ip && a.maxJobs == b.maxJobs && a.platform == b.platform && a.offline == b.offline && a.noRemote == b.noRemote;
+}
+
+// Snapshot functions
+
+Snapshot makeSnapshot( const std::vector<QueryTarget>& targets, const std::vector<QueryResult>& results )
+{
+    Snapshot snapshot { time( nullptr ), {} };
+
+    for( std::size_t i = 0; i < results.size(); ++i )
+    {
+        if( results[i].exitCode != EXIT_OK )
+        {
+            continue;
+        }
+
+        const std::string label = targets[i].label();
+
+        for( const auto& node : results[i].nodes )
+        {
+            snapshot.nodes.push_back( SnapshotNode { label, node->hostId(), std::string( node->name() ), std::string( node->ip() ), node->maxJobs(),
+                                                     std::string( node->platform() ), node->isOffline(), node->noRemote() } );
+        }
+    }
+
+    std::sort( snapshot.nodes.begin(), snapshot.nodes.end(), nodeLess );
+
+    return snapshot;
+}
+
+bool writeSnapshot( const std::string& path, const Snapshot& snapshot )
+{
+    FILE* out = fopen( path.c_str(), "w" );
+
+    if( !out )
+    {
+        int lastErrno = errno;
+
+        PRINT_ERR( "Unable to open '%s': (%d) %s\n", path.c_str(), lastErrno, strerror( lastErrno ) );
+
+        return false;
+    }
+
+    fprintf( out, "%s %d %lld\n", SNAPSHOT_MAGIC, SNAPSHOT_VERSION, static_cast<long long>( snapshot.time ) );
+
+    for( const SnapshotNode& node : snapshot.nodes )
+    {
+        fprintf( out, "%s\t%u\t%s\t%s\t%u\t%s\t%d\t%d\n", node.scheduler.c_str(), node.hostId, node.name.c_str(), node.ip.c_str(), node.maxJobs,
+                 node.platform.c_str(), node.offline, node.noRemote );
+    }
+
+    if( ferror( out ) | fclose( out ) )
+    {
+        int lastErrno = errno;
+
+        PRINT_ERR( "Unable to write '%s': (%d) %s\n", path.c_str(), lastErrno, strerror( lastErrno ) );
+
+        return false;
+    }
+
+    return true;
+}
+
+bool readSnapshot( const std::string& path, Snapshot& snapshot )
+{
+    FILE* in = fopen( path.c_str(), "r" );
+
+    if( !in )
+    {
+        int lastErrno = errno;
+
+        PRINT_ERR( "Unable to open '%s': (%d) %s\n", path.c_str(), lastErrno, strerror( lastErrno ) );
+
+        return false;
+    }
+
+    bool res = true;
+    char* lineBuf = nullptr;
+    std::size_t lineBufSize = 0;
+    ssize_t lineLen;
+    unsigned lineNo = 0;
+
+    snapshot.nodes.clear();
+
+    while( res && ( lineLen = getline( &lineBuf, &lineBufSize, in ) ) != -1 )
+    {
+        ++lineNo;
+
+        std::string_view line( lineBuf, lineLen );
+
+        if( !line.empty() && line.back() == '\n' )
+        {
+            line.remove_suffix( 1 );
+        }
+
+        if( lineNo == 1 )
+        {
+            int version;
+            long long time;
+            int consumed = 0;
+
+            res = sscanf( lineBuf, SNAPSHOT_MAGIC " %d %lld%n", &version, &time, &consumed ) == 2 && version == SNAPSHOT_VERSION &&
+                  static_cast<std::size_t>( consumed ) == line.size();
+            snapshot.time = time;
+        }
+        else
+        {
+            snapshot.nodes.emplace_back();
+            res = parseNode( line, snapshot.nodes.back() );
+        }
+
+        if( !res )
+        {
+            PRINT_ERR( "Invalid snapshot '%s' at line %u.\n", path.c_str(), lineNo );
+        }
+    }
+
+    free( lineBuf );
+
+    if( res && ferror( in ) )
+    {
+        int lastErrno = errno;
+
+        PRINT_ERR( "Unable to read '%s': (%d) %s\n", path.c_str(), lastErrno, strerror( lastErrno ) );
+
+        res = false;
+    }
+    else if( res && lineNo == 0 )
+    {
+        PRINT_ERR( "Invalid snapshot '%s', it's empty.\n", path.c_str() );
+
+        res = false;
+    }
+
+    fclose( in );
+
+    // Written sorted, but might have been edited
+    if( res && !std::is_sorted( snapshot.nodes.begin(), snapshot.nodes.end(), nodeLess ) )
+    {
+        std::sort( snapshot.nodes.begin(), snapshot.nodes.end(), nodeLess );
+    }
+
+    return res;
+}
+
+SnapshotDiff diffSnapshots( const Snapshot& before, const Snapshot& after )
+{
+    typedef SnapshotChange::Kind Kind;
+
+    SnapshotDiff diff { {}, 0, 0 };
+    auto a = before.nodes.begin();
+    auto b = after.nodes.begin();
+
+    while( a != before.nodes.end() || b != after.nodes.end() )
+    {
+        if( b == after.nodes.end() || ( a != before.nodes.end() && nodeLess( *a, *b ) ) )
+        {
+            diff.changes.push_back( SnapshotChange { Kind::Removed, &*a, nullptr } );
+            diff.coresBefore += a->cores();
+            ++a;
+        }
+        else if( a == before.nodes.end() || nodeLess( *b, *a ) )
+        {
+            diff.changes.push_back( SnapshotChange { Kind::Added, nullptr, &*b } );
+            diff.coresAfter += b->cores();
+            ++b;
+        }
+        else
+        {
+            if( !sameNode( *a, *b ) )
+            {
+                diff.changes.push_back( SnapshotChange { Kind::Changed, &*a, &*b } );
+            }
+
+            diff.coresBefore += a->cores();
+            diff.coresAfter += b->cores();
+            ++a;
+            ++b;
+        }
+    }
+
+    // A daemon registering again gets a new id, such nodes are paired up by
+    // the scheduler and name
+    std::unordered_map<std::string, std::size_t> removed;
+
+    for( std::size_t i = 0; i < diff.changes.size(); ++i )
+    {
+        const SnapshotChange& change = diff.changes[i];
+
+        if( change.kind == Kind::Removed )
+        {
+            removed.emplace( change.before->scheduler + '\t' + change.before->name, i );
+        }
+    }
+
+    if( removed.empty() )
+    {
+        return diff;
+    }
+
+    std::vector<bool> paired( diff.changes.size() );
+
+    for( std::size_t i = 0; i < diff.changes.size(); ++i )
+    {
+        SnapshotChange& change = diff.changes[i];
+
+        if( change.kind != Kind::Added )
+        {
+            continue;
+        }
+
+        auto it = removed.find( change.after->scheduler + '\t' + change.after->name );
+
+        if( it != removed.end() )
+        {
+            SnapshotChange& removal = diff.changes[it->second];
+            removal.kind = Kind::Renumbered;
+            removal.after = change.after;
+
+            paired[i] = true;
+            removed.erase( it );
+        }
+    }
+
+    std::size_t kept = 0;
+
+    for( std::size_t i = 0; i < diff.changes.size(); ++i )
+    {
+        if( !paired[i] )
+        {
+            diff.changes[kept++] = diff.changes[i];
+        }
+    }
+
+    diff.changes.resize( kept );
+
+    return diff;
+}
@@ -0,0 +1,107 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef ICEQUERY_SNAPSHOT_H
+#define ICEQUERY_SNAPSHOT_H
+
+#include <cstdint>      // uint32_t, int64_t
+#include <string>
+#include <vector>
+
+#include "async.h"
+
+/*
+    A snapshot is a text file with the nodes of one or more schedulers at some
+    point in time. The first line is 'icequery-snapshot <VERSION> <TIME>',
+    each of the others a node's tab-separated scheduler label, host id, name,
+    IP, max jobs, platform and 0/1 offline and no remote flags, in order of
+    the scheduler label and host id.
+*/
+
+#define SNAPSHOT_MAGIC              "icequery-snapshot"
+#define SNAPSHOT_VERSION            1
+
+struct SnapshotNode
+{
+    std::string scheduler;
+    uint32_t hostId;
+    std::string name;
+    std::string ip;
+    uint32_t maxJobs;
+    std::string platform;
+    bool offline;
+    bool noRemote;
+
+    // The cores it contributes, as counted by default
+    uint32_t cores() const
+    {
+        return offline || noRemote ? 0 : maxJobs;
+    }
+};
+
+struct Snapshot
+{
+    // Seconds since the Epoch
+    int64_t time;
+
+    // Sorted by the scheduler and host id
+    std::vector<SnapshotNode> nodes;
+};
+
+struct SnapshotChange
+{
+    enum class Kind : char
+    {
+        Added,
+        Removed,
+
+        // Same id, different max jobs, flags, name, IP or platform
+        Changed,
+
+        // Same scheduler and name under a new id, as after the daemon
+        // re-registered
+        Renumbered
+    };
+
+    Kind kind;
+
+    // Null for added and removed nodes respectively
+    const SnapshotNode* before;
+    const SnapshotNode* after;
+};
+
+struct SnapshotDiff
+{
+    std::vector<SnapshotChange> changes;
+
+    uint64_t coresBefore;
+    uint64_t coresAfter;
+};
+
+// The nodes of the results that succeeded, labeled by their targets
+Snapshot makeSnapshot( const std::vector<QueryTarget>& targets, const std::vector<QueryResult>& results );
+
+// Both false on error, after printing it
+bool writeSnapshot( const std::string& path, const Snapshot& snapshot );
+bool readSnapshot( const std::string& path, Snapshot& snapshot );
+
+// A single merge of the sorted nodes; the changes refer to the snapshots
+SnapshotDiff diffSnapshots( const Snapshot& before, const Snapshot& after );
+
+#endif // ICEQUERY_SNAPSHOT_H
@@ -0,0 +1,268 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "standin.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>       // snprintf()
+#include <cstring>      // strerror()
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>     // close(), read(), write()
+
+#include <icecc/comm.h>
+
+#include "common.h"
+#include "session.h"    // SESSION_TICK
+
+// Utility functions
+
+static void appendUint32( std::string& buf, uint32_t value, bool bigEndian = true )
+{
+    for( int i = 0; i < 4; ++i )
+    {
+        buf.push_back( static_cast<char>( value >> ( bigEndian ? 24 - 8 * i : 8 * i ) ) );
+    }
+}
+
+// Both false once the peer is gone or the stand-in stopped
+static Task<bool> readExactly( Reactor& reactor, int fd, char* data, std::size_t size, const std::atomic<bool>& stopped )
+{
+    while( size && !stopped )
+    {
+        ssize_t len = read( fd, data, size );
+
+        if( len > 0 )
+        {
+            data += len;
+            size -= len;
+        }
+        else if( len == 0 || ( errno != EAGAIN && errno != EINTR ) )
+        {
+            co_return false;
+        }
+        else
+        {
+            co_await reactor.wait( fd, POLLIN, getTimestamp() + SESSION_TICK );
+        }
+    }
+
+    co_return !size;
+}
+
+static Task<bool> writeAll( Reactor& reactor, int fd, const char* data, std::size_t size, const std::atomic<bool>& stopped )
+{
+    while( size && !stopped )
+    {
+        ssize_t len = send( fd, data, size, MSG_NOSIGNAL );
+
+        if( len >= 0 )
+        {
+            data += len;
+            size -= len;
+        }
+        else if( errno != EAGAIN && errno != EINTR )
+        {
+            co_return false;
+        }
+        else
+        {
+            co_await reactor.wait( fd, POLLOUT, getTimestamp() + SESSION_TICK );
+        }
+    }
+
+    co_return !size;
+}
+
+// Frames
+
+void appendFrame( std::string& buf, uint32_t type, const std::string& fields )
+{
+    appendUint32( buf, sizeof( uint32_t ) + fields.size() );
+    appendUint32( buf, type );
+    buf.append( fields );
+}
+
+std::string makeStandInDump( uint32_t nodeCount, uint32_t jobsPerNode, uint32_t& msgCount )
+{
+    std::string dump;
+    std::string fields;
+    msgCount = 0;
+
+    for( uint32_t i = 0; i < nodeCount; ++i )
+    {
+        char stats[256];
+        int len = snprintf( stats, sizeof( stats ), "Name:build-node-%u\nIP:10.%u.%u.%u\nMaxJobs:%u\nNoRemote:false\nPlatform:x86_64\nLoad:%u\n"
+                            "Speed:%u.5\nVersion:1.4.0\nFeatures:env_xz env_zstd\n", i, ( i >> 16 ) & 255, ( i >> 8 ) & 255, i & 255, 8 + i % 56, i % 1000, 100 + i % 900 );
+
+        fields.clear();
+        appendUint32( fields, i + 1 );
+        appendUint32( fields, len + 1 );
+        fields.append( stats, len + 1 );
+
+        appendFrame( dump, M_MON_STATS, fields );
+        ++msgCount;
+
+        for( uint32_t j = 0; j < jobsPerNode; ++j )
+        {
+            fields.clear();
+            appendUint32( fields, i * jobsPerNode + j + 1 );
+            appendUint32( fields, 1700000000 );
+            appendUint32( fields, i + 1 );
+
+            appendFrame( dump, M_MON_JOB_BEGIN, fields );
+            ++msgCount;
+        }
+    }
+
+    return dump;
+}
+
+// StandInScheduler
+
+StandInScheduler::StandInScheduler( std::string dump )
+    : m_dump( std::move( dump ) )
+    , m_listenFd( -1 )
+    , m_port( 0 )
+    , m_stopped( false )
+    , m_connectionCount( 0 )
+{
+}
+
+StandInScheduler::~StandInScheduler()
+{
+    m_stopped = true;
+
+    if( m_thread.joinable() )
+    {
+        m_thread.join();
+    }
+
+    if( m_listenFd >= 0 )
+    {
+        close( m_listenFd );
+    }
+}
+
+bool StandInScheduler::start( IoBackend::Type backendType )
+{
+    struct sockaddr_in addr {};
+    socklen_t addrLen = sizeof( addr );
+
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+    m_listenFd = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+
+    if( m_listenFd < 0 || bind( m_listenFd, reinterpret_cast<struct sockaddr*>( &addr ), sizeof( addr ) ) < 0 || listen( m_listenFd, SOMAXCONN ) < 0 ||
+        getsockname( m_listenFd, reinterpret_cast<struct sockaddr*>( &addr ), &addrLen ) < 0 )
+    {
+        int lastErrno = errno;
+
+        PRINT_ERR( "Unable to listen on the loopback: (%d) %s\n", lastErrno, strerror( lastErrno ) );
+
+        return false;
+    }
+
+    m_port = ntohs( addr.sin_port );
+
+    m_thread = std::thread( [this, backendType] ()
+    {
+        Reactor reactor( backendType );
+
+        reactor.spawn( acceptMonitors( reactor ) );
+        reactor.run();
+    } );
+
+    return true;
+}
+
+Task<void> StandInScheduler::acceptMonitors( Reactor& reactor )
+{
+    while( !m_stopped )
+    {
+        int fd;
+
+        while( ( fd = accept4( m_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC ) ) >= 0 )
+        {
+            ++m_connectionCount;
+            reactor.spawn( serve( reactor, fd ) );
+        }
+
+        co_await reactor.wait( m_listenFd, POLLIN, getTimestamp() + SESSION_TICK );
+    }
+}
+
+Task<void> StandInScheduler::serve( Reactor& reactor, int fd )
+{
+    std::string out;
+    char in[8];
+
+    // Both sides send their version right away, then the one agreed on
+    appendUint32( out, PROTOCOL_VERSION, false );
+
+    bool isOpen = co_await writeAll( reactor, fd, out.data(), out.size(), m_stopped ) &&
+                  co_await readExactly( reactor, fd, in, 4, m_stopped );
+
+    if( isOpen )
+    {
+        uint32_t version = 0;
+
+        for( int i = 0; i < 4; ++i )
+        {
+            version |= uint32_t( static_cast<unsigned char>( in[i] ) ) << ( 8 * i );
+        }
+
+        out.clear();
+        appendUint32( out, std::min<uint32_t>( version, PROTOCOL_VERSION ), false );
+
+        // The agreed version, then the login
+        isOpen = co_await writeAll( reactor, fd, out.data(), out.size(), m_stopped ) &&
+                 co_await readExactly( reactor, fd, in, 4, m_stopped ) &&
+                 co_await readExactly( reactor, fd, in, 8, m_stopped ) &&
+                 co_await writeAll( reactor, fd, m_dump.data(), m_dump.size(), m_stopped );
+    }
+
+    std::string jobFrame;
+    std::string fields;
+
+    appendUint32( fields, 0 );
+    appendUint32( fields, 1700000000 );
+    appendUint32( fields, 1 );
+    appendFrame( jobFrame, M_MON_JOB_BEGIN, fields );
+
+    long nextJob = getTimestamp();
+
+    while( isOpen && !m_stopped )
+    {
+        nextJob += STANDIN_JOB_INTERVAL;
+
+        // Anything readable now is the monitor leaving
+        if( co_await reactor.wait( fd, POLLIN, nextJob ) )
+        {
+            break;
+        }
+
+        isOpen = co_await writeAll( reactor, fd, jobFrame.data(), jobFrame.size(), m_stopped );
+    }
+
+    close( fd );
+}
@@ -0,0 +1,81 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef ICEQUERY_STANDIN_H
+#define ICEQUERY_STANDIN_H
+
+#include <atomic>
+#include <cstdint>      // uint16_t, uint32_t
+#include <string>
+#include <thread>
+
+#include "async.h"
+
+// How often a busy farm's job messages follow the stats dump, in msecs
+#define STANDIN_JOB_INTERVAL        10
+
+// Appends the fields as a frame of the scheduler protocol, see
+// monitorchannel.h
+void appendFrame( std::string& buf, uint32_t type, const std::string& fields );
+
+// The stats of that many made-up nodes, each followed by some job starts, as
+// sent by a scheduler after a monitor logs in
+std::string makeStandInDump( uint32_t nodeCount, uint32_t jobsPerNode, uint32_t& msgCount );
+
+// Plays a scheduler to monitors on a loopback port, in a thread of its own:
+// exchanges the versions, takes the login, sends the dump, then a job start
+// every STANDIN_JOB_INTERVAL till the monitor leaves
+class StandInScheduler
+{
+public:
+    explicit StandInScheduler( std::string dump );
+    ~StandInScheduler();
+
+    StandInScheduler( const StandInScheduler& ) = delete;
+    StandInScheduler& operator=( const StandInScheduler& ) = delete;
+
+public:
+    // False on failure, after printing it
+    bool start( IoBackend::Type backendType );
+
+    uint16_t port() const
+    {
+        return m_port;
+    }
+
+    // Monitors served so far
+    uint64_t connectionCount() const
+    {
+        return m_connectionCount;
+    }
+
+private:
+    Task<void> acceptMonitors( Reactor& reactor );
+    Task<void> serve( Reactor& reactor, int fd );
+
+private:
+    std::string m_dump;
+    int m_listenFd;
+    uint16_t m_port;
+
+    std::thread m_thread;
+    std::atomic<bool> m_stopped;
+    std::atomic<uint64_t> m_connectionCount;
+};
+
+#endif // ICEQUERY_STANDIN_H
@@ -0,0 +1,203 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "statsscan.h"
+
+#include <cstring>      // memcpy()
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#   define ICEQUERY_WITH_X86_SIMD
+#   include <immintrin.h>
+#endif
+
+// Implementations
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+// Bit i set if byte i of the word equals c, 8 bytes at a time
+static uint64_t matchBytes( uint64_t word, char c )
+{
+    const uint64_t low7 = 0x7f7f7f7f7f7f7f7full;
+
+    uint64_t x = word ^ ( 0x0101010101010101ull * static_cast<unsigned char>( c ) );
+
+    // High bit of each byte set if the byte is zero, exactly
+    uint64_t zeroes = ~( ( ( x & low7 ) + low7 ) | x | low7 );
+
+    // Gather the high bits into the top byte
+    return ( ( zeroes >> 7 ) * 0x0102040810204080ull ) >> 56;
+}
+
+static StatsMasks scanBlockScalar( const char* data )
+{
+    StatsMasks masks { 0, 0 };
+
+    for( int i = 0; i < STATS_BLOCK_SIZE; i += 8 )
+    {
+        uint64_t word;
+        memcpy( &word, data + i, sizeof( word ) );
+
+        masks.newlines |= matchBytes( word, '\n' ) << i;
+        masks.colons |= matchBytes( word, ':' ) << i;
+    }
+
+    return masks;
+}
+
+#else
+
+static StatsMasks scanBlockScalar( const char* data )
+{
+    StatsMasks masks { 0, 0 };
+
+    for( int i = 0; i < STATS_BLOCK_SIZE; ++i )
+    {
+        masks.newlines |= uint64_t( data[i] == '\n' ) << i;
+        masks.colons |= uint64_t( data[i] == ':' ) << i;
+    }
+
+    return masks;
+}
+
+#endif
+
+#ifdef ICEQUERY_WITH_X86_SIMD
+
+__attribute__(( target( "sse2" ) ))
+static StatsMasks scanBlockSSE2( const char* data )
+{
+    const __m128i newline = _mm_set1_epi8( '\n' );
+    const __m128i colon = _mm_set1_epi8( ':' );
+
+    StatsMasks masks { 0, 0 };
+
+    for( int i = 0; i < STATS_BLOCK_SIZE; i += 16 )
+    {
+        __m128i chunk = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + i ) );
+
+        masks.newlines |= uint64_t( static_cast<uint16_t>( _mm_movemask_epi8( _mm_cmpeq_epi8( chunk, newline ) ) ) ) << i;
+        masks.colons |= uint64_t( static_cast<uint16_t>( _mm_movemask_epi8( _mm_cmpeq_epi8( chunk, colon ) ) ) ) << i;
+    }
+
+    return masks;
+}
+
+__attribute__(( target( "avx2" ) ))
+static StatsMasks scanBlockAVX2( const char* data )
+{
+    const __m256i newline = _mm256_set1_epi8( '\n' );
+    const __m256i colon = _mm256_set1_epi8( ':' );
+
+    __m256i low = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( data ) );
+    __m256i high = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( data + 32 ) );
+
+    StatsMasks masks;
+
+    masks.newlines = uint64_t( static_cast<uint32_t>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( low, newline ) ) ) ) |
+                     uint64_t( static_cast<uint32_t>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( high, newline ) ) ) ) << 32;
+    masks.colons = uint64_t( static_cast<uint32_t>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( low, colon ) ) ) ) |
+                   uint64_t( static_cast<uint32_t>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( high, colon ) ) ) ) << 32;
+
+    return masks;
+}
+
+#endif // ICEQUERY_WITH_X86_SIMD
+
+// Dispatch
+
+typedef StatsMasks ( *BlockScanner )( const char* );
+
+static StatsScanner bestScanner()
+{
+#ifdef ICEQUERY_WITH_X86_SIMD
+    __builtin_cpu_init();
+
+    if( __builtin_cpu_supports( "avx2" ) )
+    {
+        return StatsScanner::AVX2;
+    }
+
+    if( __builtin_cpu_supports( "sse2" ) )
+    {
+        return StatsScanner::SSE2;
+    }
+#endif
+
+    return StatsScanner::Scalar;
+}
+
+static BlockScanner blockScanner( StatsScanner scanner )
+{
+    switch( scanner )
+    {
+#ifdef ICEQUERY_WITH_X86_SIMD
+        case StatsScanner::SSE2:
+            return scanBlockSSE2;
+
+        case StatsScanner::AVX2:
+            return scanBlockAVX2;
+#endif
+
+        default:
+            return scanBlockScalar;
+    }
+}
+
+static StatsScanner currentScanner = bestScanner();
+static BlockScanner currentBlockScanner = blockScanner( currentScanner );
+
+StatsScanner statsScanner()
+{
+    return currentScanner;
+}
+
+bool setStatsScanner( StatsScanner scanner )
+{
+    if( scanner > bestScanner() )
+    {
+        return false;
+    }
+
+    currentScanner = scanner;
+    currentBlockScanner = blockScanner( scanner );
+
+    return true;
+}
+
+const char* StatsScannerToStr( StatsScanner scanner )
+{
+    switch( scanner )
+    {
+        case StatsScanner::Scalar:
+            return "scalar";
+
+        case StatsScanner::SSE2:
+            return "sse2";
+
+        case StatsScanner::AVX2:
+            return "avx2";
+    }
+
+    return "<Unknown>";
+}
+
+StatsMasks scanStatsBlock( const char* data )
+{
+    return currentBlockScanner( data );
+}
@@ -0,0 +1,111 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef ICEQUERY_STATSSCAN_H
+#define ICEQUERY_STATSSCAN_H
+
+#include <cstdint>      // uint64_t
+#include <string_view>
+
+// Stats messages are scanned in blocks of this many bytes, one mask bit each
+#define STATS_BLOCK_SIZE            64
+
+// Positions of the newlines and colons within a block
+struct StatsMasks
+{
+    uint64_t newlines;
+    uint64_t colons;
+};
+
+enum class StatsScanner : char
+{
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+// The fastest scanner supported by the CPU, picked at startup
+StatsScanner statsScanner();
+
+// For the benchmarks, false if not supported by the CPU or the build
+bool setStatsScanner( StatsScanner scanner );
+
+const char* StatsScannerToStr( StatsScanner scanner );
+
+// Masks of the block at data, reading exactly STATS_BLOCK_SIZE bytes
+StatsMasks scanStatsBlock( const char* data );
+
+// Calls fn( name, value ) for every 'name:value' line of a stats message,
+// in a single pass; lines without a colon are skipped
+template<typename Fn>
+void scanStats( std::string_view stats, Fn&& fn )
+{
+    const std::size_t size = stats.size();
+
+    std::size_t lineStart = 0;
+    std::size_t colonPos = std::string_view::npos;
+
+    auto visit = [&] ( std::size_t base, StatsMasks masks )
+    {
+        for( uint64_t events = masks.newlines | masks.colons; events; events &= events - 1 )
+        {
+            const int bit = __builtin_ctzll( events );
+            const std::size_t pos = base + bit;
+
+            if( ( masks.newlines >> bit ) & 1 )
+            {
+                if( colonPos != std::string_view::npos )
+                {
+                    fn( stats.substr( lineStart, colonPos - lineStart ), stats.substr( colonPos + 1, pos - colonPos - 1 ) );
+                }
+
+                lineStart = pos + 1;
+                colonPos = std::string_view::npos;
+            }
+            else if( colonPos == std::string_view::npos )
+            {
+                colonPos = pos;
+            }
+        }
+    };
+
+    std::size_t base = 0;
+
+    for( ; base + STATS_BLOCK_SIZE <= size; base += STATS_BLOCK_SIZE )
+    {
+        visit( base, scanStatsBlock( stats.data() + base ) );
+    }
+
+    if( base < size )
+    {
+        // Padding with zeroes, which match nothing
+        char tail[STATS_BLOCK_SIZE] = {};
+        stats.copy( tail, size - base, base );
+
+        visit( base, scanStatsBlock( tail ) );
+    }
+
+    // The last line doesn't have to be terminated
+    if( colonPos != std::string_view::npos )
+    {
+        fn( stats.substr( lineStart, colonPos - lineStart ), stats.substr( colonPos + 1 ) );
+    }
+}
+
+#endif // ICEQUERY_STATSSCAN_H
@@ -0,0 +1,137 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef ICEQUERY_STATSSCHEMA_H
+#define ICEQUERY_STATSSCHEMA_H
+
+#include <array>
+#include <charconv>     // from_chars()
+#include <cstdint>      // uint8_t, uint32_t
+#include <string_view>
+#include <system_error> // errc
+
+// Compile-time lookup of the stats keys: a perfect hash over the keys of a
+// field table, so that any key costs one hash and at most one comparison
+
+// Case-insensitive for letters, which is all the keys are made of besides
+// digits (unaffected by the case bit)
+constexpr uint32_t hashStatsKey( std::string_view key, uint32_t seed )
+{
+    uint32_t hash = 2166136261u ^ seed;
+
+    for( char c : key )
+    {
+        hash ^= static_cast<uint8_t>( c | 0x20 );
+        hash *= 16777619u;
+    }
+
+    // The low bits of a multiplicative hash only depend on the low bits of the
+    // input, mix the high ones in
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+
+    return hash;
+}
+
+constexpr bool equalsStatsKey( std::string_view a, std::string_view b )
+{
+    if( a.size() != b.size() )
+    {
+        return false;
+    }
+
+    for( std::size_t i = 0; i < a.size(); ++i )
+    {
+        if( ( a[i] | 0x20 ) != ( b[i] | 0x20 ) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Slot count must be a power of 2, at least twice the key count keeps the
+// seed search short
+template<std::size_t Size>
+struct StatsKeyTable
+{
+    static constexpr uint8_t EMPTY = 0xff;
+
+    uint32_t seed;
+    std::array<uint8_t, Size> slots;
+
+    // Index of the slot's field, EMPTY if the key can't be one of them
+    constexpr uint8_t candidate( std::string_view key ) const
+    {
+        return slots[hashStatsKey( key, seed ) & ( Size - 1 )];
+    }
+};
+
+// Tries seeds until every key of the field table lands in a slot of its own
+template<std::size_t Size, typename Field, std::size_t N>
+constexpr StatsKeyTable<Size> makeStatsKeyTable( const Field ( &fields )[N] )
+{
+    static_assert( ( Size & ( Size - 1 ) ) == 0 && N < Size && N < StatsKeyTable<Size>::EMPTY );
+
+    for( uint32_t seed = 0; ; ++seed )
+    {
+        StatsKeyTable<Size> table { seed, {} };
+        bool collided = false;
+
+        for( auto& slot : table.slots )
+        {
+            slot = StatsKeyTable<Size>::EMPTY;
+        }
+
+        for( std::size_t i = 0; i < N && !collided; ++i )
+        {
+            uint8_t& slot = table.slots[hashStatsKey( fields[i].key, seed ) & ( Size - 1 )];
+
+            collided = ( slot != StatsKeyTable<Size>::EMPTY );
+            slot = static_cast<uint8_t>( i );
+        }
+
+        if( !collided )
+        {
+            return table;
+        }
+    }
+}
+
+// Value parsers, false if the value is malformed, leaving the target as is
+
+template<typename T>
+bool parseStatsNumber( std::string_view value, T& target )
+{
+    T res;
+    auto parsed = std::from_chars( value.data(), value.data() + value.size(), res );
+
+    if( parsed.ec != std::errc() || parsed.ptr != value.data() + value.size() )
+    {
+        return false;
+    }
+
+    target = res;
+
+    return true;
+}
+
+#endif // ICEQUERY_STATSSCHEMA_H
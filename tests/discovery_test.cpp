@@ -0,0 +1,207 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Checks parsing the schedulers' replies to discovery broadcasts, built the
+    way icecc's scheduler writes them.
+*/
+
+#include <algorithm>  // min()
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>     // close()
+#include <arpa/inet.h>  // inet_pton()
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <icecc/comm.h> // PROTOCOL_VERSION
+
+#include "discovery.h"
+
+// Utility macros
+
+#define CHECK( cond ) \
+    do \
+    { \
+        if( !( cond ) ) \
+        { \
+            fprintf( stderr, "%s:%d: Check failed: %s\n", __FILE__, __LINE__, #cond ); \
+            ++failures; \
+        } \
+    } while( false )
+
+// Globals
+
+static int failures = 0;
+
+// Utility functions
+
+// The reply of a scheduler of protocol schedVersion to a client of
+// sentVersion, laid out as icecc's prepare_broadcast_reply() does
+static std::string makeReply( int sentVersion, uint32_t schedVersion, const char* netName )
+{
+    int knownVersion = std::min<int>( sentVersion, static_cast<int>( schedVersion ) );
+    std::string reply;
+
+    if( knownVersion < 33 )
+    {
+        reply.assign( 16, '\0' );
+        reply[0] = static_cast<char>( sentVersion + 1 );
+        strncpy( &reply[1], netName, reply.size() - 2 );
+
+        return reply;
+    }
+
+    uint64_t startTime = 1700000000;
+    const std::size_t nameOffset = 1 + sizeof( schedVersion ) + sizeof( startTime );
+
+    reply.assign( knownVersion < 36 ? 32 : 268, '\0' );
+    reply[0] = static_cast<char>( sentVersion + ( knownVersion < 36 ? 2 : 3 ) );
+    memcpy( &reply[1], &schedVersion, sizeof( schedVersion ) );
+    memcpy( &reply[1 + sizeof( schedVersion )], &startTime, sizeof( startTime ) );
+    strncpy( &reply[nameOffset], netName, reply.size() - nameOffset - 1 );
+
+    return reply;
+}
+
+// Tests
+
+// A scheduler answering a client of protocol 35: the version bumped by two,
+// its own version and start time in host order, then the net name
+static void testReplyTo35()
+{
+    const std::string reply = makeReply( 35, 35, "ICECREAM" );
+    SchedulerInfo info;
+
+    CHECK( reply.size() == 32 );
+    CHECK( parseBroadcastReply( reply.data(), reply.size(), 35, info ) );
+    CHECK( info.protocolVersion == 35 );
+    CHECK( info.netName == "ICECREAM" );
+
+    // Asked by a newer client, it answers the way it knows
+    const std::string olderReply = makeReply( 42, 35, "ICECREAM" );
+
+    CHECK( parseBroadcastReply( olderReply.data(), olderReply.size(), 42, info ) );
+    CHECK( info.protocolVersion == 35 );
+}
+
+// From protocol 36 on: bumped by three, the same fields in a 268 byte reply
+static void testReplyTo36()
+{
+    const std::string reply = makeReply( 42, 43, "ICECREAM" );
+    SchedulerInfo info;
+
+    CHECK( reply.size() == 268 );
+    CHECK( static_cast<unsigned char>( reply[0] ) == 45 );
+    CHECK( parseBroadcastReply( reply.data(), reply.size(), 42, info ) );
+    CHECK( info.protocolVersion == 43 );
+    CHECK( info.netName == "ICECREAM" );
+}
+
+// Schedulers before protocol 33 only bump the version by one, with the net
+// name right after it
+static void testOldReply()
+{
+    const std::string reply = makeReply( 42, 32, "ICECREAM" );
+    SchedulerInfo info;
+
+    CHECK( parseBroadcastReply( reply.data(), reply.size(), 42, info ) );
+    CHECK( info.protocolVersion == -1 );
+    CHECK( info.netName == "ICECREAM" );
+}
+
+static void testMalformedReplies()
+{
+    SchedulerInfo info;
+    std::string reply = makeReply( 42, 43, "ICECREAM" );
+
+    // A bump too big for the version sent
+    std::string bumped = reply;
+    bumped[0] = 35 + 3;
+    CHECK( !parseBroadcastReply( bumped.data(), bumped.size(), 35, info ) );
+    CHECK( !parseBroadcastReply( "\x2e" "ICECREAM", 10, 42, info ) );
+
+    // Cut off, or without the net name terminated
+    CHECK( !parseBroadcastReply( reply.data(), 40, 42, info ) );
+    reply.replace( 13, std::string::npos, 255, 'X' );
+    CHECK( !parseBroadcastReply( reply.data(), reply.size(), 42, info ) );
+    CHECK( !parseBroadcastReply( "\x2b", 1, 42, info ) );
+}
+
+// Replies read off a socket, as the native monitor client looks for its
+// net name among them
+static void testReadReplies()
+{
+    int fd = socket( AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+    int schedFd = socket( AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0 );
+    struct sockaddr_in addr {};
+    socklen_t addrLen = sizeof( addr );
+
+    addr.sin_family = AF_INET;
+    inet_pton( AF_INET, "127.0.0.1", &addr.sin_addr );
+
+    CHECK( bind( fd, reinterpret_cast<struct sockaddr*>( &addr ), sizeof( addr ) ) == 0 );
+    CHECK( getsockname( fd, reinterpret_cast<struct sockaddr*>( &addr ), &addrLen ) == 0 );
+
+    for( const char* netName : { "ICECREAM", "OTHERNET", "ICECREAM" } )
+    {
+        const std::string reply = makeReply( PROTOCOL_VERSION, PROTOCOL_VERSION, netName );
+
+        CHECK( sendto( schedFd, reply.data(), reply.size(), 0, reinterpret_cast<struct sockaddr*>( &addr ), sizeof( addr ) ) ==
+               static_cast<ssize_t>( reply.size() ) );
+    }
+
+    std::vector<SchedulerInfo> schedulers;
+    readDiscoveryReplies( fd, schedulers );
+
+    // The repeated reply is dropped
+    CHECK( schedulers.size() == 2 );
+
+    if( schedulers.size() == 2 )
+    {
+        CHECK( schedulers[0].netName == "ICECREAM" );
+        CHECK( schedulers[0].addr == "127.0.0.1" );
+        CHECK( schedulers[0].protocolVersion == PROTOCOL_VERSION );
+        CHECK( schedulers[1].netName == "OTHERNET" );
+    }
+
+    close( schedFd );
+    close( fd );
+}
+
+// And the entry point...
+
+int main()
+{
+    testReplyTo35();
+    testReplyTo36();
+    testOldReply();
+    testMalformedReplies();
+    testReadReplies();
+
+    if( failures )
+    {
+        fprintf( stderr, "%d check(s) failed\n", failures );
+        return 1;
+    }
+
+    return 0;
+}
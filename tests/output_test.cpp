@@ -0,0 +1,141 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Checks that the progressive table prints the same layout as the regular
+    one when no column widens after the first row.
+*/
+
+#include <cstdio>
+#include <string>
+
+#include "output.h"
+
+// Utility macros
+
+#define CHECK( cond ) \
+    do \
+    { \
+        if( !( cond ) ) \
+        { \
+            fprintf( stderr, "%s:%d: Check failed: %s\n", __FILE__, __LINE__, #cond ); \
+            ++failures; \
+        } \
+    } while( false )
+
+// Globals
+
+static int failures = 0;
+
+// Utility functions
+
+// The first node is the widest in every column
+static NodeList makeNodes()
+{
+    NodeList nodes;
+
+    nodes.push_back( NodeInfo::create( 1, "Name:build-node-10\nIP:10.0.0.10\nMaxJobs:16\nNoRemote:false\nPlatform:x86_64\n" ) );
+    nodes.push_back( NodeInfo::create( 2, "Name:node-2\nIP:10.0.0.2\nMaxJobs:8\nNoRemote:true\nPlatform:x86_64\n" ) );
+    nodes.push_back( NodeInfo::create( 3, "Name:node-3\nIP:10.0.0.3\nMaxJobs:4\nNoRemote:false\nPlatform:armv7\n" ) );
+
+    return nodes;
+}
+
+static std::string readAll( FILE* file )
+{
+    std::string res;
+    char buf[4096];
+    std::size_t len;
+
+    rewind( file );
+
+    while( ( len = fread( buf, 1, sizeof( buf ), file ) ) > 0 )
+    {
+        res.append( buf, len );
+    }
+
+    fclose( file );
+
+    return res;
+}
+
+static std::string printRegular( const OutputSpec& spec, const NodeList& nodes )
+{
+    FILE* out = tmpfile();
+
+    printNodes( spec, nodes, out );
+
+    return readAll( out );
+}
+
+static std::string printProgressive( const OutputSpec& spec, const NodeList& nodes )
+{
+    FILE* out = tmpfile();
+
+    {
+        ProgressiveTable table( spec, out );
+
+        for( const auto& node : nodes )
+        {
+            table.addNode( *node );
+        }
+
+        table.finish( nodes );
+    }
+
+    return readAll( out );
+}
+
+// Tests
+
+static void testLayouts()
+{
+    NodeList nodes = makeNodes();
+    OutputSpec spec;
+    spec.customEncoding = "UTF-8";
+
+    CHECK( printProgressive( spec, nodes ) == printRegular( spec, nodes ) );
+
+    spec.ascii = true;
+    spec.plain = true;
+    CHECK( printProgressive( spec, nodes ) == printRegular( spec, nodes ) );
+
+    spec.perPlatform = true;
+    CHECK( printProgressive( spec, nodes ) == printRegular( spec, nodes ) );
+
+    spec.noTable = true;
+    CHECK( printProgressive( spec, nodes ) == printRegular( spec, nodes ) );
+
+    spec.brief = true;
+    CHECK( printProgressive( spec, nodes ) == printRegular( spec, nodes ) );
+}
+
+// And the entry point...
+
+int main()
+{
+    testLayouts();
+
+    if( failures )
+    {
+        fprintf( stderr, "%d check(s) failed\n", failures );
+        return 1;
+    }
+
+    return 0;
+}
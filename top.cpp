@@ -0,0 +1,656 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "top.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>      // SIZE_MAX
+#include <cstring>      // strerror()
+
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>     // read(), isatty()
+#include <sys/ioctl.h>
+
+#include "common.h"
+
+// Consts
+
+#define TOP_COLUMN_GAP              2
+
+#define TERM_ENTER                  "\x1b[?1049h\x1b[?25l"
+#define TERM_LEAVE                  "\x1b[?25h\x1b[?1049l"
+#define TERM_CLEAR                  "\x1b[H\x1b[2J"
+#define TERM_CLEAR_LINE             "\x1b[K"
+#define TERM_CLEAR_BELOW            "\x1b[J"
+#define TERM_BOLD                   "\x1b[1m"
+#define TERM_NORMAL                 "\x1b[0m"
+
+// Terminal state
+
+// What the signal handler needs for putting the terminal back
+static struct termios savedTermios;
+static int savedTermiosFd = -1;
+static int screenFd = -1;
+
+static void restoreTerminal()
+{
+    if( screenFd != -1 )
+    {
+        // Async-signal-safe, unlike stdio
+        ssize_t res = write( screenFd, TERM_LEAVE, sizeof( TERM_LEAVE ) - 1 );
+        static_cast<void>( res );
+    }
+
+    if( savedTermiosFd != -1 )
+    {
+        tcsetattr( savedTermiosFd, TCSANOW, &savedTermios );
+    }
+}
+
+static void onTerminate( int /*signal*/ )
+{
+    restoreTerminal();
+    _exit( EXIT_OK );
+}
+
+// ColumnWidth
+
+void ColumnWidth::add( std::size_t width )
+{
+    if( width >= m_counts.size() )
+    {
+        m_counts.resize( width + 1 );
+    }
+
+    ++m_counts[width];
+    m_width = std::max( m_width, width );
+}
+
+void ColumnWidth::remove( std::size_t width )
+{
+    --m_counts[width];
+
+    while( m_width > 0 && m_counts[m_width] == 0 )
+    {
+        --m_width;
+    }
+}
+
+// TerminalScreen
+
+static void moveTo( std::string& out, std::size_t row, std::size_t column )
+{
+    char buffer[32];
+    snprintf( buffer, sizeof( buffer ), "\x1b[%zu;%zuH", row + 1, column + 1 );
+
+    out.append( buffer );
+}
+
+void TerminalScreen::update( const ScreenFrame& frame, std::string& out )
+{
+    if( !m_valid )
+    {
+        out.append( TERM_CLEAR );
+        m_previous.clear();
+        m_valid = true;
+    }
+
+    // Where the cursor is after the last write, so that writing adjacent
+    // cells doesn't need moving it
+    std::size_t cursorRow = SIZE_MAX;
+    std::size_t cursorColumn = 0;
+
+    for( std::size_t r = 0; r < frame.size(); ++r )
+    {
+        const std::vector<ScreenCell>& cells = frame[r];
+        const std::vector<ScreenCell>* previous = r < m_previous.size() ? &m_previous[r] : nullptr;
+
+        // The cells cover the row from the left, so only the ones that moved
+        // or changed have to be written
+        for( std::size_t c = 0; c < cells.size(); ++c )
+        {
+            if( previous && c < previous->size() && ( *previous )[c] == cells[c] )
+            {
+                continue;
+            }
+
+            if( cursorRow != r || cursorColumn != cells[c].x )
+            {
+                moveTo( out, r, cells[c].x );
+            }
+
+            out.append( cells[c].text );
+
+            cursorRow = r;
+            cursorColumn = cells[c].x + cells[c].width;
+        }
+
+        std::size_t end = cells.empty() ? 0 : cells.back().x + cells.back().width;
+        std::size_t previousEnd = ( !previous || previous->empty() ) ? 0 : previous->back().x + previous->back().width;
+
+        if( previousEnd > end )
+        {
+            moveTo( out, r, end );
+            out.append( TERM_CLEAR_LINE );
+        }
+    }
+
+    if( m_previous.size() > frame.size() )
+    {
+        moveTo( out, frame.size(), 0 );
+        out.append( TERM_CLEAR_BELOW );
+    }
+
+    m_previous = frame;
+}
+
+// TopView
+
+TopView::TopView( const std::vector<std::unique_ptr<Session>>& sessions, const OutputSpec& spec, int interval, int inFd, FILE* out )
+    : m_sessions( sessions )
+    , m_spec( spec )
+    , m_interval( interval )
+    , m_inFd( inFd )
+    , m_out( out )
+    , m_decoder( nodeHeader( spec ), spec.ascii, spec.customEncoding )
+    , m_columns( 0 )
+    , m_lines( 0 )
+    , m_dirty( true )
+{
+    if( m_sessions.size() > 1 )
+    {
+        m_header.emplace_back( Alignment::Left, Encoding::UTF8, "Scheduler" );
+    }
+
+    m_header.insert( m_header.end(), {
+        { Alignment::Right , Encoding::UTF8     , "Node #"     },
+        { Alignment::Left  , Encoding::Custom   , "Name"       },
+        { Alignment::Left  , Encoding::UTF8     , "IP"         },
+        { Alignment::Left  , Encoding::UTF8     , "Platform"   },
+        { Alignment::Right , Encoding::UTF8     , "Cores"      },
+        { Alignment::Right , Encoding::UTF8     , "Jobs"       },
+        { Alignment::Right , Encoding::UTF8     , "Free"       },
+        { Alignment::Left  , Encoding::UTF8     , "State"      }
+    } );
+
+    m_widths.resize( m_header.size() );
+
+    for( std::size_t c = 0; c < m_header.size(); ++c )
+    {
+        m_headerCells.push_back( makeCell( m_header[c].name(), Encoding::UTF8 ) );
+        m_widths[c].add( m_headerCells.back().width );
+    }
+
+    for( std::size_t i = 0; i < m_sessions.size(); ++i )
+    {
+        for( const auto& node : m_sessions[i]->nodes() )
+        {
+            updateRow( NodeKey( i, node.first ), node.second.get() );
+        }
+
+        m_sessions[i]->addListener( this );
+    }
+}
+
+TopView::~TopView()
+{
+    for( const auto& session : m_sessions )
+    {
+        session->removeListener( this );
+    }
+}
+
+Task<int> TopView::run( Reactor& reactor )
+{
+    // Keys are read one by one, without echoing them
+    if( isatty( m_inFd ) && tcgetattr( m_inFd, &savedTermios ) == 0 )
+    {
+        struct termios raw = savedTermios;
+        raw.c_lflag &= ~( ICANON | ECHO );
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+
+        savedTermiosFd = m_inFd;
+        tcsetattr( m_inFd, TCSANOW, &raw );
+    }
+
+    screenFd = fileno( m_out );
+
+    struct sigaction action {};
+    action.sa_handler = onTerminate;
+
+    sigaction( SIGINT, &action, nullptr );
+    sigaction( SIGTERM, &action, nullptr );
+    sigaction( SIGHUP, &action, nullptr );
+
+    fputs( TERM_ENTER, m_out );
+
+    // Without a terminal to read keys from, only a signal ends it
+    int inFd = ( savedTermiosFd != -1 ) ? m_inFd : -1;
+    int res = EXIT_OK;
+    bool quit = false;
+    long nextPaint = getTimestamp();
+
+    while( !quit )
+    {
+        short revents = co_await reactor.wait( inFd, POLLIN, nextPaint );
+
+        if( revents )
+        {
+            char keys[64];
+            ssize_t len = read( inFd, keys, sizeof( keys ) );
+
+            if( len < 0 && errno != EINTR && errno != EAGAIN )
+            {
+                int lastErrno = errno;
+
+                restoreTerminal();
+                PRINT_ERR( "read(): (%d) %s\n", lastErrno, strerror( lastErrno ) );
+
+                res = EXIT_IO_ERR;
+                break;
+            }
+
+            quit = ( len == 0 );
+
+            for( ssize_t i = 0; i < len; ++i )
+            {
+                if( keys[i] == 'q' || keys[i] == 'Q' )
+                {
+                    quit = true;
+                }
+                else if( keys[i] == '\f' )
+                {
+                    // Ctrl+L, as usual
+                    m_screen.invalidate();
+                    m_dirty = true;
+                }
+            }
+        }
+
+        long now = getTimestamp();
+
+        if( !quit && now >= nextPaint )
+        {
+            if( !paint() )
+            {
+                restoreTerminal();
+                PRINT_ERR( "Unable to write to the terminal.\n" );
+
+                res = EXIT_IO_ERR;
+                break;
+            }
+
+            // Skip the ticks missed rather than catch up with them
+            nextPaint = std::max( nextPaint + m_interval, now + 1 );
+        }
+    }
+
+    restoreTerminal();
+
+    screenFd = -1;
+    savedTermiosFd = -1;
+
+    signal( SIGINT, SIG_DFL );
+    signal( SIGTERM, SIG_DFL );
+    signal( SIGHUP, SIG_DFL );
+
+    for( const auto& session : m_sessions )
+    {
+        session->stop();
+    }
+
+    co_return res;
+}
+
+void TopView::onStateChanged( Session& session )
+{
+    // The scheduler doesn't repeat the running jobs after a reconnect
+    if( session.state() == Session::State::Connecting )
+    {
+        std::size_t index = sessionIndex( session );
+
+        for( uint32_t hostId : m_jobs.drop( index ) )
+        {
+            updateJobCells( NodeKey( index, hostId ) );
+        }
+    }
+
+    m_dirty = true;
+}
+
+void TopView::onNodeUpdated( Session& session, const NodeInfo& node )
+{
+    updateRow( NodeKey( sessionIndex( session ), node.hostId() ), &node );
+}
+
+void TopView::onNodeRemoved( Session& session, const NodeInfo& node )
+{
+    updateRow( NodeKey( sessionIndex( session ), node.hostId() ), nullptr );
+}
+
+void TopView::onMessage( Session& session, const Msg& msg )
+{
+    std::size_t index = sessionIndex( session );
+
+    if( uint32_t hostId = m_jobs.handle( index, msg ) )
+    {
+        updateJobCells( NodeKey( index, hostId ) );
+    }
+}
+
+TopView::Cell TopView::makeCell( std::string_view text, Encoding encoding ) const
+{
+    icu::UnicodeString str = m_decoder.decode( text, encoding );
+    Cell cell { std::string(), static_cast<std::size_t>( str.length() ) };
+
+    str.toUTF8String( cell.text );
+
+    return cell;
+}
+
+void TopView::updateRow( const NodeKey& key, const NodeInfo* node )
+{
+    if( !node )
+    {
+        auto it = m_rows.find( key );
+
+        if( it != m_rows.end() )
+        {
+            setCells( it->second, false, {} );
+            m_rows.erase( it );
+        }
+
+        return;
+    }
+
+    Row& row = m_rows[key];
+    row.maxJobs = node->maxJobs();
+    row.counted = isNodeCounted( m_spec, *node );
+
+    std::vector<Cell> cells;
+    cells.reserve( m_header.size() );
+
+    if( m_sessions.size() > 1 )
+    {
+        cells.push_back( makeCell( m_sessions[key.first]->target().label(), Encoding::UTF8 ) );
+    }
+
+    cells.push_back( makeCell( std::to_string( node->hostId() ), Encoding::UTF8 ) );
+    cells.push_back( makeCell( node->name(), Encoding::Custom ) );
+    cells.push_back( makeCell( node->ip(), Encoding::UTF8 ) );
+    cells.push_back( makeCell( node->platform(), Encoding::UTF8 ) );
+    cells.push_back( makeCell( std::to_string( node->maxJobs() ), Encoding::UTF8 ) );
+
+    // Filled in by updateJobCells()
+    cells.push_back( Cell { std::string(), 0 } );
+    cells.push_back( Cell { std::string(), 0 } );
+
+    cells.push_back( makeCell( node->isOffline() ? "offline" : node->isStale() ? "stale" : node->noRemote() ? "no remote" : "", Encoding::UTF8 ) );
+
+    setCells( row, isNodeShown( m_spec, *node ), std::move( cells ) );
+    updateJobCells( key );
+}
+
+void TopView::updateJobCells( const NodeKey& key )
+{
+    auto it = m_rows.find( key );
+
+    if( it == m_rows.end() )
+    {
+        return;
+    }
+
+    Row& row = it->second;
+    uint32_t jobs = m_jobs.jobCount( key.first, key.second );
+
+    std::vector<Cell> cells = row.cells;
+    std::size_t jobsColumn = m_header.size() - 3;
+
+    cells[jobsColumn] = makeCell( std::to_string( jobs ), Encoding::UTF8 );
+    cells[jobsColumn + 1] = row.counted ? makeCell( std::to_string( row.maxJobs > jobs ? row.maxJobs - jobs : 0 ), Encoding::UTF8 ) : Cell { std::string(), 0 };
+
+    setCells( row, row.shown, std::move( cells ) );
+}
+
+void TopView::setCells( Row& row, bool shown, std::vector<Cell> cells )
+{
+    if( row.shown )
+    {
+        for( std::size_t c = 0; c < row.cells.size(); ++c )
+        {
+            m_widths[c].remove( row.cells[c].width );
+        }
+    }
+
+    row.shown = shown;
+    row.cells = std::move( cells );
+
+    if( row.shown )
+    {
+        for( std::size_t c = 0; c < row.cells.size(); ++c )
+        {
+            m_widths[c].add( row.cells[c].width );
+        }
+    }
+
+    m_dirty = true;
+}
+
+std::size_t TopView::sessionIndex( const Session& session ) const
+{
+    for( std::size_t i = 0; i < m_sessions.size(); ++i )
+    {
+        if( m_sessions[i].get() == &session )
+        {
+            return i;
+        }
+    }
+
+    return 0;
+}
+
+// Pads the text of the cell to the width, after the gap separating it from
+// the previous one
+static ScreenCell layoutCell( std::size_t x, std::size_t gap, std::size_t width, Alignment alignment, const std::string& text, std::size_t textWidth,
+                              const char* prefix = "", const char* suffix = "" )
+{
+    std::size_t lenDiff = width - textWidth;
+    std::size_t left = 0;
+
+    switch( alignment )
+    {
+        case Alignment::Left:
+            break;
+
+        case Alignment::Right:
+            left = lenDiff;
+            break;
+
+        case Alignment::Center:
+            left = lenDiff / 2;
+            break;
+    }
+
+    ScreenCell cell { static_cast<uint16_t>( x ), static_cast<uint16_t>( gap + width ), std::string( gap + left, ' ' ) };
+
+    cell.text.append( prefix ).append( text ).append( suffix ).append( lenDiff - left, ' ' );
+
+    return cell;
+}
+
+ScreenFrame TopView::buildFrame( std::size_t columns, std::size_t lines ) const
+{
+    ScreenFrame frame;
+
+    std::uint32_t nodeCount = 0;
+    std::uint32_t coreCount = 0;
+    std::uint32_t jobCount = 0;
+    std::uint32_t freeCount = 0;
+
+    for( const auto& entry : m_rows )
+    {
+        const Row& row = entry.second;
+        uint32_t jobs = m_jobs.jobCount( entry.first.first, entry.first.second );
+
+        nodeCount += row.shown;
+        jobCount += jobs;
+
+        if( row.counted )
+        {
+            coreCount += row.maxJobs;
+            freeCount += row.maxJobs > jobs ? row.maxJobs - jobs : 0;
+        }
+    }
+
+    // The summary line, and the schedulers that can't be trusted at the moment
+    char buffer[128];
+    snprintf( buffer, sizeof( buffer ), "%u node%s, %u core%s, %u job%s running, %u free", nodeCount, nodeCount == 1 ? "" : "s",
+              coreCount, coreCount == 1 ? "" : "s", jobCount, jobCount == 1 ? "" : "s", freeCount );
+
+    std::string summary( buffer );
+
+    for( const auto& session : m_sessions )
+    {
+        if( session->state() != Session::State::Live )
+        {
+            summary.append( " - " ).append( session->target().label() ).append( ": " ).append( Session::stateToStr( session->state() ) );
+        }
+    }
+
+    std::size_t rowsLeft = lines > 2 ? lines - 2 : 0;
+
+    if( nodeCount > rowsLeft )
+    {
+        snprintf( buffer, sizeof( buffer ), " (%zu more below)", nodeCount - rowsLeft );
+        summary.append( buffer );
+    }
+
+    // Without decoding, so it's only cut correctly when it's ASCII
+    summary.resize( std::min( summary.size(), columns ) );
+    frame.push_back( { ScreenCell { 0, static_cast<uint16_t>( summary.size() ), summary } } );
+
+    // The columns, as far as they fit
+    std::vector<std::size_t> xs;
+    std::size_t x = 0;
+
+    for( std::size_t c = 0; c < m_header.size(); ++c )
+    {
+        std::size_t gap = c > 0 ? TOP_COLUMN_GAP : 0;
+
+        if( x + gap + m_widths[c].width() > columns )
+        {
+            break;
+        }
+
+        xs.push_back( x );
+        x += gap + m_widths[c].width();
+    }
+
+    auto appendRow = [&] ( const std::vector<Cell>& cells, const char* prefix, const char* suffix )
+    {
+        frame.emplace_back();
+
+        for( std::size_t c = 0; c < xs.size(); ++c )
+        {
+            frame.back().push_back( layoutCell( xs[c], c > 0 ? TOP_COLUMN_GAP : 0, m_widths[c].width(), m_header[c].alignment(), cells[c].text, cells[c].width, prefix, suffix ) );
+        }
+    };
+
+    if( lines > 1 )
+    {
+        appendRow( m_headerCells, TERM_BOLD, TERM_NORMAL );
+    }
+
+    for( const auto& entry : m_rows )
+    {
+        if( rowsLeft == 0 )
+        {
+            break;
+        }
+
+        if( entry.second.shown )
+        {
+            appendRow( entry.second.cells, "", "" );
+            --rowsLeft;
+        }
+    }
+
+    return frame;
+}
+
+bool TopView::paint()
+{
+    struct winsize size {};
+
+    if( ioctl( fileno( m_out ), TIOCGWINSZ, &size ) != 0 || size.ws_col == 0 || size.ws_row == 0 )
+    {
+        size.ws_col = 80;
+        size.ws_row = 24;
+    }
+
+    if( size.ws_col != m_columns || size.ws_row != m_lines )
+    {
+        m_columns = size.ws_col;
+        m_lines = size.ws_row;
+
+        m_screen.invalidate();
+        m_dirty = true;
+    }
+
+    if( !m_dirty )
+    {
+        return true;
+    }
+
+    std::string out;
+    m_screen.update( buildFrame( m_columns, m_lines ), out );
+    m_dirty = false;
+
+    return fwrite( out.data(), 1, out.size(), m_out ) == out.size() && fflush( m_out ) == 0;
+}
+
+// Top
+
+int runTop( const std::vector<QueryTarget>& targets, IoBackend::Type ioBackend, const OutputSpec& spec, int interval )
+{
+    Reactor reactor( ioBackend );
+    std::vector<std::unique_ptr<Session>> sessions;
+
+    for( const QueryTarget& target : targets )
+    {
+        sessions.emplace_back( new Session( target ) );
+        reactor.spawn( sessions.back()->run( reactor ) );
+    }
+
+    TopView view( sessions, spec, interval, STDIN_FILENO, stdout );
+    int exitCode = EXIT_OK;
+
+    reactor.spawn( awaitInto( view.run( reactor ), exitCode ) );
+
+    if( !reactor.run() )
+    {
+        return EXIT_CONNECTION_ERR;
+    }
+
+    return exitCode;
+}
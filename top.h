@@ -0,0 +1,183 @@
+/*
+    Copyright (C) 2014 Robert Płóciennik
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef ICEQUERY_TOP_H
+#define ICEQUERY_TOP_H
+
+#include <cstdint>      // uint16_t, uint32_t
+#include <cstdio>
+#include <map>
+#include <memory>       // unique_ptr
+#include <string>
+#include <string_view>
+#include <utility>      // pair
+#include <vector>
+
+#include "async.h"
+#include "jobtracker.h"
+#include "output.h"
+#include "session.h"
+
+#define TOP_INTERVAL_DEFAULT        1000
+
+// Width of a column as that of its widest cell, kept up to date as the cells
+// come and go by counting the cells of each width
+class ColumnWidth
+{
+public:
+    ColumnWidth()
+        : m_width( 0 )
+    {
+    }
+
+public:
+    void add( std::size_t width );
+    void remove( std::size_t width );
+
+    std::size_t width() const
+    {
+        return m_width;
+    }
+
+private:
+    std::vector<uint32_t> m_counts;
+    std::size_t m_width;
+};
+
+// Text at a fixed position of a screen row, already padded
+struct ScreenCell
+{
+    uint16_t x;
+    uint16_t width;
+    std::string text;
+
+    bool operator==( const ScreenCell& other ) const
+    {
+        return x == other.x && text == other.text;
+    }
+};
+
+// Cells of each row of the screen, top to bottom
+typedef std::vector<std::vector<ScreenCell>> ScreenFrame;
+
+// Brings a terminal from one frame to the next, with cursor addressing escape
+// sequences repainting only the cells that changed
+class TerminalScreen
+{
+public:
+    TerminalScreen()
+        : m_valid( false )
+    {
+    }
+
+public:
+    // Appends the escape sequences and text to out
+    void update( const ScreenFrame& frame, std::string& out );
+
+    // Makes the next update repaint everything, e.g. after a resize
+    void invalidate()
+    {
+        m_valid = false;
+    }
+
+private:
+    ScreenFrame m_previous;
+    bool m_valid;
+};
+
+// A full-screen live view of the nodes of the sessions, their running jobs
+// and free slots, repainted every interval if anything changed
+class TopView : public SessionListener
+{
+public:
+    TopView( const std::vector<std::unique_ptr<Session>>& sessions, const OutputSpec& spec, int interval, int inFd, FILE* out );
+    ~TopView();
+
+    TopView( const TopView& ) = delete;
+    TopView& operator=( const TopView& ) = delete;
+
+public:
+    // Runs until 'q' is pressed or the input is closed, then stops the
+    // sessions; returns one of EXIT_* codes
+    Task<int> run( Reactor& reactor );
+
+    void onStateChanged( Session& session ) override;
+    void onNodeUpdated( Session& session, const NodeInfo& node ) override;
+    void onNodeRemoved( Session& session, const NodeInfo& node ) override;
+    void onMessage( Session& session, const Msg& msg ) override;
+
+private:
+    // Session index and host id
+    typedef std::pair<std::size_t, uint32_t> NodeKey;
+
+    struct Cell
+    {
+        std::string text;
+        std::size_t width;
+    };
+
+    struct Row
+    {
+        uint32_t maxJobs = 0;
+        bool counted = false;
+        bool shown = false;
+
+        // One per column, only counted in the widths if shown
+        std::vector<Cell> cells;
+    };
+
+    Cell makeCell( std::string_view text, Encoding encoding ) const;
+
+    // Removes the row if node is null
+    void updateRow( const NodeKey& key, const NodeInfo* node );
+    void updateJobCells( const NodeKey& key );
+    void setCells( Row& row, bool shown, std::vector<Cell> cells );
+
+    std::size_t sessionIndex( const Session& session ) const;
+
+    ScreenFrame buildFrame( std::size_t columns, std::size_t lines ) const;
+    bool paint();
+
+private:
+    const std::vector<std::unique_ptr<Session>>& m_sessions;
+    OutputSpec m_spec;
+    int m_interval;
+    int m_inFd;
+    FILE* m_out;
+
+    CellDecoder m_decoder;
+    std::vector<ColumnHeader> m_header;
+    std::vector<Cell> m_headerCells;
+    std::vector<ColumnWidth> m_widths;
+
+    // Ordered, so that the nodes keep their places on the screen
+    std::map<NodeKey, Row> m_rows;
+
+    JobTracker m_jobs;
+
+    TerminalScreen m_screen;
+    std::size_t m_columns;
+    std::size_t m_lines;
+    bool m_dirty;
+};
+
+// Keeps the sessions to the targets and shows them until quit
+int runTop( const std::vector<QueryTarget>& targets, IoBackend::Type ioBackend, const OutputSpec& spec, int interval );
+
+#endif // ICEQUERY_TOP_H